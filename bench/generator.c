@@ -0,0 +1,408 @@
+/*!
+ * \file generator.c
+ * \brief deterministic generator of synthetic assembly sources
+ *
+ * Every unit is a valid source that fits into the 2000 word memory: it
+ * declares externals, uses all 16 operations with all of their legal
+ * addressing modes, references code labels, data labels and externals, and
+ * ends with .data and .string sections. The same seed gives the same units.
+ *
+ * Programs are sources that can be run in the simulator: nested loops over
+ * random arithmetic, with subroutine calls and prn-s.
+ */
+
+#include "generator.h"
+
+extern operation_t g_operations[16];
+
+/*!
+ * \brief code labels of a unit, one at every 8th instruction line
+ */
+#define CODE_LABELS (GENERATOR_CODE_LINES / 8)
+
+/*!
+ * \brief data labels that are referenced, every unit defines at least this many
+ */
+#define DATA_LABELS 20
+
+/*!
+ * \brief initialises the generator
+ *
+ * \param gen	generator
+ * \param seed	seed, the same seed gives the same sources
+ */
+void generator_init(generator_t * gen, uint32_t seed) {
+    gen->state = seed ? seed : 0x2545F491; /* xorshift can't start from 0 */
+    gen->units = 0;
+}
+
+/*!
+ * \brief gets the next pseudo random number (xorshift32)
+ *
+ * \param gen	generator
+ * \return		random number
+ */
+uint32_t generator_next(generator_t * gen) {
+    uint32_t x = gen->state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return gen->state = x;
+}
+
+/*!
+ * \brief appends formatted text to a buffer
+ *
+ * \param text	buffer
+ * \param fmt	printf style format string
+ * \param ...	printf style variable argument list
+ */
+void text_append(text_t * text, const char * fmt, ...) {
+    va_list list;
+    int n;
+
+    if (text->capacity - text->len < 256) {
+        size_t capacity = text->capacity ? text->capacity * 2 : 65536;
+        char * grown = (char *)realloc(text->data, capacity);
+
+        if (!grown) {
+            return;
+        }
+
+        text->data = grown;
+        text->capacity = capacity;
+    }
+
+    va_start(list, fmt);
+    n = vsnprintf(text->data + text->len, text->capacity - text->len, fmt, list);
+    va_end(list);
+
+    if (n > 0) {
+        text->len += (size_t)n;
+    }
+}
+
+/*!
+ * \brief releases a buffer
+ *
+ * \param text	buffer
+ */
+void text_free(text_t * text) {
+    free(text->data);
+    text->data = NULL;
+    text->len = 0;
+    text->capacity = 0;
+}
+
+/*!
+ * \brief appends a label operand
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param code	only code labels and externals (jump targets)
+ */
+static void append_label(generator_t * gen, text_t * text, bool code) {
+    uint32_t r = generator_next(gen) % 10;
+
+    if (r < 3) {
+        text_append(text, "X%u", generator_next(gen) % GENERATOR_EXTERNS);
+    } else if (r < 6 || code) {
+        uint32_t l = generator_next(gen) % CODE_LABELS;
+
+        if (l == 0) {
+            text_append(text, "MAIN");
+        } else {
+            text_append(text, "L%u", l);
+        }
+    } else {
+        text_append(text, "D%u", generator_next(gen) % DATA_LABELS);
+    }
+}
+
+/*!
+ * \brief appends an operand with the given addressing mode
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param op	operation
+ * \param mode	addressing mode
+ * \return		number of additional words
+ */
+static uint32_t append_operand(generator_t * gen, text_t * text, operation_t * op, addressing_mode_t mode) {
+    bool jump = op->opcode == 0x9 || op->opcode == 0xA || op->opcode == 0xD;
+    int value;
+
+    switch (mode) {
+    case INSTANT:
+        value = (int)(generator_next(gen) % 2001) - 1000;
+        text_append(text, value >= 0 && generator_next(gen) % 4 == 0 ? "#+%d" : "#%d", value);
+        return 1;
+
+    case DIRECT:
+        if (op->opcode == 0x6) {
+            text_append(text, "D%u", generator_next(gen) % DATA_LABELS); /* lea */
+        } else {
+            append_label(gen, text, jump);
+        }
+        return 1;
+
+    case INDIRECT:
+        text_append(text, "@");
+        append_label(gen, text, jump);
+        return 1;
+
+    case DIRECT_REGISTER:
+        text_append(text, "r%u", generator_next(gen) % 8);
+        return 0;
+
+    case INDIRECT_REGISTER:
+    default:
+        text_append(text, "@r%u", generator_next(gen) % 8);
+        return 0;
+    }
+}
+
+/*!
+ * \brief picks one of the legal addressing modes
+ *
+ * \param gen	generator
+ * \param legal	legal modes, e.g. "01234"
+ * \return		addressing mode
+ */
+static addressing_mode_t pick_mode(generator_t * gen, const char * legal) {
+    return (addressing_mode_t)(legal[generator_next(gen) % strlen(legal)] - '0');
+}
+
+/*!
+ * \brief appends one instruction line
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param index	index of the instruction line in the unit
+ * \return		number of words
+ */
+static uint32_t append_instruction(generator_t * gen, text_t * text, uint32_t index) {
+    operation_t * op = &g_operations[generator_next(gen) % 16];
+    uint32_t words = 1;
+
+    if (index == 0) {
+        text_append(text, "MAIN:\t");
+    } else if (index % 8 == 0) {
+        text_append(text, generator_next(gen) % 2 ? "L%u:\t" : "L%u:  ", index / 8);
+    } else {
+        text_append(text, generator_next(gen) % 2 ? "\t" : "        ");
+    }
+
+    text_append(text, "%s", op->mnemonic);
+
+    if (op->operands == 2) {
+        text_append(text, " ");
+        words += append_operand(gen, text, op, pick_mode(gen, op->src_legal));
+        text_append(text, generator_next(gen) % 2 ? ", " : ",");
+        words += append_operand(gen, text, op, pick_mode(gen, op->dest_legal));
+    } else if (op->operands == 1) {
+        text_append(text, " ");
+        words += append_operand(gen, text, op, pick_mode(gen, op->dest_legal));
+    }
+
+    if (generator_next(gen) % 4 == 0) {
+        text_append(text, "\t; %u words", words);
+    }
+
+    text_append(text, "\n");
+
+    return words;
+}
+
+/*!
+ * \brief appends one .data or .string line
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param label	index of the label
+ * \return		number of words
+ */
+static uint32_t append_data(generator_t * gen, text_t * text, uint32_t label) {
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    uint32_t i, n = 1 + generator_next(gen) % 16;
+
+    text_append(text, "D%u:\t", label);
+
+    if (generator_next(gen) % 2) {
+        text_append(text, ".string \"");
+        for (i = 0; i < n; i++) {
+            text_append(text, "%c", chars[generator_next(gen) % (sizeof(chars) - 1)]);
+        }
+        text_append(text, "\"\n");
+
+        return n + 1; /* + NULL */
+    }
+
+    n = n / 2 + 1; /* numbers are longer, stay below 80 characters */
+
+    text_append(text, ".data ");
+    for (i = 0; i < n; i++) {
+        text_append(text, i ? ",%d" : "%d", (int)(generator_next(gen) % 65536) - 32768);
+    }
+    text_append(text, "\n");
+
+    return n;
+}
+
+/*!
+ * \brief generates the next unit, a source that fits into the memory
+ *
+ * \param gen	generator
+ * \param text	buffer, the unit is appended
+ * \return		number of lines of the unit
+ */
+uint32_t generator_unit(generator_t * gen, text_t * text) {
+    uint32_t lines = 0, words = 0, i;
+
+    text_append(text, "; synthetic unit %u\n\n\t.entry MAIN\n", gen->units++);
+    lines += 3;
+
+    for (i = 0; i < GENERATOR_EXTERNS; i++) {
+        text_append(text, "\t.extern X%u\n", i);
+        lines++;
+    }
+
+    for (i = 0; i < GENERATOR_CODE_LINES; i++) {
+        if (generator_next(gen) % 32 == 0) {
+            text_append(text, generator_next(gen) % 2 ? "; block %u\n" : "\n", i);
+            lines++;
+        }
+
+        append_instruction(gen, text, i);
+        lines++;
+    }
+
+    for (i = 0; words < GENERATOR_DATA_WORDS || i < DATA_LABELS; i++) {
+        words += append_data(gen, text, i);
+        lines++;
+    }
+
+    return lines;
+}
+
+/*!
+ * \brief appends a source operand of a generated program
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param div	the value must not be zero
+ */
+static void append_program_src(generator_t * gen, text_t * text, bool div) {
+    switch (div ? 0 : generator_next(gen) % 4) {
+    case 0:
+        text_append(text, "#%u", 1 + generator_next(gen) % 9); /* one digit, never zero */
+        break;
+    case 1:
+        text_append(text, "r%u", generator_next(gen) % 5);
+        break;
+    case 2:
+        text_append(text, "P%u", generator_next(gen) % GENERATOR_PROGRAM_DATA);
+        break;
+    default:
+        text_append(text, "@r5");
+        break;
+    }
+}
+
+/*!
+ * \brief appends a destination operand of a generated program
+ *
+ * \param gen	generator
+ * \param text	buffer
+ */
+static void append_program_dest(generator_t * gen, text_t * text) {
+    if (generator_next(gen) % 4 == 0) {
+        text_append(text, "P%u", generator_next(gen) % GENERATOR_PROGRAM_DATA);
+    } else {
+        text_append(text, "r%u", generator_next(gen) % 5);
+    }
+}
+
+/*!
+ * \brief appends the body of a loop or a subroutine of a generated program
+ *
+ * r0-r4 and the data are modified, r5 points to the data, r6 and r7 are the
+ * loop counters. No instruction can fail.
+ *
+ * \param gen	generator
+ * \param text	buffer
+ * \param lines	number of instructions
+ */
+static void append_program_body(generator_t * gen, text_t * text, uint32_t lines) {
+    static const char * ops[] = { "mov", "cmp", "add", "sub", "mul" };
+    uint32_t i;
+
+    for (i = 0; i < lines; i++) {
+        uint32_t r = generator_next(gen) % 16;
+
+        if (r < 8) {
+            text_append(text, "\t%s ", ops[r % 5]);
+            append_program_src(gen, text, false);
+            text_append(text, ", ");
+            append_program_dest(gen, text);
+        } else if (r < 9) {
+            text_append(text, "\tdiv ");
+            append_program_src(gen, text, true);
+            text_append(text, ", ");
+            append_program_dest(gen, text);
+        } else if (r < 12) {
+            text_append(text, "\t%s r%u", r % 2 ? "inc" : "dec", generator_next(gen) % 5);
+        } else if (r < 13) {
+            text_append(text, "\tinc P%u", generator_next(gen) % GENERATOR_PROGRAM_DATA);
+        } else if (r < 14) {
+            text_append(text, "\tshl r%u, #%u", generator_next(gen) % 5, 1 + generator_next(gen) % 3);
+        } else if (r < 15) {
+            text_append(text, "\tprn @r5");
+        } else {
+            text_append(text, "\tprn r%u", generator_next(gen) % 5);
+        }
+
+        text_append(text, "\n");
+    }
+}
+
+/*!
+ * \brief generates a program that can be run, nested loops over random bodies
+ *
+ * \note the counters are palindromes, so they don't depend on the order of the digits
+ *
+ * \param gen		generator
+ * \param text		buffer, the program is appended
+ * \param outer	number of iterations of the outer loop (palindrome)
+ * \return			number of lines
+ */
+uint32_t generator_program(generator_t * gen, text_t * text, uint32_t outer) {
+    size_t start = text->len;
+    uint32_t i, lines = 0;
+
+    text_append(text, "; synthetic program %u\n\t.entry MAIN\n", gen->units++);
+    text_append(text, "MAIN:\tlea P0, r5\n\tmov #%u, r7\n", outer);
+    text_append(text, "OUTER:\tmov #99, r6\n");
+    text_append(text, "INNER:");
+    append_program_body(gen, text, GENERATOR_PROGRAM_BODY);
+    text_append(text, "\tjsr F%u\n", generator_next(gen) % GENERATOR_PROGRAM_FUNCTIONS);
+    text_append(text, "\tsub #1, r6\n\tjnz INNER\n\tdec r7\n\tjnz OUTER\n\thlt\n");
+
+    for (i = 0; i < GENERATOR_PROGRAM_FUNCTIONS; i++) {
+        text_append(text, "F%u:", i);
+        append_program_body(gen, text, GENERATOR_PROGRAM_BODY / 2);
+        text_append(text, "\trts\n");
+    }
+
+    for (i = 0; i < GENERATOR_PROGRAM_DATA; i++) {
+        text_append(text, "P%u:\t.data %u\n", i, generator_next(gen) % 10);
+    }
+
+    for (; start < text->len; start++) {
+        lines += text->data[start] == '\n';
+    }
+
+    return lines;
+}
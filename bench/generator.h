@@ -0,0 +1,66 @@
+/*!
+ * \file generator.h
+ * \brief deterministic generator of synthetic assembly sources
+ */
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "asm.h"
+
+/*!
+ * \brief instruction words of a generated unit (at most 3 words per line)
+ */
+#define GENERATOR_CODE_LINES 400
+
+/*!
+ * \brief data words of a generated unit
+ */
+#define GENERATOR_DATA_WORDS 560
+
+/*!
+ * \brief number of externals declared by a generated unit
+ */
+#define GENERATOR_EXTERNS 16
+
+/*!
+ * \brief instructions in the inner loop of a generated program
+ */
+#define GENERATOR_PROGRAM_BODY 16
+
+/*!
+ * \brief subroutines of a generated program
+ */
+#define GENERATOR_PROGRAM_FUNCTIONS 4
+
+/*!
+ * \brief data words of a generated program
+ */
+#define GENERATOR_PROGRAM_DATA 8
+
+/*!
+ * \brief state of the generator
+ */
+typedef struct generator_s {
+    uint32_t state; /*!< \brief state of the xorshift random number generator */
+    uint32_t units; /*!< \brief number of generated units */
+} generator_t;
+
+/*!
+ * \brief growable text buffer
+ */
+typedef struct text_s {
+    char * data; /*!< \brief content, NULL terminated */
+    size_t len; /*!< \brief length of the content */
+    size_t capacity; /*!< \brief allocated size */
+} text_t;
+
+void generator_init(generator_t * gen, uint32_t seed);
+uint32_t generator_next(generator_t * gen);
+uint32_t generator_unit(generator_t * gen, text_t * text);
+uint32_t generator_program(generator_t * gen, text_t * text, uint32_t outer);
+
+void text_append(text_t * text, const char * fmt, ...);
+void text_free(text_t * text);
+
+#endif
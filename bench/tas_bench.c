@@ -0,0 +1,295 @@
+/*!
+ * \file tas_bench.c
+ * \brief end-to-end benchmark of the assembler over synthetic sources
+ *
+ * usage: tas-bench [-s seed] [-m max_lines] [-o results.json]
+ *
+ * For every size (1K, 10K, ... lines up to max_lines) synthetic units are
+ * generated and assembled in-process, phase by phase. The generation is not
+ * measured. Results are written as JSON, a summary goes to stderr.
+ *
+ * The memory of a phase is the growth of the current resident set size
+ * (/proc/self/statm) during the phase, the largest one of the units. The peak
+ * resident set size of the process only grows, it is reported once per size.
+ */
+
+#include "generator.h"
+
+#include <sys/resource.h> /* for getrusage() */
+#include <time.h> /* for clock_gettime() */
+#include <unistd.h> /* for sysconf() */
+
+/*!
+ * \brief phases of the assembling
+ */
+typedef enum phase_e {
+    PHASE_LEX = 0, /*!< splitting and cleaning the lines */
+    PHASE_FIRST_PASS, /*!< first pass */
+    PHASE_SECOND_PASS, /*!< second pass */
+    PHASE_OUTPUT, /*!< writing the object file */
+    PHASE_COUNT
+} phase_t;
+
+/*!
+ * \brief names of the phases in the results
+ */
+static const char * s_phase_names[PHASE_COUNT] = { "lex", "first_pass", "second_pass", "output" };
+
+/*!
+ * \brief measurements of one size
+ */
+typedef struct measurement_s {
+    uint64_t lines; /*!< \brief assembled lines */
+    uint64_t bytes; /*!< \brief assembled bytes */
+    uint32_t units; /*!< \brief assembled units */
+    uint32_t diagnostics; /*!< \brief errors and warnings, must be 0 */
+    double seconds[PHASE_COUNT]; /*!< \brief time spent in the phases */
+    long rss_growth_kb[PHASE_COUNT + 1]; /*!< \brief largest growth of the resident set size in the phases and in the unit */
+    long peak_rss_kb; /*!< \brief peak resident set size of the process after the size */
+} measurement_t;
+
+/*!
+ * \brief gets a monotonic time in seconds
+ *
+ * \return time in seconds
+ */
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*!
+ * \brief gets the current resident set size of the process
+ *
+ * \return resident set size in kilobytes, 0 if unknown
+ */
+static long current_rss_kb(void) {
+    FILE * fp = fopen("/proc/self/statm", "r");
+    long size = 0, resident = 0;
+
+    if (!fp) {
+        return 0;
+    }
+
+    if (fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*!
+ * \brief keeps the largest growth of the resident set size
+ *
+ * \param growth	largest growth so far, updated
+ * \param before	resident set size at the start
+ * \param after		resident set size at the end
+ */
+static void update_growth(long * growth, long before, long after) {
+    if (after - before > *growth) {
+        *growth = after - before;
+    }
+}
+
+/*!
+ * \brief gets the peak resident set size of the process
+ *
+ * \return peak resident set size in kilobytes
+ */
+static long peak_rss_kb(void) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_maxrss;
+}
+
+/*!
+ * \brief counts the diagnostics instead of printing them
+ */
+static void count_diagnostic(void * data, tas_severity_t severity,
+                             const char * file_name, uint32_t line,
+                             const char * message) {
+    (void)severity;
+    (void)file_name;
+    (void)line;
+    (void)message;
+
+    (*(uint32_t *)data)++;
+}
+
+/*!
+ * \brief assembles one unit phase by phase
+ *
+ * \param m		measurements, updated
+ * \param text	source of the unit
+ * \param null	output stream of the object file
+ */
+static void assemble_unit(measurement_t * m, text_t * text, FILE * null) {
+    double t[PHASE_COUNT + 1];
+    long rss[PHASE_COUNT + 1];
+    source_t source;
+    int p;
+
+    /* reading the resident set size is not timed */
+    rss[0] = current_rss_kb();
+    t[0] = now();
+    source_load(&source, "bench", text->data, text->len);
+    t[1] = now();
+    rss[1] = current_rss_kb();
+
+    reset_tables();
+    first_pass(&source);
+    t[2] = now();
+    rss[2] = current_rss_kb();
+
+    second_pass(&source);
+    t[3] = now();
+    rss[3] = current_rss_kb();
+
+    write_object_code(null);
+    t[4] = now();
+    rss[4] = current_rss_kb();
+
+    source_free(&source);
+
+    for (p = 0; p < PHASE_COUNT; p++) {
+        update_growth(&m->rss_growth_kb[p], rss[p], rss[p + 1]);
+    }
+    update_growth(&m->rss_growth_kb[PHASE_COUNT], rss[0], rss[PHASE_COUNT]);
+
+    m->seconds[PHASE_LEX] += t[1] - t[0];
+    m->seconds[PHASE_FIRST_PASS] += t[2] - t[1];
+    m->seconds[PHASE_SECOND_PASS] += t[3] - t[2];
+    m->seconds[PHASE_OUTPUT] += t[4] - t[3];
+}
+
+/*!
+ * \brief measures one size
+ *
+ * \param m			measurements
+ * \param seed		seed of the generator
+ * \param lines		number of lines to assemble at least
+ * \param null		output stream of the object file
+ */
+static void measure(measurement_t * m, uint32_t seed, uint64_t lines, FILE * null) {
+    generator_t gen;
+
+    memset(m, 0, sizeof(measurement_t));
+    generator_init(&gen, seed);
+    set_diagnostic_handler(count_diagnostic, &m->diagnostics);
+
+    while (m->lines < lines) {
+        text_t text = { NULL, 0, 0 };
+
+        m->lines += generator_unit(&gen, &text);
+        m->bytes += text.len;
+        m->units++;
+
+        assemble_unit(m, &text, null);
+        text_free(&text);
+    }
+
+    set_diagnostic_handler(NULL, NULL);
+
+    m->peak_rss_kb = peak_rss_kb();
+}
+
+/*!
+ * \brief writes the measurement of a phase
+ *
+ * \param fp	output stream
+ * \param m		measurements
+ * \param name	name of the phase
+ * \param sec	time spent
+ * \param rss	largest growth of the resident set size
+ */
+static void write_phase(FILE * fp, measurement_t * m, const char * name, double sec, long rss) {
+    fprintf(fp, "        \"%s\": { \"seconds\": %.6f, \"lines_per_s\": %.0f, "
+                "\"mb_per_s\": %.3f, \"rss_growth_kb\": %ld }",
+            name, sec, sec > 0 ? m->lines / sec : 0.0,
+            sec > 0 ? m->bytes / sec / 1e6 : 0.0, rss);
+}
+
+/*!
+ * \brief entry point of the benchmark
+ *
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    uint32_t seed = 1;
+    uint64_t max_lines = 10000000, lines;
+    const char * out_name = NULL;
+    FILE * out = stdout;
+    FILE * null;
+    bool first = true;
+    int a, p, failed = 0;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc) {
+            max_lines = strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            out_name = argv[++a];
+        } else {
+            fprintf(stderr, "usage: tas-bench [-s seed] [-m max_lines] [-o results.json]\n");
+            return 1;
+        }
+    }
+
+    null = fopen("/dev/null", "w");
+    if (out_name) {
+        out = fopen(out_name, "w");
+    }
+
+    if (!null || !out) {
+        fprintf(stderr, "unable to open the output\n");
+        return 2;
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"tas-e2e\",\n  \"seed\": %u,\n  \"results\": [", seed);
+
+    for (lines = 1000; lines <= max_lines; lines *= 10) {
+        measurement_t m;
+        double total = 0;
+
+        measure(&m, seed, lines, null);
+
+        fprintf(out, "%s\n    {\n      \"lines\": %" PRIu64 ",\n      \"bytes\": %" PRIu64 ",\n"
+                     "      \"units\": %u,\n      \"diagnostics\": %u,\n      \"process_peak_rss_kb\": %ld,\n"
+                     "      \"phases\": {\n",
+                first ? "" : ",", m.lines, m.bytes, m.units, m.diagnostics, m.peak_rss_kb);
+        first = false;
+
+        for (p = 0; p < PHASE_COUNT; p++) {
+            write_phase(out, &m, s_phase_names[p], m.seconds[p], m.rss_growth_kb[p]);
+            fprintf(out, ",\n");
+            total += m.seconds[p];
+        }
+
+        write_phase(out, &m, "total", total, m.rss_growth_kb[PHASE_COUNT]);
+        fprintf(out, "\n      }\n    }");
+
+        fprintf(stderr, "%10" PRIu64 " lines: %8.3f s, %10.0f lines/s, %7.2f MB/s, %u diagnostic(s)\n",
+                m.lines, total, total > 0 ? m.lines / total : 0.0,
+                total > 0 ? m.bytes / total / 1e6 : 0.0, m.diagnostics);
+
+        failed |= m.diagnostics != 0;
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    fclose(null);
+    if (out_name) {
+        fclose(out);
+    }
+
+    return failed ? 3 : 0;
+}
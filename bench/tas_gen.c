@@ -0,0 +1,69 @@
+/*!
+ * \file tas_gen.c
+ * \brief writes synthetic assembly sources
+ *
+ * usage: tas-gen [-s seed] [-n units] [-o prefix]
+ *
+ * Without -o the units are written to stdout, one after the other (only the
+ * first one is a valid source then). With -o every unit goes to prefixN.as.
+ */
+
+#include "generator.h"
+
+/*!
+ * \brief entry point of the generator
+ *
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    uint32_t seed = 1, units = 1, i;
+    const char * prefix = NULL;
+    generator_t gen;
+    int a;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            units = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            prefix = argv[++a];
+        } else {
+            fprintf(stderr, "usage: tas-gen [-s seed] [-n units] [-o prefix]\n");
+            return 1;
+        }
+    }
+
+    generator_init(&gen, seed);
+
+    for (i = 0; i < units; i++) {
+        text_t text = { NULL, 0, 0 };
+        FILE * fp = stdout;
+
+        generator_unit(&gen, &text);
+
+        if (prefix) {
+            char name[1024];
+
+            snprintf(name, sizeof(name), "%s%u.as", prefix, i);
+            fp = fopen(name, "w");
+            if (!fp) {
+                fprintf(stderr, "unable to open '%s'\n", name);
+                text_free(&text);
+                return 2;
+            }
+        }
+
+        fwrite(text.data, 1, text.len, fp);
+
+        if (prefix) {
+            fclose(fp);
+        }
+
+        text_free(&text);
+    }
+
+    return 0;
+}
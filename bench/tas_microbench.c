@@ -0,0 +1,500 @@
+/*!
+ * \file tas_microbench.c
+ * \brief microbenchmarks of the parser and the string primitives
+ *
+ * usage: tas-microbench [-s seed] [-n iterations] [-o results.json]
+ *
+ * The inputs are the lines, columns, operands and literals of synthetic units,
+ * so every function sees the token distribution of real sources. Reports
+ * ns/op and allocations/op. Allocations are counted by wrapping the glibc
+ * allocator; on other C libraries they are reported as -1.
+ */
+
+#include "generator.h"
+
+#include <time.h> /* for clock_gettime() */
+
+extern operation_t g_operations[16];
+
+/* counting allocator, every allocation of the process goes through it */
+#ifdef __GLIBC__
+static uint64_t s_allocations = 0; /*!< \brief number of allocations */
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void __libc_free(void * ptr);
+
+void * malloc(size_t size) {
+    s_allocations++;
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t n, size_t size) {
+    s_allocations++;
+    return __libc_calloc(n, size);
+}
+
+void * realloc(void * ptr, size_t size) {
+    s_allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void * ptr) {
+    __libc_free(ptr);
+}
+
+    #define ALLOCATIONS() s_allocations
+#else
+    #define ALLOCATIONS() 0
+#endif
+
+/*!
+ * \brief token with the arguments of the parser functions
+ */
+typedef struct token_s {
+    char * str; /*!< \brief text of the token */
+    int start; /*!< \brief start index ('#', '@' prefixes) */
+    int end; /*!< \brief end offset (':' suffix) */
+} token_t;
+
+/*!
+ * \brief list of tokens
+ */
+typedef struct tokens_s {
+    token_t * items; /*!< \brief tokens */
+    uint32_t count; /*!< \brief number of tokens */
+    uint32_t capacity; /*!< \brief allocated tokens */
+} tokens_t;
+
+/*!
+ * \brief inputs of the benchmarks, taken from synthetic units
+ */
+typedef struct corpus_s {
+    tokens_t raw_lines; /*!< \brief lines as written */
+    tokens_t clean_lines; /*!< \brief cleaned, not empty lines */
+    tokens_t columns; /*!< \brief columns of the cleaned lines */
+    tokens_t mnemonics; /*!< \brief columns that are operations */
+    tokens_t operands; /*!< \brief operands of the operations */
+    tokens_t labels; /*!< \brief label definitions and label operands */
+    tokens_t numbers; /*!< \brief numeric literals of .data and '#' operands */
+    instruction_t * instructions; /*!< \brief instructions of the operations */
+    uint32_t instructions_count; /*!< \brief number of instructions */
+} corpus_t;
+
+/*!
+ * \brief result of a benchmark
+ */
+typedef struct result_s {
+    const char * name; /*!< \brief name of the function */
+    double ns_per_op; /*!< \brief time of one call */
+    double allocations_per_op; /*!< \brief allocations of one call */
+} result_t;
+
+static volatile uint32_t s_sink; /*!< \brief keeps the results alive */
+
+/*!
+ * \brief gets a monotonic time in nanoseconds
+ *
+ * \return time in nanoseconds
+ */
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*!
+ * \brief adds a copy of a token to a list
+ *
+ * \param tokens	list of tokens
+ * \param str		text of the token
+ * \param start		start index
+ * \param end		end offset
+ */
+static void add_token(tokens_t * tokens, const char * str, int start, int end) {
+    if (tokens->count == tokens->capacity) {
+        tokens->capacity = tokens->capacity ? tokens->capacity * 2 : 1024;
+        tokens->items = (token_t *)realloc(tokens->items, tokens->capacity * sizeof(token_t));
+    }
+
+    tokens->items[tokens->count].str = strdup(str);
+    tokens->items[tokens->count].start = start;
+    tokens->items[tokens->count].end = end;
+    tokens->count++;
+}
+
+/*!
+ * \brief collects the tokens of an operand
+ *
+ * \param corpus	inputs
+ * \param operand	operand
+ */
+static void add_operand(corpus_t * corpus, const char * operand) {
+    add_token(&corpus->operands, operand, 0, 0);
+
+    if (operand[0] == '#') {
+        add_token(&corpus->numbers, operand, 1, 0);
+    } else if (operand[0] == '@') {
+        add_token(&corpus->labels, operand, 1, 0);
+    } else {
+        add_token(&corpus->labels, operand, 0, 0);
+    }
+}
+
+/*!
+ * \brief collects the tokens of a cleaned line
+ *
+ * \param corpus	inputs
+ * \param clean		cleaned line
+ */
+static void add_line(corpus_t * corpus, const char * clean) {
+    char * col;
+    int c;
+
+    add_token(&corpus->clean_lines, clean, 0, 0);
+
+    for (c = 0; (col = string_split(clean, " ", c)) != NULL; c++) {
+        column_t type = column_type(col);
+
+        add_token(&corpus->columns, col, 0, 0);
+
+        if (type == LABEL) {
+            add_token(&corpus->labels, col, 0, 1);
+        } else if (type == OPERATION) {
+            operation_t * op = get_operation(col);
+            char * operands = string_split(clean, " ", c + 1);
+            char * src = op->operands == 2 ? string_split(operands, ",", 0) : NULL;
+            char * dest = string_split(operands, ",", op->operands == 2 ? 1 : 0);
+            instruction_t inst;
+
+            add_token(&corpus->mnemonics, col, 0, 0);
+
+            memset(&inst, 0, sizeof(inst));
+            inst.op = op->opcode;
+
+            if (src) {
+                add_operand(corpus, src);
+                inst.src_addr = get_addressing(src)->mode;
+            }
+
+            if (dest) {
+                add_operand(corpus, dest);
+                inst.dest_addr = get_addressing(dest)->mode;
+            }
+
+            corpus->instructions = (instruction_t *)realloc(corpus->instructions,
+                                                            (corpus->instructions_count + 1) * sizeof(instruction_t));
+            corpus->instructions[corpus->instructions_count++] = inst;
+
+            free(src);
+            free(dest);
+            free(operands);
+            free(col);
+            break;
+        } else if (type == DIRECTIVE_NUMBER) {
+            char * list = string_split(clean, " ", c + 1);
+            char * number;
+            int n;
+
+            for (n = 0; (number = string_split(list, ",", n)) != NULL; n++) {
+                add_token(&corpus->numbers, number, 0, 0);
+                free(number);
+            }
+
+            free(list);
+        }
+
+        free(col);
+    }
+}
+
+/*!
+ * \brief builds the inputs from synthetic units
+ *
+ * \param corpus	inputs
+ * \param seed		seed of the generator
+ * \param units		number of units
+ */
+static void build_corpus(corpus_t * corpus, uint32_t seed, uint32_t units) {
+    generator_t gen;
+    uint32_t u, i;
+
+    memset(corpus, 0, sizeof(corpus_t));
+    generator_init(&gen, seed);
+
+    for (u = 0; u < units; u++) {
+        text_t text = { NULL, 0, 0 };
+        source_t source;
+
+        generator_unit(&gen, &text);
+        source_load(&source, "bench", text.data, text.len);
+
+        for (i = 0; i < source.count; i++) {
+            source_line_t * line = &source.lines[i];
+
+            add_token(&corpus->raw_lines, line->raw, 0, 0);
+
+            if (line->clean && line->clean[0] != 0 && line->clean[0] != ';') {
+                add_line(corpus, line->clean);
+            }
+        }
+
+        source_free(&source);
+        text_free(&text);
+    }
+}
+
+/*!
+ * \brief runs one benchmark
+ *
+ * \param r				result
+ * \param name			name of the function
+ * \param tokens		inputs
+ * \param iterations	number of calls
+ * \param fn			calls the function with one input
+ */
+static void run(result_t * r, const char * name, tokens_t * tokens, uint32_t iterations,
+                uint32_t (*fn)(token_t * token)) {
+    uint64_t allocations;
+    uint32_t i, sink = 0;
+    double start;
+
+    /* warm up */
+    for (i = 0; i < tokens->count && i < iterations; i++) {
+        sink += fn(&tokens->items[i]);
+    }
+
+    allocations = ALLOCATIONS();
+    start = now_ns();
+
+    for (i = 0; i < iterations; i++) {
+        sink += fn(&tokens->items[i % tokens->count]);
+    }
+
+    r->name = name;
+    r->ns_per_op = (now_ns() - start) / iterations;
+#ifdef __GLIBC__
+    r->allocations_per_op = (double)(ALLOCATIONS() - allocations) / iterations;
+#else
+    (void)allocations;
+    r->allocations_per_op = -1;
+#endif
+
+    s_sink = sink;
+}
+
+/*!
+ * \brief frees a returned string and derives a value from it
+ *
+ * \param str	returned string
+ * \return		value derived from the string
+ */
+static uint32_t consume(char * str) {
+    uint32_t v = str ? (uint32_t)str[0] : 0;
+
+    free(str);
+
+    return v;
+}
+
+/* benchmarked calls */
+static uint32_t bench_clean_line(token_t * t) {
+    return consume(clean_line(t->str));
+}
+
+static uint32_t bench_string_split(token_t * t) {
+    return consume(string_split(t->str, " ", 1));
+}
+
+static uint32_t bench_string_trim(token_t * t) {
+    return consume(string_trim(t->str, " \t"));
+}
+
+static uint32_t bench_string_trim_end(token_t * t) {
+    return consume(string_trim_end(t->str, " \t\r\n"));
+}
+
+static uint32_t bench_column_type(token_t * t) {
+    return (uint32_t)column_type(t->str);
+}
+
+static uint32_t bench_get_operation(token_t * t) {
+    return get_operation(t->str)->opcode;
+}
+
+static uint32_t bench_get_addressing(token_t * t) {
+    addressing_t * addr = get_addressing(t->str);
+
+    return addr ? (uint32_t)addr->mode : 0;
+}
+
+static uint32_t bench_is_valid_label_name(token_t * t) {
+    return is_valid_label_name(t->str, t->start, t->end);
+}
+
+static uint32_t bench_get_number(token_t * t) {
+    return get_number(t->str, t->start);
+}
+
+/*!
+ * \brief is_valid_numeric_literal() before parse_number(), the baseline of parse_number
+ *
+ * \param str			string containing the numeric literal
+ * \param start_index	start of the numeric literal in the input string
+ * \return				valid or not
+ */
+static bool old_is_valid_numeric_literal(char * str, int start_index) {
+    size_t len;
+    char ch;
+
+    if (!str || !str[0]) {
+        return false;
+    }
+
+    len = strlen(str);
+    if ((size_t)start_index >= len) {
+        return true;
+    }
+
+    /* first character can be [-+][0-9] */
+    ch = str[start_index];
+    if (!(g_char_class[(uint8_t)ch] & CHAR_DIGIT) && ch != '-' && ch != '+') {
+        return false;
+    }
+
+    /* other characters can be [0-9] */
+    return scan_span(str + start_index + 1, len - start_index - 1, CHAR_DIGIT) == len - start_index - 1;
+}
+
+/*!
+ * \brief get_number() before parse_number(), the baseline of parse_number
+ *
+ * \note it reads the digits backwards, "12" is 21, only its cost is compared
+ *
+ * \param str			string containing the number
+ * \param start_index	start of the number in the input string
+ * \return				numeric value
+ */
+static uint16_t old_get_number(char * str, int start_index) {
+    uint16_t value = 0;
+    bool negative = false;
+    int i, len = (int)strlen(str);
+
+    if (str[start_index] == '-') {
+        negative = true;
+        start_index++;
+    } else if (str[start_index] == '+') {
+        start_index++;
+    }
+
+    for (i = len - 1; i >= start_index; i--) {
+        value *= 10;
+        value += str[i] - '0';
+    }
+
+    if (negative == true) {
+        value = ~value;
+        value += 1;
+    }
+
+    return value;
+}
+
+static uint32_t bench_old_validate_get_number(token_t * t) {
+    return old_is_valid_numeric_literal(t->str, t->start) ? old_get_number(t->str, t->start) : 0;
+}
+
+static uint32_t bench_parse_number(token_t * t) {
+    uint16_t value = 0;
+
+    return parse_number(t->str, t->start, &value) == NUMBER_OK ? value : 0;
+}
+
+static instruction_t * s_instructions; /*!< \brief inputs of instruction_to_word() */
+
+static uint32_t bench_instruction_to_word(token_t * t) {
+    return instruction_to_word(s_instructions[t->start]);
+}
+
+/*!
+ * \brief entry point of the microbenchmarks
+ *
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    uint32_t seed = 1, iterations = 1000000, i;
+    const char * out_name = NULL;
+    FILE * out = stdout;
+    tokens_t indices = { NULL, 0, 0 };
+    result_t results[12];
+    corpus_t corpus;
+    int a;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            iterations = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            out_name = argv[++a];
+        } else {
+            fprintf(stderr, "usage: tas-microbench [-s seed] [-n iterations] [-o results.json]\n");
+            return 1;
+        }
+    }
+
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    build_corpus(&corpus, seed, 4);
+
+    /* instruction_to_word() takes structs, the tokens only carry the index */
+    s_instructions = corpus.instructions;
+    for (i = 0; i < corpus.instructions_count; i++) {
+        add_token(&indices, "", (int)i, 0);
+    }
+
+    run(&results[0], "clean_line", &corpus.raw_lines, iterations, bench_clean_line);
+    run(&results[1], "string_split", &corpus.clean_lines, iterations, bench_string_split);
+    run(&results[2], "string_trim", &corpus.raw_lines, iterations, bench_string_trim);
+    run(&results[3], "string_trim_end", &corpus.raw_lines, iterations, bench_string_trim_end);
+    run(&results[4], "column_type", &corpus.columns, iterations, bench_column_type);
+    run(&results[5], "get_operation", &corpus.mnemonics, iterations, bench_get_operation);
+    run(&results[6], "get_addressing", &corpus.operands, iterations, bench_get_addressing);
+    run(&results[7], "is_valid_label_name", &corpus.labels, iterations, bench_is_valid_label_name);
+    run(&results[8], "get_number", &corpus.numbers, iterations, bench_get_number);
+    run(&results[9], "old_validate+get", &corpus.numbers, iterations, bench_old_validate_get_number);
+    run(&results[10], "parse_number", &corpus.numbers, iterations, bench_parse_number);
+    run(&results[11], "instruction_to_word", &indices, iterations, bench_instruction_to_word);
+
+    if (out_name) {
+        out = fopen(out_name, "w");
+        if (!out) {
+            fprintf(stderr, "unable to open '%s'\n", out_name);
+            return 2;
+        }
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"tas-micro\",\n  \"seed\": %u,\n  \"iterations\": %u,\n  \"scan\": \"%s\",\n  \"results\": [",
+            seed, iterations, scan_implementation());
+    fprintf(stderr, "character scanner: %s\n", scan_implementation());
+    for (i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+        fprintf(out, "%s\n    { \"name\": \"%s\", \"ns_per_op\": %.2f, \"allocations_per_op\": %.2f }",
+                i ? "," : "", results[i].name, results[i].ns_per_op, results[i].allocations_per_op);
+        fprintf(stderr, "%-20s %10.2f ns/op %8.2f allocs/op\n",
+                results[i].name, results[i].ns_per_op, results[i].allocations_per_op);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out_name) {
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*!
+ * \file tas_simbench.c
+ * \brief benchmark of the dispatch strategies of the simulator
+ *
+ * usage: tas-simbench [-s seed] [-n programs] [-r random_images] [-o results.json]
+ *
+ * Synthetic programs are assembled and run with every dispatch strategy. The
+ * final state of the machine and the output of prn must be the same for all
+ * strategies (including the JIT), a mismatch fails the benchmark. Random
+ * images are run the same way, they cover the faults, the step limit and the
+ * self-modifying code. Results are written as JSON, a summary goes to stderr.
+ */
+
+#include "generator.h"
+
+#include <time.h> /* for clock_gettime() */
+
+/*!
+ * \brief iterations of the outer loop of the programs
+ */
+#define OUTER_LOOPS 999
+
+/*!
+ * \brief maximum number of instructions of a random image
+ */
+#define RANDOM_STEPS 20000
+
+/*!
+ * \brief instruction words at the start of a random image
+ */
+#define RANDOM_CODE 256
+
+extern operation_t g_operations[16];
+
+/*!
+ * \brief measurements of one dispatch strategy
+ */
+typedef struct measurement_s {
+    uint64_t steps; /*!< \brief executed instructions */
+    double seconds; /*!< \brief time spent in sim_run() */
+} measurement_t;
+
+/*!
+ * \brief gets a monotonic time in seconds
+ *
+ * \return time in seconds
+ */
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*!
+ * \brief assembles a program into the global tables
+ *
+ * \param text	source
+ * \return		success
+ */
+static bool assemble(text_t * text) {
+    source_t source;
+    bool ok;
+
+    if (!source_load(&source, "program", text->data, text->len)) {
+        return false;
+    }
+
+    reset_tables();
+    ok = first_pass(&source) == 0 && second_pass(&source) == 0;
+    source_free(&source);
+
+    return ok;
+}
+
+/*!
+ * \brief compares the state of two machines after running
+ *
+ * \param a	machine
+ * \param b	machine
+ * \return	same state
+ */
+static bool same_state(machine_t * a, machine_t * b) {
+    return a->pc == b->pc && a->sp == b->sp && a->psw == b->psw && a->steps == b->steps &&
+           memcmp(a->r, b->r, sizeof(a->r)) == 0 &&
+           memcmp(a->memory, b->memory, sizeof(a->memory)) == 0;
+}
+
+/*!
+ * \brief generates a random additional word
+ *
+ * \param gen	generator
+ * \return		mostly an address of the code or the data, rarely anything
+ */
+static uint16_t random_word(generator_t * gen) {
+    uint32_t r = generator_next(gen);
+
+    return (r & 0x3F) == 0 ? (uint16_t)(r >> 8) : (uint16_t)((r >> 8) % (RANDOM_CODE * 2));
+}
+
+/*!
+ * \brief picks one of the legal addressing modes
+ *
+ * \param gen	generator
+ * \param legal	legal modes, e.g. "01234"
+ * \return		addressing mode
+ */
+static uint16_t random_mode(generator_t * gen, const char * legal) {
+    return (uint16_t)(legal[generator_next(gen) % strlen(legal)] - '0');
+}
+
+/*!
+ * \brief generates a random image of legal instructions followed by data
+ *
+ * The addresses point into the code and the data, so the images overwrite
+ * their code, and rarely outside of the memory.
+ *
+ * \param gen		generator
+ * \param words	image of TABLE_SIZE words
+ * \param regs		initial registers
+ */
+static void random_image(generator_t * gen, uint16_t * words, uint16_t * regs) {
+    uint32_t i = 0;
+
+    while (i < RANDOM_CODE - 3) {
+        uint32_t r = generator_next(gen);
+        operation_t * op = &g_operations[r % 16];
+        uint32_t first = i;
+        uint16_t mode;
+
+        if (op->opcode == 0xF && r % 7 != 0) {
+            continue; /* few hlt-s */
+        }
+
+        words[i++] = (uint16_t)(op->opcode << 12);
+
+        if (op->operands == 2) {
+            mode = random_mode(gen, op->src_legal);
+            words[first] |= (uint16_t)((mode << 9) | ((generator_next(gen) % 8) << 6));
+            if (mode <= INDIRECT) {
+                words[i++] = random_word(gen);
+            }
+        }
+
+        if (op->operands >= 1) {
+            mode = random_mode(gen, op->dest_legal);
+            words[first] |= (uint16_t)((mode << 3) | (generator_next(gen) % 8));
+            if (mode <= INDIRECT) {
+                words[i++] = random_word(gen);
+            }
+        }
+    }
+
+    for (; i < TABLE_SIZE; i++) {
+        words[i] = random_word(gen);
+    }
+
+    for (i = 0; i < 8; i++) {
+        regs[i] = random_word(gen);
+    }
+}
+
+/*!
+ * \brief runs random images with every dispatch strategy and compares the results
+ *
+ * \param gen		generator
+ * \param machines	a machine for every strategy
+ * \param images	number of images
+ * \return			number of mismatches
+ */
+static uint32_t run_random_images(generator_t * gen, machine_t ** machines, uint32_t images) {
+    uint16_t words[TABLE_SIZE];
+    uint16_t regs[8];
+    uint32_t mismatches = 0, i;
+    int d;
+
+    for (i = 0; i < images; i++) {
+        char * outputs[SIM_DISPATCH_COUNT];
+        size_t lengths[SIM_DISPATCH_COUNT];
+        sim_status_t statuses[SIM_DISPATCH_COUNT];
+
+        random_image(gen, words, regs);
+
+        for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+            machine_t * m = machines[d];
+            FILE * output = open_memstream(&outputs[d], &lengths[d]);
+
+            if (!output) {
+                return mismatches + 1;
+            }
+
+            sim_init(m, output);
+            m->dispatch = (sim_dispatch_t)d;
+            sim_load(m, words, TABLE_SIZE, RANDOM_CODE, 0);
+            memcpy(m->r, regs, sizeof(regs));
+
+            statuses[d] = sim_run(m, RANDOM_STEPS);
+
+            sim_release(m);
+            fclose(output);
+
+            if (d > 0 && (statuses[d] != statuses[0] || !same_state(machines[0], m) ||
+                          lengths[d] != lengths[0] || memcmp(outputs[d], outputs[0], lengths[0]) != 0)) {
+                fprintf(stderr, "random image %u, %s: %s at %04x after %" PRIu64 ", %s: %s at %04x after %" PRIu64 "\n",
+                        i, sim_dispatch_string((sim_dispatch_t)d), sim_status_string(statuses[d]),
+                        m->pc, m->steps,
+                        sim_dispatch_string(SIM_DISPATCH_DECODE), sim_status_string(statuses[0]),
+                        machines[0]->pc, machines[0]->steps);
+                mismatches++;
+            }
+        }
+
+        for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+            free(outputs[d]);
+        }
+    }
+
+    return mismatches;
+}
+
+/*!
+ * \brief entry point of the benchmark
+ *
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    measurement_t results[SIM_DISPATCH_COUNT];
+    machine_t * machines[SIM_DISPATCH_COUNT];
+    uint32_t seed = 1, programs = 8, images = 1000, i;
+    uint32_t mismatches = 0, failures = 0;
+    const char * out_name = NULL;
+    FILE * out = stdout;
+    char * outputs[SIM_DISPATCH_COUNT];
+    size_t lengths[SIM_DISPATCH_COUNT];
+    generator_t gen;
+    int a, d;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            seed = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            programs = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) {
+            images = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            out_name = argv[++a];
+        } else {
+            fprintf(stderr, "usage: tas-simbench [-s seed] [-n programs] [-r random_images] [-o results.json]\n");
+            return 1;
+        }
+    }
+
+    if (out_name) {
+        out = fopen(out_name, "w");
+    }
+
+    if (!out) {
+        fprintf(stderr, "unable to open the output\n");
+        return 2;
+    }
+
+    for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+        machines[d] = (machine_t *)malloc(sizeof(machine_t));
+        if (!machines[d]) {
+            fprintf(stderr, "unable to allocate memory for the simulator\n");
+            return 2;
+        }
+    }
+
+    memset(results, 0, sizeof(results));
+    generator_init(&gen, seed);
+
+    for (i = 0; i < programs; i++) {
+        text_t text = { NULL, 0, 0 };
+
+        generator_program(&gen, &text, OUTER_LOOPS);
+
+        if (!assemble(&text)) {
+            fprintf(stderr, "program %u: assembling failed\n", i);
+            failures++;
+            text_free(&text);
+            continue;
+        }
+
+        text_free(&text);
+
+        for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+            machine_t * m = machines[d];
+            FILE * output = open_memstream(&outputs[d], &lengths[d]);
+            sim_status_t status;
+            double start;
+
+            if (!output) {
+                fprintf(stderr, "unable to open the output of prn\n");
+                return 2;
+            }
+
+            sim_init(m, output);
+            m->dispatch = (sim_dispatch_t)d;
+            sim_load_object_code(m);
+
+            start = now();
+            status = sim_run(m, UINT64_MAX);
+            results[d].seconds += now() - start;
+            results[d].steps += m->steps;
+
+            sim_release(m);
+            fclose(output);
+
+            if (status != SIM_HALTED) {
+                fprintf(stderr, "program %u, %s: %s\n", i, sim_dispatch_string((sim_dispatch_t)d),
+                        sim_status_string(status));
+                failures++;
+            } else if (d > 0 && (!same_state(machines[0], m) || lengths[d] != lengths[0] ||
+                                 memcmp(outputs[d], outputs[0], lengths[0]) != 0)) {
+                fprintf(stderr, "program %u, %s: state or output differs from %s\n", i,
+                        sim_dispatch_string((sim_dispatch_t)d), sim_dispatch_string(SIM_DISPATCH_DECODE));
+                mismatches++;
+            }
+        }
+
+        for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+            free(outputs[d]);
+        }
+    }
+
+    mismatches += run_random_images(&gen, machines, images);
+
+    fprintf(out, "{\n  \"benchmark\": \"tas-sim\",\n  \"seed\": %u,\n  \"programs\": %u,\n"
+                 "  \"random_images\": %u,\n  \"mismatches\": %u,\n  \"results\": [",
+            seed, programs, images, mismatches);
+
+    for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+        measurement_t * r = &results[d];
+        double ips = r->seconds > 0 ? r->steps / r->seconds : 0.0;
+
+        fprintf(out, "%s\n    { \"dispatch\": \"%s\", \"instructions\": %" PRIu64 ", \"seconds\": %.6f, "
+                     "\"instructions_per_s\": %.0f }",
+                d ? "," : "", sim_dispatch_string((sim_dispatch_t)d),
+                r->steps, r->seconds, ips);
+
+        fprintf(stderr, "%18s: %12" PRIu64 " instructions, %8.3f s, %8.1f M instructions/s\n",
+                sim_dispatch_string((sim_dispatch_t)d), r->steps,
+                r->seconds, ips / 1e6);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+        free(machines[d]);
+    }
+
+    if (out_name) {
+        fclose(out);
+    }
+
+    return failures || mismatches ? 3 : 0;
+}
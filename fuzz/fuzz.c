@@ -0,0 +1,74 @@
+/*!
+ * \file fuzz.c
+ * \brief helpers of the fuzz targets
+ */
+
+#include "fuzz.h"
+
+#include <stdarg.h> /* for va_list */
+
+/*!
+ * \brief reports a broken invariant and aborts, the drivers keep the input
+ *
+ * \param file	source file of the check
+ * \param line	line of the check
+ * \param fmt	format of the message
+ */
+void fuzz_fail(const char * file, int line, const char * fmt, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s:%d: ", file, line);
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+
+    fprintf(stderr, "\n");
+    abort();
+}
+
+/*!
+ * \brief copies the input into a NULL terminated string
+ *
+ * \note the string ends at the first NULL of the input
+ * \note returned string, if not NULL, must be free()-d
+ *
+ * \param data	input
+ * \param size	size of the input
+ * \return		string or NULL
+ */
+char * fuzz_string(const uint8_t * data, size_t size) {
+    char * str = (char *)malloc(size + 1);
+
+    if (str) {
+        memcpy(str, data, size);
+        str[size] = 0;
+    }
+
+    return str;
+}
+
+/*!
+ * \brief cuts the next line from a string, like strsep() with "\n"
+ *
+ * \param p	position in the string, set to the next line, NULL after the last one
+ * \return	line or NULL after the last one
+ */
+char * fuzz_next_line(char ** p) {
+    char * line = *p;
+    char * end;
+
+    if (!line) {
+        return NULL;
+    }
+
+    end = strchr(line, '\n');
+    if (end) {
+        *end = 0;
+        *p = end + 1;
+    } else {
+        *p = NULL;
+    }
+
+    return line;
+}
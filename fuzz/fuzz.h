@@ -0,0 +1,30 @@
+/*!
+ * \file fuzz.h
+ * \brief in-memory entry points of the fuzz targets
+ *
+ * Every target defines LLVMFuzzerTestOneInput(), the entry point of libFuzzer.
+ * The targets are linked either with libFuzzer or with the standalone driver
+ * (fuzz_driver.c), which mutates generated sources. A target checks the
+ * invariants of the functions it calls with FUZZ_CHECK(), a failure aborts,
+ * so the input is kept as a crash by both drivers.
+ */
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "asm.h"
+#include "tas.h"
+
+/*!
+ * \brief aborts with a message if an invariant does not hold
+ */
+#define FUZZ_CHECK(cond, ...) ((cond) ? (void)0 : fuzz_fail(__FILE__, __LINE__, __VA_ARGS__))
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+/* fuzz.c */
+void fuzz_fail(const char * file, int line, const char * fmt, ...);
+char * fuzz_string(const uint8_t * data, size_t size);
+char * fuzz_next_line(char ** p);
+
+#endif
@@ -0,0 +1,48 @@
+/*!
+ * \file fuzz_assemble.c
+ * \brief fuzz target of the whole assembling (macros, first and second pass)
+ *
+ * The input is a source, assembled in memory with tas_assemble(). A failed
+ * assembling must have errors, a successful one a consistent image.
+ */
+
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    tas_options_t options = { "fuzz", 0 };
+    tas_result_t result;
+    tas_status_t status;
+    uint32_t i;
+
+    status = tas_assemble((const char *)data, size, options, &result);
+
+    if (status == TAS_FIRST_PASS_FAILED || status == TAS_SECOND_PASS_FAILED) {
+        FUZZ_CHECK(result.errors > 0 && result.diagnostics_size > 0, "failed without an error");
+    }
+
+    if (status == TAS_OK) {
+        FUZZ_CHECK(result.code_size == result.instructions_size + result.data_size && result.code_size <= TABLE_SIZE,
+                   "invalid size of the image: %u code, %u data", result.instructions_size, result.data_size);
+
+        for (i = 0; i < result.code_size; i++) {
+            char type = result.code[i].type;
+
+            FUZZ_CHECK(i < result.instructions_size ? type == 'a' || type == 'r' || type == 'e' : type == ' ',
+                       "invalid type of the word %u: '%c'", i, type);
+        }
+
+        for (i = 0; i < result.externals_size; i++) {
+            FUZZ_CHECK(result.externals[i].value < result.instructions_size &&
+                           result.code[result.externals[i].value].type == 'e',
+                       "external %s refers to a word that is not external", result.externals[i].name);
+        }
+    }
+
+    for (i = 0; i < result.diagnostics_size; i++) {
+        FUZZ_CHECK(result.diagnostics[i].message != NULL, "diagnostic without a message");
+    }
+
+    tas_free_result(&result);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*!
+ * \file fuzz_clean_line.c
+ * \brief fuzz target of clean_line() and the string functions
+ *
+ * The input is one line. The cleaned line must not be longer, must have no
+ * white space at its ends, no tab, no repeated space and no space next to a
+ * comma, and cleaning it again must not change it. The columns and the
+ * trimmed strings are computed too, for the sanitizers.
+ */
+
+#include "fuzz.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    char * line = fuzz_string(data, size);
+    char * clean, * again, * trimmed, * column;
+    size_t len;
+    int i;
+
+    if (!line) {
+        return 0;
+    }
+
+    clean = clean_line(line);
+    if (clean) {
+        len = strlen(clean);
+
+        FUZZ_CHECK(len <= strlen(line), "clean_line() made the line longer: '%s'", clean);
+        FUZZ_CHECK(!strchr(clean, '\t'), "tab in the cleaned line: '%s'", clean);
+        FUZZ_CHECK(len == 0 || (clean[0] != ' ' && !strchr(" \r\n", clean[len - 1])),
+                   "white space at the ends of the cleaned line: '%s'", clean);
+        FUZZ_CHECK(!strstr(clean, "  ") && !strstr(clean, " ,") && !strstr(clean, ", "),
+                   "white space left in the cleaned line: '%s'", clean);
+
+        again = clean_line(clean);
+        FUZZ_CHECK(again && strcmp(again, clean) == 0, "clean_line() is not idempotent: '%s' -> '%s'", clean,
+                   again ? again : "(null)");
+        free(again);
+
+        for (i = 0; (column = string_split(clean, " ", i)) != NULL; i++) {
+            FUZZ_CHECK(column[0] && !strchr(column, ' '), "invalid column %d: '%s'", i, column);
+            free(column);
+        }
+
+        free(clean);
+    }
+
+    trimmed = string_trim(line, " \t");
+    FUZZ_CHECK(trimmed && strstr(line, trimmed) && trimmed[0] != ' ' && trimmed[0] != '\t',
+               "string_trim() of '%s'", line);
+    free(trimmed);
+
+    trimmed = string_trim_end(line, " \t\r\n");
+    len = trimmed ? strlen(trimmed) : 0;
+    FUZZ_CHECK(trimmed && strncmp(line, trimmed, len) == 0 && (len == 0 || !strchr(" \t\r\n", trimmed[len - 1])),
+               "string_trim_end() of '%s'", line);
+    free(trimmed);
+
+    free(line);
+
+    return 0;
+}
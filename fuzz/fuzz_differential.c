@@ -0,0 +1,482 @@
+/*!
+ * \file fuzz_differential.c
+ * \brief differential fuzz target, the fast paths against reference implementations
+ *
+ * The fast paths must give the same results as the simple implementations
+ * they replaced:
+ *
+ * - scan_span() (SSE2/AVX2 blocks) against a byte by byte classification,
+ * - clean_line() (copies runs at once) against the copy character by character,
+ * - parse_number() (one pass) against strtol(),
+ * - the words of tas_assemble() against a reference encoder, on instructions
+ *   made of the input with legal addressing modes,
+ * - the dispatch strategies of the simulator (pre-decoded instructions,
+ *   computed goto, superinstructions, JIT) against the decoding of every
+ *   instruction, on the image assembled from the input.
+ */
+
+#include "fuzz.h"
+
+/* global variables */
+extern operation_t g_operations[16];
+
+/*!
+ * \brief maximum number of instructions of a simulated run
+ */
+#define FUZZ_STEPS 10000
+
+/*!
+ * \brief maximum number of instructions made of an input
+ */
+#define FUZZ_INSTRUCTIONS 64
+
+/*!
+ * \brief operand of an instruction made of the input, with its expected additional word
+ */
+typedef struct fuzz_operand_s {
+    uint8_t mode; /*!< \brief addressing mode */
+    uint8_t reg; /*!< \brief register of the register modes, else 0 */
+    const char * label; /*!< \brief MAIN, D (data) or X (external) in the direct and indirect modes, else NULL */
+    int16_t value; /*!< \brief value of the instant mode */
+} fuzz_operand_t;
+
+/*!
+ * \brief sets of classes compared by scan_span()
+ */
+static const uint8_t s_classes[] = {
+    CHAR_SPACE,
+    CHAR_DIGIT,
+    CHAR_DIGIT | CHAR_ALPHA,
+    CHAR_DIGIT | CHAR_ALPHA | CHAR_SPECIAL,
+    CHAR_SPACE | CHAR_COMMENT | CHAR_COMMA,
+    CHAR_SPACE | CHAR_COMMENT | CHAR_COMMA | CHAR_DIGIT | CHAR_ALPHA | CHAR_SPECIAL
+};
+
+static const char * s_labels[] = { "MAIN", "D", "X" }; /*!< \brief labels of the direct and indirect operands */
+
+static machine_t s_machines[SIM_DISPATCH_COUNT]; /*!< \brief a machine for every dispatch strategy */
+
+/*!
+ * \brief gets the class of a byte with comparisons
+ *
+ * \param ch	byte
+ * \return		class, 0 for NULL
+ */
+static uint8_t reference_class(char ch) {
+    if (ch == 0) {
+        return 0;
+    } else if (ch == ' ' || ch == '\t') {
+        return CHAR_SPACE;
+    } else if (ch == ';') {
+        return CHAR_COMMENT;
+    } else if (ch == ',') {
+        return CHAR_COMMA;
+    } else if (ch >= '0' && ch <= '9') {
+        return CHAR_DIGIT;
+    } else if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) {
+        return CHAR_ALPHA;
+    }
+
+    return CHAR_SPECIAL;
+}
+
+/*!
+ * \brief cleans a line character by character
+ *
+ * \note returned string, if not NULL, must be free()-d
+ *
+ * \param line	line of a source file
+ * \return		cleaned string or NULL
+ */
+static char * reference_clean_line(const char * line) {
+    size_t i, n = 0, len;
+    char * ret;
+
+    line += strspn(line, " \t"); /* remove starting junk */
+    len = strlen(line);
+
+    ret = (char *)malloc(len + 1);
+    if (!ret) {
+        return NULL;
+    }
+
+    for (i = 0; i < len; i++) {
+        char ch = line[i] == '\t' ? ' ' : line[i];
+
+        /* start of comment, the first character is copied */
+        if (ch == ';' && i > 0) {
+            break;
+        }
+
+        /* not add duplicated space or space after comma */
+        if (ch == ' ' && (ret[n - 1] == ' ' || ret[n - 1] == ',')) {
+            continue;
+        }
+
+        /* not add space before a comma */
+        if (ch == ' ' && line[i + strspn(line + i, " \t")] == ',') {
+            continue;
+        }
+
+        ret[n++] = ch;
+    }
+
+    /* remove ending junk */
+    while (n > 0 && strchr(" \t\r\n", ret[n - 1])) {
+        n--;
+    }
+    ret[n] = 0;
+
+    return ret;
+}
+
+/*!
+ * \brief parses a numeric literal with strtol()
+ *
+ * \param str	numeric literal
+ * \param value	set to the value if the literal is valid
+ * \return		NUMBER_OK, NUMBER_SYNTAX or NUMBER_RANGE
+ */
+static number_status_t reference_parse_number(const char * str, uint16_t * value) {
+    const char * digits = "0123456789";
+    bool negative = str[0] == '-';
+    int base = 10;
+    long n;
+
+    str += str[0] == '-' || str[0] == '+';
+
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        digits = "0123456789abcdefABCDEF";
+        base = 16;
+        str += 2;
+    } else if (str[0] == '0' && (str[1] == 'b' || str[1] == 'B')) {
+        digits = "01";
+        base = 2;
+        str += 2;
+    }
+
+    if (!str[0] || strspn(str, digits) != strlen(str)) {
+        return NUMBER_SYNTAX;
+    }
+
+    /* strtol() stops at its limit, the limits of the words are far below */
+    n = strtol(str, NULL, base);
+    if (n > (negative ? 0x8000 : 0xffff)) {
+        return NUMBER_RANGE;
+    }
+
+    *value = (uint16_t)(negative ? -n : n);
+
+    return NUMBER_OK;
+}
+
+/*!
+ * \brief encodes an instruction word, bits 15-12 op, 11-9 source mode, 8-6 source
+ * register, 5-3 destination mode, 2-0 destination register
+ *
+ * \param op		operation code
+ * \param src		source operand
+ * \param dest		destination operand
+ * \return			instruction word
+ */
+static uint16_t reference_encode(uint8_t op, const fuzz_operand_t * src, const fuzz_operand_t * dest) {
+    return (uint16_t)(op * 0x1000 + src->mode * 0x200 + src->reg * 0x40 + dest->mode * 0x8 + dest->reg);
+}
+
+/*!
+ * \brief makes an operand of the input with one of the legal modes
+ *
+ * \param operand	operand
+ * \param modes		legal modes, e.g. "1234"
+ * \param data		two bytes of the input
+ */
+static void fuzz_make_operand(fuzz_operand_t * operand, const char * modes, const uint8_t * data) {
+    memset(operand, 0, sizeof(fuzz_operand_t));
+
+    if (!modes[0]) {
+        return;
+    }
+
+    operand->mode = (uint8_t)(modes[data[0] % strlen(modes)] - '0');
+
+    switch (operand->mode) {
+    case INSTANT:
+        operand->value = (int16_t)((int8_t)data[1] * 129); /* -16512..16383 */
+        break;
+    case DIRECT:
+    case INDIRECT:
+        operand->label = s_labels[data[1] % 3];
+        break;
+    default:
+        operand->reg = data[1] & 0x7;
+    }
+}
+
+/*!
+ * \brief writes an operand in the source
+ *
+ * \param fp		source
+ * \param operand	operand
+ * \param hex		the instant value is hexadecimal, if it is not negative
+ */
+static void fuzz_write_operand(FILE * fp, const fuzz_operand_t * operand, bool hex) {
+    switch (operand->mode) {
+    case INSTANT:
+        fprintf(fp, hex && operand->value >= 0 ? "#0x%x" : "#%d", operand->value);
+        break;
+    case DIRECT:
+    case INDIRECT:
+        fprintf(fp, "%s%s", operand->mode == INDIRECT ? "@" : "", operand->label);
+        break;
+    case DIRECT_REGISTER:
+    case INDIRECT_REGISTER:
+        fprintf(fp, "%sr%u", operand->mode == INDIRECT_REGISTER ? "@" : "", operand->reg);
+        break;
+    }
+}
+
+/*!
+ * \brief checks the additional word of an operand
+ *
+ * \param result	assembled image
+ * \param address	address of the word, incremented if the mode has one
+ * \param operand	operand
+ */
+static void fuzz_check_operand(tas_result_t * result, uint32_t * address, const fuzz_operand_t * operand) {
+    uint16_t value;
+    char type;
+
+    if (operand->mode == DIRECT_REGISTER || operand->mode == INDIRECT_REGISTER) {
+        return;
+    }
+
+    if (operand->mode == INSTANT) {
+        value = (uint16_t)operand->value;
+        type = 'a';
+    } else if (strcmp(operand->label, "X") == 0) {
+        value = 0xFFFF; /* filled by the linker */
+        type = 'e';
+    } else {
+        value = strcmp(operand->label, "D") == 0 ? (uint16_t)result->instructions_size : 0; /* MAIN is at 0 */
+        type = 'r';
+    }
+
+    FUZZ_CHECK(result->code[*address].value == value && result->code[*address].type == type,
+               "word %u is %04x %c, not %04x %c", *address, result->code[*address].value, result->code[*address].type,
+               value, type);
+    (*address)++;
+}
+
+/*!
+ * \brief assembles instructions made of the input and compares the words with the reference encoder
+ *
+ * \param data	input
+ * \param size	size of the input
+ */
+static void fuzz_encode(const uint8_t * data, size_t size) {
+    fuzz_operand_t operands[FUZZ_INSTRUCTIONS][2];
+    uint8_t ops[FUZZ_INSTRUCTIONS];
+    tas_options_t options = { "encode", 0 };
+    tas_result_t result;
+    tas_status_t status;
+    uint32_t count, i, address = 0;
+    char * text = NULL;
+    size_t len = 0;
+    FILE * fp = open_memstream(&text, &len);
+
+    FUZZ_CHECK(fp != NULL, "unable to open the source of the encoder");
+
+    /* 5 bytes per instruction: operation, mode and register or value of both operands */
+    for (count = 0; count < FUZZ_INSTRUCTIONS && (count + 1) * 5 <= size; count++) {
+        const uint8_t * bytes = data + count * 5;
+        operation_t * op = &g_operations[bytes[0] & 0xF];
+
+        ops[count] = op->opcode;
+        fuzz_make_operand(&operands[count][0], op->operands == 2 ? op->src_legal : "", bytes + 1);
+        fuzz_make_operand(&operands[count][1], op->operands >= 1 ? op->dest_legal : "", bytes + 3);
+
+        fprintf(fp, "%s %s", count == 0 ? "MAIN:" : "", op->mnemonic);
+        if (op->operands == 2) {
+            fprintf(fp, " ");
+            fuzz_write_operand(fp, &operands[count][0], (bytes[0] & 0x10) != 0);
+            fprintf(fp, ",");
+        } else if (op->operands == 1) {
+            fprintf(fp, " ");
+        }
+        if (op->operands >= 1) {
+            fuzz_write_operand(fp, &operands[count][1], (bytes[0] & 0x20) != 0);
+        }
+        fprintf(fp, "\n");
+    }
+
+    fprintf(fp, "%s hlt\nD: .data 7\n.extern X\n", count == 0 ? "MAIN:" : "");
+    fclose(fp);
+
+    status = tas_assemble(text, len, options, &result);
+    FUZZ_CHECK(status == TAS_OK, "the encoder source failed: %s\n%s",
+               result.diagnostics_size > 0 ? result.diagnostics[0].message : "(no diagnostic)", text);
+
+    for (i = 0; i < count; i++) {
+        instruction_t inst;
+        uint16_t word = reference_encode(ops[i], &operands[i][0], &operands[i][1]);
+
+        inst.op = ops[i];
+        inst.src_addr = operands[i][0].mode;
+        inst.src_reg = operands[i][0].reg;
+        inst.dest_addr = operands[i][1].mode;
+        inst.dest_reg = operands[i][1].reg;
+
+        FUZZ_CHECK(instruction_to_word(inst) == word, "instruction_to_word() is %04x, not %04x",
+                   instruction_to_word(inst), word);
+        FUZZ_CHECK(address < result.instructions_size && result.code[address].value == word &&
+                       result.code[address].type == 'a',
+                   "instruction %u at %u is %04x, not %04x\n%s", i, address, result.code[address].value, word, text);
+        address++;
+
+        if (g_operations[ops[i]].operands == 2) {
+            fuzz_check_operand(&result, &address, &operands[i][0]);
+        }
+        if (g_operations[ops[i]].operands >= 1) {
+            fuzz_check_operand(&result, &address, &operands[i][1]);
+        }
+    }
+
+    FUZZ_CHECK(address + 1 == result.instructions_size && result.code[address].value == 0xF000,
+               "the image has %u instruction words, not %u", result.instructions_size, address + 1);
+
+    tas_free_result(&result);
+    free(text);
+}
+
+/*!
+ * \brief compares scan_span() with the classification byte by byte
+ *
+ * \param text	input
+ * \param len	length of the input
+ */
+static void fuzz_scan(const char * text, size_t len) {
+    size_t c, start;
+
+    /* the starts move the blocks of the SIMD paths */
+    for (c = 0; c < sizeof(s_classes); c++) {
+        for (start = 0; start < len && start < 33; start++) {
+            size_t expected = 0;
+
+            while (start + expected < len && (reference_class(text[start + expected]) & s_classes[c])) {
+                expected++;
+            }
+
+            FUZZ_CHECK(scan_span(text + start, len - start, s_classes[c]) == expected,
+                       "scan_span(%u) at %u is not %u", s_classes[c], (unsigned)start, (unsigned)expected);
+        }
+    }
+}
+
+/*!
+ * \brief compares clean_line() and parse_number() with the references on every line
+ *
+ * \param text	input, the lines are cut in place
+ */
+static void fuzz_lines(char * text) {
+    char * line;
+
+    while ((line = fuzz_next_line(&text)) != NULL) {
+        char * clean = clean_line(line);
+        char * expected = reference_clean_line(line);
+        char * token;
+        int i;
+
+        FUZZ_CHECK(clean && expected && strcmp(clean, expected) == 0, "clean_line('%s') is '%s', not '%s'", line,
+                   clean ? clean : "(null)", expected ? expected : "(null)");
+
+        /* the operands, the numbers of .data and the line itself */
+        for (i = 0; (token = string_split(line, " \t,#", i)) != NULL; i++) {
+            uint16_t value = 0, reference = 0;
+            number_status_t status = parse_number(token, 0, &value);
+
+            FUZZ_CHECK(status == reference_parse_number(token, &reference) && value == reference,
+                       "parse_number('%s') is %d %u, not %u", token, (int)status, value, reference);
+            free(token);
+        }
+
+        free(clean);
+        free(expected);
+    }
+}
+
+/*!
+ * \brief runs the assembled image with every dispatch strategy and compares them
+ *
+ * \param result	assembled image without externals
+ */
+static void fuzz_simulate(tas_result_t * result) {
+    uint16_t words[TABLE_SIZE];
+    char * outputs[SIM_DISPATCH_COUNT];
+    size_t lengths[SIM_DISPATCH_COUNT];
+    sim_status_t statuses[SIM_DISPATCH_COUNT];
+    uint16_t entry = 0, i;
+    int d;
+
+    for (i = 0; i < result->code_size; i++) {
+        words[i] = result->code[i].value;
+    }
+
+    for (i = 0; i < result->entries_size; i++) {
+        if (strcmp(result->entries[i].name, "MAIN") == 0) {
+            entry = result->entries[i].value;
+        }
+    }
+
+    for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+        machine_t * m = &s_machines[d];
+        machine_t * r = &s_machines[0];
+        FILE * output = open_memstream(&outputs[d], &lengths[d]);
+
+        FUZZ_CHECK(output != NULL, "unable to open the output of prn");
+
+        sim_init(m, output);
+        m->dispatch = (sim_dispatch_t)d;
+        sim_load(m, words, result->code_size, result->instructions_size, entry);
+        statuses[d] = sim_run(m, FUZZ_STEPS);
+
+        sim_release(m);
+        fclose(output);
+
+        FUZZ_CHECK(statuses[d] == statuses[0] && m->pc == r->pc && m->sp == r->sp && m->psw == r->psw &&
+                       m->steps == r->steps && memcmp(m->r, r->r, sizeof(m->r)) == 0 &&
+                       memcmp(m->memory, r->memory, sizeof(m->memory)) == 0,
+                   "%s: %s at %04x after %lu steps, %s: %s at %04x after %lu steps", sim_dispatch_string(m->dispatch),
+                   sim_status_string(statuses[d]), m->pc, (unsigned long)m->steps, sim_dispatch_string(r->dispatch),
+                   sim_status_string(statuses[0]), r->pc, (unsigned long)r->steps);
+        FUZZ_CHECK(lengths[d] == lengths[0] && memcmp(outputs[d], outputs[0], lengths[0]) == 0,
+                   "%s: the output of prn is not the same", sim_dispatch_string(m->dispatch));
+    }
+
+    for (d = 0; d < SIM_DISPATCH_COUNT; d++) {
+        free(outputs[d]);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    tas_options_t options = { "fuzz", 0 };
+    tas_result_t result;
+    char * text = fuzz_string(data, size);
+
+    if (!text) {
+        return 0;
+    }
+
+    fuzz_scan(text, strlen(text));
+    fuzz_lines(text);
+    free(text);
+
+    fuzz_encode(data, size);
+
+    if (tas_assemble((const char *)data, size, options, &result) == TAS_OK && result.externals_size == 0) {
+        fuzz_simulate(&result);
+    }
+
+    tas_free_result(&result);
+
+    return 0;
+}
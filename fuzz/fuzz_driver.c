@@ -0,0 +1,303 @@
+/*!
+ * \file fuzz_driver.c
+ * \brief standalone driver of the fuzz targets, when libFuzzer is not used
+ *
+ * usage: tas-fuzz-<target> [-s seed] [-n runs] [-m max_len] [-r run] [-w file] [input ...]
+ *
+ * With input files every file is run once, a crash found by libFuzzer can be
+ * reproduced this way. Otherwise the inputs are windows of generated units
+ * and programs with random mutations: bytes replaced, inserted, deleted,
+ * ranges repeated and tokens of the assembly language inserted. Every run has
+ * a generator of its own, so a run can be repeated alone (-r) and its input
+ * written to a file (-w). A crash prints the run to repeat.
+ */
+
+#include "fuzz.h"
+#include "generator.h"
+
+#include <signal.h> /* for signal() */
+
+/*!
+ * \brief number of generated texts the inputs are cut from
+ */
+#define FUZZ_BASES 4
+
+/*!
+ * \brief maximum number of lines of a window of a base text
+ */
+#define FUZZ_WINDOW_LINES 48
+
+/*!
+ * \brief maximum number of mutations of an input
+ */
+#define FUZZ_MUTATIONS 8
+
+/*!
+ * \brief tokens inserted by the mutations
+ */
+static const char * s_tokens[] = {
+    " ", "\t", ",", ";", ":", "\n", "\r\n", "#", "@", "-", "+", "\"", "(", ")", "*", "<<", "&", "|",
+    "0", "9", "0x", "0b", "65535", "65536", "-32768", "-32769", "0xffff", "0b2", "r0", "r7", "r8", "@r3",
+    "MAIN", "MAIN:", "LOOP:", "X1", ".data", ".string", ".entry", ".extern", ".equ", ".set",
+    ".macro", ".endm", ".include", "mov", "cmp", "add", "sub", "mul", "div", "lea", "inc", "dec",
+    "jnz", "jnc", "shl", "prn", "jsr", "rts", "hlt", "\"abc\"", "A23456789012345678901234567890123",
+};
+
+/*!
+ * \brief interesting bytes of the mutations
+ */
+static const char s_bytes[] = " \t\n\r,;:#@-+\".*()0123456789abfxrAZ\x7f\x80\xff";
+
+static uint32_t s_seed = 1; /*!< \brief seed of the runs */
+static uint32_t s_run = 0; /*!< \brief current run */
+static bool s_generated = false; /*!< \brief the current input is generated, not a file */
+
+/*!
+ * \brief prints how to repeat the run that crashed, then crashes
+ *
+ * \param sig	signal
+ */
+static void on_crash(int sig) {
+    if (s_generated) {
+        fprintf(stderr, "crash in run %u, repeat it with -s %u -r %u -w crash.as\n", s_run, s_seed, s_run);
+    }
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/*!
+ * \brief gets a random number below a limit
+ *
+ * \param gen	generator
+ * \param limit	limit, not 0
+ * \return		random number
+ */
+static size_t random_below(generator_t * gen, size_t limit) {
+    return generator_next(gen) % limit;
+}
+
+/*!
+ * \brief input of a run, max_len bytes at most
+ */
+typedef struct input_s {
+    char * data; /*!< \brief content, can contain NULL */
+    size_t len; /*!< \brief length of the content */
+    size_t max_len; /*!< \brief allocated size */
+} input_t;
+
+/*!
+ * \brief copies a window of lines of a base text
+ *
+ * \param gen	generator
+ * \param base	base text
+ * \param input	set to the window
+ */
+static void fuzz_window(generator_t * gen, const text_t * base, input_t * input) {
+    size_t start = random_below(gen, base->len);
+    size_t end;
+    uint32_t lines = 1 + (uint32_t)random_below(gen, FUZZ_WINDOW_LINES);
+
+    /* the whole text, a program can run */
+    if (random_below(gen, 4) == 0) {
+        start = 0;
+        lines = base->len;
+    }
+
+    /* from the start of a line */
+    while (start > 0 && base->data[start - 1] != '\n') {
+        start--;
+    }
+
+    for (end = start; end < base->len && end - start < input->max_len && lines > 0; end++) {
+        lines -= base->data[end] == '\n';
+    }
+
+    memcpy(input->data, base->data + start, end - start);
+    input->len = end - start;
+}
+
+/*!
+ * \brief applies a random mutation
+ *
+ * \param gen		generator
+ * \param input		input
+ */
+static void fuzz_mutate(generator_t * gen, input_t * input) {
+    size_t pos = random_below(gen, input->len + 1);
+    size_t n = 1 + random_below(gen, 16);
+    const char * insert;
+    char byte;
+
+    switch (random_below(gen, 6)) {
+    case 0: /* replace a byte */
+        if (pos < input->len) {
+            input->data[pos] = s_bytes[random_below(gen, sizeof(s_bytes) - 1)];
+        }
+        return;
+    case 1: /* delete a range */
+        n = pos + n > input->len ? input->len - pos : n;
+        memmove(input->data + pos, input->data + pos + n, input->len - pos - n);
+        input->len -= n;
+        return;
+    case 2: /* repeat a range, it is left in place by the move */
+        n = pos + n > input->len ? input->len - pos : n;
+        insert = NULL;
+        break;
+    case 3: /* insert a random byte, NULL too */
+        byte = (char)generator_next(gen);
+        insert = &byte;
+        n = 1;
+        break;
+    default: /* insert a token */
+        insert = s_tokens[random_below(gen, sizeof(s_tokens) / sizeof(s_tokens[0]))];
+        n = strlen(insert);
+        break;
+    }
+
+    if (input->len + n > input->max_len) {
+        return;
+    }
+
+    memmove(input->data + pos + n, input->data + pos, input->len - pos);
+    if (insert) {
+        memcpy(input->data + pos, insert, n);
+    }
+    input->len += n;
+}
+
+/*!
+ * \brief runs the target on a file
+ *
+ * \param name	name of the file
+ * \return		success
+ */
+static bool fuzz_file(const char * name) {
+    FILE * fp = fopen(name, "rb");
+    char * data = NULL;
+    long size = -1;
+
+    if (fp && fseek(fp, 0, SEEK_END) == 0) {
+        size = ftell(fp);
+        rewind(fp);
+    }
+
+    if (size >= 0) {
+        data = (char *)malloc((size_t)size + 1); /* the file can be empty */
+    }
+
+    if (!data || fread(data, 1, (size_t)size, fp) != (size_t)size) {
+        fprintf(stderr, "unable to read '%s'\n", name);
+        free(data);
+        if (fp) {
+            fclose(fp);
+        }
+        return false;
+    }
+
+    fclose(fp);
+
+    LLVMFuzzerTestOneInput((const uint8_t *)data, (size_t)size);
+    free(data);
+
+    return true;
+}
+
+/*!
+ * \brief entry point of the driver
+ *
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    text_t bases[FUZZ_BASES];
+    input_t input = { NULL, 0, 4096 };
+    uint32_t runs = 10000, only = 0, files = 0, i;
+    const char * write_name = NULL;
+    bool repeat = false;
+    generator_t gen;
+    int a;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            s_seed = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            runs = (uint32_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc) {
+            input.max_len = (size_t)strtoul(argv[++a], NULL, 10);
+        } else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) {
+            only = (uint32_t)strtoul(argv[++a], NULL, 10);
+            repeat = true;
+        } else if (strcmp(argv[a], "-w") == 0 && a + 1 < argc) {
+            write_name = argv[++a];
+        } else if (argv[a][0] == '-') {
+            fprintf(stderr, "usage: %s [-s seed] [-n runs] [-m max_len] [-r run] [-w file] [input ...]\n", argv[0]);
+            return 1;
+        } else if (!fuzz_file(argv[a])) {
+            return 2;
+        } else {
+            files++;
+        }
+    }
+
+    if (files > 0) {
+        fprintf(stderr, "%u file(s) run\n", files);
+        return 0;
+    }
+
+    input.data = (char *)malloc(input.max_len + 1);
+    if (!input.data) {
+        fprintf(stderr, "unable to allocate memory for the input\n");
+        return 2;
+    }
+
+    signal(SIGABRT, on_crash);
+    signal(SIGSEGV, on_crash);
+    signal(SIGFPE, on_crash);
+
+    /* units (externals, all the addressing modes) and programs (they run) */
+    generator_init(&gen, s_seed);
+    for (i = 0; i < FUZZ_BASES; i++) {
+        memset(&bases[i], 0, sizeof(text_t));
+
+        if (i % 2) {
+            generator_program(&gen, &bases[i], 3);
+        } else {
+            generator_unit(&gen, &bases[i]);
+        }
+    }
+
+    s_generated = true;
+    for (s_run = repeat ? only : 0; s_run < (repeat ? only + 1 : runs); s_run++) {
+        uint32_t mutations;
+
+        generator_init(&gen, s_seed ^ (s_run * 0x9E3779B9u));
+
+        fuzz_window(&gen, &bases[random_below(&gen, FUZZ_BASES)], &input);
+        for (mutations = (uint32_t)random_below(&gen, FUZZ_MUTATIONS + 1); mutations > 0; mutations--) {
+            fuzz_mutate(&gen, &input);
+        }
+
+        if (write_name) {
+            FILE * fp = fopen(write_name, "wb");
+
+            if (fp) {
+                fwrite(input.data, 1, input.len, fp);
+                fclose(fp);
+            }
+        }
+
+        LLVMFuzzerTestOneInput((const uint8_t *)input.data, input.len);
+    }
+    s_generated = false;
+
+    fprintf(stderr, "%u run(s), seed %u\n", repeat ? 1 : runs, s_seed);
+
+    free(input.data);
+    for (i = 0; i < FUZZ_BASES; i++) {
+        text_free(&bases[i]);
+    }
+
+    return 0;
+}
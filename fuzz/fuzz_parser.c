@@ -0,0 +1,94 @@
+/*!
+ * \file fuzz_parser.c
+ * \brief fuzz target of the parser functions
+ *
+ * Every line of the input is cleaned and split into columns and operands, the
+ * tokens go through the classification and the validators. The validators
+ * must agree with the functions that get the values.
+ */
+
+#include "fuzz.h"
+
+/*!
+ * \brief checks one operand
+ *
+ * \param op		operation of the line, can be NULL
+ * \param operand	operand
+ * \param dest		destination operand
+ */
+static void fuzz_operand(operation_t * op, char * operand, bool dest) {
+    addressing_t * addr = get_addressing(operand);
+    uint16_t value = 0;
+    number_status_t status;
+    bool relocatable;
+    int start = operand[0] == '#' || operand[0] == '@' ? 1 : 0;
+
+    if (op && addr) {
+        is_valid_addressing(op, addr, dest);
+    }
+
+    if (is_valid_register_name(operand, start)) {
+        FUZZ_CHECK(get_register(operand, start) < 8, "register out of range: '%s'", operand);
+    }
+
+    is_valid_label_name(operand, start, 0);
+
+    status = parse_number(operand, start, &value);
+    FUZZ_CHECK(is_valid_numeric_literal(operand, start) == (status != NUMBER_SYNTAX),
+               "is_valid_numeric_literal() and parse_number() disagree: '%s'", operand);
+    FUZZ_CHECK(status != NUMBER_OK || get_number(operand, start) == value,
+               "get_number() and parse_number() disagree: '%s'", operand);
+    FUZZ_CHECK(operand[0] != '#' || status == NUMBER_SYNTAX || (addr && addr->mode == INSTANT),
+               "a number is not an instant: '%s'", operand);
+
+    if (is_valid_expression(operand, start)) {
+        constant_evaluate(operand + start, true, &value, &relocatable);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    char * text = fuzz_string(data, size);
+    char * p = text;
+    char * line;
+
+    if (!text) {
+        return 0;
+    }
+
+    while ((line = fuzz_next_line(&p)) != NULL) {
+        char * clean = clean_line(line);
+        char * column;
+        operation_t * op = NULL;
+        int c;
+
+        if (!clean) {
+            continue;
+        }
+
+        for (c = 0; (column = string_split(clean, " ", c)) != NULL; c++) {
+            column_t type = column_type(column);
+            char * operand;
+            int o;
+
+            FUZZ_CHECK((unsigned)type <= OPERATION, "unknown column type %d: '%s'", (int)type, column);
+
+            if (type == OPERATION) {
+                op = get_operation(column);
+                FUZZ_CHECK(op != NULL, "operation without a mnemonic: '%s'", column);
+            }
+
+            for (o = 0; (operand = string_split(column, ",", o)) != NULL; o++) {
+                fuzz_operand(op, operand, o == 1);
+                free(operand);
+            }
+
+            free(column);
+        }
+
+        free(clean);
+    }
+
+    free(text);
+
+    return 0;
+}
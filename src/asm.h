@@ -7,6 +7,7 @@
 #define ASM_H
 
 /* standard headers */
+#include <inttypes.h> /* for PRIu64 */
 #include <stdarg.h> /* for variable arguments in error()/warning() */
 #include <stdbool.h> /* for bool */
 #include <stdint.h> /* for uint8_t, uint16_t, ... */
@@ -14,6 +15,8 @@
 #include <stdlib.h> /* for malloc(),free() */
 #include <string.h> /* for strcpy(), len(), tok() ... */
 
+#include "tas.h" /* public interface of the library */
+
 /*!
  * \brief maximum size of any table
  * 
@@ -21,14 +24,25 @@
  */
 #define TABLE_SIZE 2000
 
+/*!
+ * \brief classes of the characters (scan.c), a set of them is their bitwise or
+ */
+#define CHAR_SPACE 0x01 /*!< ' ' and '\t' */
+#define CHAR_COMMENT 0x02 /*!< ';' */
+#define CHAR_COMMA 0x04 /*!< ',' */
+#define CHAR_DIGIT 0x08 /*!< '0'-'9' */
+#define CHAR_ALPHA 0x10 /*!< 'A'-'Z' and 'a'-'z' */
+#define CHAR_SPECIAL 0x20 /*!< any other byte but NULL */
+
 /*!
  * \brief formatted error reporting
  * 
  * \note file_base_name, line_number and errors must be defined in the file, where this macro is ussed
+ * \note errors saturates, many errors do not wrap around to 0, the diagnostics count all of them
  * 
  * \param ...  format string and arguments
  */
-#define ERROR(...) error(file_base_name, line_number, __VA_ARGS__), errors++
+#define ERROR(...) error(file_base_name, line_number, __VA_ARGS__), errors += errors != UINT16_MAX
 
 /*!
  * \brief formatted warning reporting
@@ -39,6 +53,26 @@
  */
 #define WARN(...) warning(file_base_name, line_number, __VA_ARGS__)
 
+/*!
+ * \brief records the start of a traced event, if tracing is on
+ *
+ * \param name	name of the event
+ */
+#define TRACE_BEGIN(name)          \
+    if (g_trace_enabled) {         \
+        trace_event('B', (name)); \
+    }
+
+/*!
+ * \brief records the end of a traced event, if tracing is on
+ *
+ * \param name	name of the event
+ */
+#define TRACE_END(name)            \
+    if (g_trace_enabled) {         \
+        trace_event('E', (name)); \
+    }
+
 /*!
  * \brief possible types of a column
  */
@@ -49,9 +83,37 @@ typedef enum column_e {
     DIRECTIVE_EXTERN, /*!< extern (.extern) */
     DIRECTIVE_NUMBER, /*!< number (.data) */
     DIRECTIVE_STRING, /*!< string (.string) */
+    DIRECTIVE_EQU, /*!< constant (.equ) */
+    DIRECTIVE_SET, /*!< redefinable constant (.set) */
     OPERATION /*!< mnemonic (mov, add, ...) */
 } column_t;
 
+/*!
+ * \brief result of the evaluation of a constant expression
+ */
+typedef enum constant_status_e {
+    CONSTANT_OK = 0, /*!< no error */
+    CONSTANT_SYNTAX, /*!< invalid expression */
+    CONSTANT_UNDEFINED, /*!< unknown name */
+    CONSTANT_NOT_ABSOLUTE, /*!< label or a constant defined later in the first pass */
+    CONSTANT_EXTERNAL, /*!< external label */
+    CONSTANT_RELOCATION, /*!< label in a multiplication, a shift, an and, an or, or more labels added */
+    CONSTANT_RECURSIVE, /*!< constant depends on itself */
+    CONSTANT_UNSET, /*!< .set constant used before it is set */
+    CONSTANT_DEFINED, /*!< constant is defined again */
+    CONSTANT_RANGE, /*!< number does not fit in 16 bits */
+    CONSTANT_MEMORY /*!< out of memory */
+} constant_status_t;
+
+/*!
+ * \brief result of the parsing of a numeric literal
+ */
+typedef enum number_status_e {
+    NUMBER_OK = 0, /*!< no error */
+    NUMBER_SYNTAX, /*!< not a numeric literal */
+    NUMBER_RANGE /*!< number does not fit in 16 bits */
+} number_status_t;
+
 /*!
  * \brief possible addressing modes
  */
@@ -115,10 +177,317 @@ typedef struct object_code_s {
     char type; /*!< \brief type ('e'xternal|'r'elocatable|'a'bsolute) */
 } object_code_t;
 
+/*!
+ * \brief receives a formatted diagnostic
+ */
+typedef void (*diagnostic_handler_t)(void * data, tas_severity_t severity,
+                                     const char * file_name, uint32_t line,
+                                     const char * message);
+
+/*!
+ * \brief output format of the buffered diagnostics
+ */
+typedef enum diagnostic_format_e {
+    DIAGNOSTIC_TEXT = 0, /*!< file:line: severity: message */
+    DIAGNOSTIC_JSON /*!< one JSON object per line */
+} diagnostic_format_t;
+
+/*!
+ * \brief buffered diagnostic
+ */
+typedef struct diagnostic_s {
+    tas_severity_t severity; /*!< \brief error or warning */
+    uint32_t file; /*!< \brief offset of the name of the file in the text */
+    uint32_t line; /*!< \brief line number */
+    uint32_t message; /*!< \brief offset of the message in the text */
+} diagnostic_t;
+
+/*!
+ * \brief diagnostics of one source, written when the source is done
+ */
+typedef struct diagnostics_s {
+    diagnostic_t * items; /*!< \brief diagnostics in order of appearance */
+    uint32_t size; /*!< \brief number of diagnostics */
+    uint32_t capacity; /*!< \brief allocated diagnostics */
+    char * text; /*!< \brief names of the files and the messages */
+    uint32_t text_size; /*!< \brief used bytes of the text */
+    uint32_t text_capacity; /*!< \brief allocated bytes of the text */
+    const char * file; /*!< \brief name of the file of the last diagnostic, its copy is reused */
+    uint32_t file_offset; /*!< \brief offset of the copy of the name of the file */
+    uint32_t errors; /*!< \brief number of errors, dropped ones included */
+    uint32_t warnings; /*!< \brief number of warnings, dropped ones included */
+    uint32_t limit; /*!< \brief the passes stop after this number of errors, 0 for no limit */
+    bool stopped; /*!< \brief the limit has been reached */
+    diagnostic_format_t format; /*!< \brief output format */
+    FILE * fp; /*!< \brief output stream */
+} diagnostics_t;
+
+/*!
+ * \brief one line of the source code
+ */
+typedef struct source_line_s {
+    char * raw; /*!< \brief line as written, without the new line */
+    char * clean; /*!< \brief line after clean_line(), NULL if it was not possible */
+    uint32_t length; /*!< \brief length of the raw line */
+    uint32_t number; /*!< \brief line number */
+    uint16_t address; /*!< \brief address of the first object word of the line (set by the first pass) */
+    uint16_t size; /*!< \brief number of object words of the line (set by the first pass) */
+    uint16_t data_size; /*!< \brief number of data words of the line (set by the first pass) */
+    const char * file; /*!< \brief name of the included file of the line, NULL for the source itself */
+} source_line_t;
+
+/*!
+ * \brief source code split into lines
+ */
+typedef struct source_s {
+    char * name; /*!< \brief name of the source, used in the diagnostics */
+    source_line_t * lines; /*!< \brief lines of the source */
+    uint32_t count; /*!< \brief number of lines */
+} source_t;
+
+/*!
+ * \brief instruction of the source, for the analyses between the passes
+ */
+typedef struct cfg_instruction_s {
+    source_line_t * line; /*!< \brief line of the instruction */
+    char * label; /*!< \brief label column with the ':' or NULL */
+    char * src; /*!< \brief source operand or NULL */
+    char * dest; /*!< \brief destination operand or NULL */
+    instruction_t decoded; /*!< \brief fields of the instruction word */
+    int32_t target; /*!< \brief index of the target of a jump to a label, -1 if unknown */
+    uint32_t block; /*!< \brief index of the basic block */
+} cfg_instruction_t;
+
+/*!
+ * \brief basic block, a run of instructions entered at the first and left at the last
+ */
+typedef struct cfg_block_s {
+    uint32_t first; /*!< \brief index of the first instruction */
+    uint32_t last; /*!< \brief index of the last instruction */
+    int32_t successors[2]; /*!< \brief indices of the following blocks, -1 if none */
+    bool reachable; /*!< \brief reachable from an entry */
+} cfg_block_t;
+
+/*!
+ * \brief control flow graph of the source after the first pass
+ */
+typedef struct cfg_s {
+    cfg_instruction_t * instructions; /*!< \brief instructions in the order of the addresses */
+    uint32_t count; /*!< \brief number of instructions */
+    cfg_block_t * blocks; /*!< \brief basic blocks in the order of the addresses */
+    uint32_t blocks_count; /*!< \brief number of basic blocks */
+    bool * used; /*!< \brief symbols named by a reachable instruction or an entry, by symbol index */
+    bool * written; /*!< \brief symbols whose words an instruction or another file may write, by symbol index */
+    bool computed_jumps; /*!< \brief a reachable jump goes to a computed address */
+} cfg_t;
+
+/*!
+ * \brief address of the top of the stack, the stack grows downwards
+ */
+#define SIM_STACK_TOP 0x7cf
+
+/*!
+ * \brief size of the stack in words
+ */
+#define SIM_STACK_SIZE 16
+
+/*!
+ * \brief carry flag of the PSW
+ */
+#define PSW_C 0x1
+
+/*!
+ * \brief zero flag of the PSW
+ */
+#define PSW_Z 0x2
+
+/*!
+ * \brief state of the simulated machine after running
+ */
+typedef enum sim_status_e {
+    SIM_HALTED = 0, /*!< hlt was executed */
+    SIM_STEP_LIMIT, /*!< the maximum number of instructions was executed */
+    SIM_ILLEGAL_INSTRUCTION, /*!< illegal addressing mode */
+    SIM_ADDRESS_FAULT, /*!< access outside of the memory */
+    SIM_STACK_OVERFLOW, /*!< jsr with a full stack */
+    SIM_STACK_UNDERFLOW, /*!< rts with an empty stack */
+    SIM_DIVISION_BY_ZERO /*!< div with a zero source */
+} sim_status_t;
+
+/*!
+ * \brief handlers of the simulator, the first 16 are the operation codes
+ */
+typedef enum sim_op_e {
+    SIM_MOV = 0, /*!< mov */
+    SIM_CMP, /*!< cmp */
+    SIM_ADD, /*!< add */
+    SIM_SUB, /*!< sub */
+    SIM_MUL, /*!< mul */
+    SIM_DIV, /*!< div */
+    SIM_LEA, /*!< lea */
+    SIM_INC, /*!< inc */
+    SIM_DEC, /*!< dec */
+    SIM_JNZ, /*!< jnz */
+    SIM_JNC, /*!< jnc */
+    SIM_SHL, /*!< shl */
+    SIM_PRN, /*!< prn */
+    SIM_JSR, /*!< jsr */
+    SIM_RTS, /*!< rts */
+    SIM_HLT, /*!< hlt */
+    SIM_INC_REG, /*!< superinstruction: inc rX */
+    SIM_DEC_REG, /*!< superinstruction: dec rX */
+    SIM_PRN_INDIRECT_REG, /*!< superinstruction: prn @rX */
+    SIM_SUB_JNZ, /*!< superinstruction: sub #n, rX followed by jnz LABEL */
+    SIM_OP_COUNT
+} sim_op_t;
+
+/*!
+ * \brief dispatch strategies of the simulator
+ */
+typedef enum sim_dispatch_e {
+    SIM_DISPATCH_DECODE = 0, /*!< switch, decodes every instruction again */
+    SIM_DISPATCH_SWITCH, /*!< switch over the decoded instructions */
+    SIM_DISPATCH_THREADED, /*!< computed goto over the decoded instructions (switch without GCC/Clang) */
+    SIM_DISPATCH_SUPER, /*!< threaded, with superinstructions */
+    SIM_DISPATCH_JIT, /*!< native code of the basic blocks (x86-64 Linux, threaded elsewhere) */
+    SIM_DISPATCH_COUNT
+} sim_dispatch_t;
+
+/*!
+ * \brief pre-decoded instruction
+ */
+typedef struct decoded_s {
+    uint8_t op; /*!< \brief handler (sim_op_t) */
+    uint8_t src_mode; /*!< \brief source addressing mode */
+    uint8_t src_reg; /*!< \brief source register */
+    uint8_t dest_mode; /*!< \brief destination addressing mode */
+    uint8_t dest_reg; /*!< \brief destination register */
+    uint8_t size; /*!< \brief number of words, 0 if the entry is not decoded */
+    uint8_t span; /*!< \brief number of words the entry was decoded from, more than size for a superinstruction */
+    uint16_t src_word; /*!< \brief additional word of the source */
+    uint16_t dest_word; /*!< \brief additional word of the destination */
+} decoded_t;
+
+/*!
+ * \brief calling context of the profiler, a function reached through a chain of jsr-s
+ */
+typedef struct profile_node_s {
+    uint16_t function; /*!< \brief address of the function */
+    uint32_t parent; /*!< \brief index of the caller */
+    uint32_t child; /*!< \brief index of the first callee, 0 if none */
+    uint32_t sibling; /*!< \brief index of the next callee of the caller, 0 if none */
+    uint64_t calls; /*!< \brief number of jsr-s into this context */
+    uint64_t self; /*!< \brief instructions executed in this context, without the callees */
+} profile_node_t;
+
+/*!
+ * \brief counters of the profiler
+ */
+typedef struct profile_s {
+    uint64_t counts[TABLE_SIZE]; /*!< \brief executed instructions by address */
+    uint64_t back_edges[TABLE_SIZE]; /*!< \brief taken backward jumps by the address of the jump */
+    uint16_t back_targets[TABLE_SIZE]; /*!< \brief target of the last taken backward jump */
+    profile_node_t * nodes; /*!< \brief calling contexts, the first one is the entry of the program */
+    uint32_t nodes_size; /*!< \brief number of calling contexts */
+    uint32_t nodes_capacity; /*!< \brief allocated calling contexts */
+    uint32_t current; /*!< \brief index of the current calling context */
+    uint32_t lost; /*!< \brief calls that did not fit into the memory, returns pop them first */
+} profile_t;
+
+/*!
+ * \brief simulated machine
+ */
+typedef struct machine_s {
+    uint16_t memory[TABLE_SIZE]; /*!< \brief memory */
+    decoded_t cache[TABLE_SIZE]; /*!< \brief decoded instructions by address */
+    uint16_t code_end; /*!< \brief end of the decoded words, writes below it invalidate the cache */
+    uint16_t r[8]; /*!< \brief general registers */
+    uint16_t pc; /*!< \brief program counter */
+    uint16_t sp; /*!< \brief stack pointer */
+    uint16_t psw; /*!< \brief program status word */
+    uint64_t steps; /*!< \brief number of executed instructions */
+    sim_dispatch_t dispatch; /*!< \brief dispatch strategy, set before loading */
+    void * jit; /*!< \brief translated code, NULL if not used, released by sim_release() */
+    profile_t * profile; /*!< \brief counters of the profiler, NULL if not profiling, set before loading */
+    FILE * out; /*!< \brief output of prn */
+} machine_t;
+
+/*!
+ * \brief image of the memory loaded from an object or a binary file
+ */
+typedef struct image_s {
+    uint16_t words[TABLE_SIZE]; /*!< \brief content of the memory from address 0 */
+    uint16_t size; /*!< \brief number of words */
+    uint16_t code_size; /*!< \brief number of instruction words at the start */
+    uint16_t entry; /*!< \brief address of the first instruction (MAIN) */
+} image_t;
+
+/*!
+ * \brief type of a JSON value
+ */
+typedef enum json_type_e {
+    JSON_NULL = 0, /*!< null */
+    JSON_BOOL, /*!< true or false */
+    JSON_NUMBER, /*!< number */
+    JSON_STRING, /*!< string */
+    JSON_ARRAY, /*!< array, the elements are the children */
+    JSON_OBJECT /*!< object, the members are the children with a key */
+} json_type_t;
+
+/*!
+ * \brief JSON value
+ */
+typedef struct json_s {
+    json_type_t type; /*!< \brief type of the value */
+    char * key; /*!< \brief name of the member of an object, NULL otherwise */
+    char * string; /*!< \brief value of a string */
+    double number; /*!< \brief value of a number */
+    bool boolean; /*!< \brief value of a bool */
+    struct json_s * children; /*!< \brief elements of an array, members of an object */
+    uint32_t count; /*!< \brief number of children */
+} json_t;
+
+/*!
+ * \brief names of an object file
+ */
+typedef struct image_names_s {
+    link_object_t * entries; /*!< \brief entries, the value is the address */
+    uint16_t entries_size; /*!< \brief number of entries */
+    link_object_t * externals; /*!< \brief externals, the value is the address of the word that refers to it */
+    uint16_t externals_size; /*!< \brief number of externals */
+    char types[TABLE_SIZE]; /*!< \brief type of every word ('a', 'r', 'e', ' ' for the data), 0 in a binary file */
+} image_names_t;
+
+/*!
+ * \brief source lines of the addresses, one entry for every run of words of the same line
+ */
+typedef struct line_table_s {
+    char * file_name; /*!< \brief name of the source */
+    uint16_t * addresses; /*!< \brief start address of the runs, ascending */
+    uint32_t * lines; /*!< \brief line of the runs, 0 for the data */
+    uint32_t size; /*!< \brief number of runs */
+} line_table_t;
+
+/*!
+ * \brief creates the output files of an assembled source
+ */
+typedef int (*output_handler_t)(const char * file_name);
+
 /* error.c */
+void set_diagnostic_handler(diagnostic_handler_t handler, void * data);
+void diagnostics_init(diagnostics_t * d, FILE * fp, diagnostic_format_t format, uint32_t limit);
+void diagnostics_select(diagnostics_t * d);
+bool diagnostics_stopped(void);
+bool diagnostics_flush(diagnostics_t * d);
+void diagnostics_free(diagnostics_t * d);
 void error(const char * file_name, uint32_t line, char * fmt, ...);
 void warning(const char * file_name, uint32_t line, char * fmt, ...);
 
+/* scan.c */
+extern const uint8_t g_char_class[256];
+size_t scan_span(const char * str, size_t len, uint8_t classes);
+const char * scan_implementation(void);
+
 /* string_functions.c */
 char * string_trim(const char * str, const char * chars);
 char * string_trim_end(const char * str, const char * chars);
@@ -127,6 +496,7 @@ char * string_split(const char * str, const char * delim, int index);
 char * clean_line(const char * str);
 
 /* parser.c */
+number_status_t parse_number(const char * str, int start_index, uint16_t * value);
 bool is_valid_numeric_literal(char * str, int start_index);
 bool is_valid_label_name(char * str, int start_index, int end_offset);
 bool is_valid_register_name(char * str, int start_index);
@@ -151,8 +521,30 @@ void print_object_code(void);
 void print_link_table(void);
 void print_extern_table(void);
 
+void reset_tables(void);
+
+/* constant.c */
+bool is_valid_expression(char * str, int start_index);
+constant_status_t constant_evaluate(const char * expression, bool labels, uint16_t * value, bool * relocatable);
+constant_status_t constant_define(const char * name, const char * expression, bool redefinable);
+constant_status_t constant_set(const char * name, const char * expression);
+void constant_unset(void);
+bool is_constant(const char * name);
+bool constants_redefined(void);
+void constant_symbols(const char * expression, void (*visit)(const char * name, void * context), void * context);
+const char * constant_message(constant_status_t status);
+void constants_reset(void);
+
+/* macro.c */
+uint16_t macro_expand(source_t * source, const char * path, source_t * expanded, bool * changed);
+
+/* include.c */
+source_t * include_load(const char * path);
+void include_cache_free(void);
+
 /* first_pass.c */
-uint16_t first_pass(const char * file_name);
+uint16_t first_pass(source_t * source);
+uint16_t first_pass_line(source_t * source, uint32_t index, int column_index);
 void first_process_line(char * line, int column_index);
 void first_process_label(char * line);
 void first_process_numbers(char * line, int column_index);
@@ -160,15 +552,30 @@ void first_process_string(char * line, int column_index);
 void first_process_operation(char * line, int column_index);
 void first_process_entry(char * line, int column_index);
 void first_process_extern(char * line, int column_index);
+void first_process_constant(char * line, int column_index, bool redefinable);
 
 uint16_t first_create_instruction(operation_t * op, char * src, char * dest);
 
+/* cfg.c */
+bool cfg_build(cfg_t * cfg, source_t * source);
+void cfg_free(cfg_t * cfg);
+void print_cfg(cfg_t * cfg);
+uint16_t strip_dead_code(source_t * source, uint32_t * dropped);
+
+/* optimize.c */
+uint16_t optimize(source_t * source, uint32_t * rewrites);
+
+/* pool.c */
+bool pool_data(source_t * source, uint16_t * saved);
+
 /* second_pass.c */
-uint16_t second_pass(const char * file_name);
+uint16_t second_pass(source_t * source);
+uint16_t second_pass_line(source_t * source, uint32_t index);
 void second_update_tables(void);
 void second_process_line(char * line, int column_index);
 void second_process_label(char * line);
 void second_process_operation(char * line, int column_index);
+void second_process_set(char * line, int column_index);
 
 uint16_t second_get_symbol_value(char * symbol, int start_index, bool * ext);
 
@@ -179,11 +586,99 @@ uint16_t second_get_word(char * operand, bool * ext);
 void second_add_object_word(char * operand, uint16_t word, bool ext);
 void second_add_external(char * operand);
 
+/* source.c */
+bool source_load(source_t * source, const char * name, const char * src, size_t len);
+bool source_update(source_t * source, const char * src, size_t len,
+                   uint32_t * first, uint32_t * old_end, uint32_t * new_end,
+                   source_line_t ** removed);
+bool source_splice(source_t * source, uint32_t first, uint32_t end, const char * src, size_t len,
+                   source_line_t ** removed);
+void source_lines_free(source_line_t * lines, uint32_t count);
+void source_free(source_t * source);
+
+/* json.c */
+json_t * json_parse(const char * text, size_t len);
+json_t * json_get(const json_t * object, const char * key);
+const char * json_get_string(const json_t * object, const char * key);
+double json_get_number(const json_t * object, const char * key, double fallback);
+void json_free(json_t * value);
+
+/* jit.c */
+bool jit_available(void);
+sim_status_t jit_run(machine_t * m, uint64_t max_steps);
+void jit_free(machine_t * m);
+
+/* size_report.c */
+uint16_t create_size_report(source_t * source, const char * cost_name, FILE * fp);
+
+/* disasm.c */
+bool disassemble(const image_t * image, const image_names_t * names, const line_table_t * lines, FILE * fp);
+
+/* listing.c */
+bool listing_open(const char * file_name, bool data_words);
+void listing_line(const source_line_t * line, uint16_t data_start);
+bool listing_close(void);
+
+/* line_table.c */
+bool line_table_build(line_table_t * t, const char * file_name, const uint32_t * lines, uint16_t size);
+void line_table_free(line_table_t * t);
+uint32_t line_table_lookup(const line_table_t * t, uint16_t address);
+void line_table_write(const line_table_t * t, FILE * fp);
+bool line_table_read(const char * path, line_table_t * t);
+uint16_t create_line_table_file(const char * file_name);
+
+/* profile.c */
+profile_t * profile_create(uint16_t entry);
+void profile_free(profile_t * p);
+void profile_call(profile_t * p, uint16_t function);
+void profile_return(profile_t * p);
+void profile_report(profile_t * p, source_t * source, FILE * fp);
+bool profile_write_folded(profile_t * p, const char * file_name);
+
+/* sim.c */
+void sim_init(machine_t * m, FILE * out);
+bool sim_load(machine_t * m, const uint16_t * words, uint16_t size, uint16_t code_size, uint16_t entry);
+bool sim_load_object_code(machine_t * m);
+bool sim_decode(machine_t * m, uint16_t address);
+sim_status_t sim_run(machine_t * m, uint64_t max_steps);
+sim_status_t sim_interpret(machine_t * m, uint64_t max_steps);
+void sim_release(machine_t * m);
+const char * sim_status_string(sim_status_t status);
+const char * sim_dispatch_string(sim_dispatch_t dispatch);
+
+/* trace.c */
+extern bool g_trace_enabled;
+
+bool trace_open(const char * file_name);
+void trace_event(char phase, const char * name);
+void trace_thread_name(const char * name);
+bool trace_flush(void);
+void trace_close(void);
+
+/* batch.c */
+int run_batch(char ** paths, uint32_t count, uint32_t threads, uint64_t max_steps, bool jit);
+
+/* watch.c */
+bool assemble_incremental(source_t * source, source_line_t * removed, uint32_t first, uint32_t end);
+int watch_file(const char * file_name, output_handler_t output, diagnostics_t * d);
+
+/* lsp.c */
+int lsp_run(FILE * in, FILE * out, uint32_t error_limit);
+
 /* file_io.c */
 char * get_file_base_name(const char * path);
 char * get_file_name_no_ext(const char * file);
+char * get_file_name_with_ext(const char * path, const char * ext);
+
+char * read_file(const char * path, size_t * len);
+
+void write_object_code(FILE * fp);
 
 uint16_t create_object_file(const char * file_name);
 uint16_t create_binary_file(const char * file_name);
 
+bool read_image(const char * path, image_t * image);
+bool read_image_names(const char * path, image_t * image, image_names_t * names);
+void image_names_free(image_names_t * names);
+
 #endif
@@ -0,0 +1,467 @@
+/*!
+ * \file batch.c
+ * \brief batch mode, runs many object or binary files on all cores
+ *
+ * Every worker thread owns one machine, the images are loaded into it one
+ * after the other, so the memory of a running program (a few tens of KB with
+ * the decoded instructions) stays in the caches of its core. The programs are
+ * split into equal ranges, one per worker: a worker takes its programs from
+ * the front of its range, an idle worker steals the back half of the largest
+ * remaining range, so a few long programs do not keep the other cores idle.
+ * The results are collected per program and printed in the order of the
+ * arguments.
+ */
+
+#include "asm.h"
+
+#include <time.h> /* for clock_gettime(), timespec_get() */
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <pthread.h> /* for pthread_create(), pthread_mutex_lock() */
+    #include <unistd.h> /* for sysconf() */
+    #define BATCH_THREADS 1
+#else
+    #define BATCH_THREADS 0
+#endif
+
+/*!
+ * \brief maximum number of worker threads
+ */
+#define BATCH_MAX_THREADS 256
+
+/*!
+ * \brief result of one program
+ */
+typedef struct batch_result_s {
+    const char * path; /*!< \brief path of the image */
+    bool loaded; /*!< \brief the image was loaded */
+    sim_status_t status; /*!< \brief exit state */
+    uint16_t pc; /*!< \brief program counter at the exit */
+    char * location; /*!< \brief source of the program counter (file:line) from the line table file, must be free()-d */
+    uint64_t steps; /*!< \brief executed instructions */
+    char * output; /*!< \brief output of prn, must be free()-d */
+    size_t output_size; /*!< \brief length of the output */
+} batch_result_t;
+
+/*!
+ * \brief range of programs that are not started yet, owned by a worker
+ */
+typedef struct batch_queue_s {
+#if BATCH_THREADS
+    pthread_mutex_t lock; /*!< \brief guards begin and end */
+#endif
+    uint32_t begin; /*!< \brief next program of the owner */
+    uint32_t end; /*!< \brief end of the range, thieves take from here */
+} batch_queue_t;
+
+/*!
+ * \brief shared state of the workers
+ */
+typedef struct batch_s {
+    batch_result_t * results; /*!< \brief results by program */
+    batch_queue_t queues[BATCH_MAX_THREADS]; /*!< \brief queues by worker */
+    uint32_t threads; /*!< \brief number of workers */
+    uint64_t max_steps; /*!< \brief maximum number of instructions per program */
+    sim_dispatch_t dispatch; /*!< \brief dispatch strategy */
+} batch_t;
+
+/*!
+ * \brief arguments of a worker thread
+ */
+typedef struct batch_worker_s {
+    batch_t * batch; /*!< \brief shared state */
+    uint32_t index; /*!< \brief index of the worker and its queue */
+} batch_worker_t;
+
+/*!
+ * \brief gets a monotonic time in seconds
+ *
+ * \return time in seconds
+ */
+static double batch_now(void) {
+    struct timespec ts;
+
+#if defined(_WIN32)
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*!
+ * \brief takes the next program from the front of a queue
+ *
+ * \param q			queue
+ * \param program	set to the program
+ * \return			success, false if the queue is empty
+ */
+static bool batch_pop(batch_queue_t * q, uint32_t * program) {
+    bool ok;
+
+#if BATCH_THREADS
+    pthread_mutex_lock(&q->lock);
+#endif
+    ok = q->begin < q->end;
+    if (ok) {
+        *program = q->begin++;
+    }
+#if BATCH_THREADS
+    pthread_mutex_unlock(&q->lock);
+#endif
+
+    return ok;
+}
+
+/*!
+ * \brief moves the back half of the largest other queue into an empty queue
+ *
+ * \param b		shared state
+ * \param thief	index of the empty queue
+ * \return		success, false if every queue is empty
+ */
+static bool batch_steal(batch_t * b, uint32_t thief) {
+    for (;;) {
+        uint32_t victim = thief, most = 0, i;
+        uint32_t from = 0, half = 0;
+        batch_queue_t * q;
+
+        /* the sizes can change before the victim is locked again */
+        for (i = 0; i < b->threads; i++) {
+            uint32_t size;
+
+            if (i == thief) {
+                continue;
+            }
+
+            q = &b->queues[i];
+#if BATCH_THREADS
+            pthread_mutex_lock(&q->lock);
+#endif
+            size = q->end - q->begin;
+#if BATCH_THREADS
+            pthread_mutex_unlock(&q->lock);
+#endif
+
+            if (size > most) {
+                victim = i;
+                most = size;
+            }
+        }
+
+        if (victim == thief) {
+            return false;
+        }
+
+        q = &b->queues[victim];
+
+#if BATCH_THREADS
+        pthread_mutex_lock(&q->lock);
+#endif
+        if (q->begin < q->end) {
+            half = (q->end - q->begin + 1) / 2;
+            q->end -= half;
+            from = q->end;
+        }
+#if BATCH_THREADS
+        pthread_mutex_unlock(&q->lock);
+#endif
+
+        /* the stolen range is private until it is published, so one lock is held at a time */
+        if (half > 0) {
+            batch_queue_t * own = &b->queues[thief];
+
+#if BATCH_THREADS
+            pthread_mutex_lock(&own->lock);
+#endif
+            own->begin = from;
+            own->end = from + half;
+#if BATCH_THREADS
+            pthread_mutex_unlock(&own->lock);
+#endif
+            return true;
+        }
+    }
+}
+
+/*!
+ * \brief finds the source line of the exit in the line table file (.ln) beside the image, if any
+ *
+ * \param r	result of the program
+ */
+static void batch_locate(batch_result_t * r) {
+    char * table_name = get_file_name_with_ext(r->path, ".ln");
+    line_table_t t;
+    uint32_t line;
+
+    if (table_name && line_table_read(table_name, &t)) {
+        line = line_table_lookup(&t, r->pc);
+
+        if (line != 0 && (r->location = (char *)malloc(strlen(t.file_name) + 12)) != NULL) {
+            sprintf(r->location, "%s:%u", t.file_name, line);
+        }
+
+        line_table_free(&t);
+    }
+
+    free(table_name);
+}
+
+/*!
+ * \brief loads and runs one program
+ *
+ * \param b			shared state
+ * \param m			machine of the worker
+ * \param image		buffer of the image
+ * \param r			result of the program
+ */
+static void batch_run_program(batch_t * b, machine_t * m, image_t * image, batch_result_t * r) {
+    FILE * out;
+
+    if (!read_image(r->path, image)) {
+        return;
+    }
+
+#if defined(_WIN32)
+    out = tmpfile();
+#else
+    out = open_memstream(&r->output, &r->output_size);
+#endif
+    if (!out) {
+        return;
+    }
+
+    sim_init(m, out);
+    m->dispatch = b->dispatch;
+
+    if (sim_load(m, image->words, image->size, image->code_size, image->entry)) {
+        r->loaded = true;
+        r->status = sim_run(m, b->max_steps);
+        r->pc = m->pc;
+        r->steps = m->steps;
+    }
+
+    sim_release(m);
+
+    if (r->loaded) {
+        batch_locate(r);
+    }
+
+#if defined(_WIN32)
+    /* read the output back */
+    r->output_size = (size_t)ftell(out);
+    r->output = (char *)malloc(r->output_size + 1);
+    if (r->output) {
+        rewind(out);
+        r->output_size = fread(r->output, 1, r->output_size, out);
+    }
+#endif
+
+    fclose(out);
+}
+
+/*!
+ * \brief runs programs until every queue is empty
+ *
+ * \param arg	worker (batch_worker_t)
+ * \return		NULL
+ */
+static void * batch_worker(void * arg) {
+    batch_worker_t * w = (batch_worker_t *)arg;
+    batch_t * b = w->batch;
+    machine_t * m = (machine_t *)malloc(sizeof(machine_t));
+    image_t * image = (image_t *)malloc(sizeof(image_t));
+    char name[32];
+    uint32_t program;
+
+    /* worker 0 is the main thread */
+    if (w->index > 0) {
+        sprintf(name, "batch %u", w->index);
+        trace_thread_name(name);
+    }
+
+    while (m && image) {
+        if (!batch_pop(&b->queues[w->index], &program)) {
+            if (!batch_steal(b, w->index)) {
+                break;
+            }
+            continue;
+        }
+
+        TRACE_BEGIN(get_file_base_name(b->results[program].path));
+        batch_run_program(b, m, image, &b->results[program]);
+        TRACE_END(get_file_base_name(b->results[program].path));
+    }
+
+    free(image);
+    free(m);
+
+    return NULL;
+}
+
+/*!
+ * \brief gets the number of the online processors
+ *
+ * \return number of processors, at least 1
+ */
+static uint32_t batch_processors(void) {
+#if BATCH_THREADS
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (uint32_t)n : 1;
+#else
+    return 1;
+#endif
+}
+
+/*!
+ * \brief prints the result of a program
+ *
+ * \param r	result
+ */
+static void batch_print_result(batch_result_t * r) {
+    size_t i;
+
+    if (!r->loaded) {
+        printf("%s: unable to load\n", r->path);
+        return;
+    }
+
+    printf("%s: %s at %04x", r->path, sim_status_string(r->status), r->pc);
+    if (r->location) {
+        printf(" (%s)", r->location);
+    }
+    printf(" after %" PRIu64 " instruction(s), output \"", r->steps);
+
+    for (i = 0; i < r->output_size; i++) {
+        unsigned char c = (unsigned char)r->output[i];
+
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            printf("\\x%02x", c);
+        } else {
+            putchar(c);
+        }
+    }
+
+    printf("\"\n");
+}
+
+/*!
+ * \brief runs object (.oc) and binary (.bin) files on a pool of threads
+ *
+ * \param paths		paths of the files
+ * \param count		number of files
+ * \param threads	number of worker threads, 0 for one per processor
+ * \param max_steps	maximum number of instructions per program
+ * \param jit		run with the JIT, if it is available
+ * \return			error code, 0 if every program halted
+ */
+int run_batch(char ** paths, uint32_t count, uint32_t threads, uint64_t max_steps, bool jit) {
+    batch_worker_t workers[BATCH_MAX_THREADS];
+    uint64_t steps = 0;
+    uint32_t halted = 0, i;
+    double start;
+    batch_t * b = (batch_t *)calloc(1, sizeof(batch_t));
+
+    if (!b || !(b->results = (batch_result_t *)calloc(count ? count : 1, sizeof(batch_result_t)))) {
+        fprintf(stderr, "unable to allocate memory for the batch\n");
+        free(b);
+        return 1;
+    }
+
+    if (threads == 0) {
+        threads = batch_processors();
+    }
+    if (threads > count) {
+        threads = count ? count : 1;
+    }
+    if (threads > BATCH_MAX_THREADS) {
+        threads = BATCH_MAX_THREADS;
+    }
+#if !BATCH_THREADS
+    threads = 1;
+#endif
+
+    if (jit && !jit_available()) {
+        fprintf(stderr, "the JIT is not available on this platform, using the interpreter\n");
+        jit = false;
+    }
+
+    b->threads = threads;
+    b->max_steps = max_steps;
+    b->dispatch = jit ? SIM_DISPATCH_JIT : SIM_DISPATCH_SUPER;
+
+    for (i = 0; i < count; i++) {
+        b->results[i].path = paths[i];
+    }
+
+    /* equal ranges, the stealing balances the rest */
+    for (i = 0; i < threads; i++) {
+        b->queues[i].begin = (uint32_t)((uint64_t)count * i / threads);
+        b->queues[i].end = (uint32_t)((uint64_t)count * (i + 1) / threads);
+#if BATCH_THREADS
+        pthread_mutex_init(&b->queues[i].lock, NULL);
+#endif
+        workers[i].batch = b;
+        workers[i].index = i;
+    }
+
+    start = batch_now();
+
+#if BATCH_THREADS
+    {
+        pthread_t ids[BATCH_MAX_THREADS];
+        uint32_t started = 0;
+
+        /* the calling thread is worker 0 */
+        for (i = 1; i < threads; i++) {
+            if (pthread_create(&ids[i], NULL, batch_worker, &workers[i]) == 0) {
+                started++;
+            } else {
+                break;
+            }
+        }
+
+        batch_worker(&workers[0]);
+
+        for (i = 1; i <= started; i++) {
+            pthread_join(ids[i], NULL);
+        }
+
+        for (i = 0; i < threads; i++) {
+            pthread_mutex_destroy(&b->queues[i].lock);
+        }
+
+        threads = started + 1;
+    }
+#else
+    batch_worker(&workers[0]);
+#endif
+
+    start = batch_now() - start;
+
+    for (i = 0; i < count; i++) {
+        batch_result_t * r = &b->results[i];
+
+        batch_print_result(r);
+
+        if (r->loaded && r->status == SIM_HALTED) {
+            halted++;
+        }
+        steps += r->steps;
+        free(r->output);
+        free(r->location);
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "%u of %u program(s) halted, %" PRIu64 " instruction(s) in %.3f s on %u thread(s)\n",
+            halted, count, steps, start, threads);
+
+    free(b->results);
+    free(b);
+
+    return halted == count ? 0 : 6;
+}
@@ -0,0 +1,653 @@
+/*!
+ * \file cfg.c
+ * \brief control flow graph, dead code elimination
+ *
+ * The instructions of the source are split into basic blocks after the first
+ * pass. A block starts at the first instruction, at a labeled instruction and
+ * after a jnz, jnc, jsr, rts or hlt. Its successors are the target of the jump
+ * to a label and the next block, except after an rts or a hlt.
+ *
+ * The blocks reachable from the entries (.entry), or from the first
+ * instruction without entries, are marked. A code label named by a reachable
+ * instruction in any other way than as the target of a jump (e.g. lea LOOP,r1)
+ * is reachable too, its address may be jumped to. The data labels named by the
+ * reachable instructions, also in a constant expression (#TABLE+2), and the
+ * entries are the used data.
+ *
+ * The written symbols are the ones named as the operand an instruction stores
+ * into (the destination, the source of a shl) and the entries, which other
+ * files may write. With a store through a pointer (@X, @rX) every label whose
+ * address is taken (lea, #TABLE+2) is written too.
+ *
+ * strip_dead_code() drops the lines of the unreachable instructions and the
+ * data that is not used (a labeled .data or .string with the unlabeled ones
+ * after it), then runs the first pass again. With a jump to a computed address
+ * every instruction is kept.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern object_code_t g_object_code[TABLE_SIZE];
+extern uint16_t g_object_code_size;
+
+extern operation_t g_operations[16];
+
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+extern link_object_t g_link_table[TABLE_SIZE];
+extern uint16_t g_link_table_size;
+
+/*!
+ * \brief decodes an instruction word
+ *
+ * \param word	instruction word
+ * \return		fields
+ */
+static instruction_t cfg_decode(uint16_t word) {
+    instruction_t i;
+
+    i.op = (uint8_t)(word >> 12);
+    i.src_addr = (uint8_t)((word >> 9) & 0x7);
+    i.src_reg = (uint8_t)((word >> 6) & 0x7);
+    i.dest_addr = (uint8_t)((word >> 3) & 0x7);
+    i.dest_reg = (uint8_t)(word & 0x7);
+
+    return i;
+}
+
+/*!
+ * \brief finds a symbol by name
+ *
+ * \param name	name of the symbol
+ * \return		index of the symbol, -1 if not found
+ */
+static int32_t cfg_symbol(const char * name) {
+    uint16_t i;
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        if (strcmp(g_symbol_table[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*!
+ * \brief finds the symbol named by an operand
+ *
+ * \param operand	operand
+ * \return			index of the symbol, -1 if the operand names no symbol
+ */
+static int32_t cfg_operand_symbol(char * operand) {
+    addressing_t * addressing = get_addressing(operand);
+
+    if (!addressing) {
+        return -1;
+    } else if (addressing->mode == DIRECT) {
+        return cfg_symbol(operand);
+    } else if (addressing->mode == INDIRECT) {
+        return cfg_symbol(operand + 1); /* skip '@' */
+    } else {
+        return -1;
+    }
+}
+
+/*!
+ * \brief checks if an operation is a jump
+ *
+ * \param op	operation code
+ * \return		jnz, jnc or jsr
+ */
+static bool cfg_is_jump(uint8_t op) {
+    return op == 0x9 || op == 0xA || op == 0xD;
+}
+
+/*!
+ * \brief finds the instruction at an address
+ *
+ * \param cfg		graph with the instructions
+ * \param address	address
+ * \return			index of the instruction, -1 if none starts there
+ */
+static int32_t cfg_instruction_at(cfg_t * cfg, uint16_t address) {
+    uint32_t low = 0, high = cfg->count;
+
+    /* the instructions are in the order of the addresses */
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        uint16_t a = cfg->instructions[mid].line->address;
+
+        if (a == address) {
+            return (int32_t)mid;
+        } else if (a < address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return -1;
+}
+
+/*!
+ * \brief collects the instructions of the source
+ *
+ * \param cfg		graph
+ * \param source	lines of the source
+ * \return			success
+ */
+static bool cfg_collect(cfg_t * cfg, source_t * source) {
+    uint32_t i;
+
+    cfg->instructions = (cfg_instruction_t *)calloc(source->count ? source->count : 1, sizeof(cfg_instruction_t));
+    if (!cfg->instructions) {
+        return false;
+    }
+
+    for (i = 0; i < source->count; i++) {
+        source_line_t * line = &source->lines[i];
+        cfg_instruction_t * inst = &cfg->instructions[cfg->count];
+        operation_t * op;
+        char * first;
+        char * operands;
+        int col;
+
+        if (line->size == 0 || !line->clean) {
+            continue;
+        }
+
+        first = string_split(line->clean, " ", 0);
+        col = first && column_type(first) == LABEL ? 1 : 0;
+        inst->label = col ? first : NULL;
+        if (!col) {
+            free(first);
+        }
+
+        inst->line = line;
+        inst->decoded = cfg_decode(g_object_code[line->address].value);
+        inst->target = -1;
+
+        op = &g_operations[inst->decoded.op];
+        operands = string_split(line->clean, " ", col + 1);
+        if (op->operands == 2) {
+            inst->src = string_split(operands, ",", 0);
+            inst->dest = string_split(operands, ",", 1);
+        } else if (op->operands == 1) {
+            inst->dest = string_split(operands, ",", 0);
+        }
+        free(operands);
+
+        cfg->count++;
+    }
+
+    /* the targets of the jumps to labels */
+    for (i = 0; i < cfg->count; i++) {
+        cfg_instruction_t * inst = &cfg->instructions[i];
+        int32_t sym;
+
+        if (cfg_is_jump(inst->decoded.op) && inst->decoded.dest_addr == DIRECT && inst->dest &&
+            (sym = cfg_symbol(inst->dest)) >= 0 && g_symbol_table[sym].type == 'a') {
+            inst->target = cfg_instruction_at(cfg, g_symbol_table[sym].value);
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief splits the instructions into basic blocks
+ *
+ * \param cfg	graph with the instructions
+ * \return		success
+ */
+static bool cfg_split(cfg_t * cfg) {
+    uint32_t i;
+
+    cfg->blocks = (cfg_block_t *)calloc(cfg->count ? cfg->count : 1, sizeof(cfg_block_t));
+    if (!cfg->blocks) {
+        return false;
+    }
+
+    for (i = 0; i < cfg->count; i++) {
+        cfg_instruction_t * inst = &cfg->instructions[i];
+        uint8_t prev = i > 0 ? cfg->instructions[i - 1].decoded.op : 0;
+
+        /* a new block at a label and after a transfer of control */
+        if (i == 0 || inst->label || cfg_is_jump(prev) || prev == 0xE || prev == 0xF) {
+            cfg_block_t * b = &cfg->blocks[cfg->blocks_count++];
+
+            b->first = i;
+            b->successors[0] = -1;
+            b->successors[1] = -1;
+        }
+
+        cfg->blocks[cfg->blocks_count - 1].last = i;
+        inst->block = cfg->blocks_count - 1;
+    }
+
+    for (i = 0; i < cfg->blocks_count; i++) {
+        cfg_block_t * b = &cfg->blocks[i];
+        cfg_instruction_t * last = &cfg->instructions[b->last];
+
+        /* rts and hlt do not continue, the rest continue with the next block, if any */
+        if (last->decoded.op != 0xE && last->decoded.op != 0xF && i + 1 < cfg->blocks_count) {
+            b->successors[0] = (int32_t)(i + 1);
+        }
+
+        if (cfg_is_jump(last->decoded.op) && last->target >= 0) {
+            b->successors[1] = (int32_t)cfg->instructions[last->target].block;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief marks a block reachable
+ *
+ * \param cfg	graph
+ * \param block	index of the block
+ * \param stack	blocks to visit
+ * \param size	number of blocks to visit
+ */
+static void cfg_reach(cfg_t * cfg, uint32_t block, uint32_t * stack, uint32_t * size) {
+    if (!cfg->blocks[block].reachable) {
+        cfg->blocks[block].reachable = true;
+        stack[(*size)++] = block;
+    }
+}
+
+/*!
+ * \brief marks a symbol used, the block of a code label reachable
+ *
+ * \param cfg	graph
+ * \param sym	index of the symbol, -1 if none
+ * \param stack	blocks to visit
+ * \param size	number of blocks to visit
+ */
+static void cfg_use(cfg_t * cfg, int32_t sym, uint32_t * stack, uint32_t * size) {
+    int32_t inst;
+
+    if (sym < 0) {
+        return;
+    }
+
+    cfg->used[sym] = true;
+
+    if (g_symbol_table[sym].type == 'a' && (inst = cfg_instruction_at(cfg, g_symbol_table[sym].value)) >= 0) {
+        cfg_reach(cfg, cfg->instructions[inst].block, stack, size);
+    }
+}
+
+/*!
+ * \brief blocks to visit, the context of cfg_use_name()
+ */
+typedef struct cfg_walk_s {
+    cfg_t * cfg; /*!< \brief graph */
+    uint32_t * stack; /*!< \brief blocks to visit */
+    uint32_t * size; /*!< \brief number of blocks to visit */
+} cfg_walk_t;
+
+/*!
+ * \brief marks a label of a constant expression used
+ *
+ * \param name		name of the label
+ * \param context	blocks to visit
+ */
+static void cfg_use_name(const char * name, void * context) {
+    cfg_walk_t * walk = (cfg_walk_t *)context;
+
+    cfg_use(walk->cfg, cfg_symbol(name), walk->stack, walk->size);
+}
+
+/*!
+ * \brief marks the symbols named by an operand used
+ *
+ * \param cfg		graph
+ * \param operand	operand, can be NULL
+ * \param stack		blocks to visit
+ * \param size		number of blocks to visit
+ */
+static void cfg_use_operand(cfg_t * cfg, char * operand, uint32_t * stack, uint32_t * size) {
+    if (operand && operand[0] == '#' && !is_valid_numeric_literal(operand, 1)) {
+        cfg_walk_t walk;
+
+        /* the labels of the expression and of its constants (#END-START) */
+        walk.cfg = cfg;
+        walk.stack = stack;
+        walk.size = size;
+        constant_symbols(operand + 1, cfg_use_name, &walk);
+    } else {
+        cfg_use(cfg, cfg_operand_symbol(operand), stack, size);
+    }
+}
+
+/*!
+ * \brief marks a label of a constant expression, its address is taken
+ *
+ * \param name		name of the label
+ * \param context	flags of the symbols
+ */
+static void cfg_take_address(const char * name, void * context) {
+    int32_t sym = cfg_symbol(name);
+
+    if (sym >= 0) {
+        ((bool *)context)[sym] = true;
+    }
+}
+
+/*!
+ * \brief checks if an operation stores into an operand
+ *
+ * \param op		operation code
+ * \param dest	destination operand, else the source
+ * \return		the operand is written
+ */
+static bool cfg_is_store(uint8_t op, bool dest) {
+    if (dest) {
+        return op == 0x0 || (op >= 0x2 && op <= 0x8); /* mov, add, sub, mul, div, lea, inc, dec */
+    }
+
+    return op == 0xB; /* shl shifts its source */
+}
+
+/*!
+ * \brief marks the symbols of the data the instructions may write
+ *
+ * \param cfg	graph with the instructions
+ * \return		success
+ */
+static bool cfg_mark_written(cfg_t * cfg) {
+    bool * taken = (bool *)calloc(g_symbol_table_size ? g_symbol_table_size : 1, sizeof(bool));
+    bool pointers = false;
+    uint32_t i, j;
+
+    cfg->written = (bool *)calloc(g_symbol_table_size ? g_symbol_table_size : 1, sizeof(bool));
+    if (!taken || !cfg->written) {
+        free(taken);
+        return false;
+    }
+
+    for (i = 0; i < g_link_table_size; i++) {
+        int32_t sym;
+
+        if (g_link_table[i].type == 'n' && (sym = cfg_symbol(g_link_table[i].name)) >= 0) {
+            cfg->written[sym] = true;
+        }
+    }
+
+    for (i = 0; i < cfg->count; i++) {
+        cfg_instruction_t * inst = &cfg->instructions[i];
+        char * operands[2];
+        uint8_t modes[2];
+
+        operands[0] = inst->src;
+        operands[1] = inst->dest;
+        modes[0] = inst->decoded.src_addr;
+        modes[1] = inst->decoded.dest_addr;
+
+        for (j = 0; j < 2; j++) {
+            int32_t sym;
+
+            if (!operands[j]) {
+                continue;
+            }
+
+            if (cfg_is_store(inst->decoded.op, j == 1)) {
+                if (modes[j] == DIRECT && (sym = cfg_symbol(operands[j])) >= 0) {
+                    cfg->written[sym] = true;
+                } else if (modes[j] == INDIRECT || modes[j] == INDIRECT_REGISTER) {
+                    pointers = true;
+                }
+            }
+
+            if (inst->decoded.op == 0x6 && j == 0 && (sym = cfg_symbol(operands[j])) >= 0) {
+                taken[sym] = true; /* lea */
+            } else if (modes[j] == INSTANT && !is_valid_numeric_literal(operands[j], 1)) {
+                constant_symbols(operands[j] + 1, cfg_take_address, taken);
+            }
+        }
+    }
+
+    for (i = 0; pointers && i < g_symbol_table_size; i++) {
+        cfg->written[i] = cfg->written[i] || taken[i];
+    }
+
+    free(taken);
+
+    return true;
+}
+
+/*!
+ * \brief marks the blocks reachable from the entries and the used symbols
+ *
+ * \param cfg	graph with the blocks
+ * \return		success
+ */
+static bool cfg_mark(cfg_t * cfg) {
+    uint32_t * stack = (uint32_t *)malloc((cfg->blocks_count ? cfg->blocks_count : 1) * sizeof(uint32_t));
+    uint32_t size = 0, i;
+    bool entries = false;
+
+    cfg->used = (bool *)calloc(g_symbol_table_size ? g_symbol_table_size : 1, sizeof(bool));
+    if (!stack || !cfg->used) {
+        free(stack);
+        return false;
+    }
+
+    for (i = 0; i < g_link_table_size; i++) {
+        if (g_link_table[i].type == 'n') {
+            entries = true;
+            cfg_use(cfg, cfg_symbol(g_link_table[i].name), stack, &size);
+        }
+    }
+
+    if (!entries && cfg->blocks_count > 0) {
+        cfg_reach(cfg, 0, stack, &size);
+    }
+
+    while (size > 0) {
+        cfg_block_t * b = &cfg->blocks[stack[--size]];
+
+        for (i = b->first; i <= b->last; i++) {
+            cfg_instruction_t * inst = &cfg->instructions[i];
+            int32_t sym;
+
+            cfg_use_operand(cfg, inst->src, stack, &size);
+
+            if (!cfg_is_jump(inst->decoded.op)) {
+                cfg_use_operand(cfg, inst->dest, stack, &size);
+            } else if (inst->decoded.dest_addr == DIRECT) {
+                /* the target is a successor, not an address that may be jumped to later */
+                if ((sym = cfg_symbol(inst->dest)) >= 0) {
+                    cfg->used[sym] = true;
+                }
+            } else {
+                cfg->computed_jumps = true;
+                cfg_use_operand(cfg, inst->dest, stack, &size);
+            }
+        }
+
+        for (i = 0; i < 2; i++) {
+            if (b->successors[i] >= 0) {
+                cfg_reach(cfg, (uint32_t)b->successors[i], stack, &size);
+            }
+        }
+    }
+
+    free(stack);
+
+    return true;
+}
+
+/*!
+ * \brief builds the control flow graph of the source after the first pass
+ *
+ * \note the graph must be released with cfg_free()
+ *
+ * \param cfg		graph
+ * \param source	lines of the source, after a successful first pass
+ * \return			success
+ */
+bool cfg_build(cfg_t * cfg, source_t * source) {
+    memset(cfg, 0, sizeof(cfg_t));
+
+    if (!cfg_collect(cfg, source) || !cfg_split(cfg) || !cfg_mark(cfg) || !cfg_mark_written(cfg)) {
+        cfg_free(cfg);
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief releases the graph
+ *
+ * \param cfg	graph
+ */
+void cfg_free(cfg_t * cfg) {
+    uint32_t i;
+
+    for (i = 0; i < cfg->count; i++) {
+        free(cfg->instructions[i].label);
+        free(cfg->instructions[i].src);
+        free(cfg->instructions[i].dest);
+    }
+
+    free(cfg->instructions);
+    free(cfg->blocks);
+    free(cfg->used);
+    free(cfg->written);
+    memset(cfg, 0, sizeof(cfg_t));
+}
+
+/*!
+ * \brief prints the basic blocks
+ *
+ * \param cfg	graph
+ */
+void print_cfg(cfg_t * cfg) {
+    uint32_t i, j;
+
+    printf("\nBasic blocks (first last reachable -> successors):\n");
+    for (i = 0; i < cfg->blocks_count; i++) {
+        cfg_block_t * b = &cfg->blocks[i];
+
+        printf("  %04x %04x %c ->", cfg->instructions[b->first].line->address,
+               cfg->instructions[b->last].line->address, b->reachable ? '+' : '-');
+
+        for (j = 0; j < 2; j++) {
+            if (b->successors[j] >= 0) {
+                printf(" %04x", cfg->instructions[cfg->blocks[b->successors[j]].first].line->address);
+            }
+        }
+
+        printf("\n");
+    }
+}
+
+/*!
+ * \brief checks if a line is a .data or a .string
+ *
+ * \param line	cleaned line
+ * \param label	set to the label column with the ':' or NULL
+ * \return		data line
+ */
+static bool is_data_line(const char * line, char ** label) {
+    char * first = string_split(line, " ", 0);
+    char * second;
+    column_t col;
+
+    *label = NULL;
+
+    if (!first) {
+        return false;
+    }
+
+    col = column_type(first);
+    if (col == LABEL) {
+        second = string_split(line, " ", 1);
+        col = second ? column_type(second) : UNKNOWN;
+        free(second);
+        *label = first;
+    } else {
+        free(first);
+    }
+
+    if (col != DIRECTIVE_NUMBER && col != DIRECTIVE_STRING) {
+        free(*label);
+        *label = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief drops the unreachable instructions and the unused data, runs the first pass again
+ *
+ * \param source	lines of the source, after a successful first pass
+ * \param dropped	set to the number of the dropped lines
+ * \return			number of errors of the first pass
+ */
+uint16_t strip_dead_code(source_t * source, uint32_t * dropped) {
+    cfg_t cfg;
+    bool keep = true;
+    uint32_t i;
+
+    *dropped = 0;
+
+    if (!cfg_build(&cfg, source)) {
+        return 1;
+    }
+
+    /* the targets of the computed jumps are not known, every instruction may be one */
+    if (!cfg.computed_jumps) {
+        for (i = 0; i < cfg.count; i++) {
+            cfg_instruction_t * inst = &cfg.instructions[i];
+
+            if (!cfg.blocks[inst->block].reachable) {
+                inst->line->clean[0] = '\0';
+                (*dropped)++;
+            }
+        }
+    }
+
+    /* unlabeled data belongs to the labeled data before it */
+    for (i = 0; i < source->count; i++) {
+        source_line_t * line = &source->lines[i];
+        char * label;
+
+        if (!line->clean || !is_data_line(line->clean, &label)) {
+            continue;
+        }
+
+        if (label) {
+            int32_t sym;
+
+            label[strlen(label) - 1] = '\0'; /* remove ':' */
+            sym = cfg_symbol(label);
+            keep = sym < 0 || cfg.used[sym];
+            free(label);
+        }
+
+        if (!keep) {
+            line->clean[0] = '\0';
+            (*dropped)++;
+        }
+    }
+
+    cfg_free(&cfg);
+
+    if (*dropped == 0) {
+        return 0;
+    }
+
+    /* compute the labels and the addresses again */
+    reset_tables();
+
+    return first_pass(source);
+}
@@ -0,0 +1,762 @@
+/*!
+ * \file constant.c
+ * \brief named constants (.equ, .set) and constant expressions
+ *
+ * A constant is defined by the first pass with the text of its value, and is
+ * evaluated when it is used first, so an .equ can refer to the constants and
+ * the labels defined after it. The value of an instant operand (#SIZE*2+1)
+ * is computed by the second pass, when the addresses of the labels are final.
+ *
+ * The expressions have the operators of C with their precedence:
+ *
+ *     ( )   unary - +   *   + -   <<   &   |
+ *
+ * the words are 16-bit, the operations wrap around. A label is relocatable:
+ * the difference of two labels is a number, a label plus a number is an
+ * address, anything else with a label is an error.
+ *
+ * A .set constant can be defined again, its uses see the last .set before
+ * them. An .equ constant can be defined once.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+extern link_object_t g_link_table[TABLE_SIZE];
+extern uint16_t g_link_table_size;
+
+/*!
+ * \brief number of the buckets of the constant table, power of 2
+ */
+#define CONSTANT_BUCKETS 256
+
+/*!
+ * \brief state of the value of a constant
+ */
+typedef enum constant_state_e {
+    CONSTANT_PENDING = 0, /*!< not evaluated yet */
+    CONSTANT_EVALUATING, /*!< being evaluated, a use now is a cycle */
+    CONSTANT_DONE, /*!< evaluated */
+    CONSTANT_NOT_SET /*!< .set constant before its first .set in the second pass */
+} constant_state_t;
+
+/*!
+ * \brief named constant
+ */
+typedef struct constant_s {
+    char * name; /*!< \brief name */
+    char * expression; /*!< \brief text of the value */
+    uint16_t value; /*!< \brief value, if evaluated */
+    int32_t relocation; /*!< \brief number of the labels added to the value, if evaluated */
+    constant_state_t state; /*!< \brief state of the value */
+    bool redefinable; /*!< \brief defined by .set */
+    bool visiting; /*!< \brief being visited by constant_symbols() */
+    uint32_t definitions; /*!< \brief number of the definitions */
+    struct constant_s * next; /*!< \brief next constant in the bucket */
+} constant_t;
+
+/*!
+ * \brief state of the parsing of an expression
+ */
+typedef struct constant_parser_s {
+    const char * p; /*!< \brief next character */
+    bool labels; /*!< \brief labels can be used */
+    bool check; /*!< \brief only the syntax is checked, the names are not resolved */
+    constant_status_t status; /*!< \brief first error */
+} constant_parser_t;
+
+static constant_t * s_constants[CONSTANT_BUCKETS]; /*!< \brief constants by the hash of the name */
+static bool s_redefined = false; /*!< \brief a .set constant has been defined more than once */
+
+static bool constant_parse_or(constant_parser_t * parser, uint16_t * value, int32_t * relocation);
+
+/*!
+ * \brief hashes a name (FNV-1a)
+ *
+ * \param str	name
+ * \param len	length of the name
+ * \return		bucket of the name
+ */
+static uint32_t constant_hash(const char * str, size_t len) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash & (CONSTANT_BUCKETS - 1);
+}
+
+/*!
+ * \brief finds a constant by name
+ *
+ * \param name	name of the constant, not terminated
+ * \param len	length of the name
+ * \return		constant or NULL
+ */
+static constant_t * constant_find(const char * name, size_t len) {
+    constant_t * c;
+
+    for (c = s_constants[constant_hash(name, len)]; c; c = c->next) {
+        if (strncmp(c->name, name, len) == 0 && c->name[len] == 0) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief checks if a character can be in a name
+ *
+ * \param ch	character
+ * \param first	first character of the name
+ * \return		valid
+ */
+static bool is_name_char(char ch, bool first) {
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (!first && ch >= '0' && ch <= '9');
+}
+
+/*!
+ * \brief records the first error of the parsing
+ *
+ * \param parser	parser
+ * \param status	error
+ * \return			false
+ */
+static bool constant_fail(constant_parser_t * parser, constant_status_t status) {
+    if (parser->status == CONSTANT_OK) {
+        parser->status = status;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief gets the value of a name, a constant or a label
+ *
+ * \param parser		parser
+ * \param name			name
+ * \param len			length of the name
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_resolve(constant_parser_t * parser, const char * name, size_t len, uint16_t * value,
+                             int32_t * relocation) {
+    constant_t * c = constant_find(name, len);
+    uint16_t i;
+
+    if (c) {
+        constant_parser_t inner;
+
+        switch (c->state) {
+        case CONSTANT_DONE:
+            break;
+
+        case CONSTANT_EVALUATING:
+            return constant_fail(parser, CONSTANT_RECURSIVE);
+
+        case CONSTANT_NOT_SET:
+            return constant_fail(parser, CONSTANT_UNSET);
+
+        case CONSTANT_PENDING:
+        default:
+            inner.p = c->expression;
+            inner.labels = parser->labels;
+            inner.check = false;
+            inner.status = CONSTANT_OK;
+
+            c->state = CONSTANT_EVALUATING;
+            if (!constant_parse_or(&inner, &c->value, &c->relocation) || *inner.p != 0) {
+                c->state = CONSTANT_PENDING; /* evaluated again at the next use */
+                return constant_fail(parser, inner.status == CONSTANT_OK ? CONSTANT_SYNTAX : inner.status);
+            }
+            c->state = CONSTANT_DONE;
+            break;
+        }
+
+        *value = c->value;
+        *relocation = c->relocation;
+        return true;
+    }
+
+    if (!parser->labels) {
+        return constant_fail(parser, CONSTANT_NOT_ABSOLUTE);
+    }
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        symbol_t * sym = &g_symbol_table[i];
+
+        if (strlen(sym->name) == len && strncmp(sym->name, name, len) == 0) {
+            if (sym->type == 'e') {
+                return constant_fail(parser, CONSTANT_EXTERNAL);
+            }
+
+            *value = sym->value;
+            *relocation = 1;
+            return true;
+        }
+    }
+
+    for (i = 0; i < g_link_table_size; i++) {
+        link_object_t * obj = &g_link_table[i];
+
+        if (obj->type == 'e' && strlen(obj->name) == len && strncmp(obj->name, name, len) == 0) {
+            return constant_fail(parser, CONSTANT_EXTERNAL);
+        }
+    }
+
+    return constant_fail(parser, CONSTANT_UNDEFINED);
+}
+
+/*!
+ * \brief parses a number, a name or an expression in parentheses
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_primary(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    const char * start = parser->p;
+    char number[24]; /* "0b" and 16 binary digits, with leading zeros */
+
+    *value = 0;
+    *relocation = 0;
+
+    if (*parser->p == '(') {
+        parser->p++;
+
+        if (!constant_parse_or(parser, value, relocation)) {
+            return false;
+        }
+
+        if (*parser->p != ')') {
+            return constant_fail(parser, CONSTANT_SYNTAX);
+        }
+
+        parser->p++;
+        return true;
+    }
+
+    if (*parser->p >= '0' && *parser->p <= '9') {
+        number_status_t status;
+
+        /* the digits, the 0x and 0b prefixes, parse_number() checks them */
+        while (is_name_char(*parser->p, false)) {
+            parser->p++;
+        }
+
+        if ((size_t)(parser->p - start) >= sizeof(number)) {
+            return constant_fail(parser, CONSTANT_RANGE);
+        }
+
+        memcpy(number, start, parser->p - start);
+        number[parser->p - start] = 0;
+
+        status = parse_number(number, 0, value);
+        if (status == NUMBER_SYNTAX) {
+            return constant_fail(parser, CONSTANT_SYNTAX);
+        }
+
+        /* the range is checked with the value, like the names */
+        return status == NUMBER_OK || parser->check || constant_fail(parser, CONSTANT_RANGE);
+    }
+
+    if (is_name_char(*parser->p, true)) {
+        while (is_name_char(*parser->p, false)) {
+            parser->p++;
+        }
+
+        /* registers have no value */
+        if (parser->p - start == 2 && start[0] == 'r' && start[1] >= '0' && start[1] <= '7') {
+            return constant_fail(parser, CONSTANT_SYNTAX);
+        }
+
+        return parser->check || constant_resolve(parser, start, parser->p - start, value, relocation);
+    }
+
+    return constant_fail(parser, CONSTANT_SYNTAX);
+}
+
+/*!
+ * \brief parses the unary operators
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_unary(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    if (*parser->p == '-') {
+        parser->p++;
+
+        if (!constant_parse_unary(parser, value, relocation)) {
+            return false;
+        }
+
+        *value = (uint16_t)(0 - *value);
+        *relocation = -*relocation;
+        return true;
+    }
+
+    if (*parser->p == '+') {
+        parser->p++;
+        return constant_parse_unary(parser, value, relocation);
+    }
+
+    return constant_parse_primary(parser, value, relocation);
+}
+
+/*!
+ * \brief parses the multiplications
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_mul(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    uint16_t right;
+    int32_t right_relocation;
+
+    if (!constant_parse_unary(parser, value, relocation)) {
+        return false;
+    }
+
+    while (*parser->p == '*') {
+        parser->p++;
+
+        if (!constant_parse_unary(parser, &right, &right_relocation)) {
+            return false;
+        }
+
+        if (*relocation != 0 || right_relocation != 0) {
+            return constant_fail(parser, CONSTANT_RELOCATION);
+        }
+
+        *value = (uint16_t)(*value * right);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief parses the additions and the subtractions
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_add(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    uint16_t right;
+    int32_t right_relocation;
+
+    if (!constant_parse_mul(parser, value, relocation)) {
+        return false;
+    }
+
+    while (*parser->p == '+' || *parser->p == '-') {
+        bool add = *parser->p++ == '+';
+
+        if (!constant_parse_mul(parser, &right, &right_relocation)) {
+            return false;
+        }
+
+        *value = (uint16_t)(add ? *value + right : *value - right);
+        *relocation += add ? right_relocation : -right_relocation;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief parses the left shifts
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_shift(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    uint16_t right;
+    int32_t right_relocation;
+
+    if (!constant_parse_add(parser, value, relocation)) {
+        return false;
+    }
+
+    while (parser->p[0] == '<' && parser->p[1] == '<') {
+        parser->p += 2;
+
+        if (!constant_parse_add(parser, &right, &right_relocation)) {
+            return false;
+        }
+
+        if (*relocation != 0 || right_relocation != 0) {
+            return constant_fail(parser, CONSTANT_RELOCATION);
+        }
+
+        *value = right < 16 ? (uint16_t)(*value << right) : 0;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief parses the bitwise ands
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_and(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    uint16_t right;
+    int32_t right_relocation;
+
+    if (!constant_parse_shift(parser, value, relocation)) {
+        return false;
+    }
+
+    while (*parser->p == '&') {
+        parser->p++;
+
+        if (!constant_parse_shift(parser, &right, &right_relocation)) {
+            return false;
+        }
+
+        if (*relocation != 0 || right_relocation != 0) {
+            return constant_fail(parser, CONSTANT_RELOCATION);
+        }
+
+        *value &= right;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief parses the bitwise ors, a whole expression
+ *
+ * \param parser		parser
+ * \param value			set to the value
+ * \param relocation	set to the number of the labels added to the value
+ * \return				success
+ */
+static bool constant_parse_or(constant_parser_t * parser, uint16_t * value, int32_t * relocation) {
+    uint16_t right;
+    int32_t right_relocation;
+
+    if (!constant_parse_and(parser, value, relocation)) {
+        return false;
+    }
+
+    while (*parser->p == '|') {
+        parser->p++;
+
+        if (!constant_parse_and(parser, &right, &right_relocation)) {
+            return false;
+        }
+
+        if (*relocation != 0 || right_relocation != 0) {
+            return constant_fail(parser, CONSTANT_RELOCATION);
+        }
+
+        *value |= right;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief checks if the input string is a valid constant expression
+ *
+ * \note the names are not checked, they can be defined later
+ *
+ * \param str			string containing the expression
+ * \param start_index	start of the expression in the input string
+ * \return				valid or not
+ */
+bool is_valid_expression(char * str, int start_index) {
+    constant_parser_t parser;
+    uint16_t value;
+    int32_t relocation;
+
+    if (!str || (int)strlen(str) <= start_index) {
+        return false;
+    }
+
+    parser.p = str + start_index;
+    parser.labels = true;
+    parser.check = true;
+    parser.status = CONSTANT_OK;
+
+    return constant_parse_or(&parser, &value, &relocation) && *parser.p == 0;
+}
+
+/*!
+ * \brief evaluates a constant expression
+ *
+ * \param expression	expression, without whitespace
+ * \param labels		labels can be used (second pass), or only numbers and constants (first pass)
+ * \param value			set to the value
+ * \param relocatable	set if the value is the address of a label, optional
+ * \return				CONSTANT_OK or the error
+ */
+constant_status_t constant_evaluate(const char * expression, bool labels, uint16_t * value, bool * relocatable) {
+    constant_parser_t parser;
+    int32_t relocation = 0;
+
+    parser.p = expression;
+    parser.labels = labels;
+    parser.check = false;
+    parser.status = CONSTANT_OK;
+
+    *value = 0;
+
+    if (!constant_parse_or(&parser, value, &relocation)) {
+        return parser.status;
+    }
+
+    if (*parser.p != 0) {
+        return CONSTANT_SYNTAX;
+    }
+
+    /* a label plus a number, or a number */
+    if (relocation != 0 && relocation != 1) {
+        return CONSTANT_RELOCATION;
+    }
+
+    if (relocatable) {
+        *relocatable = relocation == 1;
+    }
+
+    return CONSTANT_OK;
+}
+
+/*!
+ * \brief defines a constant (first pass)
+ *
+ * \param name			name of the constant, must be a valid label name and not an operation
+ * \param expression	text of the value, must pass is_valid_expression()
+ * \param redefinable	defined by .set
+ * \return				CONSTANT_OK or the error
+ */
+constant_status_t constant_define(const char * name, const char * expression, bool redefinable) {
+    constant_t * c = constant_find(name, strlen(name));
+    uint16_t value = 0;
+    bool relocatable = false;
+    bool evaluated = false;
+    char * text;
+
+    if (c && (!c->redefinable || !redefinable)) {
+        return CONSTANT_DEFINED;
+    }
+
+    /* a .set gets the value now, it can use the constant itself (.set N N+1) */
+    if (redefinable) {
+        evaluated = constant_evaluate(expression, false, &value, &relocatable) == CONSTANT_OK;
+    }
+
+    text = strdup(expression);
+    if (!text) {
+        return CONSTANT_MEMORY;
+    }
+
+    if (!c) {
+        uint32_t bucket = constant_hash(name, strlen(name));
+
+        c = (constant_t *)calloc(1, sizeof(constant_t));
+        if (!c || !(c->name = strdup(name))) {
+            free(c);
+            free(text);
+            return CONSTANT_MEMORY;
+        }
+
+        c->redefinable = redefinable;
+        c->next = s_constants[bucket];
+        s_constants[bucket] = c;
+    } else {
+        s_redefined = true;
+    }
+
+    free(c->expression);
+    c->expression = text;
+    c->value = value;
+    c->relocation = 0;
+    c->state = evaluated ? CONSTANT_DONE : CONSTANT_PENDING; /* a .set using the labels is evaluated by the second pass */
+    c->definitions++;
+
+    return CONSTANT_OK;
+}
+
+/*!
+ * \brief evaluates a .set constant again (second pass)
+ *
+ * \param name			name of the constant
+ * \param expression	text of the value
+ * \return				CONSTANT_OK or the error
+ */
+constant_status_t constant_set(const char * name, const char * expression) {
+    constant_t * c = constant_find(name, strlen(name));
+    constant_status_t status;
+    uint16_t value;
+    bool relocatable;
+
+    if (!c || !c->redefinable) {
+        return CONSTANT_UNDEFINED;
+    }
+
+    status = constant_evaluate(expression, true, &value, &relocatable);
+    if (status != CONSTANT_OK) {
+        return status;
+    }
+
+    c->value = value;
+    c->relocation = relocatable ? 1 : 0;
+    c->state = CONSTANT_DONE;
+
+    return CONSTANT_OK;
+}
+
+/*!
+ * \brief forgets the values of the .set constants before the second pass, they are set again line by line
+ */
+void constant_unset(void) {
+    uint32_t i;
+    constant_t * c;
+
+    for (i = 0; i < CONSTANT_BUCKETS; i++) {
+        for (c = s_constants[i]; c; c = c->next) {
+            if (c->redefinable) {
+                c->state = CONSTANT_NOT_SET;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief checks if a name is a constant
+ *
+ * \param name	name
+ * \return		defined by .equ or .set
+ */
+bool is_constant(const char * name) {
+    return name && constant_find(name, strlen(name)) != NULL;
+}
+
+/*!
+ * \brief checks if a .set constant has been defined more than once
+ *
+ * \return		the values of the constants depend on the line using them
+ */
+bool constants_redefined(void) {
+    return s_redefined;
+}
+
+/*!
+ * \brief visits the labels of an expression and of the constants it uses
+ *
+ * \param expression	expression
+ * \param visit			called with every label name
+ * \param context		passed to visit
+ */
+void constant_symbols(const char * expression, void (*visit)(const char * name, void * context), void * context) {
+    const char * p = expression;
+
+    while (*p) {
+        const char * start = p;
+        constant_t * c;
+        char * name;
+
+        if (!is_name_char(*p, true)) {
+            /* skip the numbers and the operators */
+            while (*p && !is_name_char(*p, true)) {
+                p++;
+            }
+            continue;
+        }
+
+        while (is_name_char(*p, false)) {
+            p++;
+        }
+
+        c = constant_find(start, p - start);
+        if (c) {
+            if (!c->visiting) {
+                c->visiting = true;
+                constant_symbols(c->expression, visit, context);
+                c->visiting = false;
+            }
+        } else if ((name = (char *)malloc(p - start + 1)) != NULL) {
+            memcpy(name, start, p - start);
+            name[p - start] = 0;
+            visit(name, context);
+            free(name);
+        }
+    }
+}
+
+/*!
+ * \brief gets the message of a constant error
+ *
+ * \param status	error
+ * \return			message
+ */
+const char * constant_message(constant_status_t status) {
+    switch (status) {
+    case CONSTANT_OK:
+        return "no error";
+    case CONSTANT_SYNTAX:
+        return "invalid expression";
+    case CONSTANT_UNDEFINED:
+        return "symbol is not defined";
+    case CONSTANT_NOT_ABSOLUTE:
+        return "expected numbers and constants defined before";
+    case CONSTANT_EXTERNAL:
+        return "external symbol in an expression";
+    case CONSTANT_RELOCATION:
+        return "labels can only be added to or subtracted from each other";
+    case CONSTANT_RECURSIVE:
+        return "constant depends on itself";
+    case CONSTANT_UNSET:
+        return "constant is used before its .set";
+    case CONSTANT_DEFINED:
+        return "constant is already defined";
+    case CONSTANT_RANGE:
+        return "number out of range";
+    case CONSTANT_MEMORY:
+    default:
+        return "unable to allocate memory for the constant";
+    }
+}
+
+/*!
+ * \brief releases the constants
+ *
+ * \note called by reset_tables()
+ */
+void constants_reset(void) {
+    uint32_t i;
+
+    for (i = 0; i < CONSTANT_BUCKETS; i++) {
+        while (s_constants[i]) {
+            constant_t * c = s_constants[i];
+
+            s_constants[i] = c->next;
+            free(c->name);
+            free(c->expression);
+            free(c);
+        }
+    }
+
+    s_redefined = false;
+}
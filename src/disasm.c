@@ -0,0 +1,542 @@
+/*!
+ * \file disasm.c
+ * \brief disassembler of the object (.oc) and binary (.bin) images
+ *
+ * Every 16-bit word is decoded once into a table of 64K entries: the fields
+ * of the instruction (op 15-12, source mode 11-9 and register 8-6,
+ * destination mode 5-3 and register 2-0) and the number of its words, 0 if
+ * the word is not an instruction that the assembler can write (an illegal
+ * addressing mode or a field of a missing operand that is not 0). Decoding an
+ * image is then one table lookup per instruction.
+ *
+ * The code is decoded from address 0 to the end of the code, the words that
+ * are not instructions are written as .data, marked "not code" (the assembler
+ * puts every .data behind the code). The addresses named by the
+ * operands get a label: the name of the entry, or L<address> in the code and
+ * D<address> in the data, also an instant that is relocatable in the object
+ * file; an operand word listed in the externals is the name of the external. An instruction that contains a named address is
+ * written as .data too, so the label can be put in front of the word.
+ *
+ * The output is a source that the assembler accepts, it goes through a
+ * buffer of its own, not through the formatted output of the C library.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern operation_t g_operations[16];
+extern addressing_t g_addressings[5];
+
+/*!
+ * \brief size of the output buffer
+ */
+#define DISASM_BUFFER_SIZE (64 * 1024)
+
+/*!
+ * \brief number of values of a .data line
+ */
+#define DISASM_DATA_PER_LINE 8
+
+/*!
+ * \brief decoded instruction word
+ */
+typedef struct disasm_decoded_s {
+    uint8_t op; /*!< \brief operation code */
+    uint8_t src_mode; /*!< \brief source addressing mode */
+    uint8_t src_reg; /*!< \brief source register */
+    uint8_t dest_mode; /*!< \brief destination addressing mode */
+    uint8_t dest_reg; /*!< \brief destination register */
+    uint8_t size; /*!< \brief number of words with the additional ones, 0 if the word is not an instruction */
+} disasm_decoded_t;
+
+/*!
+ * \brief buffered output
+ */
+typedef struct disasm_writer_s {
+    FILE * fp; /*!< \brief output stream */
+    char buffer[DISASM_BUFFER_SIZE]; /*!< \brief characters not written yet */
+    size_t used; /*!< \brief number of characters in the buffer */
+    bool failed; /*!< \brief a write failed */
+} disasm_writer_t;
+
+/*!
+ * \brief role of an address of the image
+ */
+typedef enum disasm_word_e {
+    DISASM_DATA = 0, /*!< data word, or a word of the code that is not an instruction */
+    DISASM_INSTRUCTION, /*!< first word of an instruction */
+    DISASM_OPERAND /*!< additional word of an instruction */
+} disasm_word_t;
+
+/*!
+ * \brief state of the disassembling of an image
+ */
+typedef struct disasm_s {
+    const image_t * image; /*!< \brief image */
+    const image_names_t * names; /*!< \brief entries and externals, can be NULL */
+    uint8_t words[TABLE_SIZE]; /*!< \brief role of every word (disasm_word_t) */
+    bool demoted[TABLE_SIZE]; /*!< \brief the word is written as data, it belongs to an instruction with a label inside */
+    bool labeled[TABLE_SIZE]; /*!< \brief the address is named by an operand or an entry */
+    const char * entry[TABLE_SIZE]; /*!< \brief name of the entry at the address, NULL if none */
+    const char * external[TABLE_SIZE]; /*!< \brief name of the external of the operand word, NULL if none */
+} disasm_t;
+
+static disasm_decoded_t s_decode[65536]; /*!< \brief decoded words */
+static bool s_decode_ready = false; /*!< \brief s_decode is filled */
+
+/*!
+ * \brief fills the decode table
+ */
+static void disasm_build_table(void) {
+    uint32_t word;
+
+    for (word = 0; word < 65536; word++) {
+        disasm_decoded_t * d = &s_decode[word];
+        operation_t * op = &g_operations[word >> 12];
+        uint8_t size = 1;
+        bool valid = true;
+
+        d->op = (uint8_t)(word >> 12);
+        d->src_mode = (uint8_t)((word >> 9) & 0x7);
+        d->src_reg = (uint8_t)((word >> 6) & 0x7);
+        d->dest_mode = (uint8_t)((word >> 3) & 0x7);
+        d->dest_reg = (uint8_t)(word & 0x7);
+
+        /* the fields of a missing operand are 0 */
+        if (op->operands < 2 && (word & 0x0FC0) != 0) {
+            valid = false;
+        }
+
+        if (op->operands < 1 && (word & 0x003F) != 0) {
+            valid = false;
+        }
+
+        if (valid && op->operands == 2) {
+            valid = d->src_mode <= INDIRECT_REGISTER && is_valid_addressing(op, &g_addressings[d->src_mode], false);
+            size += valid ? g_addressings[d->src_mode].add_word : 0;
+        }
+
+        if (valid && op->operands >= 1) {
+            valid = d->dest_mode <= INDIRECT_REGISTER && is_valid_addressing(op, &g_addressings[d->dest_mode], true);
+            size += valid ? g_addressings[d->dest_mode].add_word : 0;
+        }
+
+        /* the register of an addressing without register is 0 */
+        if (valid && op->operands == 2 && d->src_mode <= INDIRECT && d->src_reg != 0) {
+            valid = false;
+        }
+
+        if (valid && op->operands >= 1 && d->dest_mode <= INDIRECT && d->dest_reg != 0) {
+            valid = false;
+        }
+
+        d->size = valid ? size : 0;
+    }
+
+    s_decode_ready = true;
+}
+
+/*!
+ * \brief writes the buffer to the stream
+ *
+ * \param w	writer
+ */
+static void disasm_flush(disasm_writer_t * w) {
+    if (w->used > 0 && fwrite(w->buffer, 1, w->used, w->fp) != w->used) {
+        w->failed = true;
+    }
+
+    w->used = 0;
+}
+
+/*!
+ * \brief writes a string
+ *
+ * \param w		writer
+ * \param str	string
+ */
+static void disasm_put(disasm_writer_t * w, const char * str) {
+    while (*str) {
+        if (w->used == DISASM_BUFFER_SIZE) {
+            disasm_flush(w);
+        }
+
+        w->buffer[w->used++] = *str++;
+    }
+}
+
+/*!
+ * \brief writes a signed decimal number
+ *
+ * \param w		writer
+ * \param value	number
+ */
+static void disasm_put_number(disasm_writer_t * w, int32_t value) {
+    char digits[16];
+    char * p = digits + sizeof(digits) - 1;
+    uint32_t magnitude = value < 0 ? (uint32_t)-value : (uint32_t)value;
+
+    *p = 0;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        *--p = '-';
+    }
+
+    disasm_put(w, p);
+}
+
+/*!
+ * \brief writes the generated name of an address, L0012 or D0040
+ *
+ * \param w			writer
+ * \param prefix	'L' for the code, 'D' for the data
+ * \param address	address
+ */
+static void disasm_put_address(disasm_writer_t * w, char prefix, uint16_t address) {
+    static const char hex[] = "0123456789abcdef";
+    char name[6];
+
+    name[0] = prefix;
+    name[1] = hex[(address >> 12) & 0xF];
+    name[2] = hex[(address >> 8) & 0xF];
+    name[3] = hex[(address >> 4) & 0xF];
+    name[4] = hex[address & 0xF];
+    name[5] = 0;
+
+    disasm_put(w, name);
+}
+
+/*!
+ * \brief writes the name of an address
+ *
+ * \param dis		disassembling
+ * \param w			writer
+ * \param address	named address
+ */
+static void disasm_put_label(disasm_t * dis, disasm_writer_t * w, uint16_t address) {
+    if (dis->entry[address]) {
+        disasm_put(w, dis->entry[address]);
+    } else {
+        disasm_put_address(w, address < dis->image->code_size ? 'L' : 'D', address);
+    }
+}
+
+/*!
+ * \brief checks if an operand word holds an address that needs a label
+ *
+ * \param dis		disassembling
+ * \param mode		addressing mode
+ * \param address	address of the operand word
+ * \return			named address
+ */
+static bool disasm_names_address(disasm_t * dis, uint8_t mode, uint16_t address) {
+    if (mode == INSTANT) {
+        return dis->names && dis->names->types[address] == 'r'; /* #TABLE+1 */
+    }
+
+    return (mode == DIRECT || mode == INDIRECT) && !dis->external[address];
+}
+
+/*!
+ * \brief decodes the code into instructions and data, labels the named addresses
+ *
+ * \param dis	disassembling
+ * \return		an instruction contained a named address and became data, decode again
+ */
+static bool disasm_decode(disasm_t * dis) {
+    const image_t * image = dis->image;
+    uint32_t address = 0;
+    bool again = false;
+
+    memset(dis->labeled, 0, sizeof(dis->labeled));
+
+    while (address < image->code_size) {
+        const disasm_decoded_t * d = &s_decode[image->words[address]];
+        uint32_t next = address + 1;
+        bool valid = d->size > 0 && address + d->size <= image->code_size && !dis->demoted[address];
+
+        /* the named addresses must be in the image */
+        if (valid) {
+            operation_t * op = &g_operations[d->op];
+
+            if (op->operands == 2 && disasm_names_address(dis, d->src_mode, (uint16_t)next) &&
+                image->words[next] >= image->size) {
+                valid = false;
+            }
+
+            next += op->operands == 2 ? g_addressings[d->src_mode].add_word : 0;
+
+            if (op->operands >= 1 && disasm_names_address(dis, d->dest_mode, (uint16_t)next) &&
+                image->words[next] >= image->size) {
+                valid = false;
+            }
+        }
+
+        if (!valid) {
+            dis->words[address++] = DISASM_DATA;
+            continue;
+        }
+
+        dis->words[address] = DISASM_INSTRUCTION;
+        for (next = address + 1; next < address + d->size; next++) {
+            dis->words[next] = DISASM_OPERAND;
+        }
+
+        address += d->size;
+    }
+
+    for (; address < image->size; address++) {
+        dis->words[address] = DISASM_DATA;
+    }
+
+    /* the named addresses */
+    for (address = 0; address < image->size; address++) {
+        if (dis->words[address] == DISASM_INSTRUCTION) {
+            const disasm_decoded_t * d = &s_decode[image->words[address]];
+            operation_t * op = &g_operations[d->op];
+            uint32_t next = address + 1;
+
+            if (op->operands == 2) {
+                if (disasm_names_address(dis, d->src_mode, (uint16_t)next)) {
+                    dis->labeled[image->words[next]] = true;
+                }
+                next += g_addressings[d->src_mode].add_word;
+            }
+
+            if (op->operands >= 1 && disasm_names_address(dis, d->dest_mode, (uint16_t)next)) {
+                dis->labeled[image->words[next]] = true;
+            }
+        }
+
+        if (dis->entry[address]) {
+            dis->labeled[address] = true;
+        }
+    }
+
+    /* a label can not point into an instruction, the instruction becomes data */
+    for (address = 0; address < image->size; address++) {
+        if (dis->labeled[address] && dis->words[address] == DISASM_OPERAND) {
+            uint32_t first = address;
+
+            while (dis->words[first] != DISASM_INSTRUCTION) {
+                first--;
+            }
+
+            dis->demoted[first++] = true;
+            while (first < image->size && dis->words[first] == DISASM_OPERAND) {
+                dis->demoted[first++] = true;
+            }
+            again = true;
+        }
+    }
+
+    return again;
+}
+
+/*!
+ * \brief writes an operand
+ *
+ * \param dis		disassembling
+ * \param w			writer
+ * \param mode		addressing mode
+ * \param reg		register
+ * \param address	address of the additional word
+ */
+static void disasm_put_operand(disasm_t * dis, disasm_writer_t * w, uint8_t mode, uint8_t reg, uint16_t address) {
+    static const char * registers[8] = { "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7" };
+
+    switch (mode) {
+    case INSTANT:
+        disasm_put(w, "#");
+        if (disasm_names_address(dis, mode, address)) {
+            disasm_put_label(dis, w, dis->image->words[address]);
+        } else {
+            disasm_put_number(w, (int16_t)dis->image->words[address]);
+        }
+        break;
+
+    case DIRECT:
+    case INDIRECT:
+        if (mode == INDIRECT) {
+            disasm_put(w, "@");
+        }
+
+        if (dis->external[address]) {
+            disasm_put(w, dis->external[address]);
+        } else {
+            disasm_put_label(dis, w, dis->image->words[address]);
+        }
+        break;
+
+    case DIRECT_REGISTER:
+        disasm_put(w, registers[reg]);
+        break;
+
+    case INDIRECT_REGISTER:
+    default:
+        disasm_put(w, "@");
+        disasm_put(w, registers[reg]);
+        break;
+    }
+}
+
+/*!
+ * \brief writes the instructions and the data
+ *
+ * \param dis		disassembling
+ * \param w			writer
+ * \param lines		source lines of the addresses, can be NULL
+ */
+static void disasm_write(disasm_t * dis, disasm_writer_t * w, const line_table_t * lines) {
+    const image_t * image = dis->image;
+    uint32_t address = 0;
+
+    while (address < image->size) {
+        if (dis->labeled[address]) {
+            disasm_put_label(dis, w, (uint16_t)address);
+            disasm_put(w, ":");
+        }
+
+        if (dis->words[address] == DISASM_INSTRUCTION) {
+            const disasm_decoded_t * d = &s_decode[image->words[address]];
+            operation_t * op = &g_operations[d->op];
+            uint32_t line;
+
+            disasm_put(w, "\t");
+            disasm_put(w, op->mnemonic);
+
+            if (op->operands == 2) {
+                disasm_put(w, "\t");
+                disasm_put_operand(dis, w, d->src_mode, d->src_reg, (uint16_t)(address + 1));
+                disasm_put(w, ",");
+                disasm_put_operand(dis, w, d->dest_mode, d->dest_reg,
+                                   (uint16_t)(address + 1 + g_addressings[d->src_mode].add_word));
+            } else if (op->operands == 1) {
+                disasm_put(w, "\t");
+                disasm_put_operand(dis, w, d->dest_mode, d->dest_reg, (uint16_t)(address + 1));
+            }
+
+            if (lines && (line = line_table_lookup(lines, (uint16_t)address)) != 0) {
+                disasm_put(w, "\t; ");
+                disasm_put(w, lines->file_name);
+                disasm_put(w, ":");
+                disasm_put_number(w, (int32_t)line);
+            }
+
+            disasm_put(w, "\n");
+            address += d->size;
+        } else {
+            uint32_t count = 0;
+
+            /* the data words up to the next label or instruction */
+            disasm_put(w, "\t.data\t");
+            do {
+                if (count > 0) {
+                    disasm_put(w, ",");
+                }
+                disasm_put_number(w, (int16_t)image->words[address]);
+                address++;
+                count++;
+            } while (address < image->size && address != image->code_size && count < DISASM_DATA_PER_LINE &&
+                     !dis->labeled[address] && dis->words[address] == DISASM_DATA);
+
+            if (address - count < image->code_size) {
+                disasm_put(w, "\t; not code"); /* the assembler moves it behind the code */
+            }
+
+            disasm_put(w, "\n");
+        }
+    }
+}
+
+/*!
+ * \brief writes the source of an image
+ *
+ * \param image	image
+ * \param names	entries and externals of the image, can be NULL
+ * \param lines	source lines of the addresses, can be NULL
+ * \param fp	output stream
+ * \return		success, false if the output could not be written or out of memory
+ */
+bool disassemble(const image_t * image, const image_names_t * names, const line_table_t * lines, FILE * fp) {
+    disasm_t * dis = (disasm_t *)calloc(1, sizeof(disasm_t));
+    disasm_writer_t * w = (disasm_writer_t *)malloc(sizeof(disasm_writer_t));
+    uint16_t i;
+    bool ok;
+
+    if (!dis || !w) {
+        free(dis);
+        free(w);
+        return false;
+    }
+
+    if (!s_decode_ready) {
+        disasm_build_table();
+    }
+
+    dis->image = image;
+    dis->names = names;
+    w->fp = fp;
+    w->used = 0;
+    w->failed = false;
+
+    if (names) {
+        for (i = 0; i < names->entries_size; i++) {
+            if (names->entries[i].value < image->size) {
+                dis->entry[names->entries[i].value] = names->entries[i].name;
+            }
+        }
+
+        for (i = 0; i < names->externals_size; i++) {
+            if (names->externals[i].value < image->size) {
+                dis->external[names->externals[i].value] = names->externals[i].name;
+            }
+        }
+    }
+
+    /* every round turns an instruction into data at least */
+    for (i = 0; i < image->code_size && disasm_decode(dis); i++) {
+    }
+
+    disasm_put(w, "; ");
+    disasm_put_number(w, image->code_size);
+    disasm_put(w, " code word(s), ");
+    disasm_put_number(w, image->size - image->code_size);
+    disasm_put(w, " data word(s)\n");
+
+    if (names) {
+        for (i = 0; i < names->entries_size; i++) {
+            disasm_put(w, ".entry\t");
+            disasm_put(w, names->entries[i].name);
+            disasm_put(w, "\n");
+        }
+
+        for (i = 0; i < names->externals_size; i++) {
+            uint16_t j;
+
+            /* an external is listed at every word that refers to it */
+            for (j = 0; j < i && strcmp(names->externals[j].name, names->externals[i].name) != 0; j++) {
+            }
+
+            if (j == i) {
+                disasm_put(w, ".extern\t");
+                disasm_put(w, names->externals[i].name);
+                disasm_put(w, "\n");
+            }
+        }
+    }
+
+    disasm_write(dis, w, lines);
+    disasm_flush(w);
+
+    ok = !w->failed;
+
+    free(dis);
+    free(w);
+
+    return ok;
+}
@@ -1,10 +1,414 @@
 /*!
  * \file error.c
  * \brief error/warning reporting functions
+ *
+ * The diagnostics go to a handler (the library), to the selected context or
+ * straight to stderr. A context keeps the diagnostics of one source and writes
+ * them in a few large blocks when the source is done, so a source with many
+ * errors does not make a system call per message, and the diagnostics of the
+ * sources come out in their order. With a handler installed, the selected
+ * context only counts the diagnostics and applies its limit of errors.
  */
 
 #include "asm.h"
 
+/*!
+ * \brief maximum length of a formatted message
+ */
+#define DIAGNOSTIC_MESSAGE 512
+
+/*!
+ * \brief number of buffered diagnostics that are written without waiting for the end of the source
+ */
+#define DIAGNOSTICS_PENDING 4096
+
+/*!
+ * \brief initial size of the text of a context
+ */
+#define DIAGNOSTICS_TEXT 65536
+
+/*!
+ * \brief size of the output buffer of diagnostics_flush()
+ */
+#define DIAGNOSTICS_BUFFER 8192
+
+/*!
+ * \brief output buffer of the diagnostics
+ */
+typedef struct diagnostics_writer_s {
+    FILE * fp; /*!< \brief output stream */
+    char buffer[DIAGNOSTICS_BUFFER]; /*!< \brief bytes not written yet */
+    size_t size; /*!< \brief number of bytes in the buffer */
+    bool ok; /*!< \brief no write error so far */
+} diagnostics_writer_t;
+
+/* private variables */
+static diagnostic_handler_t s_handler = NULL; /*!< \brief receives the diagnostics instead of stderr */
+static void * s_handler_data = NULL; /*!< \brief user data of the handler */
+static diagnostics_t * s_context = NULL; /*!< \brief buffers the diagnostics instead of stderr */
+
+/*!
+ * \brief redirects the diagnostics to a handler instead of the standard error stream
+ *
+ * \param handler	handler of the diagnostics, NULL restores stderr
+ * \param data		user data passed to the handler
+ */
+void set_diagnostic_handler(diagnostic_handler_t handler, void * data) {
+    s_handler = handler;
+    s_handler_data = data;
+}
+
+/*!
+ * \brief initialises an empty context of diagnostics
+ *
+ * \param d			context
+ * \param fp		output stream of the diagnostics
+ * \param format	output format
+ * \param limit		the passes stop after this number of errors, 0 for no limit
+ */
+void diagnostics_init(diagnostics_t * d, FILE * fp, diagnostic_format_t format, uint32_t limit) {
+    memset(d, 0, sizeof(diagnostics_t));
+    d->fp = fp;
+    d->format = format;
+    d->limit = limit;
+}
+
+/*!
+ * \brief selects the context that receives the diagnostics
+ *
+ * \note the context is per process, the assembler uses global tables anyway
+ *
+ * \param d	context, NULL writes the diagnostics to stderr at once
+ */
+void diagnostics_select(diagnostics_t * d) {
+    s_context = d;
+}
+
+/*!
+ * \brief checks if the selected context has reached its limit of errors
+ *
+ * \return	the passes should stop
+ */
+bool diagnostics_stopped(void) {
+    return s_context && s_context->stopped;
+}
+
+/*!
+ * \brief reserves bytes at the end of the text of a context
+ *
+ * \param d		context
+ * \param size	number of bytes
+ * \return		success
+ */
+static bool diagnostics_reserve(diagnostics_t * d, uint32_t size) {
+    if (d->text_size + size > d->text_capacity) {
+        uint32_t capacity = d->text_capacity ? d->text_capacity : DIAGNOSTICS_TEXT;
+        char * text;
+
+        while (d->text_size + size > capacity) {
+            capacity *= 2;
+        }
+
+        text = (char *)realloc(d->text, capacity);
+        if (!text) {
+            return false;
+        }
+
+        d->text = text;
+        d->text_capacity = capacity;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief adds a diagnostic to a context
+ *
+ * \param d			context
+ * \param severity	error or warning
+ * \param file_name	name of the source file
+ * \param line		line number
+ * \param fmt		printf style format string
+ * \param list		printf style variable argument list
+ * \return			success, false if out of memory
+ */
+static bool diagnostics_add(diagnostics_t * d, tas_severity_t severity, const char * file_name, uint32_t line,
+                            const char * fmt, va_list list) {
+    diagnostic_t * item;
+    int len;
+
+    if (d->size == d->capacity) {
+        uint32_t capacity = d->capacity ? d->capacity * 2 : 64;
+        diagnostic_t * items = (diagnostic_t *)realloc(d->items, capacity * sizeof(diagnostic_t));
+
+        if (!items) {
+            return false;
+        }
+
+        d->items = items;
+        d->capacity = capacity;
+    }
+
+    item = &d->items[d->size];
+    item->severity = severity;
+    item->line = line;
+
+    /* the diagnostics of a file come in runs, its name is copied once per run */
+    if (!file_name) {
+        file_name = "";
+    }
+    if (file_name != d->file || d->size == 0) {
+        uint32_t size = (uint32_t)strlen(file_name) + 1;
+
+        if (!diagnostics_reserve(d, size)) {
+            return false;
+        }
+
+        memcpy(d->text + d->text_size, file_name, size);
+        d->file = file_name;
+        d->file_offset = d->text_size;
+        d->text_size += size;
+    }
+    item->file = d->file_offset;
+
+    if (!diagnostics_reserve(d, DIAGNOSTIC_MESSAGE)) {
+        return false;
+    }
+
+    len = vsnprintf(d->text + d->text_size, DIAGNOSTIC_MESSAGE, fmt, list);
+    if (len < 0) {
+        len = 0;
+        d->text[d->text_size] = '\0';
+    } else if (len >= DIAGNOSTIC_MESSAGE) {
+        len = DIAGNOSTIC_MESSAGE - 1; /* truncated */
+    }
+
+    item->message = d->text_size;
+    d->text_size += (uint32_t)len + 1;
+    d->size++;
+
+    return true;
+}
+
+/*!
+ * \brief passes a diagnostic to the handler, or adds it to a context without a handler
+ *
+ * \param d			context
+ * \param severity	error or warning
+ * \param file_name	name of the source file
+ * \param line		line number
+ * \param fmt		printf style format string
+ * \param list		printf style variable argument list
+ * \return			success, false if out of memory
+ */
+static bool diagnostics_deliver(diagnostics_t * d, tas_severity_t severity, const char * file_name, uint32_t line,
+                                const char * fmt, va_list list) {
+    if (s_handler) {
+        char message[DIAGNOSTIC_MESSAGE];
+
+        vsnprintf(message, sizeof(message), fmt, list);
+        s_handler(s_handler_data, severity, file_name, line, message);
+        return true;
+    }
+
+    return diagnostics_add(d, severity, file_name, line, fmt, list);
+}
+
+/*!
+ * \brief adds an error of the assembler itself to a context
+ *
+ * \param d			context
+ * \param file_name	name of the source file
+ * \param line		line number
+ * \param fmt		printf style format string
+ * \param ...		printf style variable argument list
+ * \return			success, false if out of memory
+ */
+static bool diagnostics_note(diagnostics_t * d, const char * file_name, uint32_t line, const char * fmt, ...) {
+    va_list list;
+    bool added;
+
+    va_start(list, fmt);
+    added = diagnostics_deliver(d, TAS_ERROR, file_name, line, fmt, list);
+    va_end(list);
+
+    return added;
+}
+
+/*!
+ * \brief writes the buffer of a writer to its stream
+ *
+ * \param w	writer
+ */
+static void diagnostics_write(diagnostics_writer_t * w) {
+    if (w->size > 0 && fwrite(w->buffer, 1, w->size, w->fp) != w->size) {
+        w->ok = false;
+    }
+    w->size = 0;
+}
+
+/*!
+ * \brief appends a string to a writer, escaped for JSON if asked
+ *
+ * \param w		writer
+ * \param str	string
+ * \param json	escape the quotes, the backslashes and the control characters
+ */
+static void diagnostics_put(diagnostics_writer_t * w, const char * str, bool json) {
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+
+        if (w->size + 8 > DIAGNOSTICS_BUFFER) {
+            diagnostics_write(w);
+        }
+
+        if (json && (c == '"' || c == '\\')) {
+            w->buffer[w->size++] = '\\';
+            w->buffer[w->size++] = (char)c;
+        } else if (json && c < 0x20) {
+            w->size += sprintf(w->buffer + w->size, "\\u%04x", c);
+        } else {
+            w->buffer[w->size++] = (char)c;
+        }
+    }
+}
+
+/*!
+ * \brief writes the buffered diagnostics of a context and empties it
+ *
+ * \param d	context
+ * \return	success
+ */
+bool diagnostics_flush(diagnostics_t * d) {
+    diagnostics_writer_t w;
+    char number[32];
+    uint32_t i;
+
+    if (d->size == 0) {
+        return true;
+    }
+
+    w.fp = d->fp;
+    w.size = 0;
+    w.ok = true;
+
+    for (i = 0; i < d->size; i++) {
+        diagnostic_t * item = &d->items[i];
+        const char * severity = item->severity == TAS_ERROR ? "error" : "warning";
+
+        if (d->format == DIAGNOSTIC_JSON) {
+            diagnostics_put(&w, "{\"file\":\"", false);
+            diagnostics_put(&w, d->text + item->file, true);
+            sprintf(number, "\",\"line\":%u,\"severity\":\"", item->line);
+            diagnostics_put(&w, number, false);
+            diagnostics_put(&w, severity, false);
+            diagnostics_put(&w, "\",\"message\":\"", false);
+            diagnostics_put(&w, d->text + item->message, true);
+            diagnostics_put(&w, "\"}\n", false);
+        } else {
+            diagnostics_put(&w, d->text + item->file, false);
+            sprintf(number, ":%u: ", item->line);
+            diagnostics_put(&w, number, false);
+            diagnostics_put(&w, severity, false);
+            diagnostics_put(&w, ": ", false);
+            diagnostics_put(&w, d->text + item->message, false);
+            diagnostics_put(&w, "\n", false);
+        }
+    }
+
+    diagnostics_write(&w);
+
+    d->size = 0;
+    d->text_size = 0;
+    d->file = NULL;
+
+    return w.ok && !ferror(d->fp);
+}
+
+/*!
+ * \brief releases the memory of a context, the diagnostics must have been written
+ *
+ * \param d	context
+ */
+void diagnostics_free(diagnostics_t * d) {
+    if (s_context == d) {
+        s_context = NULL;
+    }
+
+    free(d->items);
+    free(d->text);
+    d->items = NULL;
+    d->text = NULL;
+    d->size = d->capacity = 0;
+    d->text_size = d->text_capacity = 0;
+}
+
+/*!
+ * \brief adds a diagnostic to the selected context or passes it to the handler, stops the context at its limit
+ *
+ * \param d			context
+ * \param severity	error or warning
+ * \param file_name	name of the source file
+ * \param line		line number
+ * \param fmt		printf style format string
+ * \param list		printf style variable argument list
+ */
+static void report_context(diagnostics_t * d, tas_severity_t severity, const char * file_name, uint32_t line,
+                           char * fmt, va_list list) {
+    bool added;
+
+    if (severity == TAS_ERROR) {
+        d->errors++;
+    } else {
+        d->warnings++;
+    }
+
+    if (d->stopped) {
+        return;
+    }
+
+    added = diagnostics_deliver(d, severity, file_name, line, fmt, list);
+
+    if (added && severity == TAS_ERROR && d->limit != 0 && d->errors >= d->limit) {
+        d->stopped = true;
+        added = diagnostics_note(d, file_name, line, "too many errors, stopping (-ferror-limit=%u)", d->limit);
+    }
+
+    if (!added || d->size >= DIAGNOSTICS_PENDING) {
+        diagnostics_flush(d);
+    }
+}
+
+/*!
+ * \brief reports a diagnostic through the selected context, to the handler or to stderr
+ *
+ * \param severity	error or warning
+ * \param file_name	name of the source file
+ * \param line		line number
+ * \param fmt		printf style format string
+ * \param list		printf style variable argument list
+ */
+static void report(tas_severity_t severity, const char * file_name, uint32_t line, char * fmt, va_list list) {
+    /* the context applies its limit, then passes the diagnostic to the handler */
+    if (s_context) {
+        report_context(s_context, severity, file_name, line, fmt, list);
+        return;
+    }
+
+    if (s_handler) {
+        char message[DIAGNOSTIC_MESSAGE];
+
+        vsnprintf(message, sizeof(message), fmt, list);
+        s_handler(s_handler_data, severity, file_name, line, message);
+        return;
+    }
+
+    fprintf(stderr, "%s:%u: %s: ", file_name ? file_name : "", line,
+            severity == TAS_ERROR ? "error" : "warning");
+    vfprintf(stderr, fmt, list);
+    fprintf(stderr, "\n");
+}
+
 /*!
  * \brief prints a formatted warning message to standard error stream (stderr)
  * 
@@ -16,11 +420,9 @@
 void error(const char * file_name, uint32_t line, char * fmt, ...) {
     va_list list;
 
-    fprintf(stderr, "%s:%u: error: ", file_name ? file_name : "", line);
     va_start(list, fmt);
-    vfprintf(stderr, fmt, list);
+    report(TAS_ERROR, file_name, line, fmt, list);
     va_end(list);
-    fprintf(stderr, "\n");
 }
 
 /*!
@@ -34,9 +436,7 @@ void error(const char * file_name, uint32_t line, char * fmt, ...) {
 void warning(const char * file_name, uint32_t line, char * fmt, ...) {
     va_list list;
 
-    fprintf(stderr, "%s:%u: warning: ", file_name ? file_name : "", line);
     va_start(list, fmt);
-    vfprintf(stderr, fmt, list);
+    report(TAS_WARNING, file_name, line, fmt, list);
     va_end(list);
-    fprintf(stderr, "\n");
 }
@@ -52,38 +52,141 @@ char * get_file_base_name(const char * path) {
  * "C:\dir\file.txt" -> "C:\dir\file"<br>
  * "/opt/dir/file.txt" -> "/opt/dir/file"
  * 
+ * \note returned string, if not NULL, must be free()-d
+ * 
  * \param path	path of the file
  * \return		path without extension or NULL
  */
 char * get_file_name_no_ext(const char * path) {
-    int i, len = (int)strlen(path);
-    int dot_pos = -1;
-
-    if (path) {
-        /* find the last dot */
-        for (i = 0; i < len; ++i) {
-            if (path[i] == '.') {
-                dot_pos = i;
-            }
+    const char * base = get_file_base_name(path);
+    const char * dot;
+    char * file_name_no_ext;
+    size_t len;
+
+    if (!path) {
+        return NULL;
+    }
+
+    /* the last dot of the name, not of a directory */
+    dot = strrchr(base, '.');
+    len = dot ? (size_t)(dot - path) : strlen(path);
+
+    file_name_no_ext = (char *)malloc(len + 1);
+    if (file_name_no_ext) {
+        memcpy(file_name_no_ext, path, len);
+        file_name_no_ext[len] = 0;
+    }
+
+    return file_name_no_ext;
+}
+
+/*!
+ * \brief replaces the extension of a path
+ *
+ * "/opt/dir/file.oc", ".ln" -> "/opt/dir/file.ln"<br>
+ * "/opt/dir/file", ".ln" -> "/opt/dir/file.ln"
+ *
+ * \note returned value, if not NULL, must be free()-d
+ *
+ * \param path	path of the file
+ * \param ext	new extension with the dot
+ * \return		new path or NULL
+ */
+char * get_file_name_with_ext(const char * path, const char * ext) {
+    const char * base = get_file_base_name(path);
+    const char * dot = strrchr(base, '.');
+    size_t len = dot ? (size_t)(dot - path) : strlen(path);
+    char * name = (char *)malloc(len + strlen(ext) + 1); /* + NULL */
+
+    if (name) {
+        memcpy(name, path, len);
+        strcpy(name + len, ext);
+    }
+
+    return name;
+}
+
+/*!
+ * \brief reads the whole content of a file into memory
+ *
+ * \note returned buffer, if not NULL, must be free()-d
+ * \note buffer is NULL terminated, the terminator is not part of len
+ *
+ * \param path	path of the file
+ * \param len	set to the number of bytes read
+ * \return		content of the file or NULL
+ */
+char * read_file(const char * path, size_t * len) {
+    FILE * fp = fopen(path, "r");
+    char * buffer = NULL;
+    size_t capacity = 4096, n;
+
+    *len = 0;
+
+    if (!fp) {
+        return NULL;
+    }
+
+    /* read in chunks, works on pipes and text mode streams too */
+    for (;;) {
+        char * grown = (char *)realloc(buffer, capacity + 1); /* + NULL */
+        if (!grown) {
+            free(buffer);
+            fclose(fp);
+            return NULL;
         }
 
-        /* if path contains a dot */
-        if (dot_pos != -1) {
-            char * file_base_name_no_ext = (char *)malloc(dot_pos);
-            if (file_base_name_no_ext) {
-                strncpy(file_base_name_no_ext, path, dot_pos);
-                file_base_name_no_ext[dot_pos] = 0;
+        buffer = grown;
+        n = fread(buffer + *len, 1, capacity - *len, fp);
+        *len += n;
 
-                return file_base_name_no_ext;
-            } else {
-                return NULL;
-            }
-        } else {
-            return (char *)path;
+        if (*len < capacity) {
+            break;
         }
-    } else {
-        return NULL;
+
+        capacity *= 2;
     }
+
+    fclose(fp);
+    buffer[*len] = 0;
+
+    return buffer;
+}
+
+/*!
+ * \brief writes the object code, the entries and the externals in the ascii base16 format
+ *
+ * \param fp	output stream
+ */
+void write_object_code(FILE * fp) {
+    uint16_t i;
+
+    fprintf(fp, ".cbegin\n");
+    /* header: length_of_the_instructions length_of_the_data */
+    fprintf(fp, "%x %x\n", g_object_code_size - g_data_image_size, g_data_image_size);
+    for (i = 0; i < g_object_code_size; ++i) {
+        object_code_t * o = &g_object_code[i];
+        /* object code: address machine_word type */
+        fprintf(fp, "%04x %04x %c\n", i, o->value, o->type);
+    }
+    fprintf(fp, ".cend\n");
+    fprintf(fp, ".lbegin\n");
+    for (i = 0; i < g_link_table_size; ++i) {
+        link_object_t * obj = &g_link_table[i];
+
+        if (obj->type == 'n') {
+            /* object code: name_of_the_entry address */
+            fprintf(fp, "%s %04x\n", obj->name, obj->value);
+        }
+    }
+    fprintf(fp, ".lend\n");
+    fprintf(fp, ".ebegin\n");
+    for (i = 0; i < g_external_table_size; ++i) {
+        link_object_t * obj = &g_external_table[i];
+        /* object code: name_of_the_entry address */
+        fprintf(fp, "%s %04x\n", obj->name, obj->value);
+    }
+    fprintf(fp, ".eend\n");
 }
 
 /*!
@@ -95,7 +198,6 @@ char * get_file_name_no_ext(const char * path) {
 uint16_t create_object_file(const char * file_name) {
     char * file_name_no_ext = get_file_name_no_ext(file_name);
     FILE * fp = NULL;
-    uint16_t i;
     uint16_t errors = 0;
 
     if (!file_name_no_ext) {
@@ -111,32 +213,7 @@ uint16_t create_object_file(const char * file_name) {
         fp = fopen(object_name, "w");
 
         if (fp) {
-            fprintf(fp, ".cbegin\n");
-            /* header: length_of_the_instructions length_of_the_data */
-            fprintf(fp, "%x %x\n", g_object_code_size - g_data_image_size, g_data_image_size);
-            for (i = 0; i < g_object_code_size; ++i) {
-                object_code_t * o = &g_object_code[i];
-                /* object code: address machine_word type */
-                fprintf(fp, "%04x %04x %c\n", i, o->value, o->type);
-            }
-            fprintf(fp, ".cend\n");
-            fprintf(fp, ".lbegin\n");
-            for (i = 0; i < g_link_table_size; ++i) {
-                link_object_t * obj = &g_link_table[i];
-
-                if (obj->type == 'n') {
-                    /* object code: name_of_the_entry address */
-                    fprintf(fp, "%s %04x\n", obj->name, obj->value);
-                }
-            }
-            fprintf(fp, ".lend\n");
-            fprintf(fp, ".ebegin\n");
-            for (i = 0; i < g_external_table_size; ++i) {
-                link_object_t * obj = &g_external_table[i];
-                /* object code: name_of_the_entry address */
-                fprintf(fp, "%s %04x\n", obj->name, obj->value);
-            }
-            fprintf(fp, ".eend\n");
+            write_object_code(fp);
             fclose(fp);
         } else {
             errors++;
@@ -146,6 +223,7 @@ uint16_t create_object_file(const char * file_name) {
     }
 
     free(object_name);
+    free(file_name_no_ext);
     return errors;
 }
 
@@ -190,5 +268,194 @@ uint16_t create_binary_file(const char * file_name) {
     }
 
     free(binary_name);
+    free(file_name_no_ext);
     return errors;
 }
+
+/*!
+ * \brief adds a name of an object file to a table
+ *
+ * \param table	table, reallocated
+ * \param size	size of the table
+ * \param line	"name address" line of the object file
+ * \return		success
+ */
+static bool add_image_name(link_object_t ** table, uint16_t * size, const char * line) {
+    const char * space = strchr(line, ' ');
+    link_object_t * grown;
+    unsigned int value;
+
+    if (!space || space == line || sscanf(space + 1, "%x", &value) != 1 || value >= TABLE_SIZE ||
+        *size >= TABLE_SIZE) {
+        return false;
+    }
+
+    grown = (link_object_t *)realloc(*table, (*size + 1) * sizeof(link_object_t));
+    if (!grown) {
+        return false;
+    }
+    *table = grown;
+
+    grown[*size].name = (char *)malloc(space - line + 1); /* + NULL */
+    if (!grown[*size].name) {
+        return false;
+    }
+
+    memcpy(grown[*size].name, line, space - line);
+    grown[*size].name[space - line] = 0;
+    grown[*size].value = (uint16_t)value;
+    grown[*size].type = ' ';
+    (*size)++;
+
+    return true;
+}
+
+/*!
+ * \brief loads an object file into an image of the memory
+ *
+ * \param text		content of the object file, modified
+ * \param image		loaded image
+ * \param names		set to the entries and the externals, NULL if the externals are not allowed
+ * \return			success, false if the file is invalid or contains externals
+ */
+static bool load_object_code(char * text, image_t * image, image_names_t * names) {
+    enum { NONE, HEADER, CODE, ENTRIES, EXTERNALS } section = NONE;
+    unsigned int code_size, data_size, address, value;
+    char * line = text;
+
+    while (*line) {
+        char * end = strchr(line, '\n');
+
+        if (end) {
+            *end = 0;
+        }
+
+        if (strncmp(line, ".cbegin", 7) == 0) {
+            section = HEADER;
+        } else if (strncmp(line, ".lbegin", 7) == 0) {
+            section = ENTRIES;
+        } else if (strncmp(line, ".ebegin", 7) == 0) {
+            section = EXTERNALS;
+        } else if (line[0] == '.') {
+            section = NONE;
+        } else if (section == HEADER) {
+            /* header: length_of_the_instructions length_of_the_data */
+            if (sscanf(line, "%x %x", &code_size, &data_size) != 2 || code_size + data_size > TABLE_SIZE) {
+                return false;
+            }
+            image->size = (uint16_t)(code_size + data_size);
+            image->code_size = (uint16_t)code_size;
+            section = CODE;
+        } else if (section == CODE) {
+            /* object code: address machine_word type, the type of the data is blank */
+            if (sscanf(line, "%x %x", &address, &value) != 2 || address >= image->size) {
+                return false;
+            }
+            image->words[address] = (uint16_t)value;
+
+            if (names) {
+                names->types[address] = strlen(line) > 10 ? line[10] : ' ';
+            }
+        } else if (section == ENTRIES) {
+            /* entry: name_of_the_entry address */
+            if (strncmp(line, "MAIN ", 5) == 0 && sscanf(line + 5, "%x", &value) == 1) {
+                image->entry = (uint16_t)value;
+            }
+
+            if (names && line[0] != 0 && !add_image_name(&names->entries, &names->entries_size, line)) {
+                return false;
+            }
+        } else if (section == EXTERNALS && line[0] != 0) {
+            /* external: name_of_the_external address_of_the_word */
+            if (!names || !add_image_name(&names->externals, &names->externals_size, line)) {
+                return false;
+            }
+        }
+
+        line = end ? end + 1 : line + strlen(line);
+    }
+
+    return image->size > 0;
+}
+
+/*!
+ * \brief loads an object (.oc) or a binary (.bin) file into an image of the memory
+ *
+ * \note a binary file has no entries and no boundary between the code and the
+ * data, it starts at address 0 and every word is decoded as code
+ *
+ * \param path	path of the file
+ * \param image	loaded image
+ * \return		success
+ */
+bool read_image(const char * path, image_t * image) {
+    return read_image_names(path, image, NULL);
+}
+
+/*!
+ * \brief loads an image with the names of its entries and externals
+ *
+ * \note the names must be released with image_names_free(), also on failure
+ *
+ * \param path	path of the file
+ * \param image	loaded image
+ * \param names	set to the entries and the externals, the externals are not allowed if NULL
+ * \return		success
+ */
+bool read_image_names(const char * path, image_t * image, image_names_t * names) {
+    size_t len = strlen(path);
+    bool ok;
+
+    memset(image, 0, sizeof(image_t));
+
+    if (names) {
+        memset(names, 0, sizeof(image_names_t));
+    }
+
+    if (len > 4 && strcmp(path + len - 4, ".bin") == 0) {
+        FILE * fp = fopen(path, "rb"); /* read binary */
+
+        if (!fp) {
+            return false;
+        }
+
+        image->size = (uint16_t)fread(image->words, sizeof(uint16_t), TABLE_SIZE, fp);
+        image->code_size = image->size;
+        ok = image->size > 0 && fgetc(fp) == EOF;
+        fclose(fp);
+
+        return ok;
+    } else {
+        char * text = read_file(path, &len);
+
+        if (!text) {
+            return false;
+        }
+
+        ok = load_object_code(text, image, names);
+        free(text);
+
+        return ok;
+    }
+}
+
+/*!
+ * \brief releases the names of an image
+ *
+ * \param names	names
+ */
+void image_names_free(image_names_t * names) {
+    uint16_t i;
+
+    for (i = 0; i < names->entries_size; i++) {
+        free(names->entries[i].name);
+    }
+
+    for (i = 0; i < names->externals_size; i++) {
+        free(names->externals[i].name);
+    }
+
+    free(names->entries);
+    free(names->externals);
+    memset(names, 0, sizeof(image_names_t));
+}
@@ -25,6 +25,8 @@
 extern object_code_t g_object_code[TABLE_SIZE];
 extern uint16_t g_object_code_size;
 
+extern uint32_t g_line_table[TABLE_SIZE];
+
 extern uint16_t g_data_image[TABLE_SIZE];
 extern uint16_t g_data_image_size;
 
@@ -102,52 +104,81 @@ static int errors; /* number of errors though first pass  */
         g_link_table[g_link_table_size++] = (o); \
     }
 
+/*!
+ * \brief process a line of the source during the first pass
+ *
+ * \param line			line of the source
+ * \param column_index	starting column index
+ */
+static void first_process_source_line(source_line_t * line, int column_index) {
+    uint16_t data_address = g_data_image_size;
+    uint16_t i;
+
+    line_number = line->number;
+    line->address = g_object_code_size;
+
+    if (line->length > 80) {
+        WARN("line is longer than 80 characters");
+    }
+
+    if (!line->clean) {
+        ERROR("unable to clean the line: %s", line->raw);
+    } else {
+        if (strlen(line->clean) == 0) {
+            /* empty line  */
+        } else if (line->clean[0] == ';') {
+            /* comment */
+        } else {
+            first_process_line(line->clean, column_index);
+        }
+    }
+
+    line->size = g_object_code_size - line->address;
+    line->data_size = g_data_image_size - data_address;
+
+    /* the line table maps the words back to the source, the included lines are not in it */
+    for (i = line->address; i < g_object_code_size; i++) {
+        g_line_table[i] = line->file ? 0 : line->number;
+    }
+}
+
 /*!
  * \brief main function of the first pass
  * 
- * \param file_name		path of the source file
+ * \param source		lines of the source
  * \return				number of errors during first pass
  */
-uint16_t first_pass(const char * file_name) {
-    FILE * fp;
-    char line[256];
+uint16_t first_pass(source_t * source) {
+    uint32_t i;
 
     /* initialise the variables */
-    file_base_name = get_file_base_name(file_name);
+    file_base_name = source->name;
     line_number = 1;
     errors = 0;
 
-    fp = fopen(file_name, "r");
-    if (fp == NULL) {
-        ERROR("unable to open '%s'", file_name);
-        return 1;
+    for (i = 0; i < source->count && !diagnostics_stopped(); i++) {
+        file_base_name = source->lines[i].file ? (char *)source->lines[i].file : source->name;
+        first_process_source_line(&source->lines[i], 0);
     }
 
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        if (strlen(line) > 80) {
-            WARN("line is longer than 80 characters");
-        }
-        /* remove whitespaces, tabs, spaces after commas and comments */
-        char * clean = clean_line(line);
-
-        if (!clean) {
-            ERROR("unable to clean the line: %s", line);
-        } else {
-            if (strlen(clean) == 0) {
-                /* empty line  */
-            } else if (clean[0] == ';') {
-                /* comment */
-            } else {
-                first_process_line(clean, 0);
-            }
-        }
-
-        free(clean);
+    return errors;
+}
 
-        line_number++;
-    }
+/*!
+ * \brief processes a single line again, at the current end of the object code
+ *
+ * \note used by the incremental assembling, the caller positions the object code
+ *
+ * \param source		lines of the source
+ * \param index			index of the line
+ * \param column_index	starting column index (1 skips the label)
+ * \return				number of errors
+ */
+uint16_t first_pass_line(source_t * source, uint32_t index, int column_index) {
+    file_base_name = source->lines[index].file ? (char *)source->lines[index].file : source->name;
+    errors = 0;
 
-    fclose(fp);
+    first_process_source_line(&source->lines[index], column_index);
 
     return errors;
 }
@@ -176,6 +207,11 @@ void first_process_line(char * line, int column_index) {
         first_process_extern(line, column_index + 1);
         break;
 
+    case DIRECTIVE_EQU:
+    case DIRECTIVE_SET:
+        first_process_constant(line, column_index + 1, col == DIRECTIVE_SET);
+        break;
+
     case DIRECTIVE_NUMBER:
         first_process_numbers(line, column_index + 1);
         break;
@@ -207,7 +243,7 @@ void first_process_label(char * line) {
 
     label[len - 1] = '\0'; /* remove ':' */
     symbol_t sym;
-    sym.name = (char *)malloc(strlen(label));
+    sym.name = (char *)malloc(strlen(label) + 1);
 
     if (!sym.name) {
         ERROR("unable to allocate memory for symbol '%s'", label);
@@ -225,8 +261,9 @@ void first_process_label(char * line) {
             sym.type = 'a'; /* absolute */
 
             /* add symbol, if it not defined earlier */
-            if (count_table_objects_name(label, g_symbol_table, g_symbol_table_size) > 0) {
+            if (count_table_objects_name(label, g_symbol_table, g_symbol_table_size) > 0 || is_constant(label)) {
                 ERROR("symbol is already defined: %s", label);
+                free(sym.name);
             } else {
                 ADD_SYM(sym);
             }
@@ -237,6 +274,14 @@ void first_process_label(char * line) {
         case DIRECTIVE_ENTRY:
         case DIRECTIVE_EXTERN:
             WARN("label in front of a compiler directive: %s", line);
+            free(sym.name);
+            break;
+
+        case DIRECTIVE_EQU:
+        case DIRECTIVE_SET:
+            WARN("label in front of a compiler directive: %s", line);
+            free(sym.name);
+            first_process_line(line, 1); /* the label is ignored */
             break;
 
         case DIRECTIVE_NUMBER:
@@ -245,8 +290,9 @@ void first_process_label(char * line) {
             sym.type = 'r'; /* relocatable */
 
             /* add symbol, if it not defined earlier */
-            if (count_table_objects_name(label, g_symbol_table, g_symbol_table_size) > 0) {
+            if (count_table_objects_name(label, g_symbol_table, g_symbol_table_size) > 0 || is_constant(label)) {
                 ERROR("symbol is already defined: %s", label);
+                free(sym.name);
             } else {
                 ADD_SYM(sym);
             }
@@ -255,7 +301,8 @@ void first_process_label(char * line) {
             break;
 
         default:
-            ERROR("unknown label type: %s", col2_str);
+            ERROR("unknown label type: %s", col2_str ? col2_str : line); /* a label alone has no type */
+            free(sym.name);
             break;
         }
 
@@ -338,6 +385,41 @@ void first_process_extern(char * line, int column_index) {
     free(label);
 }
 
+/*!
+ * \brief process an .equ or a .set object during the first pass
+ * 
+ * \note column_index must be point the column containing the name
+ * 
+ * \param line			line containing the constant
+ * \param column_index	column containing the name of the constant, the value follows it
+ * \param redefinable	.set, the constant can be defined again
+ */
+void first_process_constant(char * line, int column_index, bool redefinable) {
+    char * name = string_split(line, " ", column_index);
+    char * value = string_split(line, " ", column_index + 1);
+    char * rest = string_split(line, " ", column_index + 2);
+
+    if (!name || !value || rest) {
+        ERROR("expected NAME VALUE, without whitespace in the value: %s", line);
+    } else if (is_valid_label_name(name, 0, 0) == false || get_operation(name)) {
+        ERROR("invalid NAME: %s", name); /* a register or an operation */
+    } else if (is_valid_numeric_literal(value, 0) == false && is_valid_expression(value, 0) == false) {
+        ERROR("invalid expression: '%s'", value);
+    } else if (count_table_objects_name(name, g_symbol_table, g_symbol_table_size) > 0) {
+        ERROR("symbol is already defined: %s", name);
+    } else {
+        constant_status_t status = constant_define(name, value, redefinable);
+
+        if (status != CONSTANT_OK) {
+            ERROR("%s: %s", constant_message(status), name);
+        }
+    }
+
+    free(name);
+    free(value);
+    free(rest);
+}
+
 /*!
  * \brief process a .data object during the first pass
  * 
@@ -359,14 +441,23 @@ void first_process_numbers(char * line, int column_index) {
         string_split(list, ",", i); /* get the first number from the list */
     /* while there is numbers */
     while (number) {
-        /* check if number is valid */
-        if (is_valid_numeric_literal(number, 0) == false) {
+        uint16_t val = 0;
+        number_status_t status = parse_number(number, 0, &val); /* validate and get the value */
+
+        if (status == NUMBER_RANGE) {
+            ERROR("number out of range: '%s'", number);
+        } else if (status == NUMBER_SYNTAX && is_valid_expression(number, 0) == true) {
+            constant_status_t constant = constant_evaluate(number, false, &val, NULL); /* the labels are not known yet */
+
+            if (constant != CONSTANT_OK) {
+                ERROR("%s: '%s'", constant_message(constant), number);
+            }
+        } else if (status == NUMBER_SYNTAX) {
             ERROR("not a valid numeric literal: '%s'", number);
-            return;
+            free(number);
+            break;
         }
 
-        uint16_t val = get_number(number, 0); /* get the value */
-
         ADD_DATA(val); /* add the value to the data image */
 
         free(number);
@@ -387,6 +478,11 @@ void first_process_string(char * line, int column_index) {
     char * string = string_split(line, " ", column_index);
     uint32_t i = 1;
 
+    if (!string) {
+        ERROR("expected a string, got: %s", line);
+        return;
+    }
+
     /* check if the parameter is a valid string literal */
     if (string[0] != '"') {
         ERROR("not a valid string literal: '%s'", string);
@@ -476,7 +572,6 @@ void first_process_operation(char * line, int column_index) {
                     /* check if 2nd addressing is valid for this operation */
                     if (is_valid_addressing(op, dest_mode, 1) == false) {
                         ERROR("wrong destination addressing mode '%s", operand2);
-                        return;
                     } else {
                         uint16_t inst = first_create_instruction(op, operand1, operand2); /* create instruction from operation */
 
@@ -0,0 +1,103 @@
+/*!
+ * \file include.c
+ * \brief cache of the included files (.include)
+ *
+ * An included file is read and split into cleaned lines once per process. The
+ * lines are kept with the modification time and the size of the file, and are
+ * reused until the file changes, so the watch mode and the sources including
+ * the same file do not read and clean it again.
+ */
+
+#include "asm.h"
+
+#include <sys/stat.h> /* for stat() */
+
+/*!
+ * \brief included file in the cache
+ */
+typedef struct include_file_s {
+    char * path; /*!< \brief path of the file */
+    source_t source; /*!< \brief cleaned lines, the name is the path */
+    time_t mtime; /*!< \brief modification time when read */
+    off_t size; /*!< \brief size when read */
+    struct include_file_s * next; /*!< \brief next file in the cache */
+} include_file_t;
+
+static include_file_t * s_files = NULL; /*!< \brief included files */
+
+/*!
+ * \brief gets the cleaned lines of an included file, reading it if it is not cached or changed
+ *
+ * \note the lines belong to the cache, they are valid until the file is loaded again
+ *
+ * \param path	path of the file
+ * \return		lines, NULL if the file can not be read
+ */
+source_t * include_load(const char * path) {
+    include_file_t * f;
+    struct stat st;
+    size_t len;
+    char * src;
+
+    if (stat(path, &st) != 0) {
+        return NULL;
+    }
+
+    for (f = s_files; f; f = f->next) {
+        if (strcmp(f->path, path) == 0) {
+            break;
+        }
+    }
+
+    if (f && f->mtime == st.st_mtime && f->size == st.st_size) {
+        return &f->source;
+    }
+
+    src = read_file(path, &len);
+    if (!src) {
+        return NULL;
+    }
+
+    if (!f) {
+        f = (include_file_t *)calloc(1, sizeof(include_file_t));
+        if (!f || !(f->path = strdup(path))) {
+            free(f);
+            free(src);
+            return NULL;
+        }
+
+        f->next = s_files;
+        s_files = f;
+    } else {
+        source_free(&f->source);
+    }
+
+    f->mtime = st.st_mtime;
+    f->size = st.st_size;
+
+    if (!source_load(&f->source, path, src, len)) {
+        source_free(&f->source);
+        f->mtime = 0;
+        f->size = -1; /* read again next time */
+        free(src);
+        return NULL;
+    }
+
+    free(src);
+
+    return &f->source;
+}
+
+/*!
+ * \brief releases the included files
+ */
+void include_cache_free(void) {
+    while (s_files) {
+        include_file_t * f = s_files;
+
+        s_files = f->next;
+        source_free(&f->source);
+        free(f->path);
+        free(f);
+    }
+}
@@ -0,0 +1,965 @@
+/*!
+ * \file jit.c
+ * \brief x86-64 translation of the simulated program
+ *
+ * Basic blocks are translated into native code in an executable buffer, the
+ * registers, the PSW and the memory stay in the machine_t. The buffer is never
+ * writable and executable at once: it is made writable for the translation
+ * of a block and the patching of the jumps to it, then executable again. A block ends at a
+ * jump, rts, hlt or an instruction that can't be translated; a jump to a
+ * known address is chained directly to the translated target, once the
+ * target is translated. Every block checks the step limit first, near the
+ * limit the interpreter finishes the run, so the number of executed
+ * instructions is exact.
+ *
+ * A write into the translated code ends the block and the rest of the run
+ * continues in the interpreter. Faults leave the machine in the same state as
+ * the interpreter does.
+ */
+
+#include "asm.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <stddef.h> /* for offsetof() */
+#include <sys/mman.h> /* for mmap(), mprotect() */
+
+/*!
+ * \brief size of the executable buffer
+ */
+#define JIT_BUFFER_SIZE (4 * 1024 * 1024)
+
+/*!
+ * \brief maximum number of instructions in a block
+ */
+#define JIT_BLOCK_LENGTH 64
+
+/*!
+ * \brief upper bound of the native code of a block, the buffer is flushed if less is left
+ */
+#define JIT_BLOCK_BYTES (64 * 1024)
+
+/*!
+ * \brief maximum number of exits in a block
+ */
+#define JIT_BLOCK_STUBS (JIT_BLOCK_LENGTH * 6)
+
+/* exit reasons besides sim_status_t */
+#define JIT_CONTINUE 100 /*!< \brief continue at the returned address */
+#define JIT_LIMIT 101 /*!< \brief the block would exceed the step limit */
+#define JIT_SMC 102 /*!< \brief the code was overwritten */
+
+/* registers of the x86-64 */
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RSI 6
+#define RDI 7
+
+/* condition codes of the x86-64 */
+#define CC_B 0x2
+#define CC_AE 0x3
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_BE 0x6
+#define CC_A 0x7
+
+/* offsets in machine_t, rbx holds the machine */
+#define OFF_MEMORY(address) ((int32_t)(offsetof(machine_t, memory) + (address) * 2))
+#define OFF_R(reg) ((int32_t)(offsetof(machine_t, r) + (reg) * 2))
+#define OFF_PSW ((int32_t)offsetof(machine_t, psw))
+#define OFF_SP ((int32_t)offsetof(machine_t, sp))
+#define OFF_STEPS ((int32_t)offsetof(machine_t, steps))
+#define OFF_CODE_END ((int32_t)offsetof(machine_t, code_end))
+#define OFF_OUT ((int32_t)offsetof(machine_t, out))
+
+/*!
+ * \brief exit of a block to the dispatcher
+ */
+typedef struct jit_stub_s {
+    uint32_t site; /*!< \brief offset of the rel32 that jumps to the exit */
+    uint16_t pc; /*!< \brief address to continue at, unless dynamic */
+    uint8_t status; /*!< \brief exit reason */
+    uint8_t adjust; /*!< \brief number of counted, but not executed instructions */
+    bool dynamic; /*!< \brief the address is in eax */
+} jit_stub_t;
+
+/*!
+ * \brief jump to a block that is not translated yet
+ */
+typedef struct jit_patch_s {
+    uint32_t site; /*!< \brief offset of the rel32 */
+    int32_t next; /*!< \brief next patch of the same target, -1 at the end */
+} jit_patch_t;
+
+/*!
+ * \brief state of the translation
+ */
+typedef struct jit_s {
+    uint8_t * code; /*!< \brief executable buffer */
+    uint32_t used; /*!< \brief used bytes of the buffer */
+    uint32_t exit; /*!< \brief offset of the common exit */
+    uint32_t start; /*!< \brief offset of the first block */
+    int32_t blocks[TABLE_SIZE]; /*!< \brief offset of the block by address, -1 if not translated */
+    int32_t pending[TABLE_SIZE]; /*!< \brief first patch waiting for the block by address, -1 if none */
+    jit_patch_t * patches; /*!< \brief patches */
+    uint32_t patches_size; /*!< \brief number of patches */
+    uint32_t patches_capacity; /*!< \brief allocated patches */
+    jit_stub_t stubs[JIT_BLOCK_STUBS]; /*!< \brief exits of the block being translated */
+    uint32_t stubs_size; /*!< \brief number of exits */
+} jit_t;
+
+/*!
+ * \brief enters the translated code
+ *
+ * \return status in the upper 32 bits, address in the lower 32 bits
+ */
+typedef uint64_t (*jit_entry_t)(machine_t * m, uint64_t max_steps, uint8_t * block);
+
+/*!
+ * \brief emits a byte
+ *
+ * \param j		translation
+ * \param byte	byte
+ */
+static void emit8(jit_t * j, uint8_t byte) {
+    j->code[j->used++] = byte;
+}
+
+/*!
+ * \brief emits a 16-bit value
+ *
+ * \param j		translation
+ * \param value	value
+ */
+static void emit16(jit_t * j, uint16_t value) {
+    emit8(j, (uint8_t)value);
+    emit8(j, (uint8_t)(value >> 8));
+}
+
+/*!
+ * \brief emits a 32-bit value
+ *
+ * \param j		translation
+ * \param value	value
+ */
+static void emit32(jit_t * j, uint32_t value) {
+    emit16(j, (uint16_t)value);
+    emit16(j, (uint16_t)(value >> 16));
+}
+
+/*!
+ * \brief emits bytes
+ *
+ * \param j		translation
+ * \param bytes	bytes
+ * \param size	number of bytes
+ */
+static void emit(jit_t * j, const char * bytes, uint32_t size) {
+    memcpy(j->code + j->used, bytes, size);
+    j->used += size;
+}
+
+/*!
+ * \brief emits a [rbx + disp32] operand
+ *
+ * \param j		translation
+ * \param reg	register field
+ * \param disp	displacement
+ */
+static void emit_rbx(jit_t * j, uint8_t reg, int32_t disp) {
+    emit8(j, (uint8_t)(0x80 | (reg << 3) | 3));
+    emit32(j, (uint32_t)disp);
+}
+
+/*!
+ * \brief emits a [rbx + index * 2 + disp32] operand
+ *
+ * \param j		translation
+ * \param reg	register field
+ * \param index	index register
+ * \param disp	displacement
+ */
+static void emit_rbx_index(jit_t * j, uint8_t reg, uint8_t index, int32_t disp) {
+    emit8(j, (uint8_t)(0x84 | (reg << 3)));
+    emit8(j, (uint8_t)(0x40 | (index << 3) | 3));
+    emit32(j, (uint32_t)disp);
+}
+
+/*!
+ * \brief emits movzx reg, word [rbx + disp32]
+ */
+static void emit_load(jit_t * j, uint8_t reg, int32_t disp) {
+    emit(j, "\x0F\xB7", 2);
+    emit_rbx(j, reg, disp);
+}
+
+/*!
+ * \brief emits mov word [rbx + disp32], reg
+ */
+static void emit_store(jit_t * j, uint8_t reg, int32_t disp) {
+    emit(j, "\x66\x89", 2);
+    emit_rbx(j, reg, disp);
+}
+
+/*!
+ * \brief emits mov reg, imm32
+ */
+static void emit_mov_imm(jit_t * j, uint8_t reg, uint32_t imm) {
+    emit8(j, (uint8_t)(0xB8 + reg));
+    emit32(j, imm);
+}
+
+/*!
+ * \brief emits a jump (jmp or jcc) with an unresolved rel32
+ *
+ * \param j		translation
+ * \param cc	condition code, -1 for jmp
+ * \return		offset of the rel32
+ */
+static uint32_t emit_jump(jit_t * j, int cc) {
+    if (cc < 0) {
+        emit8(j, 0xE9);
+    } else {
+        emit8(j, 0x0F);
+        emit8(j, (uint8_t)(0x80 | cc));
+    }
+
+    emit32(j, 0);
+
+    return j->used - 4;
+}
+
+/*!
+ * \brief resolves the rel32 of a jump
+ *
+ * \param j			translation
+ * \param site		offset of the rel32
+ * \param target	offset of the target
+ */
+static void patch(jit_t * j, uint32_t site, uint32_t target) {
+    int32_t rel = (int32_t)target - (int32_t)(site + 4);
+
+    memcpy(j->code + site, &rel, 4);
+}
+
+/*!
+ * \brief adds an exit of the block
+ *
+ * \param j			translation
+ * \param site		offset of the rel32 that jumps to the exit
+ * \param pc		address to continue at
+ * \param status	exit reason
+ * \param adjust	number of counted, but not executed instructions
+ * \param dynamic	the address is in eax
+ */
+static void add_stub(jit_t * j, uint32_t site, uint16_t pc, uint8_t status, uint8_t adjust, bool dynamic) {
+    jit_stub_t * stub = &j->stubs[j->stubs_size++];
+
+    stub->site = site;
+    stub->pc = pc;
+    stub->status = status;
+    stub->adjust = adjust;
+    stub->dynamic = dynamic;
+}
+
+/*!
+ * \brief emits the exits of the block
+ *
+ * \param j		translation
+ */
+static void emit_stubs(jit_t * j) {
+    uint32_t i;
+
+    for (i = 0; i < j->stubs_size; i++) {
+        jit_stub_t * stub = &j->stubs[i];
+
+        patch(j, stub->site, j->used);
+
+        if (stub->adjust) {
+            emit(j, "\x48\x81", 2); /* sub qword [rbx + steps], adjust */
+            emit_rbx(j, 5, OFF_STEPS);
+            emit32(j, stub->adjust);
+        }
+
+        if (!stub->dynamic) {
+            emit_mov_imm(j, RAX, stub->pc);
+        }
+
+        emit_mov_imm(j, RDX, stub->status);
+        patch(j, emit_jump(j, -1), j->exit);
+    }
+
+    j->stubs_size = 0;
+}
+
+/*!
+ * \brief emits a jump to the block of an address, or to an exit until it is translated
+ *
+ * \param j			translation
+ * \param site		offset of the rel32 of the jump
+ * \param target	address
+ */
+static void chain(jit_t * j, uint32_t site, uint16_t target) {
+    if (target < TABLE_SIZE && j->blocks[target] >= 0) {
+        patch(j, site, (uint32_t)j->blocks[target]);
+        return;
+    }
+
+    add_stub(j, site, target, JIT_CONTINUE, 0, false);
+
+    if (target < TABLE_SIZE) {
+        if (j->patches_size == j->patches_capacity) {
+            uint32_t capacity = j->patches_capacity ? j->patches_capacity * 2 : 1024;
+            jit_patch_t * grown = (jit_patch_t *)realloc(j->patches, capacity * sizeof(jit_patch_t));
+
+            if (!grown) {
+                return; /* stays an exit */
+            }
+
+            j->patches = grown;
+            j->patches_capacity = capacity;
+        }
+
+        j->patches[j->patches_size].site = site;
+        j->patches[j->patches_size].next = j->pending[target];
+        j->pending[target] = (int32_t)j->patches_size++;
+    }
+}
+
+/*!
+ * \brief emits the code that locates an operand, a pointer to it goes into rsi or rdi
+ *
+ * \param j		translation
+ * \param d		decoded instruction
+ * \param dest	destination operand
+ * \param stub	exit of an address fault: pc and adjust
+ */
+static void emit_locate(jit_t * j, decoded_t * d, bool dest, jit_stub_t * stub) {
+    uint8_t mode = dest ? d->dest_mode : d->src_mode;
+    uint8_t reg = dest ? d->dest_reg : d->src_reg;
+    uint16_t word = dest ? d->dest_word : d->src_word;
+    uint8_t ptr = dest ? RDI : RSI;
+
+    switch (mode) {
+    case INSTANT:
+        return; /* the value is known */
+
+    case DIRECT:
+        emit8(j, 0x48);
+        emit8(j, 0x8D); /* lea ptr, [rbx + memory + word * 2] */
+        emit_rbx(j, ptr, OFF_MEMORY(word));
+        return;
+
+    case DIRECT_REGISTER:
+        emit8(j, 0x48);
+        emit8(j, 0x8D); /* lea ptr, [rbx + r + reg * 2] */
+        emit_rbx(j, ptr, OFF_R(reg));
+        return;
+
+    case INDIRECT:
+        emit_load(j, RAX, OFF_MEMORY(word));
+        break;
+
+    default: /* INDIRECT_REGISTER */
+        emit_load(j, RAX, OFF_R(reg));
+        break;
+    }
+
+    emit8(j, 0x3D); /* cmp eax, TABLE_SIZE */
+    emit32(j, TABLE_SIZE);
+    add_stub(j, emit_jump(j, CC_AE), stub->pc, SIM_ADDRESS_FAULT, stub->adjust, false);
+
+    emit8(j, 0x48);
+    emit8(j, 0x8D); /* lea ptr, [rbx + rax * 2 + memory] */
+    emit_rbx_index(j, ptr, RAX, OFF_MEMORY(0));
+}
+
+/*!
+ * \brief emits the code that loads an operand, located by emit_locate()
+ *
+ * \param j		translation
+ * \param d		decoded instruction
+ * \param dest	destination operand
+ * \param reg	register of the value, zero extended
+ */
+static void emit_value(jit_t * j, decoded_t * d, bool dest, uint8_t reg) {
+    if ((dest ? d->dest_mode : d->src_mode) == INSTANT) {
+        emit_mov_imm(j, reg, dest ? d->dest_word : d->src_word);
+    } else {
+        emit(j, "\x0F\xB7", 2); /* movzx reg, word [ptr] */
+        emit8(j, (uint8_t)((reg << 3) | (dest ? RDI : RSI)));
+    }
+}
+
+/*!
+ * \brief emits the check of a write into the translated code
+ *
+ * \param j			translation
+ * \param mode		addressing mode of the written operand
+ * \param ptr		register of the pointer to the operand
+ * \param pc		address to continue at after the write
+ * \param adjust	number of counted, but not executed instructions
+ * \param dynamic	the address to continue at is in eax
+ */
+static void emit_smc_check(jit_t * j, uint8_t mode, uint8_t ptr, uint16_t pc, uint8_t adjust, bool dynamic) {
+    if (mode == DIRECT_REGISTER) {
+        return;
+    }
+
+    emit_load(j, RDX, OFF_CODE_END);
+    emit(j, "\x48\x8D", 2); /* lea rdx, [rbx + rdx * 2 + memory] */
+    emit_rbx_index(j, RDX, RDX, OFF_MEMORY(0));
+    emit8(j, 0x48);
+    emit8(j, 0x39); /* cmp ptr, rdx */
+    emit8(j, (uint8_t)(0xC0 | (RDX << 3) | ptr));
+    add_stub(j, emit_jump(j, CC_B), pc, JIT_SMC, adjust, dynamic);
+}
+
+/*!
+ * \brief emits the update of the zero flag from a 16-bit value
+ *
+ * \param j		translation
+ * \param reg	register of the value
+ */
+static void emit_psw_z(jit_t * j, uint8_t reg) {
+    emit(j, "\x66\x85", 2); /* test reg16, reg16 */
+    emit8(j, (uint8_t)(0xC0 | (reg << 3) | reg));
+    emit(j, "\x0F\x94\xC2", 3); /* sete dl */
+    emit(j, "\x0F\xB6\xD2", 3); /* movzx edx, dl */
+    emit_load(j, RAX, OFF_PSW);
+    emit(j, "\x83\xE0", 2); /* and eax, ~PSW_Z */
+    emit8(j, (uint8_t)~PSW_Z);
+    emit(j, "\x8D\x04\x50", 3); /* lea eax, [rax + rdx * 2] */
+    emit_store(j, RAX, OFF_PSW);
+}
+
+/*!
+ * \brief emits the update of the zero and the carry flag from the 32-bit value in eax
+ *
+ * \param j		translation
+ */
+static void emit_psw_zc(jit_t * j) {
+    emit8(j, 0x3D); /* cmp eax, 0xFFFF */
+    emit32(j, 0xFFFF);
+    emit(j, "\x0F\x97\xC2", 3); /* seta dl */
+    emit(j, "\x66\x85\xC0", 3); /* test ax, ax */
+    emit(j, "\x0F\x94\xC1", 3); /* sete cl */
+    emit(j, "\x0F\xB6\xD2", 3); /* movzx edx, dl */
+    emit(j, "\x0F\xB6\xC9", 3); /* movzx ecx, cl */
+    emit(j, "\x8D\x14\x4A", 3); /* lea edx, [rdx + rcx * 2] */
+    emit_store(j, RDX, OFF_PSW);
+}
+
+/*!
+ * \brief checks if an instruction can be translated
+ *
+ * The instructions that can't be translated always fault (or don't touch
+ * the memory), they are run by the interpreter.
+ *
+ * \param d		decoded instruction
+ * \return		can be translated
+ */
+static bool translatable(decoded_t * d) {
+    bool jump = d->op == SIM_JNZ || d->op == SIM_JNC || d->op == SIM_JSR;
+
+    if (d->op >= SIM_INC_REG) {
+        return false; /* superinstructions are not decoded for the JIT */
+    }
+
+    if (d->op != SIM_LEA && d->src_mode <= INDIRECT && d->src_mode != INSTANT && d->src_word >= TABLE_SIZE) {
+        return false;
+    }
+
+    if (d->dest_mode == INDIRECT || (d->dest_mode == DIRECT && !jump)) {
+        return d->dest_word < TABLE_SIZE;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief emits the code of a jump, the last instruction of a block
+ *
+ * \param j		translation
+ * \param d		decoded instruction
+ * \param next	address of the next instruction
+ * \param fault	exit of a fault: pc and adjust
+ */
+static void emit_jump_instruction(jit_t * j, decoded_t * d, uint16_t next, jit_stub_t * fault) {
+    bool dynamic = d->dest_mode != DIRECT;
+
+    if (d->op != SIM_JSR) {
+        emit(j, "\x66\xF7", 2); /* test word [rbx + psw], flag */
+        emit_rbx(j, 0, OFF_PSW);
+        emit16(j, d->op == SIM_JNZ ? PSW_Z : PSW_C);
+        chain(j, emit_jump(j, CC_NE), next);
+    }
+
+    /* target into eax */
+    if (d->dest_mode == INDIRECT) {
+        emit_load(j, RAX, OFF_MEMORY(d->dest_word));
+    } else if (d->dest_mode == INDIRECT_REGISTER) {
+        emit_load(j, RAX, OFF_R(d->dest_reg));
+    }
+
+    if (d->op == SIM_JSR) {
+        emit_load(j, RDX, OFF_SP);
+        emit(j, "\x81\xFA", 2); /* cmp edx, SIM_STACK_TOP - SIM_STACK_SIZE */
+        emit32(j, SIM_STACK_TOP - SIM_STACK_SIZE);
+        add_stub(j, emit_jump(j, CC_BE), fault->pc, SIM_STACK_OVERFLOW, fault->adjust, false);
+
+        emit(j, "\x48\x8D", 2); /* lea rdi, [rbx + rdx * 2 + memory] */
+        emit_rbx_index(j, RDI, RDX, OFF_MEMORY(0));
+        emit(j, "\x66\xC7\x07", 3); /* mov word [rdi], next */
+        emit16(j, next);
+        emit(j, "\x66\xFF", 2); /* dec word [rbx + sp] */
+        emit_rbx(j, 1, OFF_SP);
+        emit_smc_check(j, INDIRECT, RDI, d->dest_word, fault->adjust - 1, dynamic);
+    }
+
+    if (dynamic) {
+        add_stub(j, emit_jump(j, -1), 0, JIT_CONTINUE, 0, true);
+    } else {
+        chain(j, emit_jump(j, -1), d->dest_word);
+    }
+}
+
+/*!
+ * \brief emits the code of an instruction
+ *
+ * \param m			machine
+ * \param j			translation
+ * \param address	address of the instruction
+ * \param adjust	number of instructions of the block from this one
+ * \return			the instruction ends the block
+ */
+static bool emit_instruction(machine_t * m, jit_t * j, uint16_t address, uint8_t adjust) {
+    decoded_t * d = &m->cache[address];
+    uint16_t next = (uint16_t)(address + d->size);
+    jit_stub_t fault;
+
+    fault.pc = address;
+    fault.adjust = adjust;
+
+    switch (d->op) {
+    case SIM_MOV:
+    case SIM_CMP:
+    case SIM_ADD:
+    case SIM_SUB:
+    case SIM_MUL:
+    case SIM_DIV:
+    case SIM_SHL:
+        emit_locate(j, d, false, &fault);
+        emit_locate(j, d, true, &fault);
+        break;
+
+    case SIM_LEA:
+    case SIM_INC:
+    case SIM_DEC:
+    case SIM_PRN:
+        emit_locate(j, d, true, &fault);
+        break;
+
+    default:
+        break;
+    }
+
+    switch (d->op) {
+    case SIM_MOV:
+        emit_value(j, d, false, RCX);
+        emit(j, "\x66\x89\x0F", 3); /* mov word [rdi], cx */
+        emit_smc_check(j, d->dest_mode, RDI, next, adjust - 1, false);
+        return false;
+
+    case SIM_CMP:
+        emit_value(j, d, false, RCX);
+        emit_value(j, d, true, RAX);
+        emit(j, "\x29\xC1", 2); /* sub ecx, eax */
+        emit_psw_z(j, RCX);
+        return false;
+
+    case SIM_ADD:
+    case SIM_SUB:
+    case SIM_MUL:
+        emit_value(j, d, false, RCX);
+        emit_value(j, d, true, RAX);
+        if (d->op == SIM_ADD) {
+            emit(j, "\x01\xC8", 2); /* add eax, ecx */
+        } else if (d->op == SIM_SUB) {
+            emit(j, "\x29\xC8", 2); /* sub eax, ecx */
+        } else {
+            emit(j, "\x0F\xAF\xC1", 3); /* imul eax, ecx */
+        }
+        emit(j, "\x66\x89\x07", 3); /* mov word [rdi], ax */
+        emit_psw_zc(j);
+        emit_smc_check(j, d->dest_mode, RDI, next, adjust - 1, false);
+        return false;
+
+    case SIM_DIV:
+        emit_value(j, d, false, RCX);
+        emit(j, "\x66\x85\xC9", 3); /* test cx, cx */
+        add_stub(j, emit_jump(j, CC_E), address, SIM_DIVISION_BY_ZERO, adjust, false);
+        emit(j, "\x0F\xBF\x07", 3); /* movsx eax, word [rdi] */
+        emit(j, "\x0F\xBF\xC9", 3); /* movsx ecx, cx */
+        emit(j, "\x99\xF7\xF9", 3); /* cdq, idiv ecx */
+        emit(j, "\x66\x89\x07", 3); /* mov word [rdi], ax */
+        emit_smc_check(j, d->dest_mode, RDI, next, adjust - 1, false);
+        return false;
+
+    case SIM_LEA:
+        emit(j, "\x66\xC7\x07", 3); /* mov word [rdi], src_word */
+        emit16(j, d->src_word);
+        emit_smc_check(j, d->dest_mode, RDI, next, adjust - 1, false);
+        return false;
+
+    case SIM_INC:
+    case SIM_DEC:
+        emit_value(j, d, true, RAX);
+        emit(j, d->op == SIM_INC ? "\xFF\xC0" : "\xFF\xC8", 2); /* inc eax, dec eax */
+        emit(j, "\x66\x89\x07", 3); /* mov word [rdi], ax */
+        emit_psw_z(j, RAX);
+        emit_smc_check(j, d->dest_mode, RDI, next, adjust - 1, false);
+        return false;
+
+    case SIM_SHL:
+        emit_value(j, d, true, RCX);
+        emit(j, "\x0F\xB7\x06", 3); /* movzx eax, word [rsi] */
+        emit(j, "\x83\xF9\x20", 3); /* cmp ecx, 32 */
+        emit(j, "\x72\x04", 2); /* jb shift */
+        emit(j, "\x31\xC0\xEB\x02", 4); /* xor eax, eax; jmp done */
+        emit(j, "\xD3\xE0", 2); /* shift: shl eax, cl */
+        emit(j, "\x66\x89\x06", 3); /* done: mov word [rsi], ax */
+        emit8(j, 0x25); /* and eax, 0x1FFFF */
+        emit32(j, 0x1FFFF);
+        emit_psw_zc(j);
+        emit_smc_check(j, d->src_mode, RSI, next, adjust - 1, false);
+        return false;
+
+    case SIM_PRN:
+        if (d->dest_mode == INSTANT) {
+            emit_mov_imm(j, RDI, d->dest_word & 0xFF);
+        } else {
+            emit(j, "\x0F\xB6\x3F", 3); /* movzx edi, byte [rdi] */
+        }
+        emit(j, "\x48\x8B", 2); /* mov rsi, [rbx + out] */
+        emit_rbx(j, RSI, OFF_OUT);
+        emit(j, "\x48\xB8", 2); /* mov rax, fputc */
+        {
+            uint64_t fn = (uint64_t)(uintptr_t)&fputc;
+
+            emit32(j, (uint32_t)fn);
+            emit32(j, (uint32_t)(fn >> 32));
+        }
+        emit(j, "\xFF\xD0", 2); /* call rax */
+        return false;
+
+    case SIM_JNZ:
+    case SIM_JNC:
+    case SIM_JSR:
+        emit_jump_instruction(j, d, next, &fault);
+        return true;
+
+    case SIM_RTS:
+        emit_load(j, RDX, OFF_SP);
+        emit(j, "\x81\xFA", 2); /* cmp edx, SIM_STACK_TOP */
+        emit32(j, SIM_STACK_TOP);
+        add_stub(j, emit_jump(j, CC_AE), address, SIM_STACK_UNDERFLOW, adjust, false);
+        emit(j, "\xFF\xC2", 2); /* inc edx */
+        emit_store(j, RDX, OFF_SP);
+        emit(j, "\x0F\xB7", 2); /* movzx eax, word [rbx + rdx * 2 + memory] */
+        emit_rbx_index(j, RAX, RDX, OFF_MEMORY(0));
+        add_stub(j, emit_jump(j, -1), 0, JIT_CONTINUE, 0, true);
+        return true;
+
+    default: /* hlt */
+        add_stub(j, emit_jump(j, -1), next, SIM_HALTED, 0, false);
+        return true;
+    }
+}
+
+/*!
+ * \brief drops every translation
+ *
+ * \param j		translation
+ */
+static void jit_flush(jit_t * j) {
+    j->used = j->start;
+    j->patches_size = 0;
+    j->stubs_size = 0;
+    memset(j->blocks, 0xFF, sizeof(j->blocks)); /* -1 */
+    memset(j->pending, 0xFF, sizeof(j->pending));
+}
+
+/*!
+ * \brief makes the buffer writable or executable
+ *
+ * \param j			translation
+ * \param writable	writable, else executable
+ * \return			success
+ */
+static bool jit_protect(jit_t * j, bool writable) {
+    return mprotect(j->code, JIT_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+}
+
+/*!
+ * \brief creates the executable buffer with the entry and the common exit
+ *
+ * \return translation or NULL
+ */
+static jit_t * jit_create(void) {
+    jit_t * j = (jit_t *)calloc(1, sizeof(jit_t));
+
+    if (!j) {
+        return NULL;
+    }
+
+    j->code = (uint8_t *)mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->code == MAP_FAILED) {
+        free(j);
+        return NULL;
+    }
+
+    /* entry: save the callee-saved registers, rbx = machine, r12 = max_steps, jump to the block */
+    emit(j, "\x53\x41\x54\x41\x55", 5); /* push rbx; push r12; push r13 (alignment) */
+    emit(j, "\x48\x89\xFB", 3); /* mov rbx, rdi */
+    emit(j, "\x49\x89\xF4", 3); /* mov r12, rsi */
+    emit(j, "\xFF\xE2", 2); /* jmp rdx */
+
+    /* common exit: eax = address, edx = status */
+    j->exit = j->used;
+    emit(j, "\x48\xC1\xE2\x20", 4); /* shl rdx, 32 */
+    emit(j, "\x48\x09\xD0", 3); /* or rax, rdx */
+    emit(j, "\x41\x5D\x41\x5C\x5B\xC3", 6); /* pop r13; pop r12; pop rbx; ret */
+
+    j->start = j->used;
+    jit_flush(j);
+
+    if (!jit_protect(j, false)) {
+        munmap(j->code, JIT_BUFFER_SIZE);
+        free(j);
+        return NULL;
+    }
+
+    return j;
+}
+
+/*!
+ * \brief translates the block that starts at an address
+ *
+ * \param m			machine
+ * \param j			translation
+ * \param address	address of the block
+ * \return			offset of the block, -1 if the first instruction can't be translated
+ */
+static int32_t jit_compile(machine_t * m, jit_t * j, uint16_t address) {
+    uint16_t addresses[JIT_BLOCK_LENGTH];
+    uint16_t a = address;
+    uint32_t n = 0, k;
+    uint32_t block;
+    int32_t p;
+
+    /* collect the instructions of the block */
+    while (n < JIT_BLOCK_LENGTH && a < TABLE_SIZE) {
+        decoded_t * d = &m->cache[a];
+
+        if ((d->size == 0 && !sim_decode(m, a)) || !translatable(d)) {
+            break;
+        }
+
+        addresses[n++] = a;
+        a = (uint16_t)(a + d->size);
+
+        if (d->op == SIM_JNZ || d->op == SIM_JNC || d->op == SIM_JSR ||
+            d->op == SIM_RTS || d->op == SIM_HLT) {
+            break;
+        }
+    }
+
+    if (n == 0 || !jit_protect(j, true)) {
+        return -1;
+    }
+
+    if (j->used + JIT_BLOCK_BYTES > JIT_BUFFER_SIZE) {
+        jit_flush(j);
+    }
+
+    block = j->used;
+
+    /* count the instructions, leave before the step limit */
+    emit(j, "\x48\x8B", 2); /* mov rax, [rbx + steps] */
+    emit_rbx(j, RAX, OFF_STEPS);
+    emit(j, "\x48\x83\xC0", 3); /* add rax, n */
+    emit8(j, (uint8_t)n);
+    emit(j, "\x4C\x39\xE0", 3); /* cmp rax, r12 */
+    add_stub(j, emit_jump(j, CC_A), address, JIT_LIMIT, 0, false);
+    emit(j, "\x48\x89", 2); /* mov [rbx + steps], rax */
+    emit_rbx(j, RAX, OFF_STEPS);
+
+    for (k = 0; k < n; k++) {
+        if (emit_instruction(m, j, addresses[k], (uint8_t)(n - k))) {
+            break;
+        }
+    }
+
+    /* the block was cut, continue after it */
+    if (k == n) {
+        chain(j, emit_jump(j, -1), a);
+    }
+
+    emit_stubs(j);
+
+    /* chain the jumps that were waiting for this block */
+    j->blocks[address] = (int32_t)block;
+    for (p = j->pending[address]; p >= 0; p = j->patches[p].next) {
+        patch(j, j->patches[p].site, block);
+    }
+    j->pending[address] = -1;
+
+    /* not executable, none of the blocks can run */
+    if (!jit_protect(j, false)) {
+        jit_flush(j);
+        return -1;
+    }
+
+    return (int32_t)block;
+}
+
+/*!
+ * \brief checks if the JIT can be used on this platform
+ *
+ * \return available
+ */
+bool jit_available(void) {
+    return true;
+}
+
+/*!
+ * \brief continues the run in the interpreter after the code was overwritten
+ *
+ * \param m			machine
+ * \param max_steps	maximum number of instructions
+ * \return			status
+ */
+static sim_status_t jit_fallback(machine_t * m, uint64_t max_steps) {
+    uint16_t i;
+
+    /* the written address is not known, decode everything again */
+    for (i = 0; i < TABLE_SIZE; i++) {
+        m->cache[i].size = 0;
+    }
+
+    return sim_interpret(m, max_steps);
+}
+
+/*!
+ * \brief runs the program with the translated code
+ *
+ * \param m			machine, loaded
+ * \param max_steps	maximum number of instructions, counted from the start of the program
+ * \return			status, the same as the interpreter's
+ */
+sim_status_t jit_run(machine_t * m, uint64_t max_steps) {
+    jit_t * j = (jit_t *)m->jit;
+
+    if (!j) {
+        j = jit_create();
+        if (!j) {
+            return sim_interpret(m, max_steps);
+        }
+        m->jit = j;
+    }
+
+    for (;;) {
+        jit_entry_t entry = (jit_entry_t)(void *)j->code;
+        int32_t block = -1;
+        uint64_t ret;
+        uint32_t status;
+
+        if (m->steps >= max_steps) {
+            return SIM_STEP_LIMIT;
+        }
+
+        if (m->pc < TABLE_SIZE) {
+            block = j->blocks[m->pc] >= 0 ? j->blocks[m->pc] : jit_compile(m, j, m->pc);
+        }
+
+        /* one instruction in the interpreter, these always fault or don't write */
+        if (block < 0) {
+            sim_status_t result = sim_interpret(m, m->steps + 1);
+
+            if (result != SIM_STEP_LIMIT) {
+                return result;
+            }
+            continue;
+        }
+
+        ret = entry(m, max_steps, j->code + block);
+        status = (uint32_t)(ret >> 32);
+        m->pc = (uint16_t)ret;
+
+        switch (status) {
+        case JIT_CONTINUE:
+            break;
+
+        case JIT_LIMIT:
+            return sim_interpret(m, max_steps);
+
+        case JIT_SMC:
+            return jit_fallback(m, max_steps);
+
+        default:
+            return (sim_status_t)status;
+        }
+    }
+}
+
+/*!
+ * \brief releases the translated code
+ *
+ * \param m		machine
+ */
+void jit_free(machine_t * m) {
+    jit_t * j = (jit_t *)m->jit;
+
+    if (j) {
+        munmap(j->code, JIT_BUFFER_SIZE);
+        free(j->patches);
+        free(j);
+        m->jit = NULL;
+    }
+}
+
+#else
+
+/*!
+ * \brief checks if the JIT can be used on this platform
+ *
+ * \return available
+ */
+bool jit_available(void) {
+    return false;
+}
+
+/*!
+ * \brief runs the program in the interpreter, there is no JIT on this platform
+ *
+ * \param m			machine, loaded
+ * \param max_steps	maximum number of instructions, counted from the start of the program
+ * \return			status
+ */
+sim_status_t jit_run(machine_t * m, uint64_t max_steps) {
+    return sim_interpret(m, max_steps);
+}
+
+/*!
+ * \brief releases the translated code, there is none on this platform
+ *
+ * \param m		machine
+ */
+void jit_free(machine_t * m) {
+    (void)m;
+}
+
+#endif
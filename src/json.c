@@ -0,0 +1,450 @@
+/*!
+ * \file json.c
+ * \brief minimal JSON reader, for the messages of the language server
+ *
+ * The text is parsed into a tree of values. The members of an object keep
+ * their order, they are found by a linear search, the messages are small.
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief maximum depth of the nested arrays and objects
+ */
+#define JSON_MAX_DEPTH 64
+
+/*!
+ * \brief state of the parser
+ */
+typedef struct json_parser_s {
+    const char * text; /*!< \brief text to parse */
+    size_t len; /*!< \brief length of the text */
+    size_t pos; /*!< \brief current position */
+} json_parser_t;
+
+static bool json_parse_value(json_parser_t * p, json_t * value, uint32_t depth);
+
+/*!
+ * \brief skips the white spaces
+ *
+ * \param p	parser
+ */
+static void json_skip(json_parser_t * p) {
+    while (p->pos < p->len && strchr(" \t\r\n", p->text[p->pos]) && p->text[p->pos]) {
+        p->pos++;
+    }
+}
+
+/*!
+ * \brief consumes a character if it is the next one
+ *
+ * \param p		parser
+ * \param ch	expected character
+ * \return		the character was consumed
+ */
+static bool json_accept(json_parser_t * p, char ch) {
+    json_skip(p);
+
+    if (p->pos < p->len && p->text[p->pos] == ch) {
+        p->pos++;
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief gets the value of a hexadecimal digit
+ *
+ * \param ch	digit
+ * \return		value, -1 if not a digit
+ */
+static int json_hex(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/*!
+ * \brief parses a string, the opening quote is the next character
+ *
+ * \note the escaped characters above 0x7f are written as UTF-8
+ *
+ * \param p	parser
+ * \return	string (must be free()-d), NULL on error
+ */
+static char * json_parse_string(json_parser_t * p) {
+    size_t start, len = 0;
+    char * str;
+
+    if (!json_accept(p, '"')) {
+        return NULL;
+    }
+
+    /* the unescaped string is never longer than the escaped one */
+    for (start = p->pos; p->pos < p->len && p->text[p->pos] != '"'; p->pos++) {
+        if (p->text[p->pos] == '\\') {
+            p->pos++;
+        }
+    }
+
+    if (p->pos >= p->len) {
+        return NULL;
+    }
+
+    str = (char *)malloc(p->pos - start + 1);
+    if (!str) {
+        return NULL;
+    }
+
+    p->pos = start;
+    while (p->text[p->pos] != '"') {
+        char ch = p->text[p->pos++];
+
+        if (ch != '\\') {
+            str[len++] = ch;
+            continue;
+        }
+
+        ch = p->text[p->pos++];
+        switch (ch) {
+        case 'b':
+            str[len++] = '\b';
+            break;
+        case 'f':
+            str[len++] = '\f';
+            break;
+        case 'n':
+            str[len++] = '\n';
+            break;
+        case 'r':
+            str[len++] = '\r';
+            break;
+        case 't':
+            str[len++] = '\t';
+            break;
+        case 'u': {
+            uint32_t code = 0;
+            int i;
+
+            for (i = 0; i < 4; i++) {
+                int digit = p->pos < p->len ? json_hex(p->text[p->pos]) : -1;
+
+                if (digit < 0) {
+                    free(str);
+                    return NULL;
+                }
+
+                code = code * 16 + (uint32_t)digit;
+                p->pos++;
+            }
+
+            /* 6 escaped characters are enough for 3 bytes of UTF-8 */
+            if (code < 0x80) {
+                str[len++] = (char)code;
+            } else if (code < 0x800) {
+                str[len++] = (char)(0xc0 | (code >> 6));
+                str[len++] = (char)(0x80 | (code & 0x3f));
+            } else {
+                str[len++] = (char)(0xe0 | (code >> 12));
+                str[len++] = (char)(0x80 | ((code >> 6) & 0x3f));
+                str[len++] = (char)(0x80 | (code & 0x3f));
+            }
+        } break;
+        default:
+            str[len++] = ch; /* '"', '\\' and '/' */
+            break;
+        }
+    }
+
+    p->pos++; /* closing quote */
+    str[len] = 0;
+
+    return str;
+}
+
+/*!
+ * \brief appends a new value to the children of an array or an object
+ *
+ * \param parent	array or object
+ * \return			new value, NULL if out of memory
+ */
+static json_t * json_add_child(json_t * parent) {
+    json_t * children = (json_t *)realloc(parent->children, (parent->count + 1) * sizeof(json_t));
+
+    if (!children) {
+        return NULL;
+    }
+
+    parent->children = children;
+    memset(&children[parent->count], 0, sizeof(json_t));
+
+    return &children[parent->count++];
+}
+
+/*!
+ * \brief parses the members of an object, the '{' has been consumed
+ *
+ * \param p		parser
+ * \param value	object
+ * \param depth	depth of the object
+ * \return		success
+ */
+static bool json_parse_object(json_parser_t * p, json_t * value, uint32_t depth) {
+    value->type = JSON_OBJECT;
+
+    if (json_accept(p, '}')) {
+        return true;
+    }
+
+    do {
+        json_t * member = json_add_child(value);
+        char * key;
+
+        if (!member) {
+            return false;
+        }
+
+        json_skip(p);
+        key = json_parse_string(p);
+        if (!key) {
+            return false;
+        }
+
+        member->key = key;
+        if (!json_accept(p, ':') || !json_parse_value(p, member, depth + 1)) {
+            return false;
+        }
+    } while (json_accept(p, ','));
+
+    return json_accept(p, '}');
+}
+
+/*!
+ * \brief parses the elements of an array, the '[' has been consumed
+ *
+ * \param p		parser
+ * \param value	array
+ * \param depth	depth of the array
+ * \return		success
+ */
+static bool json_parse_array(json_parser_t * p, json_t * value, uint32_t depth) {
+    value->type = JSON_ARRAY;
+
+    if (json_accept(p, ']')) {
+        return true;
+    }
+
+    do {
+        json_t * element = json_add_child(value);
+
+        if (!element || !json_parse_value(p, element, depth + 1)) {
+            return false;
+        }
+    } while (json_accept(p, ','));
+
+    return json_accept(p, ']');
+}
+
+/*!
+ * \brief checks if a keyword is the next text and consumes it
+ *
+ * \param p			parser
+ * \param keyword	keyword
+ * \return			the keyword was consumed
+ */
+static bool json_keyword(json_parser_t * p, const char * keyword) {
+    size_t len = strlen(keyword);
+
+    if (p->len - p->pos >= len && memcmp(p->text + p->pos, keyword, len) == 0) {
+        p->pos += len;
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief parses a value
+ *
+ * \param p		parser
+ * \param value	set to the value, its key is kept
+ * \param depth	depth of the value
+ * \return		success
+ */
+static bool json_parse_value(json_parser_t * p, json_t * value, uint32_t depth) {
+    char ch;
+
+    json_skip(p);
+    if (p->pos >= p->len || depth > JSON_MAX_DEPTH) {
+        return false;
+    }
+
+    ch = p->text[p->pos];
+
+    if (ch == '{') {
+        p->pos++;
+        return json_parse_object(p, value, depth);
+    }
+
+    if (ch == '[') {
+        p->pos++;
+        return json_parse_array(p, value, depth);
+    }
+
+    if (ch == '"') {
+        value->type = JSON_STRING;
+        value->string = json_parse_string(p);
+        return value->string != NULL;
+    }
+
+    if (ch == '-' || (ch >= '0' && ch <= '9')) {
+        char number[64];
+        size_t len = 0;
+
+        while (p->pos < p->len && len < sizeof(number) - 1 && strchr("+-.eE0123456789", p->text[p->pos]) &&
+               p->text[p->pos]) {
+            number[len++] = p->text[p->pos++];
+        }
+
+        number[len] = 0;
+        value->type = JSON_NUMBER;
+        value->number = strtod(number, NULL);
+        return true;
+    }
+
+    if (json_keyword(p, "true") || json_keyword(p, "false")) {
+        value->type = JSON_BOOL;
+        value->boolean = ch == 't';
+        return true;
+    }
+
+    if (json_keyword(p, "null")) {
+        value->type = JSON_NULL;
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * \brief releases the children and the strings of a value
+ *
+ * \param value	value
+ */
+static void json_release(json_t * value) {
+    uint32_t i;
+
+    for (i = 0; i < value->count; i++) {
+        json_release(&value->children[i]);
+    }
+
+    free(value->children);
+    free(value->key);
+    free(value->string);
+}
+
+/*!
+ * \brief parses a JSON text
+ *
+ * \note the value must be released with json_free()
+ *
+ * \param text	JSON text
+ * \param len	length of the text
+ * \return		value, NULL if the text is not valid JSON or out of memory
+ */
+json_t * json_parse(const char * text, size_t len) {
+    json_parser_t p;
+    json_t * value = (json_t *)calloc(1, sizeof(json_t));
+
+    if (!value) {
+        return NULL;
+    }
+
+    p.text = text;
+    p.len = len;
+    p.pos = 0;
+
+    if (!json_parse_value(&p, value, 0)) {
+        json_free(value);
+        return NULL;
+    }
+
+    json_skip(&p);
+    if (p.pos != p.len) {
+        json_free(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+/*!
+ * \brief gets a member of an object
+ *
+ * \param object	object, can be NULL
+ * \param key		name of the member
+ * \return			value of the member, NULL if not an object or no such member
+ */
+json_t * json_get(const json_t * object, const char * key) {
+    uint32_t i;
+
+    if (!object || object->type != JSON_OBJECT) {
+        return NULL;
+    }
+
+    for (i = 0; i < object->count; i++) {
+        if (strcmp(object->children[i].key, key) == 0) {
+            return &object->children[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief gets a string member of an object
+ *
+ * \param object	object, can be NULL
+ * \param key		name of the member
+ * \return			string, NULL if there is no such string member
+ */
+const char * json_get_string(const json_t * object, const char * key) {
+    json_t * value = json_get(object, key);
+
+    return value && value->type == JSON_STRING ? value->string : NULL;
+}
+
+/*!
+ * \brief gets a number member of an object
+ *
+ * \param object	object, can be NULL
+ * \param key		name of the member
+ * \param fallback	returned if there is no such number member
+ * \return			number
+ */
+double json_get_number(const json_t * object, const char * key, double fallback) {
+    json_t * value = json_get(object, key);
+
+    return value && value->type == JSON_NUMBER ? value->number : fallback;
+}
+
+/*!
+ * \brief releases a value returned by json_parse()
+ *
+ * \param value	value, can be NULL
+ */
+void json_free(json_t * value) {
+    if (value) {
+        json_release(value);
+        free(value);
+    }
+}
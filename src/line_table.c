@@ -0,0 +1,271 @@
+/*!
+ * \file line_table.c
+ * \brief table of the source lines of the addresses
+ *
+ * The table holds one entry for every run of words that come from the same
+ * line, so its size is proportional to the number of lines, not the number of
+ * words. A lookup is a binary search over the start addresses of the runs.
+ *
+ * The line table file (.ln) is binary:
+ * - "TASL" and a version byte
+ * - the length and the characters of the name of the source
+ * - the number of runs
+ * - for every run the address delta and the line delta from the previous run
+ *
+ * The numbers are variable length (7 bits per byte, the high bit marks the
+ * continuation), the line deltas are zigzag encoded because they can be negative.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern uint16_t g_object_code_size;
+
+extern uint32_t g_line_table[TABLE_SIZE];
+
+/*!
+ * \brief version of the line table file
+ */
+#define LINE_TABLE_VERSION 1
+
+/*!
+ * \brief creates the table from the line of every word
+ *
+ * \note the table must be released with line_table_free()
+ *
+ * \param t			table
+ * \param file_name	name of the source
+ * \param lines		line of every word, 0 for the data
+ * \param size		number of words
+ * \return			success
+ */
+bool line_table_build(line_table_t * t, const char * file_name, const uint32_t * lines, uint16_t size) {
+    uint16_t a;
+
+    memset(t, 0, sizeof(line_table_t));
+
+    t->file_name = strdup(file_name);
+    t->addresses = (uint16_t *)malloc((size ? size : 1) * sizeof(uint16_t));
+    t->lines = (uint32_t *)malloc((size ? size : 1) * sizeof(uint32_t));
+
+    if (!t->file_name || !t->addresses || !t->lines) {
+        line_table_free(t);
+        return false;
+    }
+
+    for (a = 0; a < size; a++) {
+        if (t->size == 0 || t->lines[t->size - 1] != lines[a]) {
+            t->addresses[t->size] = a;
+            t->lines[t->size] = lines[a];
+            t->size++;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief releases the table
+ *
+ * \param t	table
+ */
+void line_table_free(line_table_t * t) {
+    free(t->file_name);
+    free(t->addresses);
+    free(t->lines);
+    memset(t, 0, sizeof(line_table_t));
+}
+
+/*!
+ * \brief gets the source line of an address
+ *
+ * \param t			table
+ * \param address	address
+ * \return			line number, 0 if the address is data or not in the table
+ */
+uint32_t line_table_lookup(const line_table_t * t, uint16_t address) {
+    uint32_t low = 0, high = t->size;
+
+    /* find the last run that starts at or before the address */
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (t->addresses[mid] <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low > 0 ? t->lines[low - 1] : 0;
+}
+
+/*!
+ * \brief writes a variable length number
+ *
+ * \param fp	output stream
+ * \param value	number
+ */
+static void write_varint(FILE * fp, uint32_t value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7F) | 0x80, fp);
+        value >>= 7;
+    }
+
+    fputc((int)value, fp);
+}
+
+/*!
+ * \brief reads a variable length number
+ *
+ * \param fp	input stream
+ * \param value	number
+ * \return		success
+ */
+static bool read_varint(FILE * fp, uint32_t * value) {
+    uint32_t shift = 0;
+    int c;
+
+    *value = 0;
+
+    do {
+        if (shift > 28 || (c = fgetc(fp)) == EOF) {
+            return false;
+        }
+
+        *value |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return true;
+}
+
+/*!
+ * \brief writes the table
+ *
+ * \param t		table
+ * \param fp	output stream, binary
+ */
+void line_table_write(const line_table_t * t, FILE * fp) {
+    uint32_t i, length = (uint32_t)strlen(t->file_name);
+
+    fwrite("TASL", 1, 4, fp);
+    fputc(LINE_TABLE_VERSION, fp);
+
+    write_varint(fp, length);
+    fwrite(t->file_name, 1, length, fp);
+
+    write_varint(fp, t->size);
+
+    for (i = 0; i < t->size; i++) {
+        uint32_t address = i > 0 ? t->addresses[i - 1] : 0;
+        int32_t delta = (int32_t)(t->lines[i] - (i > 0 ? t->lines[i - 1] : 0));
+
+        write_varint(fp, t->addresses[i] - address);
+        write_varint(fp, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31)); /* zigzag */
+    }
+}
+
+/*!
+ * \brief reads a line table file
+ *
+ * \note the table must be released with line_table_free()
+ *
+ * \param path	path of the file
+ * \param t		table
+ * \return		success
+ */
+bool line_table_read(const char * path, line_table_t * t) {
+    FILE * fp = fopen(path, "rb"); /* read binary */
+    char magic[4];
+    uint32_t length, size, i, address = 0, line = 0;
+
+    memset(t, 0, sizeof(line_table_t));
+
+    if (!fp) {
+        return false;
+    }
+
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, "TASL", 4) != 0 || fgetc(fp) != LINE_TABLE_VERSION ||
+        !read_varint(fp, &length) || length > FILENAME_MAX) {
+        fclose(fp);
+        return false;
+    }
+
+    t->file_name = (char *)malloc(length + 1); /* + NULL */
+    if (!t->file_name || fread(t->file_name, 1, length, fp) != length || !read_varint(fp, &size) ||
+        size > TABLE_SIZE) {
+        fclose(fp);
+        line_table_free(t);
+        return false;
+    }
+    t->file_name[length] = 0;
+
+    t->addresses = (uint16_t *)malloc((size ? size : 1) * sizeof(uint16_t));
+    t->lines = (uint32_t *)malloc((size ? size : 1) * sizeof(uint32_t));
+    if (!t->addresses || !t->lines) {
+        fclose(fp);
+        line_table_free(t);
+        return false;
+    }
+
+    for (i = 0; i < size; i++) {
+        uint32_t address_delta, line_delta;
+
+        if (!read_varint(fp, &address_delta) || !read_varint(fp, &line_delta) ||
+            address + address_delta >= TABLE_SIZE) {
+            fclose(fp);
+            line_table_free(t);
+            return false;
+        }
+
+        address += address_delta;
+        line += (line_delta >> 1) ^ (0u - (line_delta & 1)); /* zigzag */
+
+        t->addresses[i] = (uint16_t)address;
+        t->lines[i] = line;
+    }
+
+    t->size = size;
+    fclose(fp);
+
+    return true;
+}
+
+/*!
+ * \brief creates a line table file from the line table of the first pass
+ *
+ * \param file_name	name of the source file
+ * \return			number of errors
+ */
+uint16_t create_line_table_file(const char * file_name) {
+    line_table_t t;
+    uint16_t errors = 0;
+    char * table_name = get_file_name_with_ext(file_name, ".ln");
+    FILE * fp;
+
+    if (!table_name) {
+        return 1;
+    }
+
+    if (!line_table_build(&t, get_file_base_name(file_name), g_line_table, g_object_code_size)) {
+        free(table_name);
+        return 1;
+    }
+
+    fp = fopen(table_name, "wb"); /* write binary */
+
+    if (fp) {
+        line_table_write(&t, fp);
+        if (fclose(fp) != 0) {
+            errors++;
+        }
+    } else {
+        errors++;
+    }
+
+    line_table_free(&t);
+    free(table_name);
+
+    return errors;
+}
@@ -0,0 +1,175 @@
+/*!
+ * \file listing.c
+ * \brief listing file (.lst), written line by line during the second pass
+ *
+ * Every line of the source is written with its number, the address of its
+ * first word and the words encoded for it with their type ('a'bsolute,
+ * 'r'elocatable, 'e'xternal, blank for the data):
+ *
+ *        5 0000  0219 a 0012 r        MAIN:   mov     LEN, r1
+ *
+ * A line with more than three words continues on the next lines. The lines
+ * expanded from a macro have the number of the invocation, they are written
+ * with a '+' and their cleaned text. The name of the file is written where
+ * the lines of an included file start and end. The symbols follow the lines.
+ *
+ * The second pass calls listing_line() after it has encoded a line, so the
+ * listing needs no pass and no memory of its own.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern object_code_t g_object_code[TABLE_SIZE];
+
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+/*!
+ * \brief number of words in a line of the listing
+ */
+#define LISTING_WORDS 3
+
+static FILE * s_fp = NULL; /*!< \brief listing file, NULL if there is no listing */
+static bool s_data_words = true; /*!< \brief the data words of the lines are listed (not pooled) */
+static uint16_t s_data_address = 0; /*!< \brief offset of the next data word in the data image */
+static const source_line_t * s_previous = NULL; /*!< \brief previous line, the expanded lines have its number */
+static const char * s_name = NULL; /*!< \brief name of the source file */
+
+/*!
+ * \brief opens the listing file of a source
+ *
+ * \param file_name		name of the source file
+ * \param data_words	list the data words of the lines, false if the data image has been rearranged
+ * \return				success
+ */
+bool listing_open(const char * file_name, bool data_words) {
+    char * name = get_file_name_with_ext(file_name, ".lst");
+
+    s_fp = name ? fopen(name, "w") : NULL;
+    free(name);
+
+    if (!s_fp) {
+        return false;
+    }
+
+    s_data_words = data_words;
+    s_data_address = 0;
+    s_previous = NULL;
+    s_name = get_file_base_name(file_name);
+
+    fprintf(s_fp, "%s\n\n  line addr  words                 source\n", s_name);
+
+    return true;
+}
+
+/*!
+ * \brief writes the words of an address range, LISTING_WORDS per line
+ *
+ * \param address	first address
+ * \param size		number of words
+ * \param number	line number
+ * \param text		source text of the first line
+ */
+static void listing_words(uint16_t address, uint16_t size, const char * number, const char * text) {
+    uint16_t i = 0;
+
+    do {
+        uint16_t j;
+
+        if (i == 0) {
+            fprintf(s_fp, "%6s ", number);
+        } else {
+            fprintf(s_fp, "%6s ", "");
+        }
+
+        if (size > 0) {
+            fprintf(s_fp, "%04x ", address + i);
+        } else {
+            fprintf(s_fp, "%4s ", "");
+        }
+
+        for (j = 0; j < LISTING_WORDS; j++, i++) {
+            if (i < size) {
+                object_code_t * o = &g_object_code[address + i];
+                fprintf(s_fp, " %04x %c", o->value, o->type);
+            } else {
+                fprintf(s_fp, "%7s", "");
+            }
+        }
+
+        fprintf(s_fp, "  %s\n", i <= LISTING_WORDS ? text : "");
+    } while (i < size);
+}
+
+/*!
+ * \brief writes a line of the source after the second pass has encoded it
+ *
+ * \param line			line of the source
+ * \param data_start	address of the data image in the object code
+ */
+void listing_line(const source_line_t * line, uint16_t data_start) {
+    char number[16];
+    const char * text = line->raw;
+    uint16_t address = line->address;
+    uint16_t size = line->size;
+    char * expanded = NULL;
+
+    if (!s_fp) {
+        return;
+    }
+
+    /* the lines of a macro have the number of the invocation */
+    if (s_previous && s_previous->number == line->number && s_previous->file == line->file && line->clean) {
+        expanded = (char *)malloc(strlen(line->clean) + 3); /* "+ " + NULL */
+        if (expanded) {
+            sprintf(expanded, "+ %s", line->clean);
+            text = expanded;
+        }
+    }
+
+    /* the name of the file, where the included lines start or end */
+    if (s_previous ? s_previous->file != line->file : line->file != NULL) {
+        fprintf(s_fp, "%6s ; %s\n", "", line->file ? line->file : s_name);
+    }
+
+    sprintf(number, "%u", line->number);
+
+    if (line->data_size > 0) {
+        address = data_start + s_data_address;
+        size = s_data_words ? line->data_size : 0;
+        s_data_address += line->data_size;
+    }
+
+    listing_words(address, size, number, text);
+
+    free(expanded);
+    s_previous = line;
+}
+
+/*!
+ * \brief writes the symbols and closes the listing file
+ *
+ * \return	success
+ */
+bool listing_close(void) {
+    uint16_t i;
+    bool ok;
+
+    if (!s_fp) {
+        return true;
+    }
+
+    fprintf(s_fp, "\nsymbols (name address type):\n");
+    for (i = 0; i < g_symbol_table_size; i++) {
+        symbol_t * sym = &g_symbol_table[i];
+        fprintf(s_fp, "  %-10s %04x %c\n", sym->name, sym->value, sym->type);
+    }
+
+    ok = !ferror(s_fp);
+    ok = fclose(s_fp) == 0 && ok;
+    s_fp = NULL;
+    s_previous = NULL;
+
+    return ok;
+}
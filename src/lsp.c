@@ -0,0 +1,1395 @@
+/*!
+ * \file lsp.c
+ * \brief language server (tas --lsp), speaks the Language Server Protocol on stdin/stdout
+ *
+ * Every open document keeps its cleaned lines and a hash of its labels. An
+ * edit replaces only the lines of its range, so only those are split, cleaned
+ * and indexed again. When a single edit keeps the number of lines of a document
+ * assembled without errors, warnings or macros, only the edited lines are
+ * encoded again at their addresses (assemble_incremental() of watch.c);
+ * otherwise the macro expansion and both passes run over the kept lines. The
+ * diagnostics are then published. After the passes the document keeps the
+ * words of every line and the symbols, the requests are answered from these:
+ * - textDocument/definition: the line that defines the label under the cursor
+ * - textDocument/references: every use of the label
+ * - textDocument/hover: the address and the encoded words of the line, and the value of the label
+ *
+ * \note the positions are counted in bytes, the sources are expected to be ASCII
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern object_code_t g_object_code[TABLE_SIZE];
+extern uint16_t g_object_code_size;
+
+extern uint16_t g_data_image_size;
+
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+/*!
+ * \brief maximum length of a header line of a message
+ */
+#define LSP_HEADER 256
+
+/*!
+ * \brief growing output buffer, the body of a message
+ */
+typedef struct lsp_buffer_s {
+    char * data; /*!< \brief text of the buffer */
+    size_t size; /*!< \brief number of used bytes */
+    size_t capacity; /*!< \brief number of allocated bytes */
+    bool ok; /*!< \brief no allocation failed */
+} lsp_buffer_t;
+
+/*!
+ * \brief definition of a label, in the hash of the document
+ */
+typedef struct lsp_definition_s {
+    char * name; /*!< \brief name of the label, NULL for an empty slot */
+    uint32_t line; /*!< \brief index of the line */
+    uint32_t column; /*!< \brief offset of the name in the raw line */
+    uint32_t count; /*!< \brief number of lines defining the name */
+} lsp_definition_t;
+
+/*!
+ * \brief open document
+ */
+typedef struct lsp_document_s {
+    char * uri; /*!< \brief URI of the document */
+    char * path; /*!< \brief path of the document, the included files are relative to it */
+    source_t source; /*!< \brief lines of the document */
+    lsp_definition_t * definitions; /*!< \brief labels by the hash of their name (open addressing) */
+    uint32_t definitions_capacity; /*!< \brief number of slots, a power of 2 */
+    uint32_t definitions_size; /*!< \brief number of names in the hash */
+    uint16_t * addresses; /*!< \brief address of the first word of every line */
+    uint16_t * sizes; /*!< \brief number of words of every line, NULL if the document has errors */
+    uint32_t words_count; /*!< \brief number of lines in addresses and sizes */
+    object_code_t code[TABLE_SIZE]; /*!< \brief words of the last successful assembling */
+    symbol_t * symbols; /*!< \brief symbols of the last successful assembling */
+    uint16_t symbols_size; /*!< \brief number of symbols */
+    lsp_buffer_t diagnostics; /*!< \brief elements of the diagnostics being published */
+    struct lsp_document_s * next; /*!< \brief next open document */
+} lsp_document_t;
+
+static lsp_document_t * s_documents = NULL; /*!< \brief open documents */
+static uint32_t s_error_limit = 0; /*!< \brief the passes stop after this number of errors, 0 for no limit */
+static lsp_document_t * s_assembled = NULL; /*!< \brief document whose lines and tables can be encoded again in place */
+
+/*!
+ * \brief reserves bytes at the end of a buffer
+ *
+ * \param b		buffer
+ * \param size	number of bytes
+ * \return		success
+ */
+static bool lsp_reserve(lsp_buffer_t * b, size_t size) {
+    if (b->size + size + 1 > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 1024;
+        char * data;
+
+        while (b->size + size + 1 > capacity) {
+            capacity *= 2;
+        }
+
+        data = (char *)realloc(b->data, capacity);
+        if (!data) {
+            b->ok = false;
+            return false;
+        }
+
+        b->data = data;
+        b->capacity = capacity;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief appends a string to a buffer
+ *
+ * \param b		buffer
+ * \param str	string
+ */
+static void lsp_put(lsp_buffer_t * b, const char * str) {
+    size_t len = strlen(str);
+
+    if (lsp_reserve(b, len)) {
+        memcpy(b->data + b->size, str, len + 1);
+        b->size += len;
+    }
+}
+
+/*!
+ * \brief appends a formatted text to a buffer
+ *
+ * \param b		buffer
+ * \param fmt	printf style format string, the result is at most 255 characters
+ * \param ...	printf style variable argument list
+ */
+static void lsp_printf(lsp_buffer_t * b, const char * fmt, ...) {
+    char text[256];
+    va_list list;
+
+    va_start(list, fmt);
+    vsnprintf(text, sizeof(text), fmt, list);
+    va_end(list);
+
+    lsp_put(b, text);
+}
+
+/*!
+ * \brief appends a JSON string to a buffer, with the quotes
+ *
+ * \param b		buffer
+ * \param str	string, NULL is written as null
+ */
+static void lsp_put_string(lsp_buffer_t * b, const char * str) {
+    if (!str) {
+        lsp_put(b, "null");
+        return;
+    }
+
+    lsp_put(b, "\"");
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+
+        if (c == '"' || c == '\\') {
+            lsp_printf(b, "\\%c", c);
+        } else if (c == '\n') {
+            lsp_put(b, "\\n");
+        } else if (c < 0x20) {
+            lsp_printf(b, "\\u%04x", c);
+        } else if (lsp_reserve(b, 1)) {
+            b->data[b->size++] = (char)c;
+            b->data[b->size] = 0;
+        }
+    }
+    lsp_put(b, "\"");
+}
+
+/*!
+ * \brief writes a message with its header
+ *
+ * \param out	output stream
+ * \param body	body of the message
+ * \return		success
+ */
+static bool lsp_send(FILE * out, lsp_buffer_t * body) {
+    if (!body->ok) {
+        return false;
+    }
+
+    fprintf(out, "Content-Length: %lu\r\n\r\n", (unsigned long)body->size);
+    fwrite(body->data, 1, body->size, out);
+    fflush(out);
+
+    return !ferror(out);
+}
+
+/*!
+ * \brief appends the id of a request
+ *
+ * \param b		buffer
+ * \param id	id of the request (number or string)
+ */
+static void lsp_put_id(lsp_buffer_t * b, const json_t * id) {
+    if (id && id->type == JSON_STRING) {
+        lsp_put_string(b, id->string);
+    } else if (id && id->type == JSON_NUMBER) {
+        lsp_printf(b, "%.0f", id->number);
+    } else {
+        lsp_put(b, "null");
+    }
+}
+
+/*!
+ * \brief starts the body of a response
+ *
+ * \param b		empty buffer
+ * \param id	id of the request
+ */
+static void lsp_begin_result(lsp_buffer_t * b, const json_t * id) {
+    lsp_put(b, "{\"jsonrpc\":\"2.0\",\"id\":");
+    lsp_put_id(b, id);
+    lsp_put(b, ",\"result\":");
+}
+
+/*!
+ * \brief appends a range of a line
+ *
+ * \param b		buffer
+ * \param line	index of the line
+ * \param start	first character
+ * \param end	end of the characters
+ */
+static void lsp_put_range(lsp_buffer_t * b, uint32_t line, uint32_t start, uint32_t end) {
+    lsp_printf(b, "{\"start\":{\"line\":%u,\"character\":%u},\"end\":{\"line\":%u,\"character\":%u}}", line, start,
+               line, end);
+}
+
+/*!
+ * \brief gets the value of a hexadecimal digit
+ *
+ * \param ch	digit
+ * \return		value, -1 if not a digit
+ */
+static int lsp_hex(char ch) {
+    const char * digits = "0123456789abcdef";
+    const char * digit = ch ? strchr(digits, ch | 0x20) : NULL;
+
+    return digit ? (int)(digit - digits) : -1;
+}
+
+/*!
+ * \brief converts a file URI to a path
+ *
+ * \param uri	URI of the document
+ * \return		path (must be free()-d), NULL if out of memory
+ */
+static char * lsp_uri_path(const char * uri) {
+    char * path;
+    size_t i, len = 0;
+
+    if (strncmp(uri, "file://", 7) == 0) {
+        uri += 7;
+    }
+
+    path = (char *)malloc(strlen(uri) + 1);
+    if (!path) {
+        return NULL;
+    }
+
+    for (i = 0; uri[i]; i++) {
+        /* %XX escapes */
+        if (uri[i] == '%' && lsp_hex(uri[i + 1]) >= 0 && lsp_hex(uri[i + 2]) >= 0) {
+            path[len++] = (char)(lsp_hex(uri[i + 1]) * 16 + lsp_hex(uri[i + 2]));
+            i += 2;
+        } else {
+            path[len++] = uri[i];
+        }
+    }
+
+    path[len] = 0;
+
+    return path;
+}
+
+/*!
+ * \brief finds an open document
+ *
+ * \param uri	URI of the document, can be NULL
+ * \return		document, NULL if it is not open
+ */
+static lsp_document_t * lsp_find(const char * uri) {
+    lsp_document_t * doc;
+
+    for (doc = s_documents; uri && doc; doc = doc->next) {
+        if (strcmp(doc->uri, uri) == 0) {
+            return doc;
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief hashes a name (FNV-1a)
+ *
+ * \param str	start of the name
+ * \param len	length of the name
+ * \return		hash
+ */
+static uint32_t lsp_hash(const char * str, size_t len) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief checks if a character can be part of a label
+ *
+ * \param ch	character
+ * \return		the character is a letter, a digit or '_'
+ */
+static bool lsp_is_word(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+/*!
+ * \brief finds the definition of a label
+ *
+ * \param doc	document
+ * \param name	start of the name
+ * \param len	length of the name
+ * \return		definition, NULL if the label is not defined in the document
+ */
+static lsp_definition_t * lsp_definition(lsp_document_t * doc, const char * name, size_t len) {
+    uint32_t i;
+
+    if (!doc->definitions) {
+        return NULL;
+    }
+
+    for (i = lsp_hash(name, len) & (doc->definitions_capacity - 1); doc->definitions[i].name;
+         i = (i + 1) & (doc->definitions_capacity - 1)) {
+        lsp_definition_t * def = &doc->definitions[i];
+
+        if (strlen(def->name) == len && memcmp(def->name, name, len) == 0) {
+            return def;
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief releases the hash of the labels
+ *
+ * \param doc	document
+ */
+static void lsp_definitions_free(lsp_document_t * doc) {
+    uint32_t i;
+
+    for (i = 0; doc->definitions && i < doc->definitions_capacity; i++) {
+        free(doc->definitions[i].name);
+    }
+
+    free(doc->definitions);
+    doc->definitions = NULL;
+    doc->definitions_capacity = 0;
+    doc->definitions_size = 0;
+}
+
+/*!
+ * \brief doubles the number of slots of the hash of the labels
+ *
+ * \param doc	document
+ * \return		success
+ */
+static bool lsp_definitions_grow(lsp_document_t * doc) {
+    uint32_t capacity = doc->definitions_capacity ? doc->definitions_capacity * 2 : 64, i;
+    lsp_definition_t * definitions = (lsp_definition_t *)calloc(capacity, sizeof(lsp_definition_t));
+
+    if (!definitions) {
+        return false;
+    }
+
+    for (i = 0; i < doc->definitions_capacity; i++) {
+        lsp_definition_t * def = &doc->definitions[i];
+        uint32_t slot;
+
+        if (!def->name) {
+            continue;
+        }
+
+        slot = lsp_hash(def->name, strlen(def->name)) & (capacity - 1);
+        while (definitions[slot].name) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        definitions[slot] = *def;
+    }
+
+    free(doc->definitions);
+    doc->definitions = definitions;
+    doc->definitions_capacity = capacity;
+
+    return true;
+}
+
+/*!
+ * \brief removes a name from the hash of the labels
+ *
+ * \param doc	document
+ * \param def	definition of the name
+ */
+static void lsp_definition_remove(lsp_document_t * doc, lsp_definition_t * def) {
+    uint32_t mask = doc->definitions_capacity - 1;
+    uint32_t hole = (uint32_t)(def - doc->definitions), i;
+
+    free(def->name);
+    def->name = NULL;
+    doc->definitions_size--;
+
+    /* the following names of the run move back into the hole if their probing passes it */
+    for (i = (hole + 1) & mask; doc->definitions[i].name; i = (i + 1) & mask) {
+        uint32_t home = lsp_hash(doc->definitions[i].name, strlen(doc->definitions[i].name)) & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            doc->definitions[hole] = doc->definitions[i];
+            doc->definitions[i].name = NULL;
+            hole = i;
+        }
+    }
+}
+
+/*!
+ * \brief gets the name defined by a line: a label, a constant, an external or a macro
+ *
+ * \param line	line of the document
+ * \return		name (must be free()-d), NULL if the line defines nothing
+ */
+static char * lsp_defined_name(source_line_t * line) {
+    char * first;
+    char * name = NULL;
+
+    if (!line->clean || !line->clean[0] || line->clean[0] == ';') {
+        return NULL;
+    }
+
+    first = string_split(line->clean, " ", 0);
+    if (!first) {
+        return NULL;
+    }
+
+    if (first[strlen(first) - 1] == ':') {
+        first[strlen(first) - 1] = 0;
+        return first;
+    }
+
+    if (strcmp(first, ".equ") == 0 || strcmp(first, ".set") == 0 || strcmp(first, ".extern") == 0 ||
+        strcmp(first, ".macro") == 0) {
+        name = string_split(line->clean, " ", 1);
+    }
+
+    free(first);
+
+    return name;
+}
+
+/*!
+ * \brief adds the name defined by a line to the hash of the labels
+ *
+ * \note the first definition of a name is kept, the passes report the others
+ *
+ * \param doc		document
+ * \param index	index of the line
+ */
+static void lsp_define(lsp_document_t * doc, uint32_t index) {
+    source_line_t * line = &doc->source.lines[index];
+    char * name = lsp_defined_name(line);
+    lsp_definition_t * def;
+    const char * column;
+    uint32_t slot;
+
+    if (!name || !name[0]) {
+        free(name);
+        return;
+    }
+
+    column = strstr(line->raw, name);
+
+    def = lsp_definition(doc, name, strlen(name));
+    if (def) {
+        def->count++;
+        if (index < def->line) {
+            def->line = index;
+            def->column = column ? (uint32_t)(column - line->raw) : 0;
+        }
+
+        free(name);
+        return;
+    }
+
+    if ((doc->definitions_size + 1) * 2 > doc->definitions_capacity && !lsp_definitions_grow(doc)) {
+        free(name);
+        return;
+    }
+
+    slot = lsp_hash(name, strlen(name)) & (doc->definitions_capacity - 1);
+    while (doc->definitions[slot].name) {
+        slot = (slot + 1) & (doc->definitions_capacity - 1);
+    }
+
+    doc->definitions[slot].name = name;
+    doc->definitions[slot].line = index;
+    doc->definitions[slot].column = column ? (uint32_t)(column - line->raw) : 0;
+    doc->definitions[slot].count = 1;
+    doc->definitions_size++;
+}
+
+/*!
+ * \brief builds the hash of the labels of a document
+ *
+ * \param doc	document
+ */
+static void lsp_index(lsp_document_t * doc) {
+    uint32_t capacity = 64, i;
+
+    lsp_definitions_free(doc);
+
+    while (capacity < doc->source.count * 2) {
+        capacity *= 2;
+    }
+
+    doc->definitions = (lsp_definition_t *)calloc(capacity, sizeof(lsp_definition_t));
+    if (!doc->definitions) {
+        return;
+    }
+    doc->definitions_capacity = capacity;
+
+    for (i = 0; i < doc->source.count; i++) {
+        lsp_define(doc, i);
+    }
+}
+
+/*!
+ * \brief replaces lines of a document, the hash of the labels is updated for these lines only
+ *
+ * \param doc		document
+ * \param first		index of the first replaced line
+ * \param end		end of the replaced lines
+ * \param text		text of the new lines
+ * \param len		length of the text
+ * \param removed	if not NULL, set to the replaced lines (see source_splice())
+ * \return			success
+ */
+static bool lsp_splice(lsp_document_t * doc, uint32_t first, uint32_t end, const char * text, size_t len,
+                       source_line_t ** removed) {
+    char ** names = (char **)calloc(end - first + 1, sizeof(char *));
+    uint32_t count = doc->source.count, i;
+    bool rescan = false;
+
+    if (!names) {
+        return false;
+    }
+
+    for (i = first; i < end; i++) {
+        names[i - first] = lsp_defined_name(&doc->source.lines[i]);
+    }
+
+    if (!source_splice(&doc->source, first, end, text, len, removed)) {
+        for (i = 0; i < end - first; i++) {
+            free(names[i]);
+        }
+        free(names);
+        return false;
+    }
+
+    /* number of new lines */
+    count = doc->source.count + (end - first) - count;
+
+    /* the names of the replaced lines lose a definition */
+    for (i = 0; i < end - first; i++) {
+        lsp_definition_t * def = names[i] && names[i][0] ? lsp_definition(doc, names[i], strlen(names[i])) : NULL;
+
+        if (def && --def->count == 0) {
+            lsp_definition_remove(doc, def);
+        } else if (def && def->line >= first && def->line < end) {
+            /* the kept definition was replaced, the next one can be anywhere */
+            rescan = true;
+        }
+
+        free(names[i]);
+    }
+
+    free(names);
+
+    if (rescan) {
+        lsp_index(doc);
+        return true;
+    }
+
+    for (i = 0; count != end - first && i < doc->definitions_capacity; i++) {
+        if (doc->definitions[i].name && doc->definitions[i].line >= end) {
+            doc->definitions[i].line = doc->definitions[i].line - end + first + count;
+        }
+    }
+
+    for (i = first; i < first + count; i++) {
+        lsp_define(doc, i);
+    }
+
+    return true;
+}
+
+/*!
+ * \brief collects a diagnostic of the passes into the document
+ *
+ * \param data		document
+ * \param severity	error or warning
+ * \param file_name	name of the file of the diagnostic
+ * \param line		line number
+ * \param message	formatted message
+ */
+static void lsp_collect(void * data, tas_severity_t severity, const char * file_name, uint32_t line,
+                        const char * message) {
+    lsp_document_t * doc = (lsp_document_t *)data;
+    lsp_buffer_t * b = &doc->diagnostics;
+    uint32_t index = 0, start = 0, end = 0;
+    bool own = !file_name || !doc->source.name || strcmp(file_name, doc->source.name) == 0;
+
+    /* the diagnostics of an included file are shown on the first line */
+    if (own && line > 0 && line <= doc->source.count) {
+        const char * raw = doc->source.lines[line - 1].raw;
+
+        index = line - 1;
+        end = doc->source.lines[index].length;
+        while (start < end && (raw[start] == ' ' || raw[start] == '\t')) {
+            start++;
+        }
+    }
+
+    if (b->size > 0) {
+        lsp_put(b, ",");
+    }
+
+    lsp_put(b, "{\"range\":");
+    lsp_put_range(b, index, start, end);
+    lsp_printf(b, ",\"severity\":%d,\"source\":\"tas\",\"message\":", severity == TAS_ERROR ? 1 : 2);
+
+    if (own) {
+        lsp_put_string(b, message);
+    } else {
+        char * text = (char *)malloc(strlen(file_name) + strlen(message) + 16);
+
+        if (text) {
+            sprintf(text, "%s:%u: %s", file_name, line, message);
+        }
+        lsp_put_string(b, text ? text : message);
+        free(text);
+    }
+
+    lsp_put(b, "}");
+}
+
+/*!
+ * \brief keeps the words of every line and the symbols of a successful assembling
+ *
+ * \param doc		document
+ * \param expanded	expanded lines, with their addresses
+ */
+static void lsp_keep_words(lsp_document_t * doc, source_t * expanded) {
+    uint16_t code_size = g_object_code_size - g_data_image_size; /* the second pass appended the data */
+    uint16_t data_address = code_size;
+    uint32_t i;
+
+    doc->addresses = (uint16_t *)calloc(doc->source.count + 1, sizeof(uint16_t));
+    doc->sizes = (uint16_t *)calloc(doc->source.count + 1, sizeof(uint16_t));
+    doc->symbols = (symbol_t *)calloc(g_symbol_table_size + 1, sizeof(symbol_t));
+
+    if (!doc->addresses || !doc->sizes || !doc->symbols) {
+        free(doc->addresses);
+        free(doc->sizes);
+        free(doc->symbols);
+        doc->addresses = doc->sizes = NULL;
+        doc->symbols = NULL;
+        return;
+    }
+
+    doc->words_count = doc->source.count;
+    memcpy(doc->code, g_object_code, g_object_code_size * sizeof(object_code_t));
+
+    /* the lines of a macro have the number of the invocation */
+    for (i = 0; i < expanded->count; i++) {
+        source_line_t * line = &expanded->lines[i];
+        uint16_t address = line->data_size ? data_address : line->address;
+        uint16_t size = line->data_size ? line->data_size : line->size;
+
+        data_address += line->data_size;
+
+        if (line->file || line->number == 0 || line->number > doc->words_count || size == 0) {
+            continue;
+        }
+
+        if (doc->sizes[line->number - 1] == 0) {
+            doc->addresses[line->number - 1] = address;
+        }
+        doc->sizes[line->number - 1] += size;
+    }
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        doc->symbols[i] = g_symbol_table[i];
+        doc->symbols[i].name = strdup(g_symbol_table[i].name);
+    }
+    doc->symbols_size = g_symbol_table_size;
+}
+
+/*!
+ * \brief releases the words and the symbols of the last assembling
+ *
+ * \param doc	document
+ */
+static void lsp_words_free(lsp_document_t * doc) {
+    uint16_t i;
+
+    for (i = 0; i < doc->symbols_size; i++) {
+        free(doc->symbols[i].name);
+    }
+
+    free(doc->symbols);
+    free(doc->addresses);
+    free(doc->sizes);
+    doc->symbols = NULL;
+    doc->symbols_size = 0;
+    doc->addresses = doc->sizes = NULL;
+    doc->words_count = 0;
+}
+
+/*!
+ * \brief keeps the words of the lines encoded again in place
+ *
+ * \param doc		document
+ * \param first		index of the first line
+ * \param end		end of the lines
+ */
+static void lsp_keep_lines(lsp_document_t * doc, uint32_t first, uint32_t end) {
+    uint32_t i;
+
+    for (i = first; i < end && i < doc->words_count; i++) {
+        memcpy(doc->code + doc->addresses[i], g_object_code + doc->addresses[i],
+               doc->sizes[i] * sizeof(object_code_t));
+    }
+}
+
+/*!
+ * \brief assembles a whole document, keeps its words and symbols on success
+ *
+ * \note without macros the passes run over the lines of the document, so the
+ * lines and the tables can be used to encode the next edit in place
+ *
+ * \param doc	document
+ */
+static void lsp_assemble(lsp_document_t * doc) {
+    source_t expanded;
+    source_t * lines = &doc->source;
+    uint16_t errors;
+    bool changed;
+
+    lsp_words_free(doc);
+    reset_tables();
+    s_assembled = NULL;
+
+    errors = macro_expand(&doc->source, doc->path, &expanded, &changed);
+    if (changed) {
+        lines = &expanded;
+    }
+    if (errors == 0) {
+        errors = first_pass(lines);
+    }
+    if (errors == 0) {
+        errors = second_pass(lines);
+    }
+    if (errors == 0) {
+        lsp_keep_words(doc, lines);
+        s_assembled = changed ? NULL : doc;
+    }
+
+    source_free(&expanded);
+    if (!s_assembled) {
+        reset_tables();
+    }
+}
+
+/*!
+ * \brief assembles a document and publishes its diagnostics
+ *
+ * \param doc		document
+ * \param out		output stream
+ * \param removed	previous version of the edited lines, NULL to assemble the whole document
+ * \param first		index of the first edited line
+ * \param end		end of the edited lines, the number of lines did not change
+ * \return			success of the output
+ */
+static bool lsp_analyze(lsp_document_t * doc, FILE * out, source_line_t * removed, uint32_t first, uint32_t end) {
+    lsp_buffer_t b = { NULL, 0, 0, true };
+    diagnostics_t diagnostics;
+    bool incremental = false;
+    bool ok;
+
+    /* the diagnostics of the unchanged lines would be lost */
+    bool reuse = removed && s_assembled == doc && doc->sizes && doc->diagnostics.size == 0;
+
+    doc->diagnostics.size = 0;
+    if (doc->diagnostics.data) {
+        doc->diagnostics.data[0] = 0;
+    }
+
+    set_diagnostic_handler(lsp_collect, doc);
+    diagnostics_init(&diagnostics, stderr, DIAGNOSTIC_TEXT, s_error_limit);
+    diagnostics_select(&diagnostics);
+
+    /* a .set value depends on the line */
+    if (reuse && !constants_redefined()) {
+        incremental = assemble_incremental(&doc->source, removed, first, end);
+    }
+
+    if (incremental) {
+        lsp_keep_lines(doc, first, end);
+    } else {
+        /* the full run reports the errors of a failed attempt again */
+        doc->diagnostics.size = 0;
+        if (doc->diagnostics.data) {
+            doc->diagnostics.data[0] = 0;
+        }
+
+        diagnostics_free(&diagnostics);
+        diagnostics_init(&diagnostics, stderr, DIAGNOSTIC_TEXT, s_error_limit);
+        diagnostics_select(&diagnostics);
+
+        lsp_assemble(doc);
+    }
+
+    diagnostics_free(&diagnostics);
+    set_diagnostic_handler(NULL, NULL);
+
+    lsp_put(&b, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    lsp_put_string(&b, doc->uri);
+    lsp_put(&b, ",\"diagnostics\":[");
+    lsp_put(&b, doc->diagnostics.data ? doc->diagnostics.data : "");
+    lsp_put(&b, "]}}");
+
+    ok = lsp_send(out, &b);
+    free(b.data);
+
+    return ok;
+}
+
+/*!
+ * \brief releases a document
+ *
+ * \param doc	document
+ */
+static void lsp_document_free(lsp_document_t * doc) {
+    if (s_assembled == doc) {
+        s_assembled = NULL;
+        reset_tables();
+    }
+
+    lsp_words_free(doc);
+    lsp_definitions_free(doc);
+    source_free(&doc->source);
+    free(doc->diagnostics.data);
+    free(doc->uri);
+    free(doc->path);
+    free(doc);
+}
+
+/*!
+ * \brief opens a document (textDocument/didOpen)
+ *
+ * \param params	parameters of the notification
+ * \param out		output stream
+ * \return			success of the output
+ */
+static bool lsp_open(const json_t * params, FILE * out) {
+    json_t * item = json_get(params, "textDocument");
+    const char * uri = json_get_string(item, "uri");
+    const char * text = json_get_string(item, "text");
+    lsp_document_t * doc;
+
+    if (!uri || !text) {
+        return true;
+    }
+
+    doc = lsp_find(uri);
+    if (doc) {
+        /* opened again, the new text replaces the old one */
+        if (!source_splice(&doc->source, 0, doc->source.count, text, strlen(text), NULL)) {
+            return true;
+        }
+
+        lsp_index(doc);
+        return lsp_analyze(doc, out, NULL, 0, 0);
+    }
+
+    doc = (lsp_document_t *)calloc(1, sizeof(lsp_document_t));
+    if (!doc) {
+        return true;
+    }
+
+    doc->diagnostics.ok = true;
+    doc->uri = strdup(uri);
+    doc->path = lsp_uri_path(uri);
+
+    /* an empty source gets the lines of the text, the last one can be empty like in the editor */
+    if (!doc->uri || !doc->path || !source_load(&doc->source, get_file_base_name(doc->path), "", 0) ||
+        !source_splice(&doc->source, 0, 0, text, strlen(text), NULL)) {
+        lsp_document_free(doc);
+        return true;
+    }
+
+    doc->next = s_documents;
+    s_documents = doc;
+
+    lsp_index(doc);
+    return lsp_analyze(doc, out, NULL, 0, 0);
+}
+
+/*!
+ * \brief gets a position of a document
+ *
+ * \param position	position object
+ * \param line		set to the index of the line
+ * \param character	set to the offset in the line
+ * \param count		number of lines
+ * \return			the position is in the document
+ */
+static bool lsp_position(const json_t * position, uint32_t * line, uint32_t * character, uint32_t count) {
+    double l = json_get_number(position, "line", -1);
+    double c = json_get_number(position, "character", -1);
+
+    if (l < 0 || c < 0 || l >= count) {
+        return false;
+    }
+
+    *line = (uint32_t)l;
+    *character = (uint32_t)c;
+
+    return true;
+}
+
+/*!
+ * \brief applies the edits of a document (textDocument/didChange)
+ *
+ * \param params	parameters of the notification
+ * \param out		output stream
+ * \return			success of the output
+ */
+static bool lsp_change(const json_t * params, FILE * out) {
+    lsp_document_t * doc = lsp_find(json_get_string(json_get(params, "textDocument"), "uri"));
+    json_t * changes = json_get(params, "contentChanges");
+    source_line_t * removed = NULL;
+    uint32_t removed_first = 0, removed_end = 0;
+    uint32_t i;
+    bool ok;
+
+    if (!doc || !changes || changes->type != JSON_ARRAY) {
+        return true;
+    }
+
+    for (i = 0; i < changes->count; i++) {
+        json_t * change = &changes->children[i];
+        json_t * range = json_get(change, "range");
+        const char * text = json_get_string(change, "text");
+        uint32_t first, first_char, last, last_char;
+        size_t prefix, suffix, len;
+        source_line_t * start, * end;
+        char * edited;
+
+        if (!text) {
+            continue;
+        }
+
+        /* without a range the text is the whole document */
+        if (!range) {
+            source_splice(&doc->source, 0, doc->source.count, text, strlen(text), NULL);
+            lsp_index(doc);
+            continue;
+        }
+
+        if (!lsp_position(json_get(range, "start"), &first, &first_char, doc->source.count) ||
+            !lsp_position(json_get(range, "end"), &last, &last_char, doc->source.count) || last < first) {
+            continue;
+        }
+
+        /* the edited lines are the start of the first one, the new text and the end of the last one */
+        start = &doc->source.lines[first];
+        end = &doc->source.lines[last];
+        prefix = first_char < start->length ? first_char : start->length;
+        suffix = last_char < end->length ? end->length - last_char : 0;
+        len = strlen(text);
+
+        edited = (char *)malloc(prefix + len + suffix + 1);
+        if (!edited) {
+            continue;
+        }
+
+        memcpy(edited, start->raw, prefix);
+        memcpy(edited + prefix, text, len);
+        memcpy(edited + prefix + len, end->raw + end->length - suffix, suffix);
+
+        /* a single edit that keeps the number of lines can be encoded in place */
+        if (changes->count == 1) {
+            uint32_t count = doc->source.count;
+
+            if (lsp_splice(doc, first, last + 1, edited, prefix + len + suffix, &removed)) {
+                removed_first = first;
+                removed_end = last + 1;
+
+                if (doc->source.count != count) {
+                    source_lines_free(removed, removed_end - removed_first);
+                    removed = NULL;
+                }
+            }
+        } else {
+            lsp_splice(doc, first, last + 1, edited, prefix + len + suffix, NULL);
+        }
+
+        free(edited);
+    }
+
+    ok = lsp_analyze(doc, out, removed, removed_first, removed_end);
+    if (removed) {
+        source_lines_free(removed, removed_end - removed_first);
+    }
+
+    return ok;
+}
+
+/*!
+ * \brief closes a document (textDocument/didClose)
+ *
+ * \param params	parameters of the notification
+ * \param out		output stream
+ * \return			success of the output
+ */
+static bool lsp_close(const json_t * params, FILE * out) {
+    lsp_document_t * doc = lsp_find(json_get_string(json_get(params, "textDocument"), "uri"));
+    lsp_document_t ** link;
+    lsp_buffer_t b = { NULL, 0, 0, true };
+    bool ok;
+
+    if (!doc) {
+        return true;
+    }
+
+    for (link = &s_documents; *link != doc; link = &(*link)->next) {
+    }
+    *link = doc->next;
+
+    /* the diagnostics of a closed document are removed */
+    lsp_put(&b, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    lsp_put_string(&b, doc->uri);
+    lsp_put(&b, ",\"diagnostics\":[]}}");
+    ok = lsp_send(out, &b);
+
+    free(b.data);
+    lsp_document_free(doc);
+
+    return ok;
+}
+
+/*!
+ * \brief finds the label under the cursor of a request
+ *
+ * \param params	parameters of the request
+ * \param doc		set to the document
+ * \param line		set to the index of the line
+ * \param start		set to the offset of the label
+ * \param len		set to the length of the label
+ * \return			there is a label under the cursor
+ */
+static bool lsp_word(const json_t * params, lsp_document_t ** doc, uint32_t * line, uint32_t * start, uint32_t * len) {
+    uint32_t character, end;
+    const char * raw;
+
+    *doc = lsp_find(json_get_string(json_get(params, "textDocument"), "uri"));
+    if (!*doc || !lsp_position(json_get(params, "position"), line, &character, (*doc)->source.count)) {
+        return false;
+    }
+
+    raw = (*doc)->source.lines[*line].raw;
+    end = (*doc)->source.lines[*line].length;
+
+    /* the cursor can be right after the label */
+    if (character > end) {
+        character = end;
+    }
+    if ((character == end || !lsp_is_word(raw[character])) && character > 0 && lsp_is_word(raw[character - 1])) {
+        character--;
+    }
+    if (character >= end || !lsp_is_word(raw[character])) {
+        return false;
+    }
+
+    for (*start = character; *start > 0 && lsp_is_word(raw[*start - 1]); (*start)--) {
+    }
+    for (end = character; end < (*doc)->source.lines[*line].length && lsp_is_word(raw[end]); end++) {
+    }
+
+    *len = end - *start;
+
+    return true;
+}
+
+/*!
+ * \brief appends a location of a document
+ *
+ * \param b		buffer
+ * \param doc	document
+ * \param line	index of the line
+ * \param start	first character
+ * \param len	number of characters
+ */
+static void lsp_put_location(lsp_buffer_t * b, lsp_document_t * doc, uint32_t line, uint32_t start, uint32_t len) {
+    lsp_put(b, "{\"uri\":");
+    lsp_put_string(b, doc->uri);
+    lsp_put(b, ",\"range\":");
+    lsp_put_range(b, line, start, start + len);
+    lsp_put(b, "}");
+}
+
+/*!
+ * \brief answers textDocument/definition
+ *
+ * \param params	parameters of the request
+ * \param b			body of the response
+ */
+static void lsp_goto_definition(const json_t * params, lsp_buffer_t * b) {
+    lsp_document_t * doc;
+    lsp_definition_t * def;
+    uint32_t line, start, len;
+
+    if (!lsp_word(params, &doc, &line, &start, &len) ||
+        !(def = lsp_definition(doc, doc->source.lines[line].raw + start, len))) {
+        lsp_put(b, "null");
+        return;
+    }
+
+    lsp_put_location(b, doc, def->line, def->column, len);
+}
+
+/*!
+ * \brief answers textDocument/references, the uses of a label outside the strings and the comments
+ *
+ * \param params	parameters of the request
+ * \param b			body of the response
+ */
+static void lsp_references(const json_t * params, lsp_buffer_t * b) {
+    json_t * context = json_get(params, "context");
+    json_t * declaration = json_get(context, "includeDeclaration");
+    bool with_declaration = !declaration || declaration->type != JSON_BOOL || declaration->boolean;
+    lsp_document_t * doc;
+    lsp_definition_t * def;
+    uint32_t line, start, len, i;
+    const char * name;
+    bool first = true;
+
+    if (!lsp_word(params, &doc, &line, &start, &len)) {
+        lsp_put(b, "null");
+        return;
+    }
+
+    name = doc->source.lines[line].raw + start;
+    def = lsp_definition(doc, name, len);
+
+    lsp_put(b, "[");
+
+    for (i = 0; i < doc->source.count; i++) {
+        const char * raw = doc->source.lines[i].raw;
+        bool quoted = false;
+        uint32_t j = 0;
+
+        while (raw[j] && (quoted || raw[j] != ';')) {
+            uint32_t k;
+
+            if (raw[j] == '"') {
+                quoted = !quoted;
+            }
+
+            if (quoted || !lsp_is_word(raw[j])) {
+                j++;
+                continue;
+            }
+
+            for (k = j; lsp_is_word(raw[k]); k++) {
+            }
+
+            /* a directive is not a label */
+            if (k - j == len && memcmp(raw + j, name, len) == 0 && (j == 0 || raw[j - 1] != '.') &&
+                (with_declaration || !def || def->line != i || def->column != j)) {
+                if (!first) {
+                    lsp_put(b, ",");
+                }
+
+                lsp_put_location(b, doc, i, j, len);
+                first = false;
+            }
+
+            j = k;
+        }
+    }
+
+    lsp_put(b, "]");
+}
+
+/*!
+ * \brief answers textDocument/hover with the words of the line and the value of the label
+ *
+ * \param params	parameters of the request
+ * \param b			body of the response
+ */
+static void lsp_hover(const json_t * params, lsp_buffer_t * b) {
+    lsp_buffer_t text = { NULL, 0, 0, true };
+    lsp_document_t * doc;
+    uint32_t line, start, len, character;
+    uint16_t i;
+
+    doc = lsp_find(json_get_string(json_get(params, "textDocument"), "uri"));
+    if (!doc || !lsp_position(json_get(params, "position"), &line, &character, doc->source.count)) {
+        lsp_put(b, "null");
+        return;
+    }
+
+    if (lsp_word(params, &doc, &line, &start, &len)) {
+        const char * name = doc->source.lines[line].raw + start;
+
+        for (i = 0; i < doc->symbols_size; i++) {
+            symbol_t * sym = &doc->symbols[i];
+
+            if (sym->name && strlen(sym->name) == len && memcmp(sym->name, name, len) == 0) {
+                lsp_printf(&text, "%s: %s %04x\n", sym->name,
+                           sym->type == 'e' ? "external" : (sym->type == 'r' ? "data" : "code"), sym->value);
+                break;
+            }
+        }
+    }
+
+    if (doc->sizes && line < doc->words_count && doc->sizes[line] > 0) {
+        uint16_t address = doc->addresses[line];
+
+        lsp_printf(&text, "%04x:", address);
+        for (i = 0; i < doc->sizes[line]; i++) {
+            object_code_t * o = &doc->code[address + i];
+
+            lsp_printf(&text, " %04x %c", o->value, o->type);
+        }
+        lsp_put(&text, "\n");
+    }
+
+    if (text.size == 0) {
+        lsp_put(b, "null");
+    } else {
+        lsp_put(b, "{\"contents\":{\"kind\":\"plaintext\",\"value\":");
+        lsp_put_string(b, text.data);
+        lsp_put(b, "}}");
+    }
+
+    free(text.data);
+}
+
+/*!
+ * \brief reads the body of the next message
+ *
+ * \param in	input stream
+ * \param len	set to the length of the body
+ * \return		body (must be free()-d), NULL at the end of the input
+ */
+static char * lsp_read(FILE * in, size_t * len) {
+    char header[LSP_HEADER];
+    unsigned long length = 0;
+    bool found = false;
+    char * body;
+
+    while (fgets(header, sizeof(header), in)) {
+        if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0) {
+            if (found) {
+                break;
+            }
+            continue;
+        }
+
+        if (strncmp(header, "Content-Length:", 15) == 0) {
+            length = strtoul(header + 15, NULL, 10);
+            found = true;
+        }
+    }
+
+    if (!found || feof(in)) {
+        return NULL;
+    }
+
+    body = (char *)malloc(length + 1);
+    if (!body || fread(body, 1, length, in) != length) {
+        free(body);
+        return NULL;
+    }
+
+    body[length] = 0;
+    *len = length;
+
+    return body;
+}
+
+/*!
+ * \brief runs the language server until the exit notification or the end of the input
+ *
+ * \param in			input stream of the messages
+ * \param out			output stream of the messages
+ * \param error_limit	the passes stop after this number of errors, 0 for no limit
+ * \return				error code (0 after shutdown and exit)
+ */
+int lsp_run(FILE * in, FILE * out, uint32_t error_limit) {
+    bool shutdown = false;
+    int ret = 1;
+    size_t len;
+    char * body;
+
+    s_error_limit = error_limit;
+
+    while ((body = lsp_read(in, &len)) != NULL) {
+        json_t * message = json_parse(body, len);
+        const char * method = json_get_string(message, "method");
+        json_t * params = json_get(message, "params");
+        json_t * id = json_get(message, "id");
+        lsp_buffer_t b = { NULL, 0, 0, true };
+        bool ok = true;
+
+        free(body);
+
+        if (!method) {
+            /* a response or an invalid message */
+        } else if (strcmp(method, "exit") == 0) {
+            ret = shutdown ? 0 : 1;
+            json_free(message);
+            break;
+        } else if (strcmp(method, "textDocument/didOpen") == 0) {
+            ok = lsp_open(params, out);
+        } else if (strcmp(method, "textDocument/didChange") == 0) {
+            ok = lsp_change(params, out);
+        } else if (strcmp(method, "textDocument/didClose") == 0) {
+            ok = lsp_close(params, out);
+        } else if (id) {
+            lsp_begin_result(&b, id);
+
+            if (strcmp(method, "initialize") == 0) {
+                lsp_put(&b, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                            "\"definitionProvider\":true,\"referencesProvider\":true,\"hoverProvider\":true},"
+                            "\"serverInfo\":{\"name\":\"tas\"}}}");
+            } else if (strcmp(method, "shutdown") == 0) {
+                shutdown = true;
+                lsp_put(&b, "null}");
+            } else if (strcmp(method, "textDocument/definition") == 0) {
+                lsp_goto_definition(params, &b);
+                lsp_put(&b, "}");
+            } else if (strcmp(method, "textDocument/references") == 0) {
+                lsp_references(params, &b);
+                lsp_put(&b, "}");
+            } else if (strcmp(method, "textDocument/hover") == 0) {
+                lsp_hover(params, &b);
+                lsp_put(&b, "}");
+            } else {
+                b.size = 0;
+                lsp_put(&b, "{\"jsonrpc\":\"2.0\",\"id\":");
+                lsp_put_id(&b, id);
+                lsp_put(&b, ",\"error\":{\"code\":-32601,\"message\":\"method not found\"}}");
+            }
+
+            ok = lsp_send(out, &b);
+        }
+
+        free(b.data);
+        json_free(message);
+
+        if (!ok) {
+            break;
+        }
+    }
+
+    while (s_documents) {
+        lsp_document_t * doc = s_documents;
+
+        s_documents = doc->next;
+        lsp_document_free(doc);
+    }
+
+    return ret;
+}
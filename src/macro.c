@@ -0,0 +1,891 @@
+/*!
+ * \file macro.c
+ * \brief preprocessor of the macros and the included files, runs before the first pass
+ *
+ * A macro is defined by the lines between .macro and .endm:
+ *
+ *     .macro PRINT2 a,b
+ *     prn a
+ *     prn b
+ *     .endm
+ *
+ * and invoked by its name with the arguments, optionally with a label, which
+ * goes to the first line of the expansion (LINE: PRINT2 r1,#5). The words of
+ * the body that are equal to a parameter are replaced by the argument, the
+ * body can invoke other macros.
+ *
+ * The lines of the body are cleaned once, after the substitution, and get the
+ * number of the invoking line; they do not go through the text of the source
+ * again. The expansion of a macro with the same arguments is made once, the
+ * repeated invocations copy the cleaned lines from a cache.
+ *
+ * An .include "file" line is replaced by the lines of the file, relative to
+ * the including file. The file is cleaned once per process (see include.c),
+ * its lines keep their own numbers and the name of the file.
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief maximum depth of the macros invoking macros
+ */
+#define MACRO_DEPTH 16
+
+/*!
+ * \brief maximum depth of the files including files
+ */
+#define INCLUDE_DEPTH 16
+
+/*!
+ * \brief number of the buckets of the expansion cache, power of 2
+ */
+#define MACRO_BUCKETS 1024
+
+/*!
+ * \brief definition of a macro
+ */
+typedef struct macro_s {
+    char * name; /*!< \brief name */
+    char ** params; /*!< \brief names of the parameters */
+    uint32_t params_count; /*!< \brief number of the parameters */
+    char ** body; /*!< \brief lines of the body as written, cleaned after the substitution */
+    uint32_t body_count; /*!< \brief number of the lines of the body */
+} macro_t;
+
+/*!
+ * \brief expansion of a macro with a list of arguments
+ */
+typedef struct macro_expansion_s {
+    char * key; /*!< \brief name and arguments of the invocation */
+    uint32_t hash; /*!< \brief hash of the key */
+    char ** lines; /*!< \brief expanded lines */
+    uint32_t count; /*!< \brief number of the expanded lines */
+    struct macro_expansion_s * next; /*!< \brief next expansion in the bucket */
+} macro_expansion_t;
+
+/*!
+ * \brief lines of a source under construction
+ */
+typedef struct macro_lines_s {
+    char ** lines; /*!< \brief lines */
+    uint32_t count; /*!< \brief number of lines */
+    uint32_t capacity; /*!< \brief allocated lines */
+} macro_lines_t;
+
+static uint32_t line_number; /* current line number of the source code */
+static char * file_base_name; /* name of the source file */
+static int errors; /* number of errors of the preprocessor */
+
+static macro_t * s_macros = NULL; /*!< \brief defined macros */
+static uint32_t s_macros_count = 0; /*!< \brief number of the defined macros */
+static macro_expansion_t * s_cache[MACRO_BUCKETS]; /*!< \brief expansions by the hash of the invocation */
+
+/*!
+ * \brief hashes a string (FNV-1a)
+ *
+ * \param str	string
+ * \return		hash
+ */
+static uint32_t macro_hash(const char * str) {
+    uint32_t hash = 2166136261u;
+
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*!
+ * \brief appends a line
+ *
+ * \param lines	lines
+ * \param line	line, owned by the lines from now
+ * \return		success
+ */
+static bool macro_lines_add(macro_lines_t * lines, char * line) {
+    if (!line) {
+        return false;
+    }
+
+    if (lines->count == lines->capacity) {
+        uint32_t capacity = lines->capacity ? lines->capacity * 2 : 16;
+        char ** grown = (char **)realloc(lines->lines, capacity * sizeof(char *));
+
+        if (!grown) {
+            free(line);
+            return false;
+        }
+
+        lines->lines = grown;
+        lines->capacity = capacity;
+    }
+
+    lines->lines[lines->count++] = line;
+
+    return true;
+}
+
+/*!
+ * \brief releases lines
+ *
+ * \param lines	lines
+ * \param count	number of lines
+ */
+static void macro_lines_free(char ** lines, uint32_t count) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        free(lines[i]);
+    }
+
+    free(lines);
+}
+
+/*!
+ * \brief finds a macro
+ *
+ * \param name	name of the macro
+ * \return		macro or NULL
+ */
+static macro_t * macro_find(const char * name) {
+    uint32_t i;
+
+    for (i = 0; i < s_macros_count; i++) {
+        if (strcmp(s_macros[i].name, name) == 0) {
+            return &s_macros[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief releases the macros and the expansions
+ */
+static void macro_reset(void) {
+    uint32_t i;
+
+    for (i = 0; i < s_macros_count; i++) {
+        free(s_macros[i].name);
+        macro_lines_free(s_macros[i].params, s_macros[i].params_count);
+        macro_lines_free(s_macros[i].body, s_macros[i].body_count);
+    }
+
+    free(s_macros);
+    s_macros = NULL;
+    s_macros_count = 0;
+
+    for (i = 0; i < MACRO_BUCKETS; i++) {
+        while (s_cache[i]) {
+            macro_expansion_t * e = s_cache[i];
+
+            s_cache[i] = e->next;
+            free(e->key);
+            macro_lines_free(e->lines, e->count);
+            free(e);
+        }
+    }
+}
+
+/*!
+ * \brief checks if a character can be part of a word
+ *
+ * \param ch	character
+ * \return		[A-Za-z0-9_]
+ */
+static bool is_word_char(char ch) {
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+/*!
+ * \brief replaces the parameters of a line of the body with the arguments
+ *
+ * \param line	line of the body
+ * \param m		macro
+ * \param args	arguments, as many as the parameters
+ * \return		substituted line or NULL
+ */
+static char * macro_substitute(const char * line, macro_t * m, char ** args) {
+    size_t size = strlen(line) + 1, len = 0, i;
+    char * out;
+
+    for (i = 0; i < m->params_count; i++) {
+        size += strlen(args[i]) * strlen(line); /* enough for every word */
+    }
+
+    out = (char *)malloc(size);
+    if (!out) {
+        return NULL;
+    }
+
+    for (i = 0; line[i];) {
+        size_t start = i, p;
+        bool replaced = false;
+
+        if (!is_word_char(line[i])) {
+            out[len++] = line[i++];
+            continue;
+        }
+
+        while (is_word_char(line[i])) {
+            i++;
+        }
+
+        for (p = 0; p < m->params_count; p++) {
+            if (strlen(m->params[p]) == i - start && strncmp(m->params[p], &line[start], i - start) == 0) {
+                memcpy(&out[len], args[p], strlen(args[p]));
+                len += strlen(args[p]);
+                replaced = true;
+                break;
+            }
+        }
+
+        if (!replaced) {
+            memcpy(&out[len], &line[start], i - start);
+            len += i - start;
+        }
+    }
+
+    out[len] = 0;
+
+    return out;
+}
+
+/*!
+ * \brief copies a part of a line
+ *
+ * \param start	first character
+ * \param len	number of characters
+ * \return		copy or NULL
+ */
+static char * macro_copy(const char * start, size_t len) {
+    char * copy = (char *)malloc(len + 1);
+
+    if (copy) {
+        memcpy(copy, start, len);
+        copy[len] = 0;
+    }
+
+    return copy;
+}
+
+/*!
+ * \brief splits a line into an optional label, a name and the arguments
+ *
+ * \note works on the raw text, the cleaned text of "PRINT2 r1" is "PRINT2r1"
+ *
+ * \param line	line
+ * \param label	set to the label with the ':' or NULL
+ * \param name	set to the name of the operation, the directive or the macro or NULL
+ * \param rest	set to the rest of the line without the white spaces and the comment, or NULL
+ */
+static void macro_split(const char * line, char ** label, char ** name, char ** rest) {
+    const char * p = line;
+    size_t len, i;
+
+    *label = NULL;
+    *name = NULL;
+    *rest = NULL;
+
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    len = strcspn(p, " \t;");
+    if (len > 0 && p[len - 1] == ':') {
+        *label = macro_copy(p, len);
+        p += len;
+
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+
+        len = strcspn(p, " \t;");
+    }
+
+    if (len == 0) {
+        return;
+    }
+
+    *name = macro_copy(p, len);
+    p += len;
+
+    len = strcspn(p, ";");
+    *rest = macro_copy(p, len);
+
+    if (*rest) {
+        for (i = 0, len = 0; (*rest)[i]; i++) {
+            if ((*rest)[i] != ' ' && (*rest)[i] != '\t' && (*rest)[i] != '\r') {
+                (*rest)[len++] = (*rest)[i];
+            }
+        }
+        (*rest)[len] = 0;
+
+        if (len == 0) {
+            free(*rest);
+            *rest = NULL;
+        }
+    }
+}
+
+static bool macro_expand_line(const char * line, macro_lines_t * out, uint32_t depth);
+
+/*!
+ * \brief checks if a line invokes a macro
+ *
+ * \param line	line
+ * \return		invokes a macro
+ */
+static bool macro_invokes(const char * line) {
+    char * label;
+    char * name;
+    char * rest;
+    bool invokes;
+
+    if (s_macros_count == 0) {
+        return false;
+    }
+
+    macro_split(line, &label, &name, &rest);
+    invokes = name && macro_find(name);
+
+    free(label);
+    free(name);
+    free(rest);
+
+    return invokes;
+}
+
+/*!
+ * \brief expands an invocation, or copies it from the cache
+ *
+ * \param m		macro
+ * \param args	arguments, separated by commas, or NULL
+ * \param out	lines to append the expansion to
+ * \param depth	depth of the invocation
+ * \return		success
+ */
+static bool macro_invoke(macro_t * m, char * args, macro_lines_t * out, uint32_t depth) {
+    char * key = (char *)malloc(strlen(m->name) + (args ? strlen(args) : 0) + 2); /* + ' ' + NULL */
+    macro_expansion_t * e;
+    uint32_t hash, i, count = 0;
+    char ** values = NULL;
+
+    if (!key) {
+        ERROR("unable to allocate memory for the macro: %s", m->name);
+        return false;
+    }
+
+    sprintf(key, "%s %s", m->name, args ? args : "");
+    hash = macro_hash(key);
+
+    for (e = s_cache[hash & (MACRO_BUCKETS - 1)]; e; e = e->next) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) {
+            free(key);
+
+            for (i = 0; i < e->count; i++) {
+                if (!macro_lines_add(out, strdup(e->lines[i]))) {
+                    ERROR("unable to allocate memory for the macro: %s", m->name);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    }
+
+    if (depth >= MACRO_DEPTH) {
+        ERROR("macros are invoked deeper than %u levels: %s", MACRO_DEPTH, m->name);
+        free(key);
+        return false;
+    }
+
+    /* the arguments */
+    if (args) {
+        values = (char **)calloc(m->params_count + 1, sizeof(char *));
+        while (values && count <= m->params_count && (values[count] = string_split(args, ",", (int)count))) {
+            count++;
+        }
+    }
+
+    if (args && !values) {
+        ERROR("unable to allocate memory for the macro: %s", m->name);
+        free(key);
+        return false;
+    }
+
+    if (count != m->params_count) {
+        ERROR("wrong number of arguments of macro '%s', expected %u, got %u", m->name, m->params_count, count);
+        macro_lines_free(values, count);
+        free(key);
+        return false;
+    }
+
+    e = (macro_expansion_t *)calloc(1, sizeof(macro_expansion_t));
+    if (!e) {
+        ERROR("unable to allocate memory for the macro: %s", m->name);
+        macro_lines_free(values, count);
+        free(key);
+        return false;
+    }
+
+    e->key = key;
+    e->hash = hash;
+
+    /* expand the body into the cache entry, then copy it */
+    {
+        macro_lines_t lines = { NULL, 0, 0 };
+        bool ok = true;
+
+        for (i = 0; ok && i < m->body_count; i++) {
+            char * line = macro_substitute(m->body[i], m, values);
+
+            ok = line && macro_expand_line(line, &lines, depth + 1);
+            free(line);
+        }
+
+        e->lines = lines.lines;
+        e->count = lines.count;
+
+        if (!ok) {
+            free(e->key);
+            macro_lines_free(e->lines, e->count);
+            free(e);
+            macro_lines_free(values, count);
+            return false;
+        }
+    }
+
+    macro_lines_free(values, count);
+
+    e->next = s_cache[hash & (MACRO_BUCKETS - 1)];
+    s_cache[hash & (MACRO_BUCKETS - 1)] = e;
+
+    for (i = 0; i < e->count; i++) {
+        if (!macro_lines_add(out, strdup(e->lines[i]))) {
+            ERROR("unable to allocate memory for the macro: %s", m->name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief expands a line, if it invokes a macro, or cleans it
+ *
+ * \param line	line
+ * \param out	lines to append the cleaned lines to
+ * \param depth	depth of the invocation
+ * \return		success
+ */
+static bool macro_expand_line(const char * line, macro_lines_t * out, uint32_t depth) {
+    char * label;
+    char * name;
+    char * rest;
+    macro_t * m;
+    bool ok = true;
+
+    macro_split(line, &label, &name, &rest);
+    m = name ? macro_find(name) : NULL;
+
+    if (!m) {
+        char * clean = clean_line(line);
+
+        ok = clean && macro_lines_add(out, clean);
+        if (!ok) {
+            ERROR("unable to clean the line: %s", line);
+        }
+    } else {
+        uint32_t first = out->count;
+
+        ok = macro_invoke(m, rest, out, depth);
+
+        /* the label goes to the first line of the expansion */
+        if (ok && label) {
+            char * first_label = NULL;
+            char * first_name = NULL;
+            char * first_rest = NULL;
+
+            if (first == out->count) {
+                ERROR("label of an empty macro: %s", label);
+                ok = false;
+            } else {
+                macro_split(out->lines[first], &first_label, &first_name, &first_rest);
+
+                if (first_label) {
+                    ERROR("label of a macro whose first line has a label: %s", label);
+                    ok = false;
+                } else {
+                    char * labeled = (char *)malloc(strlen(label) + strlen(out->lines[first]) + 2); /* + ' ' + NULL */
+
+                    if (!labeled) {
+                        ERROR("unable to allocate memory for the line: %s", line);
+                        ok = false;
+                    } else {
+                        sprintf(labeled, "%s %s", label, out->lines[first]);
+                        free(out->lines[first]);
+                        out->lines[first] = labeled;
+                    }
+                }
+
+                free(first_label);
+                free(first_name);
+                free(first_rest);
+            }
+        }
+    }
+
+    free(label);
+    free(name);
+    free(rest);
+
+    return ok;
+}
+
+/*!
+ * \brief defines a macro from the lines of the source
+ *
+ * \param source	lines of the source
+ * \param index		index of the .macro line, set to the index of the .endm line
+ * \return			success
+ */
+static bool macro_define(source_t * source, uint32_t * index) {
+    char * label;
+    char * params;
+    macro_t m;
+    macro_lines_t body = { NULL, 0, 0 };
+    macro_lines_t names = { NULL, 0, 0 };
+    uint32_t i;
+    bool ok = true;
+
+    memset(&m, 0, sizeof(macro_t));
+
+    /* ".macro NAME a,b", the name and the parameters follow the directive */
+    macro_split(strstr(source->lines[*index].raw, ".macro") + 6, &label, &m.name, &params);
+
+    if (label) {
+        ERROR("invalid macro name: %s", label);
+        ok = false;
+    } else if (!m.name || !is_valid_label_name(m.name, 0, 0) || get_operation(m.name)) {
+        ERROR("invalid macro name: %s", m.name ? m.name : "");
+        ok = false;
+    } else if (macro_find(m.name)) {
+        ERROR("macro is already defined: %s", m.name);
+        ok = false;
+    }
+
+    for (i = 0; ok && params && i < TABLE_SIZE; i++) {
+        char * name = string_split(params, ",", (int)i);
+
+        if (!name) {
+            break;
+        }
+
+        if (!is_valid_label_name(name, 0, 0)) {
+            ERROR("invalid macro parameter: %s", name);
+            free(name);
+            ok = false;
+        } else {
+            ok = macro_lines_add(&names, name);
+        }
+    }
+
+    free(label);
+    free(params);
+
+    /* the body, up to the .endm */
+    for (i = *index + 1; i < source->count; i++) {
+        const char * line = source->lines[i].clean;
+
+        line_number = source->lines[i].number;
+
+        if (!line) {
+            ERROR("unable to clean the line: %s", source->lines[i].raw);
+            ok = false;
+        } else if (strcmp(line, ".endm") == 0) {
+            break;
+        } else if (strncmp(line, ".macro", 6) == 0 && (line[6] == ' ' || line[6] == 0)) {
+            ERROR("macro defined in a macro");
+            ok = false;
+        } else if (line[0] != 0 && line[0] != ';' && ok) {
+            ok = macro_lines_add(&body, strdup(source->lines[i].raw));
+        }
+    }
+
+    if (i == source->count) {
+        line_number = source->lines[*index].number;
+        ERROR("missing .endm of the macro: %s", m.name ? m.name : "");
+        ok = false;
+    }
+
+    *index = i;
+
+    if (ok) {
+        macro_t * grown = (macro_t *)realloc(s_macros, (s_macros_count + 1) * sizeof(macro_t));
+
+        if (grown) {
+            m.params = names.lines;
+            m.params_count = names.count;
+            m.body = body.lines;
+            m.body_count = body.count;
+
+            s_macros = grown;
+            s_macros[s_macros_count++] = m;
+
+            return true;
+        }
+
+        ERROR("unable to allocate memory for the macro: %s", m.name);
+    }
+
+    free(m.name);
+    macro_lines_free(names.lines, names.count);
+    macro_lines_free(body.lines, body.count);
+
+    return false;
+}
+
+/*!
+ * \brief appends a line to the expanded source
+ *
+ * \param expanded	expanded source
+ * \param capacity	allocated lines of the expanded source
+ * \param from		line of the source
+ * \param file		name of the included file of the line, NULL for the source itself
+ * \param clean		cleaned text, owned by the expanded source from now
+ * \return			success
+ */
+static bool macro_emit(source_t * expanded, uint32_t * capacity, source_line_t * from, const char * file, char * clean) {
+    source_line_t * line;
+
+    if (expanded->count == *capacity) {
+        uint32_t grown_capacity = *capacity * 2;
+        source_line_t * grown = (source_line_t *)realloc(expanded->lines, (grown_capacity + 1) * sizeof(source_line_t));
+
+        if (!grown) {
+            free(clean);
+            return false;
+        }
+
+        expanded->lines = grown;
+        *capacity = grown_capacity;
+    }
+
+    line = &expanded->lines[expanded->count];
+    memset(line, 0, sizeof(source_line_t));
+
+    line->raw = strdup(from->raw);
+    line->clean = clean;
+    line->length = from->length;
+    line->number = from->number;
+    line->file = file;
+
+    if (!line->raw) {
+        free(clean);
+        return false;
+    }
+
+    expanded->count++;
+
+    return true;
+}
+
+/*!
+ * \brief checks if a cleaned line is a directive
+ *
+ * \param clean		cleaned line
+ * \param directive	directive, e.g. ".macro"
+ * \return			the line is the directive, with or without parameters
+ */
+static bool is_directive(const char * clean, const char * directive) {
+    size_t len = strlen(directive);
+
+    return strncmp(clean, directive, len) == 0 && (clean[len] == ' ' || clean[len] == 0);
+}
+
+static bool macro_expand_source(source_t * source, const char * path, const char * file, source_t * expanded,
+                                uint32_t * capacity, bool * changed, uint32_t depth);
+
+static const char * s_including[INCLUDE_DEPTH]; /*!< \brief paths of the files being expanded, by depth */
+
+/*!
+ * \brief expands an included file in place of the .include line
+ *
+ * \param line		.include line
+ * \param path		path of the including file, NULL for a source in memory
+ * \param expanded	expanded source
+ * \param capacity	allocated lines of the expanded source
+ * \param changed	set if a line was removed or expanded
+ * \param depth		depth of the including file
+ * \return			success, false if out of memory
+ */
+static bool macro_include(source_line_t * line, const char * path, source_t * expanded, uint32_t * capacity,
+                          bool * changed, uint32_t depth) {
+    char * label;
+    char * directive;
+    char * name;
+    char * resolved = NULL;
+    source_t * included;
+    size_t len;
+    uint32_t i;
+    bool ok = true;
+
+    macro_split(line->raw, &label, &directive, &name);
+    len = name ? strlen(name) : 0;
+
+    if (len < 3 || name[0] != '"' || name[len - 1] != '"') {
+        ERROR("expected \"file\": %s", line->raw);
+    } else if (!path) {
+        ERROR("unable to include a file into a source without a path: %s", name);
+    } else if (depth + 1 >= INCLUDE_DEPTH) {
+        ERROR("files are included deeper than %u levels: %s", INCLUDE_DEPTH, name);
+    } else {
+        size_t dir = name[1] == '/' ? 0 : (size_t)(get_file_base_name(path) - path); /* relative to the including file */
+
+        resolved = (char *)malloc(dir + len - 1); /* - quotes + NULL */
+        if (!resolved) {
+            ok = false;
+        } else {
+            memcpy(resolved, path, dir);
+            memcpy(resolved + dir, name + 1, len - 2);
+            resolved[dir + len - 2] = 0;
+
+            for (i = 0; i <= depth && strcmp(s_including[i], resolved) != 0; i++) {
+            }
+
+            included = i <= depth ? NULL : include_load(resolved);
+            if (i <= depth) {
+                ERROR("file includes itself: %s", name);
+            } else if (!included) {
+                ERROR("unable to open '%s'", resolved);
+            } else {
+                ok = macro_expand_source(included, included->name, get_file_base_name(included->name), expanded,
+                                         capacity, changed, depth + 1);
+            }
+        }
+    }
+
+    free(label);
+    free(directive);
+    free(name);
+    free(resolved);
+
+    return ok;
+}
+
+/*!
+ * \brief expands the macros and the included files of a source
+ *
+ * \param source	lines of the source
+ * \param path		path of the source, NULL for a source in memory
+ * \param file		name of the included file, NULL for the source itself
+ * \param expanded	expanded source
+ * \param capacity	allocated lines of the expanded source
+ * \param changed	set if a line was removed or expanded
+ * \param depth		depth of the included file
+ * \return			success, false if out of memory
+ */
+static bool macro_expand_source(source_t * source, const char * path, const char * file, source_t * expanded,
+                                uint32_t * capacity, bool * changed, uint32_t depth) {
+    char * name = file ? (char *)file : source->name;
+    uint32_t i, j;
+    bool ok = true;
+
+    s_including[depth] = path ? path : "";
+
+    for (i = 0; ok && i < source->count && !diagnostics_stopped(); i++) {
+        source_line_t * line = &source->lines[i];
+        macro_lines_t lines = { NULL, 0, 0 };
+
+        file_base_name = name;
+        line_number = line->number;
+
+        if (!line->clean) {
+            /* reported by the first pass */
+            ok = macro_emit(expanded, capacity, line, file, NULL);
+            continue;
+        }
+
+        if (is_directive(line->clean, ".include")) {
+            *changed = true;
+            ok = macro_include(line, path, expanded, capacity, changed, depth);
+            continue;
+        }
+
+        if (is_directive(line->clean, ".macro")) {
+            *changed = true;
+            macro_define(source, &i);
+            continue;
+        }
+
+        if (strcmp(line->clean, ".endm") == 0) {
+            ERROR(".endm without .macro");
+            *changed = true;
+            continue;
+        }
+
+        if (!macro_invokes(line->raw)) {
+            ok = macro_emit(expanded, capacity, line, file, strdup(line->clean));
+            continue;
+        }
+
+        *changed = true;
+
+        if (!macro_expand_line(line->raw, &lines, 0)) {
+            macro_lines_free(lines.lines, lines.count);
+            continue;
+        }
+
+        for (j = 0; ok && j < lines.count; j++) {
+            ok = macro_emit(expanded, capacity, line, file, lines.lines[j]);
+        }
+
+        for (; j < lines.count; j++) {
+            free(lines.lines[j]);
+        }
+
+        free(lines.lines);
+    }
+
+    return ok;
+}
+
+/*!
+ * \brief expands the macros and the included files of a source
+ *
+ * \note expanded must be released with source_free()
+ *
+ * \param source	lines of the source
+ * \param path		path of the source, the included files are relative to it, NULL for a source in memory
+ * \param expanded	set to the lines without the definitions and with the expanded invocations
+ * \param changed	set if a line was removed or expanded
+ * \return			number of errors
+ */
+uint16_t macro_expand(source_t * source, const char * path, source_t * expanded, bool * changed) {
+    uint32_t capacity = source->count ? source->count : 1;
+
+    file_base_name = source->name;
+    line_number = 1;
+    errors = 0;
+    *changed = false;
+
+    expanded->name = source->name ? strdup(source->name) : NULL;
+    expanded->count = 0;
+    expanded->lines = (source_line_t *)calloc(capacity + 1, sizeof(source_line_t));
+
+    if (!expanded->lines) {
+        ERROR("unable to allocate memory for the source");
+        return (uint16_t)errors;
+    }
+
+    if (!macro_expand_source(source, path, NULL, expanded, &capacity, changed, 0)) {
+        ERROR("unable to allocate memory for the source");
+    }
+
+    macro_reset();
+
+    return (uint16_t)errors;
+}
@@ -8,84 +8,292 @@
 
 #include "asm.h"
 
-/* global tables, zero initialized  */
-object_code_t g_object_code[TABLE_SIZE]; /*!< \brief object code */
-uint16_t g_object_code_size = 0; /*!< \brief size of the object code */
-
-uint16_t g_data_image[TABLE_SIZE]; /*!< \brief data image */
-uint16_t g_data_image_size = 0; /*!< \brief size of the data image */
-
-symbol_t g_symbol_table[TABLE_SIZE]; /*!< \brief symbol table */
-uint16_t g_symbol_table_size = 0; /*!< \brief size of the symbol table */
-
-link_object_t g_link_table[TABLE_SIZE]; /*!< \brief linker table */
-uint16_t g_link_table_size = 0; /*!< \brief size of the linker table */
-
-link_object_t g_external_table[TABLE_SIZE]; /*!< \brief table of externals */
-uint16_t g_external_table_size; /*!< \brief size of the table of externals */
+/* global variables */
+extern uint16_t g_external_table_size;
+extern uint16_t g_object_code_size;
+extern uint16_t g_data_image_size;
 
 /* private variables */
 static bool s_list_tables = false; /*!< \brief flag of table listing */
 static bool s_no_output = false; /*!< \brief flag of no output */
 static bool s_binary_out = false; /*!< \brief flag of binary output file */
+static bool s_line_table = false; /*!< \brief flag of line table output file */
+static bool s_listing = false; /*!< \brief flag of listing file */
+static bool s_optimize = false; /*!< \brief flag of the peephole optimizer */
+static bool s_strip_dead = false; /*!< \brief flag of dropping the unreachable code and the unused data */
+static bool s_pool_data = false; /*!< \brief flag of merging the equal data */
+static bool s_size_report = false; /*!< \brief flag of the size and cycle report */
+static char * s_cost_name = NULL; /*!< \brief cost table file of the size report */
+static bool s_run = false; /*!< \brief flag of running the program after assembling */
+static uint64_t s_max_steps = 100000000; /*!< \brief maximum number of simulated instructions */
+static bool s_jit = false; /*!< \brief flag of running the program with the JIT */
+static bool s_profile = false; /*!< \brief flag of profiling the program */
+static char * s_folded_name = NULL; /*!< \brief output file of the folded stacks of the profiler */
+static uint32_t s_threads = 0; /*!< \brief number of threads of the batch mode, 0 for one per processor */
+static uint32_t s_error_limit = 0; /*!< \brief the passes stop after this number of errors, 0 for no limit */
+static diagnostic_format_t s_diagnostic_format = DIAGNOSTIC_TEXT; /*!< \brief format of the diagnostics */
+static diagnostics_t s_diagnostics; /*!< \brief diagnostics of the source being assembled */
 
 /*!
- * \brief usage string
- * 
+ * \brief prints the usage
+ *
+ * \note printed in parts, C90 compilers may limit a string literal to 509 characters
  */
-const char * help = "toy two pass assembler by gmb\n\n"
-                    "usage: tas <options> source-file\n\n"
-                    "options:\n"
-                    "  -l : prints debugging lists after each pass\n"
-                    "  -n : creates NO output files\n"
-                    "  -b : creates binary output file\n"
-                    "  -h : shows this text\n";
+static void print_help(void) {
+    printf("toy two pass assembler by gmb\n\n"
+           "usage: tas <options> source-file...\n"
+           "       tas --run-batch <options> image-file...\n\n"
+           "options:\n");
+    printf("  -l      : prints debugging lists after each pass\n"
+           "  -n      : creates NO output files\n"
+           "  -b      : creates binary output file\n"
+           "  -g      : creates line table file (.ln) for the debugging tools\n"
+           "  -L      : creates listing file (.lst) with the words of every line\n"
+           "  -O      : rewrites instructions into shorter ones between the passes\n");
+    printf("  --strip-dead : drops the code unreachable from the entries and the unused data\n"
+           "  --pool-data : merges the equal .data and .string, and the tails of the .string-s\n"
+           "  --size-report : prints the size of the labeled regions and the estimated cycles\n"
+           "  --cost-table=FILE : reads the cycles of the operations and modes from FILE\n");
+    printf("  --watch : reassembles the source every time it changes\n"
+           "  --lsp   : runs the language server on stdin/stdout\n"
+           "  --trace=FILE : writes a Chrome trace of the phases to FILE\n"
+           "  -ferror-limit=N : stops assembling a source after N errors\n"
+           "  -fdiagnostics-format=json : writes the diagnostics as JSON objects, one per line\n");
+    printf("  --run   : runs the program in the simulator after assembling\n"
+           "  --max-steps=N : stops the simulator after N instructions\n"
+           "  --jit   : runs the program as native code (x86-64 Linux)\n"
+           "  --profile : runs the program and reports the hot lines, loops and calls\n"
+           "  --profile-folded=FILE : writes the folded stacks of the profile to FILE\n"
+           "  --run-batch : runs the .oc and .bin files on all cores\n"
+           "  --threads=N : runs the batch on N threads\n"
+           "  -h      : shows this text\n");
+}
 
 /*!
- * \brief entry point of the application
- * 
- * \param argc	argument count
- * \param argv	argument values
- * \return		error code
+ * \brief creates the output file selected by the flags
+ *
+ * \param file_name	path of the source file
+ * \return			error code
  */
-int main(int argc, char * argv[]) {
-    int a;
-    char * file_name = NULL;
+static int create_output(const char * file_name) {
+    uint16_t errors;
 
-    /*ther must be at lesast 2 argument (tas + source) */
-    if (argc < 2) {
-        printf("%s", help);
-        return 1;
+    /* if output is desired */
+    if (s_no_output == false) {
+        if (s_binary_out) {
+            if (g_external_table_size > 0) {
+                fprintf(stderr, "unable to create binary file if source contains .extern-s\n");
+                return 4;
+            }
+
+            errors = create_binary_file(file_name);
+            if (errors != 0) {
+                fprintf(stderr, "binary file creation failed with %u error(s)\n", errors);
+                return 5;
+            }
+        } else {
+            /* create object file from object code */
+            errors = create_object_file(file_name);
+            if (errors != 0) {
+                fprintf(stderr, "object file creation failed with %u error(s)\n", errors);
+                return 4;
+            }
+        }
+
+        if (s_line_table) {
+            errors = create_line_table_file(file_name);
+            if (errors != 0) {
+                fprintf(stderr, "line table file creation failed with %u error(s)\n", errors);
+                return 4;
+            }
+        }
     }
 
-    /* get command line switches */
-    for (a = 0; a < argc; a++) {
-        if (argv[a][0] == '-') {
-            switch (argv[a][1]) {
-            case 'l':
-                s_list_tables = true;
-                break;
+    return 0;
+}
 
-            /* no output file */
-            case 'n':
-                s_no_output = true;
-                break;
+/*!
+ * \brief runs the assembled program in the simulator
+ *
+ * \param source	lines of the source, for the report of the profiler
+ * \return			error code
+ */
+static int run_program(source_t * source) {
+    machine_t * m = (machine_t *)malloc(sizeof(machine_t));
+    sim_status_t status;
 
-            case 'b':
-                s_binary_out = true;
-                break;
+    if (!m) {
+        fprintf(stderr, "unable to allocate memory for the simulator\n");
+        return 1;
+    }
 
-            case 'h':
-                printf("%s", help);
-                return 0;
-            }
+    sim_init(m, stdout);
+    if (s_jit) {
+        if (jit_available()) {
+            m->dispatch = SIM_DISPATCH_JIT;
         } else {
-            file_name = argv[a];
+            fprintf(stderr, "the JIT is not available on this platform, using the interpreter\n");
+        }
+    }
+
+    if (s_profile) {
+        if (s_jit) {
+            fprintf(stderr, "the profiler runs in the interpreter\n");
+        }
+
+        /* the profiler starts at the entry, the program counter is set by loading */
+        m->profile = profile_create(0);
+        if (!m->profile) {
+            fprintf(stderr, "unable to allocate memory for the profiler\n");
+            free(m);
+            return 1;
+        }
+    }
+
+    if (!sim_load_object_code(m)) {
+        fprintf(stderr, "unable to run a program that contains .extern-s\n");
+        profile_free(m->profile);
+        free(m);
+        return 6;
+    }
+
+    if (m->profile) {
+        m->profile->nodes[0].function = m->pc;
+    }
+
+    TRACE_BEGIN("run");
+    status = sim_run(m, s_max_steps);
+    TRACE_END("run");
+
+    fflush(stdout);
+    fprintf(stderr, "%s after %" PRIu64 " instruction(s)\n", sim_status_string(status), m->steps);
+
+    if (status != SIM_HALTED) {
+        fprintf(stderr, "pc: %04x sp: %04x psw: %04x r0-r7: %04x %04x %04x %04x %04x %04x %04x %04x\n",
+                m->pc, m->sp, m->psw, m->r[0], m->r[1], m->r[2], m->r[3],
+                m->r[4], m->r[5], m->r[6], m->r[7]);
+    }
+
+    if (m->profile) {
+        profile_report(m->profile, source, stderr);
+
+        if (s_folded_name && !profile_write_folded(m->profile, s_folded_name)) {
+            fprintf(stderr, "unable to write the folded stacks\n");
+        }
+
+        profile_free(m->profile);
+    }
+
+    sim_release(m);
+    free(m);
+
+    return status == SIM_HALTED ? 0 : 6;
+}
+
+/*!
+ * \brief writes the diagnostics of the source, then the failure of a step
+ *
+ * \note the errors are counted by the diagnostics of the source, the counts of the passes saturate
+ *
+ * \param step	failed step
+ */
+static void report_failure(const char * step) {
+    diagnostics_flush(&s_diagnostics);
+
+    /* the JSON output has the diagnostics only */
+    if (s_diagnostic_format == DIAGNOSTIC_TEXT) {
+        fprintf(stderr, "%s failed with %lu error(s)\n", step, (unsigned long)s_diagnostics.errors);
+    }
+}
+
+/*!
+ * \brief parses the value of a =N option
+ *
+ * \param str	value, decimal digits only
+ * \param max	largest valid value
+ * \param value	set to the value if it is valid
+ * \return		valid value
+ */
+static bool parse_count(const char * str, uint64_t max, uint64_t * value) {
+    uint64_t n = 0;
+
+    if (*str == 0) {
+        return false;
+    }
+
+    for (; *str; str++) {
+        uint64_t digit = (uint64_t)(*str - '0');
+
+        if (*str < '0' || *str > '9' || n > (max - digit) / 10) {
+            return false;
         }
+
+        n = n * 10 + digit;
+    }
+
+    *value = n;
+
+    return true;
+}
+
+/*!
+ * \brief assembles a source file and creates the output
+ *
+ * \param file_name	path of the source file
+ * \return			error code
+ */
+static int assemble(const char * file_name) {
+    source_t source = { NULL, NULL, 0 };
+    source_t expanded;
+    char * src;
+    size_t len;
+    bool loaded, changed;
+    uint16_t errors;
+    int ret = 0;
+
+    reset_tables(); /* the tables of the previous source */
+
+    /* read and clean the source once, both passes use the cleaned lines */
+    TRACE_BEGIN("read");
+    src = read_file(file_name, &len);
+    TRACE_END("read");
+
+    if (!src) {
+        error(get_file_base_name(file_name), 1, "unable to open '%s'", file_name);
+        report_failure("first pass");
+        return 2;
+    }
+
+    TRACE_BEGIN("lex");
+    loaded = source_load(&source, get_file_base_name(file_name), src, len);
+    TRACE_END("lex");
+
+    free(src);
+
+    if (!loaded) {
+        fprintf(stderr, "unable to allocate memory for the source\n");
+        ret = 1;
+        goto cleanup;
+    }
+
+    /* expand the macros and the included files, the passes use the expanded lines */
+    TRACE_BEGIN("macros");
+    errors = macro_expand(&source, file_name, &expanded, &changed);
+    TRACE_END("macros");
+
+    source_free(&source);
+    source = expanded;
+
+    if (errors != 0) {
+        report_failure("macro expansion");
+        ret = 2;
+        goto cleanup;
     }
 
     /* do the first pass */
-    uint16_t errors = first_pass(file_name);
+    TRACE_BEGIN("first_pass");
+    errors = first_pass(&source);
+    TRACE_END("first_pass");
 
     /* if pass was succesfull */
     if (errors == 0) {
@@ -99,12 +307,101 @@ int main(int argc, char * argv[]) {
         }
         /* if not, exit */
     } else {
-        fprintf(stderr, "first pass failed with %u error(s)\n", errors);
-        return 2;
+        report_failure("first pass");
+        ret = 2;
+        goto cleanup;
+    }
+
+    /* drop the dead code if flag is set */
+    if (s_strip_dead) {
+        uint16_t size = g_object_code_size + g_data_image_size;
+        uint32_t dropped;
+
+        if (s_list_tables) {
+            cfg_t cfg;
+
+            if (cfg_build(&cfg, &source)) {
+                print_cfg(&cfg);
+                cfg_free(&cfg);
+            }
+        }
+
+        TRACE_BEGIN("strip_dead_code");
+        errors = strip_dead_code(&source, &dropped);
+        TRACE_END("strip_dead_code");
+
+        if (errors != 0) {
+            report_failure("first pass after dropping the dead code");
+            ret = 2;
+            goto cleanup;
+        }
+
+        if (s_list_tables) {
+            printf("\n--- Results of the dead code elimination: %u line(s) dropped, %u word(s) saved\n", dropped,
+                   size - g_object_code_size - g_data_image_size);
+            print_sym_table();
+            print_object_code();
+        }
+    }
+
+    /* optimize if flag is set */
+    if (s_optimize) {
+        uint16_t size = g_object_code_size;
+        uint32_t rewrites;
+
+        TRACE_BEGIN("optimize");
+        errors = optimize(&source, &rewrites);
+        TRACE_END("optimize");
+
+        if (errors != 0) {
+            report_failure("first pass after optimizing");
+            ret = 2;
+            goto cleanup;
+        }
+
+        if (s_list_tables) {
+            printf("\n--- Results of the optimizer: %u rewrite(s), %u word(s) saved\n", rewrites,
+                   size - g_object_code_size);
+            print_sym_table();
+            print_object_code();
+        }
+    }
+
+    /* pool the data if flag is set */
+    if (s_pool_data) {
+        uint16_t saved;
+
+        if (!pool_data(&source, &saved)) {
+            fprintf(stderr, "unable to allocate memory for pooling the data\n");
+            ret = 2;
+            goto cleanup;
+        }
+
+        if (s_list_tables) {
+            printf("\n--- Results of the data pooling: %u word(s) saved\n", saved);
+            print_sym_table();
+            print_data_image();
+        }
+    }
+
+    /* the listing is written by the second pass, the pooled data is not in the order of the lines */
+    if (s_listing && !listing_open(file_name, !s_pool_data)) {
+        fprintf(stderr, "unable to create the listing file\n");
+        ret = 3;
+        goto cleanup;
     }
 
     /* do the second pass */
-    errors = second_pass(file_name);
+    TRACE_BEGIN("second_pass");
+    errors = second_pass(&source);
+    TRACE_END("second_pass");
+
+    /* the warnings come before the output of the later steps */
+    diagnostics_flush(&s_diagnostics);
+
+    if (!listing_close()) {
+        fprintf(stderr, "unable to write the listing file\n");
+    }
 
     /* if pass was succesfull */
     if (errors == 0) {
@@ -118,32 +415,269 @@ int main(int argc, char * argv[]) {
         }
         /* if not, exit */
     } else {
-        fprintf(stderr, "second pass failed with %u error(s)\n", errors);
-        return 3;
+        report_failure("second pass");
+        ret = 3;
+        goto cleanup;
     }
 
-    /* if output is desired */
-    if (s_no_output == false) {
-        if (s_binary_out) {
-            if (g_external_table_size > 0) {
-                fprintf(stderr, "unable to create binary file if source contains .extern-s\n");
-                return 4;
+    /* report the sizes if flag is set */
+    if (s_size_report) {
+        TRACE_BEGIN("size_report");
+        errors = create_size_report(&source, s_cost_name, stdout);
+        TRACE_END("size_report");
+
+        if (errors != 0) {
+            ret = 4;
+            goto cleanup;
+        }
+    }
+
+    TRACE_BEGIN("output");
+    ret = create_output(file_name);
+    TRACE_END("output");
+
+    if (ret == 0 && s_run) {
+        ret = run_program(&source);
+    }
+
+cleanup:
+    source_free(&source);
+
+    return ret;
+}
+
+/*!
+ * \brief assembles the source files one after the other
+ *
+ * Every source gets its own context of diagnostics, written when the source
+ * is done, so the diagnostics of the sources do not interleave.
+ *
+ * \param file_names	paths of the source files
+ * \param files			number of source files
+ * \return				error code of the first failed source, 0 if every source succeeded
+ */
+static int assemble_files(char ** file_names, uint32_t files) {
+    int errors = 0;
+    uint32_t i;
+
+    for (i = 0; i < files; i++) {
+        int ret;
+
+        diagnostics_init(&s_diagnostics, stderr, s_diagnostic_format, s_error_limit);
+        diagnostics_select(&s_diagnostics);
+
+        TRACE_BEGIN(get_file_base_name(file_names[i]));
+        ret = assemble(file_names[i]);
+        TRACE_END(get_file_base_name(file_names[i]));
+
+        if (!diagnostics_flush(&s_diagnostics)) {
+            ret = ret ? ret : 1;
+        }
+        diagnostics_free(&s_diagnostics);
+
+        if (errors == 0) {
+            errors = ret;
+        }
+    }
+
+    return errors;
+}
+
+/*!
+ * \brief gets an option the watch mode does not support
+ *
+ * \note the watch mode reruns the passes and writes the output files only
+ *
+ * \param files	number of source files
+ * \return		name of the option or NULL
+ */
+static const char * get_unsupported_watch_option(uint32_t files) {
+    if (files > 1) {
+        return "more than one source file";
+    } else if (s_list_tables) {
+        return "-l";
+    } else if (s_listing) {
+        return "-L";
+    } else if (s_optimize) {
+        return "-O";
+    } else if (s_strip_dead) {
+        return "--strip-dead";
+    } else if (s_pool_data) {
+        return "--pool-data";
+    } else if (s_size_report) {
+        return "--size-report";
+    } else if (s_run) {
+        return "--run";
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief entry point of the application
+ * 
+ * \param argc	argument count
+ * \param argv	argument values
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    int a;
+    uint64_t value;
+    const char * unsupported;
+    char ** file_names;
+    uint32_t files = 0;
+    bool watch = false, batch = false, lsp = false;
+    int errors;
+
+    /*ther must be at lesast 2 argument (tas + source) */
+    if (argc < 2) {
+        print_help();
+        return 1;
+    }
+
+    file_names = (char **)malloc(argc * sizeof(char *));
+    if (!file_names) {
+        fprintf(stderr, "unable to allocate memory for the arguments\n");
+        return 1;
+    }
+
+    /* get command line switches */
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[a], "--lsp") == 0) {
+            lsp = true;
+        } else if (strcmp(argv[a], "--profile") == 0) {
+            s_run = true;
+            s_profile = true;
+        } else if (strncmp(argv[a], "--profile-folded=", 17) == 0) {
+            s_run = true;
+            s_profile = true;
+            s_folded_name = argv[a] + 17;
+        } else if (strcmp(argv[a], "--run-batch") == 0) {
+            batch = true;
+        } else if (strncmp(argv[a], "--threads=", 10) == 0) {
+            if (!parse_count(argv[a] + 10, UINT32_MAX, &value)) {
+                break;
+            }
+            s_threads = (uint32_t)value;
+        } else if (strcmp(argv[a], "--size-report") == 0) {
+            s_size_report = true;
+        } else if (strncmp(argv[a], "--cost-table=", 13) == 0) {
+            s_size_report = true;
+            s_cost_name = argv[a] + 13;
+        } else if (strcmp(argv[a], "--pool-data") == 0) {
+            s_pool_data = true;
+        } else if (strcmp(argv[a], "--strip-dead") == 0) {
+            s_strip_dead = true;
+        } else if (strcmp(argv[a], "--run") == 0) {
+            s_run = true;
+        } else if (strcmp(argv[a], "--jit") == 0) {
+            s_run = true;
+            s_jit = true;
+        } else if (strncmp(argv[a], "--max-steps=", 12) == 0) {
+            if (!parse_count(argv[a] + 12, UINT64_MAX, &value)) {
+                break;
+            }
+            s_max_steps = (uint64_t)value;
+        } else if (strncmp(argv[a], "-ferror-limit=", 14) == 0) {
+            if (!parse_count(argv[a] + 14, UINT32_MAX, &value)) {
+                break;
             }
+            s_error_limit = (uint32_t)value;
+        } else if (strcmp(argv[a], "-fdiagnostics-format=json") == 0) {
+            s_diagnostic_format = DIAGNOSTIC_JSON;
+        } else if (strcmp(argv[a], "-fdiagnostics-format=text") == 0) {
+            s_diagnostic_format = DIAGNOSTIC_TEXT;
+        } else if (strncmp(argv[a], "--trace=", 8) == 0) {
+            if (!trace_open(argv[a] + 8)) {
+                fprintf(stderr, "unable to start tracing\n");
+                free(file_names);
+                return 1;
+            }
+        } else if (argv[a][0] == '-') {
+            switch (argv[a][1]) {
+            case 'l':
+                s_list_tables = true;
+                break;
 
-            errors = create_binary_file(file_name);
-            if (errors != 0) {
-                fprintf(stderr, "binary file creation failed with %u error(s)\n", errors);
-                return 5;
+            /* no output file */
+            case 'n':
+                s_no_output = true;
+                break;
+
+            case 'b':
+                s_binary_out = true;
+                break;
+
+            case 'g':
+                s_line_table = true;
+                break;
+
+            case 'L':
+                s_listing = true;
+                break;
+
+            case 'O':
+                s_optimize = true;
+                break;
+
+            case 'h':
+                print_help();
+                free(file_names);
+                return 0;
             }
         } else {
-            /* create object file from object code */
-            errors = create_object_file(file_name);
-            if (errors != 0) {
-                fprintf(stderr, "object file creation failed with %u error(s)\n", errors);
-                return 4;
-            }
+            file_names[files++] = argv[a];
         }
     }
 
-    return 0;
+    /* a =N option with an invalid value stopped the parsing */
+    if (a < argc) {
+        fprintf(stderr, "invalid value of option '%s'\n", argv[a]);
+        trace_close();
+        free(file_names);
+        return 1;
+    }
+
+    /* only the language server reads no file */
+    if (!lsp && files == 0) {
+        print_help();
+        trace_close();
+        free(file_names);
+        return 1;
+    }
+
+    /* the watch mode assembles one source without the optional steps */
+    if (watch && !lsp && !batch && (unsupported = get_unsupported_watch_option(files)) != NULL) {
+        fprintf(stderr, "--watch does not support %s\n", unsupported);
+        trace_close();
+        free(file_names);
+        return 1;
+    }
+
+    if (lsp) {
+        errors = lsp_run(stdin, stdout, s_error_limit);
+    } else if (batch) {
+        errors = run_batch(file_names, files, s_threads, s_max_steps, s_jit);
+    } else if (watch) {
+        diagnostics_init(&s_diagnostics, stderr, s_diagnostic_format, s_error_limit);
+        diagnostics_select(&s_diagnostics);
+        errors = watch_file(file_names[0], create_output, &s_diagnostics);
+        diagnostics_flush(&s_diagnostics);
+        diagnostics_free(&s_diagnostics);
+    } else {
+        errors = assemble_files(file_names, files);
+    }
+
+    include_cache_free();
+
+    if (!trace_flush()) {
+        fprintf(stderr, "unable to write the trace\n");
+    }
+    trace_close();
+
+    free(file_names);
+
+    return errors;
 }
@@ -0,0 +1,297 @@
+/*!
+ * \file optimize.c
+ * \brief peephole optimizer, runs between the passes (-O)
+ *
+ * The cleaned lines of the source are rewritten, then the first pass runs
+ * again, so the labels and the addresses are computed from the new lines.
+ * This repeats until there is nothing to rewrite.
+ *
+ * Rewrites:
+ * - add #1,X -> inc X, sub #1,X -> dec X: one word less, if the carry is not read
+ * - mul #2^k,X -> shl X,#k: the source of shl can not be instant, it is the
+ *   shifted value, if none of the flags are read
+ * - mov rX,rX is removed
+ * - cmp #0,rX (or cmp rX,#0) is removed after an add, sub, mul, inc or dec
+ *   of rX, those already set the zero flag for the value of rX
+ *
+ * The flags that are read later are found by a liveness analysis over the
+ * instructions: the successors of an instruction are the next one and the
+ * target of a jump to a label. The flags are live at an rts, at a jump to a
+ * computed address and at the end of the code, those can go anywhere.
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief maximum number of rewrite rounds
+ */
+#define OPTIMIZE_ROUNDS 8
+
+/*!
+ * \brief checks if an operand is an instant with a value
+ *
+ * \param operand	operand
+ * \param value		set to the value
+ * \return			instant
+ */
+static bool opt_instant(char * operand, uint16_t * value) {
+    /* a constant expression gets its value in the second pass */
+    return operand && operand[0] == '#' && parse_number(operand, 1, value) == NUMBER_OK;
+}
+
+/*!
+ * \brief computes the live flags of every instruction
+ *
+ * \param insts		instructions
+ * \param count		number of instructions
+ * \param live_in	set to the flags read before written, from the instruction
+ * \param live_out	set to the flags read before written, after the instruction
+ */
+static void opt_liveness(cfg_instruction_t * insts, uint32_t count, uint16_t * live_in, uint16_t * live_out) {
+    bool changed = true;
+    uint32_t i;
+
+    while (changed) {
+        changed = false;
+
+        for (i = count; i-- > 0;) {
+            cfg_instruction_t * inst = &insts[i];
+            uint16_t next = i + 1 < count ? live_in[i + 1] : PSW_Z | PSW_C; /* the end of the code */
+            uint16_t target = inst->target >= 0 ? live_in[inst->target] : PSW_Z | PSW_C;
+            uint16_t out, in;
+
+            switch (inst->decoded.op) {
+            case 0x2: /* add */
+            case 0x3: /* sub */
+            case 0x4: /* mul */
+            case 0xB: /* shl */
+                out = next;
+                in = 0;
+                break;
+
+            case 0x1: /* cmp */
+            case 0x7: /* inc */
+            case 0x8: /* dec */
+                out = next;
+                in = out & ~PSW_Z;
+                break;
+
+            case 0x9: /* jnz */
+                out = next | target;
+                in = out | PSW_Z;
+                break;
+
+            case 0xA: /* jnc */
+                out = next | target;
+                in = out | PSW_C;
+                break;
+
+            case 0xD: /* jsr, the callee returns with an rts */
+                out = target;
+                in = out;
+                break;
+
+            case 0xE: /* rts, the caller is not known */
+                out = PSW_Z | PSW_C;
+                in = out;
+                break;
+
+            case 0xF: /* hlt */
+                out = 0;
+                in = 0;
+                break;
+
+            default: /* mov, div, lea, prn */
+                out = next;
+                in = out;
+                break;
+            }
+
+            if (out != live_out[i] || in != live_in[i]) {
+                live_out[i] = out;
+                live_in[i] = in;
+                changed = true;
+            }
+        }
+    }
+}
+
+/*!
+ * \brief replaces the cleaned text of a line, keeps its label
+ *
+ * \param inst	instruction
+ * \param text	new operation with its operands, empty to remove the instruction
+ * \return		success
+ */
+static bool opt_replace(cfg_instruction_t * inst, const char * text) {
+    size_t len = (inst->label ? strlen(inst->label) + 1 : 0) + strlen(text);
+    char * clean = (char *)malloc(len + 1); /* + NULL */
+
+    if (!clean) {
+        return false;
+    }
+
+    if (inst->label) {
+        sprintf(clean, "%s %s", inst->label, text);
+    } else {
+        strcpy(clean, text);
+    }
+
+    free(inst->line->clean);
+    inst->line->clean = clean;
+
+    return true;
+}
+
+/*!
+ * \brief checks if an instruction sets the zero flag from the value it writes into a register
+ *
+ * \param inst	instruction
+ * \param reg	register
+ * \return		sets the zero flag from the register
+ */
+static bool opt_sets_zero_of(cfg_instruction_t * inst, uint8_t reg) {
+    switch (inst->decoded.op) {
+    case 0x2: /* add */
+    case 0x3: /* sub */
+    case 0x4: /* mul */
+    case 0x7: /* inc */
+    case 0x8: /* dec */
+        return inst->decoded.dest_addr == DIRECT_REGISTER && inst->decoded.dest_reg == reg;
+
+    default:
+        return false;
+    }
+}
+
+/*!
+ * \brief rewrites an instruction, if a pattern matches
+ *
+ * \param insts		instructions
+ * \param live_out	flags read before written, after the instructions
+ * \param i			index of the instruction
+ * \return			rewritten
+ */
+static bool opt_rewrite(cfg_instruction_t * insts, uint16_t * live_out, uint32_t i) {
+    cfg_instruction_t * inst = &insts[i];
+    instruction_t * d = &inst->decoded;
+    char * text;
+    bool rewritten = false;
+    uint16_t value, k;
+
+    switch (d->op) {
+    case 0x2: /* add #1,X -> inc X */
+    case 0x3: /* sub #1,X -> dec X */
+        if (opt_instant(inst->src, &value) && value == 1 && inst->dest && !(live_out[i] & PSW_C)) {
+            text = (char *)malloc(strlen(inst->dest) + 5); /* "inc " + NULL */
+            if (text) {
+                sprintf(text, "%s %s", d->op == 0x2 ? "inc" : "dec", inst->dest);
+                rewritten = opt_replace(inst, text);
+                free(text);
+            }
+        }
+        break;
+
+    case 0x4: /* mul #2^k,X -> shl X,#k */
+        if (!opt_instant(inst->src, &value) || !inst->dest || (live_out[i] & (PSW_Z | PSW_C))) {
+            break;
+        }
+
+        for (k = 1; k < 16; k++) {
+            char count[4];
+
+            sprintf(count, "%u", k);
+
+            if (value == 1u << k) {
+                text = (char *)malloc(strlen(inst->dest) + 9); /* "shl " + ",#" + count + NULL */
+                if (text) {
+                    sprintf(text, "shl %s,#%s", inst->dest, count);
+                    rewritten = opt_replace(inst, text);
+                    free(text);
+                }
+                break;
+            }
+        }
+        break;
+
+    case 0x0: /* mov rX,rX */
+        if (!inst->label && d->src_addr == DIRECT_REGISTER && d->dest_addr == DIRECT_REGISTER &&
+            d->src_reg == d->dest_reg) {
+            rewritten = opt_replace(inst, "");
+        }
+        break;
+
+    case 0x1: /* cmp #0,rX or cmp rX,#0 after setting rX */
+        if (inst->label || i == 0) {
+            break;
+        }
+
+        if ((d->dest_addr == DIRECT_REGISTER && opt_instant(inst->src, &value) && value == 0 &&
+             opt_sets_zero_of(&insts[i - 1], d->dest_reg)) ||
+            (d->src_addr == DIRECT_REGISTER && opt_instant(inst->dest, &value) && value == 0 &&
+             opt_sets_zero_of(&insts[i - 1], d->src_reg))) {
+            rewritten = opt_replace(inst, "");
+        }
+        break;
+    }
+
+    return rewritten;
+}
+
+/*!
+ * \brief rewrites the instructions of the source after the first pass, and runs the first pass again
+ *
+ * \param source	lines of the source, after a successful first pass
+ * \param rewrites	set to the number of the rewritten instructions
+ * \return			number of errors of the first pass
+ */
+uint16_t optimize(source_t * source, uint32_t * rewrites) {
+    uint16_t errors = 0;
+    uint32_t round;
+
+    *rewrites = 0;
+
+    for (round = 0; round < OPTIMIZE_ROUNDS; round++) {
+        uint32_t i, n = 0;
+        uint16_t * live_in;
+        uint16_t * live_out;
+        cfg_t cfg;
+
+        if (!cfg_build(&cfg, source)) {
+            break;
+        }
+
+        live_in = (uint16_t *)calloc(cfg.count ? cfg.count : 1, sizeof(uint16_t));
+        live_out = (uint16_t *)calloc(cfg.count ? cfg.count : 1, sizeof(uint16_t));
+
+        if (live_in && live_out) {
+            opt_liveness(cfg.instructions, cfg.count, live_in, live_out);
+
+            /* the rewrites do not change the flags that are read later, so the liveness stays valid */
+            for (i = 0; i < cfg.count; i++) {
+                if (opt_rewrite(cfg.instructions, live_out, i)) {
+                    n++;
+                }
+            }
+        }
+
+        free(live_in);
+        free(live_out);
+        cfg_free(&cfg);
+
+        if (n == 0) {
+            break;
+        }
+
+        *rewrites += n;
+
+        /* compute the labels and the addresses again */
+        reset_tables();
+        errors = first_pass(source);
+        if (errors != 0) {
+            break;
+        }
+    }
+
+    return errors;
+}
@@ -9,42 +9,106 @@ extern operation_t g_operations[16]; /*!< \brief array of operations */
 extern addressing_t g_addressings[5]; /*!< \brief array of addressing modes */
 
 /*!
- * \brief checks if the input sting is a valid numeric literal
- * 
- * regex equivalent: ^[-+]?[0-9]+$
- * 
+ * \brief gets the value of a digit in a base
+ *
+ * \param ch		character
+ * \param base	2, 10 or 16
+ * \return		value, -1 if not a digit of the base
+ */
+static int number_digit(char ch, uint32_t base) {
+    uint32_t digit = (uint8_t)(ch - '0'); /* the other characters are above 9 */
+
+    if (digit > 9) {
+        digit = (uint8_t)((ch | 0x20) - 'a'); /* lower case */
+        digit = digit < 6 ? digit + 10 : base;
+    }
+
+    return digit < base ? (int)digit : -1;
+}
+
+/*!
+ * \brief parses a numeric literal in one pass, validates it and computes its value
+ *
+ * regex equivalent: ^[-+]?([0-9]+|0[xX][0-9a-fA-F]+|0[bB][01]+)$
+ *
+ * A number must fit in a 16-bit word: 0 to 65535, or -32768 to -1 with the '-'
+ * sign (2's complement).
+ *
  * \note start_index is there, because we want to apply the same function to "1" and "#1"
- * 
+ *
  * \param str			string containing the numeric literal
  * \param start_index	start of the numeric literal in the input string
- * \return				valid or not
+ * \param value			set to the value if the literal is valid
+ * \return				NUMBER_OK, NUMBER_SYNTAX or NUMBER_RANGE
  */
-bool is_valid_numeric_literal(char * str, int start_index) {
-    if (!str || strlen(str) < 1) {
-        return false;
+number_status_t parse_number(const char * str, int start_index, uint16_t * value) {
+    const char * p;
+    uint32_t base = 10, limit = 0xffff, n = 0;
+    bool negative = false, range = false;
+    int digit;
+
+    if (!str) {
+        return NUMBER_SYNTAX;
     }
 
-    int i, len = (int)strlen(str);
-    bool valid = false;
-    char ch;
+    p = str + start_index;
 
-    for (i = start_index; i < len; ++i) {
-        ch = str[i];
+    /* check for -+ signs */
+    if (*p == '-') {
+        negative = true;
+        limit = 0x8000;
+        p++;
+    } else if (*p == '+') {
+        p++;
+    }
 
-        /* first character can be [-+][0-9] */
-        if (i == start_index) {
-            valid = (ch >= '0' && ch <= '9') || ch == '-' || ch == '+';
-            /* other characters can be [0-9] */
-        } else {
-            valid = ch >= '0' && ch <= '9';
-        }
+    /* 0x and 0b prefixes */
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X' || p[1] == 'b' || p[1] == 'B')) {
+        base = (p[1] | 0x20) == 'x' ? 16 : 2;
+        p += 2;
+    }
 
-        if (valid == false) {
-            return false;
+    /* at least one digit */
+    if (number_digit(*p, base) < 0) {
+        return NUMBER_SYNTAX;
+    }
+
+    /* "123" -> ((1) * 10 + 2) * 10 + 3, the digits after an overflow are only validated */
+    for (; (digit = number_digit(*p, base)) >= 0; p++) {
+        if (!range) {
+            n = n * base + (uint32_t)digit;
+            range = n > limit;
         }
     }
 
-    return true;
+    if (*p) {
+        return NUMBER_SYNTAX;
+    }
+
+    if (range) {
+        return NUMBER_RANGE;
+    }
+
+    /* if negative, create 2's complement */
+    *value = (uint16_t)(negative ? ~n + 1 : n);
+
+    return NUMBER_OK;
+}
+
+/*!
+ * \brief checks if the input sting is a valid numeric literal
+ *
+ * \note a number out of range is a valid literal, the error is reported where it gets its value
+ * \note start_index is there, because we want to apply the same function to "1" and "#1"
+ *
+ * \param str			string containing the numeric literal
+ * \param start_index	start of the numeric literal in the input string
+ * \return				valid or not
+ */
+bool is_valid_numeric_literal(char * str, int start_index) {
+    uint16_t value;
+
+    return parse_number(str, start_index, &value) != NUMBER_SYNTAX;
 }
 
 /*!
@@ -61,37 +125,29 @@ bool is_valid_numeric_literal(char * str, int start_index) {
  * \return				valid or not
  */
 bool is_valid_label_name(char * str, int start_index, int end_offset) {
-    if (!str || strlen(str) < 1) {
+    int len;
+
+    if (!str || !str[0]) {
         return false;
     }
 
-    int i, len = (int)strlen(str);
-    bool valid = false;
-    char ch;
-
     /* if it is a valid register name, it cant be a label */
     if (is_valid_register_name(str, start_index) == true) {
         return false;
     }
 
-    for (i = start_index; i < len - end_offset; ++i) {
-        ch = str[i];
-
-        /* first character can be [A-Za-z] */
-        if (i == start_index) {
-            valid = (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
-            /* other characters can be [A-Za-z0-9] */
-        } else {
-            valid = (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') ||
-                    (ch >= '0' && ch <= '9');
-        }
+    len = (int)strlen(str) - end_offset - start_index;
+    if (len <= 0) {
+        return true;
+    }
 
-        if (valid == false) {
-            return false;
-        }
+    /* first character can be [A-Za-z] */
+    if (!(g_char_class[(uint8_t)str[start_index]] & CHAR_ALPHA)) {
+        return false;
     }
 
-    return true;
+    /* other characters can be [A-Za-z0-9] */
+    return scan_span(str + start_index + 1, (size_t)len - 1, CHAR_ALPHA | CHAR_DIGIT) == (size_t)len - 1;
 }
 
 /*!
@@ -191,44 +247,18 @@ uint8_t get_register(char * str, int start_index) {
 /*!
  * \brief gets a 16bit integer number from a string
  * 
- * \note string must pass is_valid_numeric_literal()
+ * \note string must pass is_valid_numeric_literal(), see parse_number()
  * \note 2's complement for negative numbers
  * \note start_index is there, because we want to apply the same function to "1" and "#1"
  * 
  * \param str			string containing the number
  * \param start_index	start of the number in the input string
- * \return				numeric value
+ * \return				numeric value, 0 if out of range
  */
 uint16_t get_number(char * str, int start_index) {
-    if (!str) {
-        return 0;
-    }
-
     uint16_t value = 0;
-    bool negative = false;
-    int i, len = (int)strlen(str);
-
-    /* check for -+ signs */
-    if (str[start_index] == '-') {
-        negative = true;
-        start_index++;
-    } else if (str[start_index] == '+') {
-        start_index++;
-    }
 
-    /* start from backwards
-	   "123" -> 3 * 1 + 2 * 10 + 1 * 100
-	*/
-    for (i = len - 1; i >= start_index; i--) {
-        value *= 10;
-        value += str[i] - '0'; /* ascii to number */
-    }
-
-    /* if negative, create 2's complement */
-    if (negative == true) {
-        value = ~value; /* 1's complement */
-        value += 1; /* 2's complement */
-    }
+    parse_number(str, start_index, &value);
 
     return value;
 }
@@ -242,10 +272,10 @@ uint16_t get_number(char * str, int start_index) {
  * \return		type of the column
  */
 column_t column_type(char * str) {
-    int i, len = (int)strlen(str);
+    int i, len = str ? (int)strlen(str) : 0;
 
     /* not a valid column */
-    if (!str || len <= 1) {
+    if (len <= 1) {
         return UNKNOWN;
         /* starts with '.' */
     } else if (str[0] == '.') {
@@ -257,6 +287,10 @@ column_t column_type(char * str) {
             return DIRECTIVE_ENTRY;
         } else if (strcmp(str, ".extern") == 0) {
             return DIRECTIVE_EXTERN;
+        } else if (strcmp(str, ".equ") == 0) {
+            return DIRECTIVE_EQU;
+        } else if (strcmp(str, ".set") == 0) {
+            return DIRECTIVE_SET;
         } else {
             return UNKNOWN;
         }
@@ -305,6 +339,7 @@ operation_t * get_operation(char * mnemonic) {
  * \brief gets the struct of the addresssing from the operand
  * 
  * "#1" -> { INSTANT, 1 }
+ * "#SIZE*2" -> { INSTANT, 1 }
  * 
  * \param operand	string of operand
  * \return			addressing or NULL
@@ -318,8 +353,8 @@ addressing_t * get_addressing(char * operand) {
 	   so we don't have to copy the value, just get the address of the struct
        this way we dont have to worry about freeing */
     if (operand[0] == '#') {
-        return is_valid_numeric_literal(operand, 1) ? &g_addressings[INSTANT]
-                                                    : NULL;
+        return is_valid_numeric_literal(operand, 1) || is_valid_expression(operand, 1) ? &g_addressings[INSTANT]
+                                                                                       : NULL;
     } else if (operand[0] == '@') {
         if (is_valid_label_name(operand, 1, 0)) {
             return &g_addressings[INDIRECT];
@@ -0,0 +1,216 @@
+/*!
+ * \file pool.c
+ * \brief pooling of the data image
+ *
+ * A data object is the run of words from a data label to the next one (a
+ * .data or a .string with the unlabeled ones after it). An object that is
+ * equal to the tail of a longer or an earlier object is not kept, its labels
+ * are moved into the other object: a repeated .data table or .string becomes
+ * one, and "def" shares the words of "abcdef", the terminating NULL included.
+ *
+ * An object the program may write (see cfg.c) is kept as it is and no other
+ * object shares its words, a write must not change the other labels.
+ *
+ * Runs after the first pass, before the second pass relocates the data labels.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern uint16_t g_data_image[TABLE_SIZE];
+extern uint16_t g_data_image_size;
+
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+/*!
+ * \brief object of the data image
+ */
+typedef struct pool_object_s {
+    uint16_t start; /*!< \brief first word in the data image */
+    uint16_t size; /*!< \brief number of words */
+    int32_t host; /*!< \brief index of the object holding the words, -1 if kept */
+    bool written; /*!< \brief the program may write the object, it is not shared */
+    uint16_t offset; /*!< \brief first word in the host, or in the new data image if kept */
+} pool_object_t;
+
+/*!
+ * \brief orders the start addresses of the data labels
+ *
+ * \param a	start address
+ * \param b	start address
+ * \return	order
+ */
+static int compare_starts(const void * a, const void * b) {
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+/*!
+ * \brief orders the objects by decreasing size, then by the image order
+ *
+ * \param a	object
+ * \param b	object
+ * \return	order
+ */
+static int compare_sizes(const void * a, const void * b) {
+    const pool_object_t * x = *(const pool_object_t * const *)a;
+    const pool_object_t * y = *(const pool_object_t * const *)b;
+
+    if (x->size != y->size) {
+        return (int)y->size - (int)x->size;
+    }
+
+    return (int)x->start - (int)y->start;
+}
+
+/*!
+ * \brief finds the object of a word of the data image
+ *
+ * \param objects	objects in the image order
+ * \param count		number of objects
+ * \param address	word of the data image
+ * \return			index of the object
+ */
+static uint32_t pool_object_of(pool_object_t * objects, uint32_t count, uint16_t address) {
+    uint32_t low = 0, high = count;
+
+    /* the last object that starts at or before the address */
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (objects[mid].start <= address) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low > 0 ? low - 1 : 0;
+}
+
+/*!
+ * \brief merges the equal data objects and the ones equal to the tail of another
+ *
+ * \param source	lines of the source, after a successful first pass
+ * \param saved		set to the number of the saved words
+ * \return			success
+ */
+bool pool_data(source_t * source, uint16_t * saved) {
+    uint16_t starts[TABLE_SIZE + 1];
+    uint16_t image[TABLE_SIZE];
+    pool_object_t * objects;
+    pool_object_t ** order;
+    uint32_t count = 0, i, j;
+    uint16_t size = 0;
+    cfg_t cfg;
+
+    *saved = 0;
+
+    /* the written labels */
+    if (!cfg_build(&cfg, source)) {
+        return false;
+    }
+
+    /* the objects start at the data labels, the words before the first label are an object too */
+    starts[count++] = 0;
+    for (i = 0; i < g_symbol_table_size; i++) {
+        if (g_symbol_table[i].type == 'r' && g_symbol_table[i].value < g_data_image_size) {
+            starts[count++] = g_symbol_table[i].value;
+        }
+    }
+
+    qsort(starts, count, sizeof(uint16_t), compare_starts);
+
+    objects = (pool_object_t *)malloc(count * sizeof(pool_object_t));
+    order = (pool_object_t **)malloc(count * sizeof(pool_object_t *));
+    if (!objects || !order) {
+        free(objects);
+        free(order);
+        cfg_free(&cfg);
+        return false;
+    }
+
+    /* labels at the same address start the same object */
+    for (i = 0, j = 0; i < count; i++) {
+        if (j == 0 || objects[j - 1].start != starts[i]) {
+            objects[j].start = starts[i];
+            objects[j].host = -1;
+            objects[j].offset = 0;
+            objects[j].written = false;
+            j++;
+        }
+    }
+    count = j;
+
+    for (i = 0; i < count; i++) {
+        objects[i].size = (uint16_t)((i + 1 < count ? objects[i + 1].start : g_data_image_size) - objects[i].start);
+        order[i] = &objects[i];
+    }
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        if (cfg.written[i] && g_symbol_table[i].type == 'r' && g_symbol_table[i].value < g_data_image_size) {
+            objects[pool_object_of(objects, count, g_symbol_table[i].value)].written = true;
+        }
+    }
+
+    cfg_free(&cfg);
+
+    /* the longer objects are kept first, a shorter one may be a tail of them */
+    qsort(order, count, sizeof(pool_object_t *), compare_sizes);
+
+    for (i = 0; i < count; i++) {
+        pool_object_t * o = order[i];
+
+        if (o->size == 0 || o->written) {
+            continue;
+        }
+
+        for (j = 0; j < i; j++) {
+            pool_object_t * h = order[j];
+
+            if (h->host < 0 && !h->written && h->size >= o->size &&
+                memcmp(&g_data_image[h->start + h->size - o->size], &g_data_image[o->start],
+                       o->size * sizeof(uint16_t)) == 0) {
+                o->host = (int32_t)(h - objects);
+                o->offset = h->size - o->size;
+                break;
+            }
+        }
+    }
+
+    /* the kept objects in the image order */
+    for (i = 0; i < count; i++) {
+        pool_object_t * o = &objects[i];
+
+        if (o->host < 0) {
+            memcpy(&image[size], &g_data_image[o->start], o->size * sizeof(uint16_t));
+            o->offset = size;
+            size += o->size;
+        }
+    }
+
+    /* move the labels, an empty object at the end stays at the end */
+    for (i = 0; i < g_symbol_table_size; i++) {
+        symbol_t * sym = &g_symbol_table[i];
+
+        if (sym->type == 'r') {
+            if (sym->value >= g_data_image_size) {
+                sym->value = size;
+            } else {
+                pool_object_t * o = &objects[pool_object_of(objects, count, sym->value)];
+                uint16_t offset = o->host < 0 ? o->offset : (uint16_t)(objects[o->host].offset + o->offset);
+
+                sym->value = offset;
+            }
+        }
+    }
+
+    *saved = g_data_image_size - size;
+    memcpy(g_data_image, image, size * sizeof(uint16_t));
+    g_data_image_size = size;
+
+    free(objects);
+    free(order);
+
+    return true;
+}
@@ -0,0 +1,466 @@
+/*!
+ * \file profile.c
+ * \brief profiler of the simulated programs
+ *
+ * The simulator counts every executed instruction by address and by calling
+ * context: the contexts form a tree, a jsr enters a child of the current
+ * context, an rts returns to its parent. The report maps the addresses back to
+ * the source with the line table of the first pass and to the nearest label:
+ * hot lines, hot loops (taken backward jumps) and the jsr/rts call graph. The
+ * folded stacks ("MAIN;F1;F2 count" lines) are the input of the flame graph
+ * tools.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+extern uint32_t g_line_table[TABLE_SIZE];
+
+/*!
+ * \brief number of rows of the tables of the report
+ */
+#define PROFILE_ROWS 20
+
+/*!
+ * \brief maximum length of a location (label+offset)
+ */
+#define PROFILE_NAME_SIZE 64
+
+/*!
+ * \brief executed instructions of a source line
+ */
+typedef struct profile_line_s {
+    uint32_t line; /*!< \brief line number */
+    uint16_t address; /*!< \brief first executed address of the line */
+    uint64_t count; /*!< \brief executed instructions */
+} profile_line_t;
+
+/*!
+ * \brief loop closed by a backward jump
+ */
+typedef struct profile_loop_s {
+    uint16_t head; /*!< \brief target of the jump */
+    uint16_t jump; /*!< \brief address of the jump */
+    uint64_t taken; /*!< \brief taken backward jumps */
+    uint64_t count; /*!< \brief executed instructions between the head and the jump */
+} profile_loop_t;
+
+/*!
+ * \brief edge of the call graph
+ */
+typedef struct profile_edge_s {
+    uint16_t caller; /*!< \brief address of the calling function */
+    uint16_t callee; /*!< \brief address of the called function */
+    uint64_t calls; /*!< \brief number of calls */
+    uint64_t count; /*!< \brief executed instructions in the callee, with its callees */
+} profile_edge_t;
+
+/*!
+ * \brief creates the counters of the profiler
+ *
+ * \note returned value, if not NULL, must be released with profile_free()
+ *
+ * \param entry	address of the first instruction, the root of the calling contexts
+ * \return		counters or NULL
+ */
+profile_t * profile_create(uint16_t entry) {
+    profile_t * p = (profile_t *)calloc(1, sizeof(profile_t));
+
+    if (!p) {
+        return NULL;
+    }
+
+    p->nodes_capacity = 64;
+    p->nodes = (profile_node_t *)calloc(p->nodes_capacity, sizeof(profile_node_t));
+    if (!p->nodes) {
+        free(p);
+        return NULL;
+    }
+
+    p->nodes[0].function = entry;
+    p->nodes_size = 1;
+
+    return p;
+}
+
+/*!
+ * \brief releases the counters of the profiler
+ *
+ * \param p	counters or NULL
+ */
+void profile_free(profile_t * p) {
+    if (p) {
+        free(p->nodes);
+        free(p);
+    }
+}
+
+/*!
+ * \brief enters a function, called by the simulator at a jsr
+ *
+ * \param p			counters
+ * \param function	address of the function
+ */
+void profile_call(profile_t * p, uint16_t function) {
+    profile_node_t * node = &p->nodes[p->current];
+    uint32_t child;
+
+    if (p->lost > 0) {
+        p->lost++;
+        return;
+    }
+
+    for (child = node->child; child != 0; child = p->nodes[child].sibling) {
+        if (p->nodes[child].function == function) {
+            break;
+        }
+    }
+
+    if (child == 0) {
+        if (p->nodes_size == p->nodes_capacity) {
+            profile_node_t * grown = (profile_node_t *)realloc(p->nodes, p->nodes_capacity * 2 * sizeof(profile_node_t));
+
+            if (!grown) {
+                /* stay in the caller, the returns are matched by the counter */
+                p->lost++;
+                return;
+            }
+
+            p->nodes = grown;
+            p->nodes_capacity *= 2;
+            node = &p->nodes[p->current];
+        }
+
+        child = p->nodes_size++;
+        memset(&p->nodes[child], 0, sizeof(profile_node_t));
+        p->nodes[child].function = function;
+        p->nodes[child].parent = p->current;
+        p->nodes[child].sibling = node->child;
+        node->child = child;
+    }
+
+    p->nodes[child].calls++;
+    p->current = child;
+}
+
+/*!
+ * \brief leaves a function, called by the simulator at an rts
+ *
+ * \param p	counters
+ */
+void profile_return(profile_t * p) {
+    if (p->lost > 0) {
+        p->lost--;
+    } else {
+        p->current = p->nodes[p->current].parent;
+    }
+}
+
+/*!
+ * \brief formats an address as the nearest label before it and an offset
+ *
+ * \param address	address
+ * \param name		buffer of PROFILE_NAME_SIZE characters
+ * \return			name
+ */
+static char * profile_location(uint16_t address, char * name) {
+    symbol_t * best = NULL;
+    uint16_t i;
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        symbol_t * s = &g_symbol_table[i];
+
+        if (s->type != 'e' && s->value <= address && (!best || s->value > best->value)) {
+            best = s;
+        }
+    }
+
+    if (!best) {
+        sprintf(name, "%04x", address);
+    } else if (best->value == address) {
+        sprintf(name, "%.*s", PROFILE_NAME_SIZE - 1, best->name);
+    } else {
+        sprintf(name, "%.*s+%u", PROFILE_NAME_SIZE - 8, best->name, address - best->value);
+    }
+
+    return name;
+}
+
+/*!
+ * \brief gets the cleaned text of a source line
+ *
+ * \param source	lines of the source or NULL
+ * \param line		line number
+ * \return			text, empty if it is not known
+ */
+static const char * profile_source_text(source_t * source, uint32_t line) {
+    if (!source || line == 0 || line > source->count || !source->lines[line - 1].clean) {
+        return "";
+    }
+
+    return source->lines[line - 1].clean;
+}
+
+/*!
+ * \brief orders the lines by their counts, descending
+ */
+static int profile_compare_lines(const void * a, const void * b) {
+    uint64_t ca = ((const profile_line_t *)a)->count, cb = ((const profile_line_t *)b)->count;
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/*!
+ * \brief orders the loops by their counts, descending
+ */
+static int profile_compare_loops(const void * a, const void * b) {
+    uint64_t ca = ((const profile_loop_t *)a)->count, cb = ((const profile_loop_t *)b)->count;
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/*!
+ * \brief orders the edges by their counts, descending
+ */
+static int profile_compare_edges(const void * a, const void * b) {
+    uint64_t ca = ((const profile_edge_t *)a)->count, cb = ((const profile_edge_t *)b)->count;
+
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+/*!
+ * \brief gets the percentage of a count
+ *
+ * \param count	count
+ * \param total	total count
+ * \return		percentage
+ */
+static double profile_percent(uint64_t count, uint64_t total) {
+    return total ? 100.0 * count / total : 0.0;
+}
+
+/*!
+ * \brief writes the hot lines
+ *
+ * \param p			counters
+ * \param source	lines of the source or NULL
+ * \param total		executed instructions
+ * \param fp		output stream
+ */
+static void profile_report_lines(profile_t * p, source_t * source, uint64_t total, FILE * fp) {
+    profile_line_t lines[TABLE_SIZE];
+    char name[PROFILE_NAME_SIZE];
+    uint32_t size = 0, i;
+    uint16_t a;
+
+    /* the words of a line are consecutive */
+    for (a = 0; a < TABLE_SIZE; a++) {
+        if (p->counts[a] == 0) {
+            continue;
+        }
+
+        if (size > 0 && g_line_table[a] != 0 && lines[size - 1].line == g_line_table[a]) {
+            lines[size - 1].count += p->counts[a];
+        } else {
+            lines[size].line = g_line_table[a];
+            lines[size].address = a;
+            lines[size].count = p->counts[a];
+            size++;
+        }
+    }
+
+    qsort(lines, size, sizeof(profile_line_t), profile_compare_lines);
+
+    fprintf(fp, "\nhot lines:\n%14s %7s  %-20s %-16s %s\n", "instructions", "%", "line", "location", "source");
+
+    for (i = 0; i < size && i < PROFILE_ROWS; i++) {
+        char at[PROFILE_NAME_SIZE + 16];
+
+        if (lines[i].line) {
+            sprintf(at, "%.*s:%u", PROFILE_NAME_SIZE, source ? source->name : "", lines[i].line);
+        } else {
+            /* data or code written at runtime */
+            sprintf(at, "%04x", lines[i].address);
+        }
+
+        fprintf(fp, "%14" PRIu64 " %6.2f%%  %-20s %-16s %s\n", lines[i].count,
+                profile_percent(lines[i].count, total), at, profile_location(lines[i].address, name),
+                profile_source_text(source, lines[i].line));
+    }
+}
+
+/*!
+ * \brief writes the hot loops
+ *
+ * \param p			counters
+ * \param source	lines of the source or NULL
+ * \param total		executed instructions
+ * \param fp		output stream
+ */
+static void profile_report_loops(profile_t * p, source_t * source, uint64_t total, FILE * fp) {
+    profile_loop_t loops[TABLE_SIZE];
+    char head[PROFILE_NAME_SIZE], jump[PROFILE_NAME_SIZE];
+    uint32_t size = 0, i;
+    uint16_t a, b;
+
+    for (a = 0; a < TABLE_SIZE; a++) {
+        if (p->back_edges[a] == 0) {
+            continue;
+        }
+
+        loops[size].head = p->back_targets[a];
+        loops[size].jump = a;
+        loops[size].taken = p->back_edges[a];
+        loops[size].count = 0;
+
+        /* the body is the code between the head and the jump, without the callees */
+        for (b = loops[size].head; b <= a; b++) {
+            loops[size].count += p->counts[b];
+        }
+
+        size++;
+    }
+
+    qsort(loops, size, sizeof(profile_loop_t), profile_compare_loops);
+
+    fprintf(fp, "\nhot loops:\n%14s %7s %12s  %s\n", "instructions", "%", "back jumps", "head -> backward jump");
+
+    for (i = 0; i < size && i < PROFILE_ROWS; i++) {
+        profile_loop_t * l = &loops[i];
+
+        fprintf(fp, "%14" PRIu64 " %6.2f%% %12" PRIu64 "  %s (%s:%u) -> %s (%s:%u)\n", l->count,
+                profile_percent(l->count, total), l->taken,
+                profile_location(l->head, head), source ? source->name : "", g_line_table[l->head],
+                profile_location(l->jump, jump), source ? source->name : "", g_line_table[l->jump]);
+    }
+}
+
+/*!
+ * \brief writes the call graph
+ *
+ * \param p			counters
+ * \param total		executed instructions
+ * \param fp		output stream
+ */
+static void profile_report_calls(profile_t * p, uint64_t total, FILE * fp) {
+    profile_edge_t * edges = (profile_edge_t *)calloc(p->nodes_size, sizeof(profile_edge_t));
+    uint64_t * inclusive = (uint64_t *)calloc(p->nodes_size, sizeof(uint64_t));
+    char caller[PROFILE_NAME_SIZE], callee[PROFILE_NAME_SIZE];
+    uint32_t size = 0, i, j;
+
+    if (!edges || !inclusive) {
+        free(edges);
+        free(inclusive);
+        return;
+    }
+
+    /* a callee is created after its caller, so the children are summed first */
+    for (i = p->nodes_size; i-- > 0;) {
+        inclusive[i] += p->nodes[i].self;
+        if (i > 0) {
+            inclusive[p->nodes[i].parent] += inclusive[i];
+        }
+    }
+
+    /* merge the contexts of the same caller and callee */
+    for (i = 1; i < p->nodes_size; i++) {
+        profile_node_t * n = &p->nodes[i];
+        uint16_t from = p->nodes[n->parent].function;
+
+        for (j = 0; j < size; j++) {
+            if (edges[j].caller == from && edges[j].callee == n->function) {
+                break;
+            }
+        }
+
+        if (j == size) {
+            edges[size].caller = from;
+            edges[size].callee = n->function;
+            size++;
+        }
+
+        edges[j].calls += n->calls;
+        edges[j].count += inclusive[i];
+    }
+
+    qsort(edges, size, sizeof(profile_edge_t), profile_compare_edges);
+
+    fprintf(fp, "\ncalls:\n%14s %7s %12s  %s\n", "instructions", "%", "calls", "caller -> callee");
+
+    for (i = 0; i < size && i < PROFILE_ROWS; i++) {
+        fprintf(fp, "%14" PRIu64 " %6.2f%% %12" PRIu64 "  %s -> %s\n", edges[i].count,
+                profile_percent(edges[i].count, total), edges[i].calls,
+                profile_location(edges[i].caller, caller), profile_location(edges[i].callee, callee));
+    }
+
+    free(edges);
+    free(inclusive);
+}
+
+/*!
+ * \brief writes the report of the profiler
+ *
+ * \param p			counters
+ * \param source	lines of the source, for the text of the lines, or NULL
+ * \param fp		output stream
+ */
+void profile_report(profile_t * p, source_t * source, FILE * fp) {
+    uint64_t total = 0;
+    uint16_t a;
+
+    for (a = 0; a < TABLE_SIZE; a++) {
+        total += p->counts[a];
+    }
+
+    fprintf(fp, "profile: %" PRIu64 " instruction(s)\n", total);
+
+    profile_report_lines(p, source, total, fp);
+    profile_report_loops(p, source, total, fp);
+    profile_report_calls(p, total, fp);
+}
+
+/*!
+ * \brief writes the stack of a calling context, "MAIN;F1;F2"
+ *
+ * \param p		counters
+ * \param node	index of the calling context
+ * \param fp	output stream
+ */
+static void profile_write_stack(profile_t * p, uint32_t node, FILE * fp) {
+    char name[PROFILE_NAME_SIZE];
+
+    if (node != 0) {
+        profile_write_stack(p, p->nodes[node].parent, fp);
+        fputc(';', fp);
+    }
+
+    fputs(profile_location(p->nodes[node].function, name), fp);
+}
+
+/*!
+ * \brief writes the folded stacks, the input of the flame graph tools
+ *
+ * \param p			counters
+ * \param file_name	output file
+ * \return			success
+ */
+bool profile_write_folded(profile_t * p, const char * file_name) {
+    FILE * fp = fopen(file_name, "w");
+    uint32_t i;
+
+    if (!fp) {
+        return false;
+    }
+
+    for (i = 0; i < p->nodes_size; i++) {
+        if (p->nodes[i].self > 0) {
+            profile_write_stack(p, i, fp);
+            fprintf(fp, " %" PRIu64 "\n", p->nodes[i].self);
+        }
+    }
+
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,264 @@
+/*!
+ * \file scan.c
+ * \brief character classification of the tokenizer and the validators
+ *
+ * Every byte belongs to one class: white space (' ', '\t'), comment start (';'),
+ * comma, digit, letter or special (any other byte but NULL, which has no class).
+ * scan_span() returns the length of the run of bytes that belong to a set of
+ * classes. On x86 the bytes are classified 16 (SSE2) or 32 (AVX2, if the
+ * processor has it) at a time with comparisons, the first byte outside the set
+ * is found from the mask of the block; elsewhere a table is used.
+ */
+
+#include "asm.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+    #define SCAN_X86
+    #include <immintrin.h> /* for the SSE2 and AVX2 intrinsics */
+#endif
+
+/* short names of the classes in the table */
+#define S_ CHAR_SPACE
+#define C_ CHAR_COMMENT
+#define K_ CHAR_COMMA
+#define D_ CHAR_DIGIT
+#define A_ CHAR_ALPHA
+#define X_ CHAR_SPECIAL
+
+/*!
+ * \brief class of every byte
+ */
+const uint8_t g_char_class[256] = {
+    0,  X_, X_, X_, X_, X_, X_, X_, X_, S_, X_, X_, X_, X_, X_, X_, /* 0x00 NULL, 0x09 '\t' */
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    S_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, K_, X_, X_, X_, /* 0x20 ' ', 0x2c ',' */
+    D_, D_, D_, D_, D_, D_, D_, D_, D_, D_, X_, C_, X_, X_, X_, X_, /* 0x30 '0'-'9', 0x3b ';' */
+    X_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, /* 0x41 'A'- */
+    A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, X_, X_, X_, X_, X_, /* -0x5a 'Z' */
+    X_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, /* 0x61 'a'- */
+    A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, A_, X_, X_, X_, X_, X_, /* -0x7a 'z' */
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_,
+    X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_, X_
+};
+
+#undef S_
+#undef C_
+#undef K_
+#undef D_
+#undef A_
+#undef X_
+
+/*!
+ * \brief length of a run of classes, one implementation per instruction set
+ */
+typedef size_t (*scan_span_t)(const char * str, size_t len, uint8_t classes);
+
+/*!
+ * \brief scans byte by byte with the table
+ *
+ * \param str		start of the run
+ * \param len		number of bytes that can be read
+ * \param classes	set of classes
+ * \return			length of the run
+ */
+static size_t scan_span_scalar(const char * str, size_t len, uint8_t classes) {
+    size_t i = 0;
+
+    while (i < len && (g_char_class[(uint8_t)str[i]] & classes)) {
+        i++;
+    }
+
+    return i;
+}
+
+#ifdef SCAN_X86
+
+/*!
+ * \brief classifies 16 bytes
+ *
+ * \param v			bytes
+ * \param classes	set of classes
+ * \return			bit i is set if byte i belongs to the set
+ */
+static uint32_t scan_mask_sse2(__m128i v, uint8_t classes) {
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    __m128i comment = _mm_cmpeq_epi8(v, _mm_set1_epi8(';'));
+    __m128i comma = _mm_cmpeq_epi8(v, _mm_set1_epi8(','));
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(9)), t); /* v - '0' <= 9 unsigned */
+    __m128i alpha;
+    __m128i in = _mm_setzero_si128();
+
+    t = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a')); /* lower case */
+    alpha = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(25)), t);
+
+    /* special is every byte but NULL and the other classes */
+    if (classes & CHAR_SPECIAL) {
+        __m128i other = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), space);
+
+        other = _mm_or_si128(other, _mm_or_si128(comment, comma));
+        other = _mm_or_si128(other, _mm_or_si128(digit, alpha));
+        in = _mm_andnot_si128(other, _mm_set1_epi8(-1));
+    }
+
+    in = classes & CHAR_SPACE ? _mm_or_si128(in, space) : in;
+    in = classes & CHAR_COMMENT ? _mm_or_si128(in, comment) : in;
+    in = classes & CHAR_COMMA ? _mm_or_si128(in, comma) : in;
+    in = classes & CHAR_DIGIT ? _mm_or_si128(in, digit) : in;
+    in = classes & CHAR_ALPHA ? _mm_or_si128(in, alpha) : in;
+
+    return (uint32_t)_mm_movemask_epi8(in);
+}
+
+/*!
+ * \brief scans 16 bytes at a time with SSE2
+ *
+ * \param str		start of the run
+ * \param len		number of bytes that can be read
+ * \param classes	set of classes
+ * \return			length of the run
+ */
+static size_t scan_span_sse2(const char * str, size_t len, uint8_t classes) {
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint32_t mask = scan_mask_sse2(_mm_loadu_si128((const __m128i *)(str + i)), classes);
+
+        if (mask != 0xffff) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+
+    return i + scan_span_scalar(str + i, len - i, classes);
+}
+
+/*!
+ * \brief classifies 32 bytes, same as scan_mask_sse2()
+ *
+ * \param v			bytes
+ * \param classes	set of classes
+ * \return			bit i is set if byte i belongs to the set
+ */
+__attribute__((target("avx2"))) static uint32_t scan_mask_avx2(__m256i v, uint8_t classes) {
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    __m256i comment = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';'));
+    __m256i comma = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','));
+    __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i digit = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(9)), t);
+    __m256i alpha;
+    __m256i in = _mm256_setzero_si256();
+
+    t = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(25)), t);
+
+    if (classes & CHAR_SPECIAL) {
+        __m256i other = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()), space);
+
+        other = _mm256_or_si256(other, _mm256_or_si256(comment, comma));
+        other = _mm256_or_si256(other, _mm256_or_si256(digit, alpha));
+        in = _mm256_andnot_si256(other, _mm256_set1_epi8(-1));
+    }
+
+    in = classes & CHAR_SPACE ? _mm256_or_si256(in, space) : in;
+    in = classes & CHAR_COMMENT ? _mm256_or_si256(in, comment) : in;
+    in = classes & CHAR_COMMA ? _mm256_or_si256(in, comma) : in;
+    in = classes & CHAR_DIGIT ? _mm256_or_si256(in, digit) : in;
+    in = classes & CHAR_ALPHA ? _mm256_or_si256(in, alpha) : in;
+
+    return (uint32_t)_mm256_movemask_epi8(in);
+}
+
+/*!
+ * \brief scans 32 bytes at a time with AVX2, the rest with SSE2
+ *
+ * \param str		start of the run
+ * \param len		number of bytes that can be read
+ * \param classes	set of classes
+ * \return			length of the run
+ */
+__attribute__((target("avx2"))) static size_t scan_span_avx2(const char * str, size_t len, uint8_t classes) {
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        uint32_t mask = scan_mask_avx2(_mm256_loadu_si256((const __m256i *)(str + i)), classes);
+
+        if (mask != 0xffffffffu) {
+            return i + (size_t)__builtin_ctz(~mask);
+        }
+    }
+
+    return i + scan_span_sse2(str + i, len - i, classes);
+}
+
+#endif
+
+static size_t scan_span_select(const char * str, size_t len, uint8_t classes);
+
+static scan_span_t s_span = scan_span_select; /*!< \brief implementation of scan_span() */
+
+/*!
+ * \brief selects the implementation for the processor on the first call
+ *
+ * \note the selection is the same in every thread, a race writes the same value
+ *
+ * \param str		start of the run
+ * \param len		number of bytes that can be read
+ * \param classes	set of classes
+ * \return			length of the run
+ */
+static size_t scan_span_select(const char * str, size_t len, uint8_t classes) {
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    s_span = __builtin_cpu_supports("avx2") ? scan_span_avx2 : scan_span_sse2;
+#else
+    s_span = scan_span_scalar;
+#endif
+
+    return s_span(str, len, classes);
+}
+
+/*!
+ * \brief gets the length of the run of bytes that belong to a set of classes
+ *
+ * \note at most len bytes are read, the NULL ends the run too
+ *
+ * \param str		start of the run
+ * \param len		number of bytes that can be read
+ * \param classes	set of classes (CHAR_SPACE | CHAR_DIGIT ...)
+ * \return			length of the run
+ */
+size_t scan_span(const char * str, size_t len, uint8_t classes) {
+    /* the tokens are short, a block is not filled */
+    if (len < 16) {
+        return scan_span_scalar(str, len, classes);
+    }
+
+    return s_span(str, len, classes);
+}
+
+/*!
+ * \brief gets the name of the implementation of scan_span(), for the benchmarks
+ *
+ * \return	"avx2", "sse2" or "scalar"
+ */
+const char * scan_implementation(void) {
+    s_span("", 0, 0); /* selects it */
+
+#ifdef SCAN_X86
+    if (s_span == scan_span_avx2) {
+        return "avx2";
+    }
+    if (s_span == scan_span_sse2) {
+        return "sse2";
+    }
+#endif
+
+    return "scalar";
+}
@@ -83,56 +83,75 @@ static uint16_t s_object_code_first_size;
         g_external_table[g_external_table_size++] = (e); \
     }
 
+/*!
+ * \brief process a line of the source during the second pass
+ *
+ * \param line	line of the source
+ */
+static void second_process_source_line(source_line_t * line) {
+    line_number = line->number;
+
+    if (!line->clean) {
+        ERROR("unable to clean the line: %s", line->raw);
+    } else {
+        if (strlen(line->clean) == 0) {
+            /* empty line  */
+        } else if (line->clean[0] == ';') {
+            /* comment */
+        } else {
+            second_process_line(line->clean, 0);
+        }
+    }
+}
+
 /*!
  * \brief main function of the second pass 
  * 
- * \param file_name		path of the source file
+ * \param source		lines of the source, after the first pass
  * \return				number of errors during second pass
  */
-uint16_t second_pass(const char * file_name) {
-    FILE * fp;
-    char line[128];
+uint16_t second_pass(source_t * source) {
+    uint32_t i;
 
     /* initialise variables */
-    file_base_name = get_file_base_name(file_name);
+    file_base_name = source->name;
     line_number = 1;
     errors = 0;
 
+    s_object_code_size = 0;
     s_object_code_first_size = g_object_code_size;
 
-    fp = fopen(file_name, "r");
-    if (fp == NULL) {
-        ERROR("unable to open '%s'", file_name);
-        return 1;
-    }
+    constant_unset(); /* the .set constants get their values line by line */
 
     /* update the tables */
     second_update_tables();
 
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        /* remove whitespaces, tabs, spaces after commas and comments */
-        char * clean = clean_line(line);
-
-        if (!clean) {
-            ERROR("unable to clean the line: %s", line);
-        } else {
-            if (strlen(clean) == 0) {
-                /* empty line  */
-            } else if (clean[0] == ';') {
-                /* comment */
-            } else {
-                second_process_line(clean, 0);
-            }
-        }
+    for (i = 0; i < source->count && !diagnostics_stopped(); i++) {
+        file_base_name = source->lines[i].file ? (char *)source->lines[i].file : source->name;
+        second_process_source_line(&source->lines[i]);
+        listing_line(&source->lines[i], s_object_code_first_size); /* if -L, the words of the line are final */
+    }
 
-        free(clean);
+    g_object_code_size = s_object_code_size + g_data_image_size; /* object code and data image had been merged */
 
-        line_number++;
-    }
+    return errors;
+}
 
-    fclose(fp);
+/*!
+ * \brief encodes a single line again, at the address found by the first pass
+ *
+ * \note used by the incremental assembling, the tables must be complete
+ *
+ * \param source		lines of the source
+ * \param index			index of the line
+ * \return				number of errors
+ */
+uint16_t second_pass_line(source_t * source, uint32_t index) {
+    file_base_name = source->lines[index].file ? (char *)source->lines[index].file : source->name;
+    errors = 0;
 
-    g_object_code_size = s_object_code_size + g_data_image_size; /* object code and data image had been merged */
+    s_object_code_size = source->lines[index].address;
+    second_process_source_line(&source->lines[index]);
 
     return errors;
 }
@@ -155,7 +174,7 @@ void second_update_tables(void) {
     for (i = 0; i < g_symbol_table_size; ++i) {
         for (j = 0; j < g_link_table_size; ++j) {
             if (strcmp(g_symbol_table[i].name, g_link_table[j].name) == 0) {
-                switch (g_link_table[i].type) {
+                switch (g_link_table[j].type) {
                 /* extern */
                 case 'e':
                     g_symbol_table[i].type = 'e';
@@ -201,8 +220,12 @@ void second_process_line(char * line, int column_index) {
     case DIRECTIVE_EXTERN:
     case DIRECTIVE_NUMBER:
     case DIRECTIVE_STRING:
+    case DIRECTIVE_EQU:
         /* had been dealt with during the first pass */
         break;
+    case DIRECTIVE_SET:
+        second_process_set(line, column_index + 1); /* the following lines see the new value */
+        break;
     case OPERATION:
         second_process_operation(line, column_index); /* this is the main purpuse of the second pass */
         break;
@@ -235,16 +258,62 @@ void second_process_label(char * line) {
     case DIRECTIVE_EXTERN:
     case DIRECTIVE_NUMBER:
     case DIRECTIVE_STRING:
+    case DIRECTIVE_EQU:
         /* had been dealt with during the first pass */
         break;
+    case DIRECTIVE_SET:
+        second_process_line(line, 1); /* the label is ignored */
+        break;
     default:
-        ERROR("unknown column type: %s", col2_str);
+        ERROR("unknown column type: %s", col2_str ? col2_str : line);
         break;
     }
 
     free(col2_str);
 }
 
+/*!
+ * \brief evaluates a .set object during the second pass
+ *
+ * \note column_index must be point the column containing the name
+ *
+ * \param line			line containing the constant
+ * \param column_index	column containing the name of the constant, the value follows it
+ */
+void second_process_set(char * line, int column_index) {
+    char * name = string_split(line, " ", column_index);
+    char * value = string_split(line, " ", column_index + 1);
+
+    /* an invalid .set had been reported by the first pass */
+    if (name && value && is_constant(name)) {
+        constant_status_t status = constant_set(name, value);
+
+        if (status != CONSTANT_OK) {
+            ERROR("%s: '%s'", constant_message(status), value);
+        }
+    }
+
+    free(name);
+    free(value);
+}
+
+/*!
+ * \brief checks if an instant operand is the address of a label (#TABLE+2)
+ *
+ * \param operand	instant operand
+ * \return			relocatable
+ */
+static bool second_is_relocatable(char * operand) {
+    uint16_t value;
+    bool relocatable = false;
+
+    if (is_valid_numeric_literal(operand, 1)) {
+        return false;
+    }
+
+    return constant_evaluate(operand + 1, true, &value, &relocatable) == CONSTANT_OK && relocatable;
+}
+
 /*!
  * \brief adds an additional word if the addressing mode requires it
  * 
@@ -259,7 +328,7 @@ void second_add_object_word(char * operand, uint16_t word, bool ext) {
     /* check if addressing mode requires the additional word */
     switch (addr_mode->mode) {
     case INSTANT:
-        type = 'a'; /* absolute */
+        type = second_is_relocatable(operand) ? 'r' : 'a'; /* address of a label | absolute */
         ADD_OBJECT_WORD(word, type); /* add the word to the object code */
         break;
     case DIRECT:
@@ -281,17 +350,16 @@ void second_add_object_word(char * operand, uint16_t word, bool ext) {
  */
 void second_add_external(char * operand) {
     addressing_t * addr_mode = get_addressing(operand);
-    char * real_symbol = (char *)malloc(strlen(operand) + 1);
-    int start_index = 0;
+    const char * real_symbol;
     link_object_t obj;
 
     /* get tel label name based on the addressing */
-    switch (addr_mode->mode) {
+    switch (addr_mode ? addr_mode->mode : INSTANT) {
     case DIRECT:
-        start_index = 0; /* LABEL */
+        real_symbol = operand; /* LABEL */
         break;
     case INDIRECT:
-        start_index = 1; /* @LABEL */
+        real_symbol = operand + 1; /* @LABEL */
         break;
     case INSTANT:
     case DIRECT_REGISTER:
@@ -301,13 +369,6 @@ void second_add_external(char * operand) {
         return;
     }
 
-    if (!real_symbol) {
-        ERROR("cannot allocate memory for symbol: %s", operand);
-        return;
-    }
-
-    strcpy(real_symbol, operand + start_index);
-
     obj.name = (char *)malloc(strlen(real_symbol) + 1);
     if (!obj.name) {
         ERROR("unable ot allocate memory for external symbol: %s", real_symbol);
@@ -410,11 +471,28 @@ void second_process_operation(char * line, int column_index) {
  */
 uint16_t second_get_word(char * operand, bool * ext) {
     addressing_t * addr_mode = get_addressing(operand);
+    constant_status_t status;
+    uint16_t value;
 
     switch (addr_mode->mode) {
     case INSTANT:
         *ext = false; /* can't be external */
-        return get_number(operand, 1); /* get the numeric value */
+        switch (parse_number(operand, 1, &value)) {
+        case NUMBER_OK:
+            return value; /* the numeric value */
+        case NUMBER_RANGE:
+            ERROR("number out of range: %s", operand);
+            return 0;
+        case NUMBER_SYNTAX:
+            break;
+        }
+
+        status = constant_evaluate(operand + 1, true, &value, NULL); /* #expression */
+        if (status != CONSTANT_OK) {
+            ERROR("%s: %s", constant_message(status), operand);
+        }
+
+        return value;
     case DIRECT:
         return second_get_symbol_value(operand, 0, ext); /* LABEL */
     case INDIRECT:
@@ -469,16 +547,9 @@ void second_create_words(operation_t * op, char * src, char * dest,
  * \return				value of the symbol
  */
 uint16_t second_get_symbol_value(char * symbol, int start_index, bool * ext) {
+    const char * real_symbol = symbol + start_index; /* the name is compared in place */
     uint32_t i;
 
-    char * real_symbol = (char *)malloc(strlen(symbol) + 1);
-    if (!real_symbol) {
-        ERROR("cannot allocate memory for symbol: %s", symbol);
-        return 0;
-    }
-
-    strcpy(real_symbol, symbol + start_index);
-
     /* search in the symbol table */
     for (i = 0; i < g_symbol_table_size; ++i) {
         symbol_t * sym = &g_symbol_table[i];
@@ -499,7 +570,6 @@ uint16_t second_get_symbol_value(char * symbol, int start_index, bool * ext) {
         }
     }
 
-    free(real_symbol);
     ERROR("symbol is not defined and not external: %s", real_symbol);
     return 0xFFFF;
 }
@@ -0,0 +1,486 @@
+/*!
+ * \file sim.c
+ * \brief simulator of the machine described in the README
+ *
+ * The image is decoded once into a cache, indexed by address: an entry holds
+ * the operation, the addressing modes, the registers and the additional
+ * words, so the execution does not touch the instruction words again. Writes
+ * below the end of the decoded words invalidate the entries they overlap,
+ * those are decoded again when they are executed next time.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern operation_t g_operations[16];
+
+extern object_code_t g_object_code[TABLE_SIZE];
+extern uint16_t g_object_code_size;
+
+extern uint16_t g_data_image_size;
+
+extern link_object_t g_link_table[TABLE_SIZE];
+extern uint16_t g_link_table_size;
+
+extern uint16_t g_external_table_size;
+
+/*!
+ * \brief initialises the machine, everything is zero except the stack pointer
+ *
+ * \param m		machine
+ * \param out	output of prn
+ */
+void sim_init(machine_t * m, FILE * out) {
+    memset(m, 0, sizeof(machine_t));
+
+    m->sp = SIM_STACK_TOP;
+    m->dispatch = SIM_DISPATCH_SUPER;
+    m->out = out;
+}
+
+/*!
+ * \brief loads an image to address 0 and decodes its instructions
+ *
+ * \param m			machine, initialised
+ * \param words		image
+ * \param size		number of words
+ * \param code_size	number of instruction words at the start of the image
+ * \param entry		address of the first instruction
+ * \return			success
+ */
+bool sim_load(machine_t * m, const uint16_t * words, uint16_t size, uint16_t code_size, uint16_t entry) {
+    uint16_t address = 0;
+
+    if (size > TABLE_SIZE || code_size > size || entry >= TABLE_SIZE) {
+        return false;
+    }
+
+    memcpy(m->memory, words, size * sizeof(uint16_t));
+    m->pc = entry;
+
+    /* decode the instructions, stop at the first invalid one */
+    while (address < code_size && sim_decode(m, address)) {
+        address += m->cache[address].size;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief loads the assembled object code
+ *
+ * \note the program starts at the MAIN entry
+ *
+ * \param m		machine, initialised
+ * \return		success, false if the object code contains externals
+ */
+bool sim_load_object_code(machine_t * m) {
+    uint16_t words[TABLE_SIZE];
+    uint16_t entry = 0;
+    uint16_t i;
+
+    if (g_external_table_size > 0) {
+        return false;
+    }
+
+    for (i = 0; i < g_object_code_size; i++) {
+        words[i] = g_object_code[i].value;
+    }
+
+    for (i = 0; i < g_link_table_size; i++) {
+        if (g_link_table[i].type == 'n' && strcmp(g_link_table[i].name, "MAIN") == 0) {
+            entry = g_link_table[i].value;
+        }
+    }
+
+    return sim_load(m, words, g_object_code_size, g_object_code_size - g_data_image_size, entry);
+}
+
+/*!
+ * \brief checks if an addressing mode is legal
+ *
+ * \param legal	legal modes, e.g. "01234"
+ * \param mode	addressing mode
+ * \return		legal
+ */
+static bool is_legal_mode(const char * legal, uint8_t mode) {
+    for (; *legal; legal++) {
+        if (*legal - '0' == mode) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+ * \brief replaces a decoded instruction with a superinstruction, if possible
+ *
+ * \param m			machine
+ * \param address	address of the instruction
+ * \param d			decoded instruction
+ */
+static void sim_fuse(machine_t * m, uint16_t address, decoded_t * d) {
+    uint16_t next;
+
+    switch (d->op) {
+    case SIM_INC:
+    case SIM_DEC:
+        if (d->dest_mode == DIRECT_REGISTER) {
+            d->op = d->op == SIM_INC ? SIM_INC_REG : SIM_DEC_REG;
+        }
+        break;
+
+    case SIM_PRN:
+        if (d->dest_mode == INDIRECT_REGISTER) {
+            d->op = SIM_PRN_INDIRECT_REG;
+        }
+        break;
+
+    case SIM_SUB:
+        /* sub #n, rX followed by jnz LABEL */
+        if (d->src_mode != INSTANT || d->dest_mode != DIRECT_REGISTER || address + 3 >= TABLE_SIZE) {
+            break;
+        }
+
+        next = m->memory[address + 2];
+        if ((next >> 12) == SIM_JNZ && ((next >> 3) & 0x7) == DIRECT) {
+            d->op = SIM_SUB_JNZ;
+            d->dest_word = m->memory[address + 3];
+            d->span = 4;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*!
+ * \brief decodes the instruction at an address into the cache
+ *
+ * \param m			machine
+ * \param address	address of the instruction
+ * \return			success, false if the instruction is illegal or does not fit into the memory
+ */
+bool sim_decode(machine_t * m, uint16_t address) {
+    decoded_t * d = &m->cache[address];
+    uint16_t word = m->memory[address];
+    operation_t * op = &g_operations[word >> 12];
+    uint16_t size = 1;
+
+    d->size = 0;
+    d->op = op->opcode;
+    d->src_mode = 0;
+    d->src_reg = 0;
+    d->dest_mode = 0;
+    d->dest_reg = 0;
+
+    if (op->operands == 2) {
+        d->src_mode = (word >> 9) & 0x7;
+        d->src_reg = (word >> 6) & 0x7;
+
+        if (!is_legal_mode(op->src_legal, d->src_mode)) {
+            return false;
+        }
+
+        if (d->src_mode <= INDIRECT) {
+            if (address + size >= TABLE_SIZE) {
+                return false;
+            }
+            d->src_word = m->memory[address + size++];
+        }
+    }
+
+    if (op->operands >= 1) {
+        d->dest_mode = (word >> 3) & 0x7;
+        d->dest_reg = word & 0x7;
+
+        if (!is_legal_mode(op->dest_legal, d->dest_mode)) {
+            return false;
+        }
+
+        if (d->dest_mode <= INDIRECT) {
+            if (address + size >= TABLE_SIZE) {
+                return false;
+            }
+            d->dest_word = m->memory[address + size++];
+        }
+    }
+
+    d->size = (uint8_t)size;
+    d->span = (uint8_t)size;
+
+    /* the profiler counts the instructions of a superinstruction separately */
+    if (m->dispatch == SIM_DISPATCH_SUPER && !m->profile) {
+        sim_fuse(m, address, d);
+    }
+
+    if (address + d->span > m->code_end) {
+        m->code_end = address + d->span;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief invalidates the decoded instructions that contain an address
+ *
+ * \param m			machine
+ * \param address	written address
+ */
+static void sim_invalidate(machine_t * m, uint16_t address) {
+    uint16_t a = address >= 3 ? address - 3 : 0; /* the longest entry spans 4 words */
+
+    for (; a <= address; a++) {
+        if (m->cache[a].size != 0 && a + m->cache[a].span > address) {
+            m->cache[a].size = 0;
+        }
+    }
+}
+
+/*!
+ * \brief locates an operand
+ *
+ * \param m		machine
+ * \param mode	addressing mode
+ * \param reg	register
+ * \param word	additional word
+ * \return		location of the value (register, memory or the additional word of an instant) or NULL
+ */
+static uint16_t * sim_operand(machine_t * m, uint8_t mode, uint8_t reg, uint16_t * word) {
+    uint16_t address;
+
+    switch (mode) {
+    case INSTANT:
+        return word;
+
+    case DIRECT:
+        address = *word;
+        break;
+
+    case INDIRECT:
+        if (*word >= TABLE_SIZE) {
+            return NULL;
+        }
+        address = m->memory[*word];
+        break;
+
+    case DIRECT_REGISTER:
+        return &m->r[reg];
+
+    default: /* INDIRECT_REGISTER */
+        address = m->r[reg];
+        break;
+    }
+
+    return address < TABLE_SIZE ? &m->memory[address] : NULL;
+}
+
+/*!
+ * \brief writes an operand, invalidates the cache if the code is overwritten
+ *
+ * \param m		machine
+ * \param dest	location of the operand
+ * \param value	new value
+ */
+static void sim_store(machine_t * m, uint16_t * dest, uint16_t value) {
+    *dest = value;
+
+    if (dest >= m->memory && dest < m->memory + m->code_end) {
+        sim_invalidate(m, (uint16_t)(dest - m->memory));
+    }
+}
+
+/*!
+ * \brief sets the zero flag, keeps the carry
+ *
+ * \param m		machine
+ * \param value	result
+ */
+static void sim_set_z(machine_t * m, uint16_t value) {
+    m->psw = (uint16_t)((m->psw & ~PSW_Z) | (value == 0 ? PSW_Z : 0));
+}
+
+/*!
+ * \brief sets the zero flag and the carry flag from a 32-bit result
+ *
+ * \param m		machine
+ * \param value	result, the carry is above the lower 16 bits
+ */
+static void sim_set_zc(machine_t * m, uint32_t value) {
+    m->psw = (uint16_t)(((value & 0xFFFF) == 0 ? PSW_Z : 0) | (value > 0xFFFF ? PSW_C : 0));
+}
+
+/*!
+ * \brief gets the target of a jump
+ *
+ * \param m		machine
+ * \param d		decoded jump
+ * \param target	set to the target
+ * \return		success, false if the address is outside of the memory
+ */
+static bool sim_target(machine_t * m, decoded_t * d, uint32_t * target) {
+    switch (d->dest_mode) {
+    case DIRECT:
+        *target = d->dest_word;
+        return true;
+
+    case INDIRECT:
+        if (d->dest_word >= TABLE_SIZE) {
+            return false;
+        }
+        *target = m->memory[d->dest_word];
+        return true;
+
+    default: /* INDIRECT_REGISTER */
+        *target = m->r[d->dest_reg];
+        return true;
+    }
+}
+
+/* the execution loops, one for every dispatch strategy */
+#define SIM_LOOP_NAME sim_run_decode
+#define SIM_LOOP_THREADED 0
+#define SIM_LOOP_DECODE 1
+#define SIM_LOOP_PROFILE 0
+#include "sim_loop.h"
+#undef SIM_LOOP_NAME
+#undef SIM_LOOP_THREADED
+#undef SIM_LOOP_DECODE
+#undef SIM_LOOP_PROFILE
+
+#define SIM_LOOP_NAME sim_run_switch
+#define SIM_LOOP_THREADED 0
+#define SIM_LOOP_DECODE 0
+#define SIM_LOOP_PROFILE 0
+#include "sim_loop.h"
+#undef SIM_LOOP_NAME
+#undef SIM_LOOP_THREADED
+#undef SIM_LOOP_DECODE
+#undef SIM_LOOP_PROFILE
+
+#if defined(__GNUC__)
+/* computed goto is an extension */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define SIM_LOOP_NAME sim_run_threaded
+#define SIM_LOOP_THREADED 1
+#define SIM_LOOP_DECODE 0
+#define SIM_LOOP_PROFILE 0
+#include "sim_loop.h"
+#undef SIM_LOOP_NAME
+#undef SIM_LOOP_THREADED
+#undef SIM_LOOP_DECODE
+#undef SIM_LOOP_PROFILE
+#pragma GCC diagnostic pop
+#else
+#define sim_run_threaded sim_run_switch
+#endif
+
+/* the profiler counts every instruction, the dispatch is not the bottleneck */
+#define SIM_LOOP_NAME sim_run_profile
+#define SIM_LOOP_THREADED 0
+#define SIM_LOOP_DECODE 0
+#define SIM_LOOP_PROFILE 1
+#include "sim_loop.h"
+#undef SIM_LOOP_NAME
+#undef SIM_LOOP_THREADED
+#undef SIM_LOOP_DECODE
+#undef SIM_LOOP_PROFILE
+
+/*!
+ * \brief runs the program until it halts, fails or executes max_steps instructions
+ *
+ * \param m			machine, loaded
+ * \param max_steps	maximum number of instructions, counted from the start of the program
+ * \return			status, m->pc is the address of the failing instruction
+ */
+sim_status_t sim_run(machine_t * m, uint64_t max_steps) {
+    /* the profiler needs every instruction, whatever the dispatch strategy is */
+    if (m->profile) {
+        return sim_run_profile(m, max_steps);
+    }
+
+    switch (m->dispatch) {
+    case SIM_DISPATCH_DECODE:
+        return sim_run_decode(m, max_steps);
+
+    case SIM_DISPATCH_SWITCH:
+        return sim_run_switch(m, max_steps);
+
+    case SIM_DISPATCH_JIT:
+        return jit_run(m, max_steps);
+
+    default:
+        return sim_run_threaded(m, max_steps);
+    }
+}
+
+/*!
+ * \brief runs the program in the threaded interpreter, whatever the dispatch strategy is
+ *
+ * \note used by the JIT for the instructions it does not translate
+ *
+ * \param m			machine, loaded
+ * \param max_steps	maximum number of instructions, counted from the start of the program
+ * \return			status
+ */
+sim_status_t sim_interpret(machine_t * m, uint64_t max_steps) {
+    return sim_run_threaded(m, max_steps);
+}
+
+/*!
+ * \brief releases the resources of the machine, it must be initialised again before use
+ *
+ * \param m		machine
+ */
+void sim_release(machine_t * m) {
+    jit_free(m);
+}
+
+/*!
+ * \brief gets the description of a status
+ *
+ * \param status	status
+ * \return			description
+ */
+const char * sim_status_string(sim_status_t status) {
+    switch (status) {
+    case SIM_HALTED:
+        return "halted";
+    case SIM_STEP_LIMIT:
+        return "step limit reached";
+    case SIM_ILLEGAL_INSTRUCTION:
+        return "illegal instruction";
+    case SIM_ADDRESS_FAULT:
+        return "address out of the memory";
+    case SIM_STACK_OVERFLOW:
+        return "stack overflow";
+    case SIM_STACK_UNDERFLOW:
+        return "stack underflow";
+    default:
+        return "division by zero";
+    }
+}
+
+/*!
+ * \brief gets the name of a dispatch strategy
+ *
+ * \param dispatch	dispatch strategy
+ * \return			name
+ */
+const char * sim_dispatch_string(sim_dispatch_t dispatch) {
+    switch (dispatch) {
+    case SIM_DISPATCH_DECODE:
+        return "decode";
+    case SIM_DISPATCH_SWITCH:
+        return "switch";
+    case SIM_DISPATCH_THREADED:
+        return "threaded";
+    case SIM_DISPATCH_SUPER:
+        return "superinstructions";
+    default:
+        return "jit";
+    }
+}
@@ -0,0 +1,320 @@
+/*!
+ * \file sim_loop.h
+ * \brief execution loop of the simulator
+ *
+ * Included by sim.c once for every dispatch strategy, so the handlers are
+ * written once. Define before including:
+ * - SIM_LOOP_NAME: name of the function
+ * - SIM_LOOP_THREADED: 1 for computed goto dispatch, 0 for a switch
+ * - SIM_LOOP_DECODE: 1 to decode every instruction again, 0 to use the cache
+ * - SIM_LOOP_PROFILE: 1 to update the counters of m->profile, 0 otherwise
+ */
+
+/*!
+ * \brief runs the program with one dispatch strategy
+ *
+ * \param m			machine, loaded
+ * \param max_steps	maximum number of instructions, counted from the start of the program
+ * \return			status
+ */
+static sim_status_t SIM_LOOP_NAME(machine_t * m, uint64_t max_steps) {
+    uint16_t pc = m->pc; /* address of the next instruction */
+    uint16_t at = pc; /* address of the current instruction */
+    uint64_t steps = m->steps;
+    uint16_t * src;
+    uint16_t * dest;
+    uint32_t value;
+    decoded_t * d;
+
+#if SIM_LOOP_PROFILE
+/* counts the current instruction, or takes it back */
+#define PROFILE_COUNT(delta)                                              \
+    do {                                                                  \
+        m->profile->counts[at] += (uint64_t)(delta);                      \
+        m->profile->nodes[m->profile->current].self += (uint64_t)(delta); \
+    } while (0)
+
+/* counts a taken jump, the backward ones close a loop */
+#define PROFILE_JUMP(target)                               \
+    if ((target) <= at) {                                  \
+        m->profile->back_edges[at]++;                      \
+        m->profile->back_targets[at] = (uint16_t)(target); \
+    }
+
+#define PROFILE_CALL(target) profile_call(m->profile, (uint16_t)(target))
+#define PROFILE_RETURN() profile_return(m->profile)
+#else
+#define PROFILE_COUNT(delta)
+#define PROFILE_JUMP(target)
+#define PROFILE_CALL(target)
+#define PROFILE_RETURN()
+#endif
+
+/* leaves the loop */
+#define EXIT(status, address) \
+    do {                      \
+        m->pc = (address);    \
+        m->steps = steps;     \
+        return (status);      \
+    } while (0)
+
+/* stops at the current instruction, it is not counted */
+#define FAULT(status)      \
+    do {                   \
+        steps--;           \
+        PROFILE_COUNT(-1); \
+        EXIT(status, at);  \
+    } while (0)
+
+/* fetches the next instruction, decodes it if it is not in the cache */
+#define FETCH()                                                                   \
+    do {                                                                          \
+        if (steps >= max_steps) {                                                 \
+            EXIT(SIM_STEP_LIMIT, pc);                                             \
+        }                                                                         \
+        if (pc >= TABLE_SIZE) {                                                   \
+            EXIT(SIM_ADDRESS_FAULT, pc);                                          \
+        }                                                                         \
+        d = &m->cache[pc];                                                        \
+        if ((SIM_LOOP_DECODE || d->size == 0) && !sim_decode(m, pc)) {            \
+            EXIT(SIM_ILLEGAL_INSTRUCTION, pc);                                    \
+        }                                                                         \
+        at = pc;                                                                  \
+        pc = (uint16_t)(pc + d->size);                                            \
+        steps++;                                                                  \
+        PROFILE_COUNT(1);                                                         \
+    } while (0)
+
+/* locates the source operand */
+#define SRC()                                                             \
+    if (!(src = sim_operand(m, d->src_mode, d->src_reg, &d->src_word))) { \
+        FAULT(SIM_ADDRESS_FAULT);                                         \
+    }
+
+/* locates the destination operand */
+#define DEST()                                                                \
+    if (!(dest = sim_operand(m, d->dest_mode, d->dest_reg, &d->dest_word))) { \
+        FAULT(SIM_ADDRESS_FAULT);                                             \
+    }
+
+/* gets the target of a jump */
+#define TARGET()                      \
+    if (!sim_target(m, d, &value)) {  \
+        FAULT(SIM_ADDRESS_FAULT);     \
+    }
+
+#if SIM_LOOP_THREADED
+    /* the order is the order of sim_op_t */
+    static void * handlers[SIM_OP_COUNT] = {
+        &&L_SIM_MOV, &&L_SIM_CMP, &&L_SIM_ADD, &&L_SIM_SUB,
+        &&L_SIM_MUL, &&L_SIM_DIV, &&L_SIM_LEA, &&L_SIM_INC,
+        &&L_SIM_DEC, &&L_SIM_JNZ, &&L_SIM_JNC, &&L_SIM_SHL,
+        &&L_SIM_PRN, &&L_SIM_JSR, &&L_SIM_RTS, &&L_SIM_HLT,
+        &&L_SIM_INC_REG, &&L_SIM_DEC_REG, &&L_SIM_PRN_INDIRECT_REG, &&L_SIM_SUB_JNZ
+    };
+
+/* every handler jumps to the next one directly */
+#define NEXT()  \
+    FETCH();    \
+    goto * handlers[d->op]
+
+#define HANDLER(op) L_##op:
+
+    NEXT();
+#else
+#define NEXT() continue
+
+#define HANDLER(op) case op:
+
+    for (;;) {
+        FETCH();
+
+        switch ((sim_op_t)d->op) {
+#endif
+
+    HANDLER(SIM_MOV) {
+        SRC();
+        DEST();
+        sim_store(m, dest, *src);
+        NEXT();
+    }
+
+    HANDLER(SIM_CMP) {
+        SRC();
+        DEST();
+        sim_set_z(m, (uint16_t)(*src - *dest));
+        NEXT();
+    }
+
+    HANDLER(SIM_ADD) {
+        SRC();
+        DEST();
+        value = (uint32_t)*dest + *src;
+        sim_set_zc(m, value);
+        sim_store(m, dest, (uint16_t)value);
+        NEXT();
+    }
+
+    /* the carry is the borrow */
+    HANDLER(SIM_SUB) {
+        SRC();
+        DEST();
+        value = (uint32_t)*dest - *src;
+        sim_set_zc(m, value);
+        sim_store(m, dest, (uint16_t)value);
+        NEXT();
+    }
+
+    HANDLER(SIM_MUL) {
+        SRC();
+        DEST();
+        value = (uint32_t)*dest * *src;
+        sim_set_zc(m, value);
+        sim_store(m, dest, (uint16_t)value);
+        NEXT();
+    }
+
+    HANDLER(SIM_DIV) {
+        SRC();
+        DEST();
+        if (*src == 0) {
+            FAULT(SIM_DIVISION_BY_ZERO);
+        }
+        sim_store(m, dest, (uint16_t)((int32_t)(int16_t)*dest / (int16_t)*src));
+        NEXT();
+    }
+
+    HANDLER(SIM_LEA) {
+        DEST();
+        sim_store(m, dest, d->src_word);
+        NEXT();
+    }
+
+    HANDLER(SIM_INC) {
+        DEST();
+        sim_store(m, dest, (uint16_t)(*dest + 1));
+        sim_set_z(m, *dest);
+        NEXT();
+    }
+
+    HANDLER(SIM_DEC) {
+        DEST();
+        sim_store(m, dest, (uint16_t)(*dest - 1));
+        sim_set_z(m, *dest);
+        NEXT();
+    }
+
+    HANDLER(SIM_JNZ) {
+        if (!(m->psw & PSW_Z)) {
+            TARGET();
+            PROFILE_JUMP(value);
+            pc = (uint16_t)value;
+        }
+        NEXT();
+    }
+
+    HANDLER(SIM_JNC) {
+        if (!(m->psw & PSW_C)) {
+            TARGET();
+            PROFILE_JUMP(value);
+            pc = (uint16_t)value;
+        }
+        NEXT();
+    }
+
+    /* the destination is the number of shifts */
+    HANDLER(SIM_SHL) {
+        SRC();
+        DEST();
+        value = *dest < 32 ? (uint32_t)*src << *dest : 0;
+        sim_set_zc(m, value & 0x1FFFF);
+        sim_store(m, src, (uint16_t)value);
+        NEXT();
+    }
+
+    HANDLER(SIM_PRN) {
+        DEST();
+        fputc(*dest & 0xFF, m->out);
+        NEXT();
+    }
+
+    HANDLER(SIM_JSR) {
+        TARGET();
+        if (m->sp <= SIM_STACK_TOP - SIM_STACK_SIZE) {
+            FAULT(SIM_STACK_OVERFLOW);
+        }
+        sim_store(m, &m->memory[m->sp--], pc);
+        PROFILE_CALL(value);
+        pc = (uint16_t)value;
+        NEXT();
+    }
+
+    HANDLER(SIM_RTS) {
+        if (m->sp >= SIM_STACK_TOP) {
+            FAULT(SIM_STACK_UNDERFLOW);
+        }
+        pc = m->memory[++m->sp];
+        PROFILE_RETURN();
+        NEXT();
+    }
+
+    HANDLER(SIM_HLT) {
+        EXIT(SIM_HALTED, pc);
+    }
+
+    /* inc rX */
+    HANDLER(SIM_INC_REG) {
+        sim_set_z(m, ++m->r[d->dest_reg]);
+        NEXT();
+    }
+
+    /* dec rX */
+    HANDLER(SIM_DEC_REG) {
+        sim_set_z(m, --m->r[d->dest_reg]);
+        NEXT();
+    }
+
+    /* prn @rX */
+    HANDLER(SIM_PRN_INDIRECT_REG) {
+        if (m->r[d->dest_reg] >= TABLE_SIZE) {
+            FAULT(SIM_ADDRESS_FAULT);
+        }
+        fputc(m->memory[m->r[d->dest_reg]] & 0xFF, m->out);
+        NEXT();
+    }
+
+    /* sub #n, rX followed by jnz LABEL, two instructions */
+    HANDLER(SIM_SUB_JNZ) {
+        value = (uint32_t)m->r[d->dest_reg] - d->src_word;
+        sim_set_zc(m, value);
+        m->r[d->dest_reg] = (uint16_t)value;
+
+        if (steps >= max_steps) {
+            EXIT(SIM_STEP_LIMIT, pc);
+        }
+        steps++;
+
+        pc = (m->psw & PSW_Z) ? (uint16_t)(pc + 2) : d->dest_word;
+        NEXT();
+    }
+
+#if !SIM_LOOP_THREADED
+        default:
+            FAULT(SIM_ILLEGAL_INSTRUCTION);
+        }
+    }
+#endif
+
+#undef EXIT
+#undef FAULT
+#undef FETCH
+#undef SRC
+#undef DEST
+#undef TARGET
+#undef NEXT
+#undef HANDLER
+#undef PROFILE_COUNT
+#undef PROFILE_JUMP
+#undef PROFILE_CALL
+#undef PROFILE_RETURN
+}
@@ -0,0 +1,448 @@
+/*!
+ * \file size_report.c
+ * \brief static size and cycle report (--size-report)
+ *
+ * A region starts at a label and ends at the next label of the same kind
+ * (code or data). The code regions count the instructions and their
+ * additional words, the data regions the data words.
+ *
+ * The cycles of an instruction are estimated from a cost table: the cost of
+ * the operation and the cost of the addressing mode of every operand. The
+ * estimate of a basic block is the sum of its instructions, a loop (a jump back
+ * to an earlier block) is estimated by the blocks from its head to the jump,
+ * one iteration.
+ *
+ * The cost table file has lines "<mnemonic> <cycles>" and "mode<N> <cycles>",
+ * N is the addressing mode (0 instant .. 4 indirect register), ';' starts a
+ * comment. The missing entries keep their defaults.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern operation_t g_operations[16];
+
+extern uint16_t g_object_code_size;
+extern uint16_t g_data_image_size;
+
+extern symbol_t g_symbol_table[TABLE_SIZE];
+extern uint16_t g_symbol_table_size;
+
+/*!
+ * \brief number of addressing modes
+ */
+#define SIZE_MODES 5
+
+/*!
+ * \brief length of the names in the report
+ */
+#define SIZE_NAME_SIZE 32
+
+/*!
+ * \brief default cycles of the operations, in the order of the operation codes
+ */
+static const uint32_t s_default_op_costs[16] = {
+    1, /* mov */
+    1, /* cmp */
+    1, /* add */
+    1, /* sub */
+    4, /* mul */
+    12, /* div */
+    1, /* lea */
+    1, /* inc */
+    1, /* dec */
+    2, /* jnz */
+    2, /* jnc */
+    1, /* shl */
+    2, /* prn */
+    3, /* jsr */
+    3, /* rts */
+    1 /* hlt */
+};
+
+/*!
+ * \brief default cycles of the addressing modes of an operand
+ */
+static const uint32_t s_default_mode_costs[SIZE_MODES] = {
+    1, /* instant, the additional word */
+    2, /* direct, the additional word and the memory */
+    3, /* indirect, the additional word and the memory twice */
+    0, /* direct register */
+    1 /* indirect register, the memory */
+};
+
+/*!
+ * \brief cycles of the operations and of the addressing modes
+ */
+typedef struct cost_table_s {
+    uint32_t ops[16]; /*!< \brief cycles of the operations */
+    uint32_t modes[SIZE_MODES]; /*!< \brief cycles of the addressing modes of an operand */
+} cost_table_t;
+
+/*!
+ * \brief labeled region of the code or the data
+ */
+typedef struct size_region_s {
+    const char * name; /*!< \brief label, "(start)" before the first one */
+    uint16_t start; /*!< \brief first address */
+    uint16_t end; /*!< \brief address after the last word */
+    uint32_t instructions; /*!< \brief number of instruction words */
+    uint32_t additional; /*!< \brief number of additional words */
+} size_region_t;
+
+/*!
+ * \brief estimated cycles of a basic block or a loop
+ */
+typedef struct size_cost_s {
+    uint32_t first; /*!< \brief index of the first block */
+    uint32_t last; /*!< \brief index of the last block */
+    uint64_t cycles; /*!< \brief estimated cycles */
+} size_cost_t;
+
+/*!
+ * \brief reads a cost table file over the defaults
+ *
+ * \param t			cost table
+ * \param file_name	path of the file or NULL for the defaults
+ * \return			number of errors
+ */
+static uint16_t read_cost_table(cost_table_t * t, const char * file_name) {
+    char line[256];
+    uint32_t line_number = 0;
+    uint16_t errors = 0;
+    FILE * fp;
+
+    memcpy(t->ops, s_default_op_costs, sizeof(t->ops));
+    memcpy(t->modes, s_default_mode_costs, sizeof(t->modes));
+
+    if (!file_name) {
+        return 0;
+    }
+
+    fp = fopen(file_name, "r");
+    if (!fp) {
+        fprintf(stderr, "unable to open the cost table: %s\n", file_name);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char key[16];
+        unsigned long cycles;
+        char * comment = strchr(line, ';');
+        int fields;
+        uint32_t mode;
+
+        line_number++;
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        fields = sscanf(line, "%15s %lu", key, &cycles);
+        if (fields <= 0) {
+            continue; /* empty line */
+        }
+
+        if (fields == 2 && get_operation(key)) {
+            t->ops[get_operation(key)->opcode] = (uint32_t)cycles;
+        } else if (fields == 2 && sscanf(key, "mode%u", &mode) == 1 && mode < SIZE_MODES) {
+            t->modes[mode] = (uint32_t)cycles;
+        } else {
+            fprintf(stderr, "%s:%u: expected \"<mnemonic> <cycles>\" or \"mode<N> <cycles>\"\n", file_name,
+                    line_number);
+            errors++;
+        }
+    }
+
+    fclose(fp);
+
+    return errors;
+}
+
+/*!
+ * \brief estimates the cycles of an instruction
+ *
+ * \param t		cost table
+ * \param inst	instruction
+ * \return		cycles
+ */
+static uint32_t instruction_cost(cost_table_t * t, cfg_instruction_t * inst) {
+    uint8_t operands = g_operations[inst->decoded.op].operands;
+    uint32_t cycles = t->ops[inst->decoded.op];
+
+    if (operands == 2 && inst->decoded.src_addr < SIZE_MODES) {
+        cycles += t->modes[inst->decoded.src_addr];
+    }
+
+    if (operands >= 1 && inst->decoded.dest_addr < SIZE_MODES) {
+        cycles += t->modes[inst->decoded.dest_addr];
+    }
+
+    return cycles;
+}
+
+/*!
+ * \brief orders the symbols by address
+ *
+ * \param a	symbol
+ * \param b	symbol
+ * \return	order
+ */
+static int compare_symbols(const void * a, const void * b) {
+    const symbol_t * x = *(const symbol_t * const *)a;
+    const symbol_t * y = *(const symbol_t * const *)b;
+
+    return (int)x->value - (int)y->value;
+}
+
+/*!
+ * \brief orders the regions by decreasing size
+ *
+ * \param a	region
+ * \param b	region
+ * \return	order
+ */
+static int compare_regions(const void * a, const void * b) {
+    const size_region_t * x = (const size_region_t *)a;
+    const size_region_t * y = (const size_region_t *)b;
+
+    if (x->end - x->start != y->end - y->start) {
+        return (int)(y->end - y->start) - (int)(x->end - x->start);
+    }
+
+    return (int)x->start - (int)y->start;
+}
+
+/*!
+ * \brief orders the costs by decreasing cycles
+ *
+ * \param a	cost
+ * \param b	cost
+ * \return	order
+ */
+static int compare_costs(const void * a, const void * b) {
+    const size_cost_t * x = (const size_cost_t *)a;
+    const size_cost_t * y = (const size_cost_t *)b;
+
+    if (x->cycles != y->cycles) {
+        return x->cycles < y->cycles ? 1 : -1;
+    }
+
+    return (int)x->first - (int)y->first;
+}
+
+/*!
+ * \brief splits an address range into the regions of the labels of a type
+ *
+ * \param regions	set to the regions, TABLE_SIZE + 1 entries
+ * \param type		type of the labels ('a' code, 'r' data)
+ * \param start		first address of the range
+ * \param end		address after the range
+ * \return			number of regions
+ */
+static uint32_t split_regions(size_region_t * regions, char type, uint16_t start, uint16_t end) {
+    symbol_t * symbols[TABLE_SIZE];
+    uint32_t count = 0, size = 0, i;
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        if (g_symbol_table[i].type == type && g_symbol_table[i].value >= start && g_symbol_table[i].value < end) {
+            symbols[count++] = &g_symbol_table[i];
+        }
+    }
+
+    qsort(symbols, count, sizeof(symbol_t *), compare_symbols);
+
+    if (start < end && (count == 0 || symbols[0]->value > start)) {
+        regions[size].name = "(start)";
+        regions[size].start = start;
+        size++;
+    }
+
+    for (i = 0; i < count; i++) {
+        /* a label at the same address as the previous one names the same region */
+        if (size > 0 && regions[size - 1].start == symbols[i]->value) {
+            continue;
+        }
+
+        regions[size].name = symbols[i]->name;
+        regions[size].start = symbols[i]->value;
+        size++;
+    }
+
+    for (i = 0; i < size; i++) {
+        regions[i].end = i + 1 < size ? regions[i + 1].start : end;
+        regions[i].instructions = 0;
+        regions[i].additional = 0;
+    }
+
+    return size;
+}
+
+/*!
+ * \brief finds the region of an address
+ *
+ * \param regions	regions in the order of the addresses
+ * \param count		number of regions
+ * \param address	address
+ * \return			region or NULL
+ */
+static size_region_t * region_of(size_region_t * regions, uint32_t count, uint16_t address) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (regions[i].start <= address && address < regions[i].end) {
+            return &regions[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*!
+ * \brief formats an address as the label of its region and an offset
+ *
+ * \param regions	regions in the order of the addresses
+ * \param count		number of regions
+ * \param address	address
+ * \param name		buffer of SIZE_NAME_SIZE characters
+ * \return			name
+ */
+static char * location_of(size_region_t * regions, uint32_t count, uint16_t address, char * name) {
+    size_region_t * r = region_of(regions, count, address);
+
+    if (!r) {
+        sprintf(name, "%04x", address);
+    } else if (r->start == address) {
+        sprintf(name, "%.*s", SIZE_NAME_SIZE - 1, r->name);
+    } else {
+        sprintf(name, "%.*s+%u", SIZE_NAME_SIZE - 8, r->name, address - r->start);
+    }
+
+    return name;
+}
+
+/*!
+ * \brief writes the size and cycle report of the assembled source
+ *
+ * \note runs after the second pass, the addresses are final
+ *
+ * \param source	lines of the source
+ * \param cost_name	path of the cost table file or NULL for the defaults
+ * \param fp		output stream
+ * \return			number of errors
+ */
+uint16_t create_size_report(source_t * source, const char * cost_name, FILE * fp) {
+    uint16_t code_size = g_object_code_size - g_data_image_size;
+    size_region_t * code = (size_region_t *)malloc((TABLE_SIZE + 1) * sizeof(size_region_t));
+    size_region_t * data = (size_region_t *)malloc((TABLE_SIZE + 1) * sizeof(size_region_t));
+    size_region_t * sorted = (size_region_t *)malloc((TABLE_SIZE + 1) * sizeof(size_region_t));
+    size_cost_t * blocks = NULL;
+    size_cost_t * loops = NULL;
+    uint32_t code_count, data_count, loops_count = 0, i, j;
+    uint16_t errors = 0;
+    cost_table_t costs;
+    cfg_t cfg;
+
+    if (!code || !data || !sorted || !cfg_build(&cfg, source)) {
+        free(code);
+        free(data);
+        free(sorted);
+        fprintf(stderr, "unable to allocate memory for the size report\n");
+        return 1;
+    }
+
+    errors = read_cost_table(&costs, cost_name);
+
+    blocks = (size_cost_t *)calloc(cfg.blocks_count ? cfg.blocks_count : 1, sizeof(size_cost_t));
+    loops = (size_cost_t *)calloc(cfg.blocks_count ? cfg.blocks_count : 1, sizeof(size_cost_t));
+
+    if (errors == 0 && blocks && loops) {
+        code_count = split_regions(code, 'a', 0, code_size);
+        data_count = split_regions(data, 'r', code_size, g_object_code_size);
+
+        for (i = 0; i < cfg.count; i++) {
+            cfg_instruction_t * inst = &cfg.instructions[i];
+            size_region_t * r = region_of(code, code_count, inst->line->address);
+
+            if (r) {
+                r->instructions++;
+                r->additional += inst->line->size - 1u;
+            }
+
+            blocks[inst->block].cycles += instruction_cost(&costs, inst);
+        }
+
+        /* a jump back to an earlier block closes a loop */
+        for (i = 0; i < cfg.blocks_count; i++) {
+            int32_t head = cfg.blocks[i].successors[1];
+
+            blocks[i].first = i;
+            blocks[i].last = i;
+
+            if (head >= 0 && (uint32_t)head <= i && cfg.instructions[cfg.blocks[i].last].decoded.op != 0xD) {
+                size_cost_t * l = &loops[loops_count++];
+
+                l->first = (uint32_t)head;
+                l->last = i;
+            }
+        }
+
+        for (i = 0; i < loops_count; i++) {
+            for (j = loops[i].first; j <= loops[i].last; j++) {
+                loops[i].cycles += blocks[j].cycles;
+            }
+        }
+
+        fprintf(fp, "\nCode regions by size (label words instructions additional):\n");
+        memcpy(sorted, code, code_count * sizeof(size_region_t));
+        qsort(sorted, code_count, sizeof(size_region_t), compare_regions);
+        for (i = 0; i < code_count; i++) {
+            fprintf(fp, "  %-20s %5u %5u %5u\n", sorted[i].name, (unsigned)(sorted[i].end - sorted[i].start),
+                    sorted[i].instructions, sorted[i].additional);
+        }
+
+        fprintf(fp, "\nData regions by size (label words):\n");
+        memcpy(sorted, data, data_count * sizeof(size_region_t));
+        qsort(sorted, data_count, sizeof(size_region_t), compare_regions);
+        for (i = 0; i < data_count; i++) {
+            fprintf(fp, "  %-20s %5u\n", sorted[i].name, (unsigned)(sorted[i].end - sorted[i].start));
+        }
+
+        fprintf(fp, "\nBasic blocks by estimated cycles (first last cycles):\n");
+        qsort(blocks, cfg.blocks_count, sizeof(size_cost_t), compare_costs);
+        for (i = 0; i < cfg.blocks_count; i++) {
+            char first[SIZE_NAME_SIZE], last[SIZE_NAME_SIZE];
+
+            fprintf(fp, "  %-20s %-20s %8" PRIu64 "\n",
+                    location_of(code, code_count, cfg.instructions[cfg.blocks[blocks[i].first].first].line->address, first),
+                    location_of(code, code_count, cfg.instructions[cfg.blocks[blocks[i].last].last].line->address, last),
+                    blocks[i].cycles);
+        }
+
+        fprintf(fp, "\nLoops by estimated cycles of an iteration (head jump cycles):\n");
+        qsort(loops, loops_count, sizeof(size_cost_t), compare_costs);
+        for (i = 0; i < loops_count; i++) {
+            char first[SIZE_NAME_SIZE], last[SIZE_NAME_SIZE];
+
+            fprintf(fp, "  %-20s %-20s %8" PRIu64 "\n",
+                    location_of(code, code_count, cfg.instructions[cfg.blocks[loops[i].first].first].line->address, first),
+                    location_of(code, code_count, cfg.instructions[cfg.blocks[loops[i].last].last].line->address, last),
+                    loops[i].cycles);
+        }
+
+        fprintf(fp, "\nTotal: %u code word(s), %u data word(s), %u of %u word(s) (%.1f%%)\n", code_size,
+                g_data_image_size, g_object_code_size, TABLE_SIZE, 100.0 * g_object_code_size / TABLE_SIZE);
+    } else if (errors == 0) {
+        fprintf(stderr, "unable to allocate memory for the size report\n");
+        errors++;
+    }
+
+    free(blocks);
+    free(loops);
+    free(code);
+    free(data);
+    free(sorted);
+    cfg_free(&cfg);
+
+    return errors;
+}
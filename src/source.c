@@ -0,0 +1,343 @@
+/*!
+ * \file source.c
+ * \brief source code split into cleaned lines
+ *
+ * The lines are cleaned once and shared by both passes. When the source
+ * changes, only the lines that differ from the previous version are cleaned again.
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief initialises a line from its raw text
+ *
+ * \param line		line to initialise
+ * \param raw		raw text of the line, without the new line
+ * \param len		length of the raw text
+ * \param number	line number
+ * \return			success
+ */
+static bool source_line_init(source_line_t * line, const char * raw, size_t len, uint32_t number) {
+    line->raw = (char *)malloc(len + 1);
+    if (!line->raw) {
+        line->clean = NULL;
+        return false;
+    }
+
+    memcpy(line->raw, raw, len);
+    line->raw[len] = 0;
+    line->length = (uint32_t)len;
+    line->number = number;
+    line->address = 0;
+    line->size = 0;
+    line->data_size = 0;
+    line->file = NULL;
+    line->clean = clean_line(line->raw); /* NULL is reported by the passes */
+
+    return true;
+}
+
+/*!
+ * \brief releases an array of lines
+ *
+ * \param lines	lines to release
+ * \param count	number of lines
+ */
+void source_lines_free(source_line_t * lines, uint32_t count) {
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        free(lines[i].raw);
+        free(lines[i].clean);
+    }
+
+    free(lines);
+}
+
+/*!
+ * \brief counts the lines of a buffer
+ *
+ * \param src	source code
+ * \param len	length of the source code
+ * \return		number of lines
+ */
+static uint32_t count_lines(const char * src, size_t len) {
+    uint32_t count = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (src[i] == '\n') {
+            count++;
+        }
+    }
+
+    /* last line without new line */
+    if (len > 0 && src[len - 1] != '\n') {
+        count++;
+    }
+
+    return count;
+}
+
+/*!
+ * \brief gets the next raw line of a buffer
+ *
+ * \param src	source code
+ * \param len	length of the source code
+ * \param pos	current position, updated
+ * \param start	set to the start of the line
+ * \return		length of the line, without the new line
+ */
+static size_t next_line(const char * src, size_t len, size_t * pos, const char ** start) {
+    const char * end;
+    size_t line_len;
+
+    *start = src + *pos;
+    end = (const char *)memchr(*start, '\n', len - *pos);
+    line_len = end ? (size_t)(end - *start) : len - *pos;
+    *pos += line_len + (end ? 1 : 0);
+
+    return line_len;
+}
+
+/*!
+ * \brief splits a source into cleaned lines
+ *
+ * \note source must be released with source_free()
+ *
+ * \param source	output source
+ * \param name		name of the source, used in the diagnostics (can be NULL)
+ * \param src		source code
+ * \param len		length of the source code
+ * \return			success
+ */
+bool source_load(source_t * source, const char * name, const char * src, size_t len) {
+    uint32_t i;
+    size_t pos = 0;
+
+    source->name = name ? strdup(name) : NULL;
+    source->count = count_lines(src, len);
+    source->lines = (source_line_t *)calloc(source->count + 1, sizeof(source_line_t));
+
+    if (!source->lines) {
+        source->count = 0;
+        return false;
+    }
+
+    for (i = 0; i < source->count; i++) {
+        const char * start;
+        size_t line_len = next_line(src, len, &pos, &start);
+
+        if (!source_line_init(&source->lines[i], start, line_len, i + 1)) {
+            source->count = i;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*!
+ * \brief updates the source to a new version, cleaning only the changed lines
+ *
+ * lines [first, old_end) of the previous version are replaced by the lines
+ * [first, new_end) of the new version, the rest of the lines are kept
+ *
+ * \param source	source to update
+ * \param src		new source code
+ * \param len		length of the new source code
+ * \param first		set to the index of the first changed line
+ * \param old_end	set to the end of the changed lines in the previous version
+ * \param new_end	set to the end of the changed lines in the new version
+ * \param removed	if not NULL, set to the replaced lines of the previous version,
+ *					which must be released with source_lines_free()
+ * \return			success
+ */
+bool source_update(source_t * source, const char * src, size_t len,
+                   uint32_t * first, uint32_t * old_end, uint32_t * new_end,
+                   source_line_t ** removed) {
+    uint32_t count = count_lines(src, len);
+    uint32_t prefix = 0, suffix = 0, i;
+    const char ** starts;
+    size_t * lens;
+    size_t pos = 0;
+    source_line_t * lines, * old;
+
+    starts = (const char **)malloc((count + 1) * sizeof(const char *));
+    lens = (size_t *)malloc((count + 1) * sizeof(size_t));
+    if (!starts || !lens) {
+        free(starts);
+        free(lens);
+        return false;
+    }
+
+    for (i = 0; i < count; i++) {
+        lens[i] = next_line(src, len, &pos, &starts[i]);
+    }
+
+    /* unchanged lines at the start */
+    while (prefix < count && prefix < source->count &&
+           source->lines[prefix].length == lens[prefix] &&
+           memcmp(source->lines[prefix].raw, starts[prefix], lens[prefix]) == 0) {
+        prefix++;
+    }
+
+    /* unchanged lines at the end */
+    while (suffix < count - prefix && suffix < source->count - prefix) {
+        source_line_t * line = &source->lines[source->count - 1 - suffix];
+        uint32_t n = count - 1 - suffix;
+
+        if (line->length != lens[n] || memcmp(line->raw, starts[n], lens[n]) != 0) {
+            break;
+        }
+
+        suffix++;
+    }
+
+    *first = prefix;
+    *old_end = source->count - suffix;
+    *new_end = count - suffix;
+
+    lines = (source_line_t *)calloc(count + 1, sizeof(source_line_t));
+    old = (source_line_t *)calloc(*old_end - prefix + 1, sizeof(source_line_t));
+    if (!lines || !old) {
+        free(lines);
+        free(old);
+        free(starts);
+        free(lens);
+        return false;
+    }
+
+    /* keep the unchanged lines, clean the changed ones */
+    for (i = 0; i < prefix; i++) {
+        lines[i] = source->lines[i];
+    }
+
+    for (i = prefix; i < *old_end; i++) {
+        old[i - prefix] = source->lines[i];
+    }
+
+    for (i = prefix; i < *new_end; i++) {
+        source_line_init(&lines[i], starts[i], lens[i], i + 1);
+    }
+
+    for (i = 0; i < suffix; i++) {
+        lines[*new_end + i] = source->lines[*old_end + i];
+        lines[*new_end + i].number = *new_end + i + 1;
+    }
+
+    free(source->lines);
+    source->lines = lines;
+    source->count = count;
+
+    if (removed) {
+        *removed = old;
+    } else {
+        source_lines_free(old, *old_end - prefix);
+    }
+
+    free(starts);
+    free(lens);
+
+    return true;
+}
+
+/*!
+ * \brief replaces a range of lines with the lines of a text, cleaning only the new lines
+ *
+ * the text is split at every new line, a text ending with a new line gives an
+ * empty last line, so an edit of the lines [first, end) can be applied by
+ * replacing them with the edited text of those lines
+ *
+ * \param source	source to update
+ * \param first		first replaced line
+ * \param end		end of the replaced lines, can be equal to first
+ * \param src		text of the new lines
+ * \param len		length of the text
+ * \param removed	if not NULL, set to the replaced lines, which must be
+ *					released with source_lines_free()
+ * \return			success
+ */
+bool source_splice(source_t * source, uint32_t first, uint32_t end, const char * src, size_t len,
+                   source_line_t ** removed) {
+    uint32_t count = 1, total, i;
+    source_line_t * lines;
+    source_line_t * old = NULL;
+    size_t pos = 0;
+
+    if (first > end || end > source->count) {
+        return false;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (src[i] == '\n') {
+            count++;
+        }
+    }
+
+    total = source->count - (end - first) + count;
+    lines = (source_line_t *)calloc(total + 1, sizeof(source_line_t));
+    if (removed) {
+        old = (source_line_t *)calloc(end - first + 1, sizeof(source_line_t));
+    }
+    if (!lines || (removed && !old)) {
+        free(lines);
+        free(old);
+        return false;
+    }
+
+    for (i = 0; i < count; i++) {
+        const char * start;
+        size_t line_len = next_line(src, len, &pos, &start);
+
+        if (!source_line_init(&lines[first + i], start, line_len, first + i + 1)) {
+            uint32_t j;
+
+            for (j = first; j <= first + i; j++) {
+                free(lines[j].raw);
+                free(lines[j].clean);
+            }
+
+            free(lines);
+            free(old);
+            return false;
+        }
+    }
+
+    /* the lines are moved, the ones after the range are renumbered */
+    memcpy(lines, source->lines, first * sizeof(source_line_t));
+    for (i = end; i < source->count; i++) {
+        lines[i - end + first + count] = source->lines[i];
+        lines[i - end + first + count].number = i - end + first + count + 1;
+    }
+
+    if (removed) {
+        memcpy(old, source->lines + first, (end - first) * sizeof(source_line_t));
+        *removed = old;
+    } else {
+        for (i = first; i < end; i++) {
+            free(source->lines[i].raw);
+            free(source->lines[i].clean);
+        }
+    }
+
+    free(source->lines);
+    source->lines = lines;
+    source->count = total;
+
+    return true;
+}
+
+/*!
+ * \brief releases a source
+ *
+ * \param source	source to release
+ */
+void source_free(source_t * source) {
+    source_lines_free(source->lines, source->count);
+    free(source->name);
+
+    source->lines = NULL;
+    source->name = NULL;
+    source->count = 0;
+}
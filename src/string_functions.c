@@ -58,7 +58,7 @@ char * string_trim_end(const char * str, const char * chars) {
     int i, j, offset = 0;
 
     /* start from the end and go backwards */
-    for (i = len - 1; str[i] && i >= 0 && found; i--) {
+    for (i = len - 1; i >= 0 && str[i] && found; i--) {
         found =
             false; /* not found a removeable character => first valid char */
         for (j = 0; j < len_chars; ++j) {
@@ -131,55 +131,60 @@ char * string_split(const char * str, const char * delim, int index) {
  * \return		cleaned string or NULL
  */
 char * clean_line(const char * line) {
+    size_t i, n = 0, len;
+    char * ret;
+
     if (!line) {
         return NULL;
     }
 
-    char * trimmed = string_trim(line, " \t"); /* remove starting junk */
-    if (!trimmed) {
+    len = strlen(line);
+    i = scan_span(line, len, CHAR_SPACE); /* remove starting junk */
+
+    ret = (char *)malloc(len - i + 1);
+    if (!ret) {
         return NULL;
     }
 
-    int i, n = 0, len = (int)strlen(trimmed);
-    char ch;
-
-    char * ret = (char *)malloc(sizeof(char) * (len + 1));
-
     /* first char is copied automatically, it is trimmed */
-    ret[0] = trimmed[0];
-    n = 1;
-
-    if (ret) {
-        for (i = 1; trimmed[i] && i < len; ++i) {
-            ch = trimmed[i];
+    if (i < len) {
+        ret[n++] = line[i++];
+    }
 
-            /* start of comment, not needed */
-            if (ch == ';') {
-                break;
-            }
+    while (i < len) {
+        /* the characters between the spaces, the commas and the comment are copied at once */
+        size_t run = scan_span(line + i, len - i, CHAR_DIGIT | CHAR_ALPHA | CHAR_SPECIAL);
 
-            /* tabs to spaces */
-            if (ch == '\t') {
-                ch = ' ';
-            }
+        memcpy(ret + n, line + i, run);
+        n += run;
+        i += run;
 
-            /* not add duplicated space or space after comma */
-            if ((ret[n - 1] == ' ' || ret[n - 1] == ',') && ch == ' ') {
-                continue;
-            }
+        /* start of comment, not needed */
+        if (i >= len || line[i] == ';') {
+            break;
+        }
 
-            /* not add space after a number */
-            if (ret[n - 1] >= '0' && ret[n - 1] <= '9' && ch == ' ') {
-                continue;
+        if (line[i] == ',') {
+            ret[n++] = ',';
+            i++;
+        } else if (ret[n - 1] != ',') {
+            /* spaces and tabs to one space, not before a comma, "5 ,6" -> "5,6" (a name can end with a digit: ".equ N2 5") */
+            i += scan_span(line + i, len - i, CHAR_SPACE);
+            if (i < len && line[i] != ',' && line[i] != ';') {
+                ret[n++] = ' ';
             }
-
-            ret[n++] = ch;
+            continue;
         }
 
-        ret[n] = 0;
+        /* not add space after comma */
+        i += scan_span(line + i, len - i, CHAR_SPACE);
     }
 
-    free(trimmed);
+    /* remove ending junk */
+    while (n > 0 && strchr(" \t\r\n", ret[n - 1])) {
+        n--;
+    }
+    ret[n] = 0;
 
-    return string_trim_end(ret, " \t\r\n"); /* remove ending junk */
+    return ret;
 }
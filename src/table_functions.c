@@ -5,21 +5,23 @@
 
 #include "asm.h"
 
-/* global variables */
-extern object_code_t g_object_code[TABLE_SIZE];
-extern uint16_t g_object_code_size;
+/* global tables, zero initialized  */
+object_code_t g_object_code[TABLE_SIZE]; /*!< \brief object code */
+uint16_t g_object_code_size = 0; /*!< \brief size of the object code */
 
-extern uint16_t g_data_image[TABLE_SIZE];
-extern uint16_t g_data_image_size;
+uint32_t g_line_table[TABLE_SIZE]; /*!< \brief source line of every instruction word, 0 for the data */
 
-extern symbol_t g_symbol_table[TABLE_SIZE];
-extern uint16_t g_symbol_table_size;
+uint16_t g_data_image[TABLE_SIZE]; /*!< \brief data image */
+uint16_t g_data_image_size = 0; /*!< \brief size of the data image */
 
-extern link_object_t g_link_table[TABLE_SIZE];
-extern uint16_t g_link_table_size;
+symbol_t g_symbol_table[TABLE_SIZE]; /*!< \brief symbol table */
+uint16_t g_symbol_table_size = 0; /*!< \brief size of the symbol table */
 
-extern link_object_t g_external_table[TABLE_SIZE];
-extern uint16_t g_external_table_size;
+link_object_t g_link_table[TABLE_SIZE]; /*!< \brief linker table */
+uint16_t g_link_table_size = 0; /*!< \brief size of the linker table */
+
+link_object_t g_external_table[TABLE_SIZE]; /*!< \brief table of externals */
+uint16_t g_external_table_size; /*!< \brief size of the table of externals */
 
 /*!
  * \brief counts a symbol/link_object based on its type in a table
@@ -124,3 +126,34 @@ void print_object_code(void) {
         printf("  %04x %04x %c\n", i, o->value, o->type);
     }
 }
+
+/*!
+ * \brief frees the names in the tables and empties every table
+ *
+ * \note needed before assembling a new source in the same process
+ */
+void reset_tables(void) {
+    uint16_t i;
+
+    for (i = 0; i < g_symbol_table_size; i++) {
+        free(g_symbol_table[i].name);
+    }
+
+    for (i = 0; i < g_link_table_size; i++) {
+        free(g_link_table[i].name);
+    }
+
+    for (i = 0; i < g_external_table_size; i++) {
+        free(g_external_table[i].name);
+    }
+
+    memset(g_line_table, 0, sizeof(g_line_table));
+
+    constants_reset();
+
+    g_object_code_size = 0;
+    g_data_image_size = 0;
+    g_symbol_table_size = 0;
+    g_link_table_size = 0;
+    g_external_table_size = 0;
+}
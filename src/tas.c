@@ -0,0 +1,210 @@
+/*!
+ * \file tas.c
+ * \brief embeddable interface of the assembler
+ *
+ * Runs both passes over a source held in memory and copies the global tables
+ * into a self-contained result, so no files are read or written.
+ */
+
+#include "asm.h"
+
+/* global variables */
+extern object_code_t g_object_code[TABLE_SIZE];
+extern uint16_t g_object_code_size;
+
+extern uint16_t g_data_image_size;
+
+extern link_object_t g_link_table[TABLE_SIZE];
+extern uint16_t g_link_table_size;
+
+extern link_object_t g_external_table[TABLE_SIZE];
+extern uint16_t g_external_table_size;
+
+/*!
+ * \brief collects the diagnostics into the result
+ *
+ * \param data		result
+ * \param severity	error or warning
+ * \param file_name	name of the source (not used)
+ * \param line		line number
+ * \param message	formatted message
+ */
+static void collect_diagnostic(void * data, tas_severity_t severity,
+                               const char * file_name, uint32_t line,
+                               const char * message) {
+    tas_result_t * result = (tas_result_t *)data;
+    tas_diagnostic_t * grown;
+
+    (void)file_name;
+
+    grown = (tas_diagnostic_t *)realloc(result->diagnostics,
+                                        (result->diagnostics_size + 1) * sizeof(tas_diagnostic_t));
+    if (!grown) {
+        return;
+    }
+
+    result->diagnostics = grown;
+    grown[result->diagnostics_size].severity = severity;
+    grown[result->diagnostics_size].line = line;
+    grown[result->diagnostics_size].message = strdup(message);
+    result->diagnostics_size++;
+}
+
+/*!
+ * \brief copies a link table into the result
+ *
+ * \param table	link table
+ * \param len	size of the link table
+ * \param type	type of the objects to copy, 0 for all
+ * \param size	set to the number of copied objects
+ * \return		copied table or NULL
+ */
+static tas_link_t * copy_links(link_object_t * table, uint16_t len, char type, uint16_t * size) {
+    tas_link_t * links = (tas_link_t *)malloc((len + 1) * sizeof(tas_link_t));
+    uint16_t i;
+
+    *size = 0;
+
+    if (!links) {
+        return NULL;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (type == 0 || table[i].type == type) {
+            links[*size].name = strdup(table[i].name);
+            links[*size].value = table[i].value;
+            (*size)++;
+        }
+    }
+
+    return links;
+}
+
+/*!
+ * \brief assembles a source held in memory
+ *
+ * \note result must be released with tas_free_result(), even if assembling failed
+ *
+ * \param src		source code
+ * \param len		length of the source code
+ * \param options	options of the assembling
+ * \param result	assembled image and diagnostics
+ * \return			status of the assembling
+ */
+tas_status_t tas_assemble(const char * src, size_t len, tas_options_t options, tas_result_t * result) {
+    tas_status_t status = TAS_OK;
+    diagnostics_t diagnostics;
+    source_t source, expanded;
+    bool changed;
+    uint16_t i;
+
+    if (!result) {
+        return TAS_INVALID;
+    }
+
+    memset(result, 0, sizeof(tas_result_t));
+
+    if (!src) {
+        return TAS_INVALID;
+    }
+
+    if (!source_load(&source, options.name, src, len)) {
+        source_free(&source);
+        return TAS_INVALID;
+    }
+
+    reset_tables();
+    set_diagnostic_handler(collect_diagnostic, result);
+
+    /* the context applies the limit of errors, the handler gets the diagnostics */
+    diagnostics_init(&diagnostics, stderr, DIAGNOSTIC_TEXT, options.error_limit);
+    diagnostics_select(&diagnostics);
+
+    TRACE_BEGIN("macros");
+    result->errors = macro_expand(&source, NULL, &expanded, &changed);
+    TRACE_END("macros");
+
+    source_free(&source);
+    source = expanded;
+
+    if (result->errors == 0) {
+        TRACE_BEGIN("first_pass");
+        result->errors = first_pass(&source);
+        TRACE_END("first_pass");
+    }
+
+    if (result->errors != 0) {
+        status = TAS_FIRST_PASS_FAILED;
+    } else {
+        TRACE_BEGIN("second_pass");
+        result->errors = second_pass(&source);
+        TRACE_END("second_pass");
+
+        if (result->errors != 0) {
+            status = TAS_SECOND_PASS_FAILED;
+        }
+    }
+
+    diagnostics_free(&diagnostics);
+    set_diagnostic_handler(NULL, NULL);
+    source_free(&source);
+
+    if (status != TAS_OK) {
+        reset_tables();
+        return status;
+    }
+
+    result->code = (tas_word_t *)malloc((g_object_code_size + 1) * sizeof(tas_word_t));
+    result->entries = copy_links(g_link_table, g_link_table_size, 'n', &result->entries_size);
+    result->externals = copy_links(g_external_table, g_external_table_size, 0, &result->externals_size);
+
+    if (!result->code || !result->entries || !result->externals) {
+        reset_tables();
+        return TAS_INVALID;
+    }
+
+    for (i = 0; i < g_object_code_size; i++) {
+        result->code[i].value = g_object_code[i].value;
+        result->code[i].type = g_object_code[i].type;
+    }
+
+    result->code_size = g_object_code_size;
+    result->data_size = g_data_image_size;
+    result->instructions_size = g_object_code_size - g_data_image_size;
+
+    reset_tables();
+
+    return status;
+}
+
+/*!
+ * \brief releases the content of a result
+ *
+ * \param result	result of tas_assemble()
+ */
+void tas_free_result(tas_result_t * result) {
+    uint32_t i;
+
+    if (!result) {
+        return;
+    }
+
+    for (i = 0; i < result->entries_size; i++) {
+        free(result->entries[i].name);
+    }
+
+    for (i = 0; i < result->externals_size; i++) {
+        free(result->externals[i].name);
+    }
+
+    for (i = 0; i < result->diagnostics_size; i++) {
+        free(result->diagnostics[i].message);
+    }
+
+    free(result->code);
+    free(result->entries);
+    free(result->externals);
+    free(result->diagnostics);
+
+    memset(result, 0, sizeof(tas_result_t));
+}
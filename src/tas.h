@@ -0,0 +1,95 @@
+/*!
+ * \file tas.h
+ * \brief public interface of the embeddable assembler library (libtas)
+ *
+ * The library assembles a source held in memory into object words, link and
+ * external tables and diagnostics, without touching the filesystem.
+ *
+ * \note the assembler uses global tables, so calls must not run concurrently
+ */
+
+#ifndef TAS_H
+#define TAS_H
+
+#include <stdbool.h> /* for bool */
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint16_t, uint32_t */
+
+/*!
+ * \brief severity of a diagnostic
+ */
+typedef enum tas_severity_e {
+    TAS_ERROR = 0, /*!< error, assembling fails */
+    TAS_WARNING /*!< warning, assembling continues */
+} tas_severity_t;
+
+/*!
+ * \brief options of the assembling
+ */
+typedef struct tas_options_s {
+    const char * name; /*!< \brief name of the source used in the diagnostics (can be NULL) */
+    uint32_t error_limit; /*!< \brief the passes stop after this number of errors, 0 for no limit */
+} tas_options_t;
+
+/*!
+ * \brief one word of the assembled image
+ */
+typedef struct tas_word_s {
+    uint16_t value; /*!< \brief 16-bit machine word */
+    char type; /*!< \brief type ('e'xternal|'r'elocatable|'a'bsolute|' ' for data) */
+} tas_word_t;
+
+/*!
+ * \brief entry or external of the assembled image
+ */
+typedef struct tas_link_s {
+    char * name; /*!< \brief label */
+    uint16_t value; /*!< \brief address of the entry or the address that refers to the external */
+} tas_link_t;
+
+/*!
+ * \brief one diagnostic message
+ */
+typedef struct tas_diagnostic_s {
+    tas_severity_t severity; /*!< \brief error or warning */
+    uint32_t line; /*!< \brief line number in the source */
+    char * message; /*!< \brief formatted message */
+} tas_diagnostic_t;
+
+/*!
+ * \brief result of the assembling
+ *
+ * \note must be released with tas_free_result()
+ */
+typedef struct tas_result_s {
+    tas_word_t * code; /*!< \brief instructions followed by the data image */
+    uint16_t code_size; /*!< \brief number of words in code */
+    uint16_t instructions_size; /*!< \brief number of instruction words */
+    uint16_t data_size; /*!< \brief number of data words */
+
+    tas_link_t * entries; /*!< \brief table of entries (.entry) */
+    uint16_t entries_size; /*!< \brief size of the table of entries */
+
+    tas_link_t * externals; /*!< \brief table of externals (.extern usages) */
+    uint16_t externals_size; /*!< \brief size of the table of externals */
+
+    tas_diagnostic_t * diagnostics; /*!< \brief errors and warnings in order of appearance */
+    uint32_t diagnostics_size; /*!< \brief number of diagnostics */
+
+    uint16_t errors; /*!< \brief number of errors of the failed pass */
+} tas_result_t;
+
+/*!
+ * \brief status codes of tas_assemble(), same as the exit codes of tas
+ */
+typedef enum tas_status_e {
+    TAS_OK = 0, /*!< success */
+    TAS_INVALID = 1, /*!< invalid arguments or out of memory */
+    TAS_FIRST_PASS_FAILED = 2, /*!< first pass failed */
+    TAS_SECOND_PASS_FAILED = 3 /*!< second pass failed */
+} tas_status_t;
+
+tas_status_t tas_assemble(const char * src, size_t len, tas_options_t options, tas_result_t * result);
+void tas_free_result(tas_result_t * result);
+
+#endif
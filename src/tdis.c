@@ -0,0 +1,111 @@
+/*!
+ * \file tdis.c
+ * \brief entry point of the disassembler
+ *
+ * tdis [-o FILE] [-g FILE] IMAGE
+ *
+ * writes the source of an object (.oc) or a binary (.bin) file, the line
+ * table next to the image (.ln) is read if there is one
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief usage string
+ */
+static const char * help = "usage: tdis [switches] <image.oc|image.bin>\n"
+                           "  -o FILE : writes the source to FILE instead of the standard output\n"
+                           "  -g FILE : reads the line table from FILE (default: the .ln next to the image)\n"
+                           "  -h      : shows this text\n";
+
+/*!
+ * \brief main function of the disassembler
+ *
+ * \param argc	number of arguments
+ * \param argv	arguments
+ * \return		error code
+ */
+int main(int argc, char * argv[]) {
+    const char * image_name = NULL;
+    const char * output_name = NULL;
+    char * line_table_name = NULL;
+    image_t * image;
+    image_names_t names;
+    line_table_t lines;
+    bool has_lines;
+    FILE * fp = stdout;
+    int a, ret = 0;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            output_name = argv[++a];
+        } else if (strcmp(argv[a], "-g") == 0 && a + 1 < argc) {
+            line_table_name = argv[++a];
+        } else if (argv[a][0] == '-' || image_name) {
+            printf("%s", help);
+            return strcmp(argv[a], "-h") == 0 ? 0 : 1;
+        } else {
+            image_name = argv[a];
+        }
+    }
+
+    if (!image_name) {
+        printf("%s", help);
+        return 1;
+    }
+
+    image = (image_t *)malloc(sizeof(image_t));
+    if (!image) {
+        fprintf(stderr, "unable to allocate memory for the image\n");
+        return 1;
+    }
+
+    if (!read_image_names(image_name, image, &names)) {
+        fprintf(stderr, "unable to load '%s'\n", image_name);
+        image_names_free(&names);
+        free(image);
+        return 2;
+    }
+
+    /* the line table is optional, only an explicit one must exist */
+    if (line_table_name) {
+        has_lines = line_table_read(line_table_name, &lines);
+        if (!has_lines) {
+            fprintf(stderr, "unable to load '%s'\n", line_table_name);
+            ret = 2;
+        }
+    } else {
+        char * name = get_file_name_with_ext(image_name, ".ln");
+
+        has_lines = name && line_table_read(name, &lines);
+        free(name);
+    }
+
+    if (ret == 0 && output_name) {
+        fp = fopen(output_name, "w");
+        if (!fp) {
+            fprintf(stderr, "unable to open '%s'\n", output_name);
+            ret = 3;
+        }
+    }
+
+    if (ret == 0) {
+        if (!disassemble(image, &names, has_lines ? &lines : NULL, fp)) {
+            fprintf(stderr, "unable to write the source\n");
+            ret = 3;
+        }
+
+        if (fp != stdout) {
+            fclose(fp);
+        }
+    }
+
+    if (has_lines) {
+        line_table_free(&lines);
+    }
+
+    image_names_free(&names);
+    free(image);
+
+    return ret;
+}
@@ -0,0 +1,286 @@
+/*!
+ * \file trace.c
+ * \brief Chrome trace (chrome://tracing, Perfetto) recording of the phases
+ *
+ * Every thread records its events into its own ring buffer, so recording
+ * needs no locks: the buffers are registered once, with a compare-and-swap on
+ * the head of a list. A full ring overwrites its oldest events, so the memory
+ * and the time spent on recording stay bounded. The ends whose begins were
+ * overwritten are dropped when writing, the number of lost events is in the
+ * "otherData" of the trace. When tracing is off, the TRACE_BEGIN()/TRACE_END()
+ * macros cost a single branch.
+ */
+
+#include "asm.h"
+
+#include <time.h> /* for clock_gettime(), timespec_get() */
+
+#if defined(_MSC_VER)
+    #include <intrin.h> /* for _InterlockedIncrement(), _InterlockedCompareExchangePointer() */
+    #define THREAD_LOCAL __declspec(thread)
+#else
+    #define THREAD_LOCAL __thread
+#endif
+
+/*!
+ * \brief number of events kept per thread
+ */
+#define TRACE_RING_SIZE 16384
+
+/*!
+ * \brief maximum length of an event name
+ */
+#define TRACE_NAME_SIZE 40
+
+/*!
+ * \brief one recorded event
+ */
+typedef struct trace_event_s {
+    uint64_t ts; /*!< \brief timestamp in nanoseconds */
+    char phase; /*!< \brief 'B'egin or 'E'nd */
+    char name[TRACE_NAME_SIZE]; /*!< \brief name of the event */
+} trace_event_t;
+
+/*!
+ * \brief ring buffer of a thread
+ */
+typedef struct trace_buffer_s {
+    trace_event_t events[TRACE_RING_SIZE]; /*!< \brief events */
+    uint64_t count; /*!< \brief number of recorded events, the ring holds the last TRACE_RING_SIZE */
+    uint32_t tid; /*!< \brief id of the thread in the trace */
+    char thread_name[TRACE_NAME_SIZE]; /*!< \brief name of the thread */
+    struct trace_buffer_s * next; /*!< \brief next buffer in the list */
+} trace_buffer_t;
+
+/* global variables */
+bool g_trace_enabled = false; /*!< \brief recording is on */
+
+/* private variables */
+static char * s_file_name = NULL; /*!< \brief output file */
+static trace_buffer_t * volatile s_buffers = NULL; /*!< \brief buffers of all threads */
+static volatile uint32_t s_next_tid = 0; /*!< \brief id of the next thread */
+static uint64_t s_start = 0; /*!< \brief time of trace_open() */
+static THREAD_LOCAL trace_buffer_t * s_buffer = NULL; /*!< \brief buffer of this thread */
+
+/*!
+ * \brief gets a monotonic time in nanoseconds
+ *
+ * \return time in nanoseconds
+ */
+static uint64_t trace_now(void) {
+    struct timespec ts;
+
+#if defined(_WIN32)
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*!
+ * \brief gets the buffer of the calling thread, registers it at the first call
+ *
+ * \return buffer or NULL
+ */
+static trace_buffer_t * trace_buffer(void) {
+    trace_buffer_t * buffer = s_buffer;
+
+    if (buffer) {
+        return buffer;
+    }
+
+    buffer = (trace_buffer_t *)calloc(1, sizeof(trace_buffer_t));
+    if (!buffer) {
+        return NULL;
+    }
+
+#if defined(_MSC_VER)
+    buffer->tid = (uint32_t)_InterlockedIncrement((volatile long *)&s_next_tid);
+    do {
+        buffer->next = s_buffers;
+    } while (_InterlockedCompareExchangePointer((void * volatile *)&s_buffers, buffer, buffer->next) != buffer->next);
+#else
+    buffer->tid = __sync_add_and_fetch(&s_next_tid, 1);
+    do {
+        buffer->next = s_buffers;
+    } while (!__sync_bool_compare_and_swap(&s_buffers, buffer->next, buffer));
+#endif
+
+    s_buffer = buffer;
+
+    return buffer;
+}
+
+/*!
+ * \brief starts recording
+ *
+ * \param file_name	output file, written by trace_flush()
+ * \return			success
+ */
+bool trace_open(const char * file_name) {
+    free(s_file_name);
+    s_file_name = strdup(file_name);
+    if (!s_file_name) {
+        return false;
+    }
+
+    s_start = trace_now();
+    g_trace_enabled = true;
+
+    trace_thread_name("main");
+
+    return true;
+}
+
+/*!
+ * \brief records an event of the calling thread
+ *
+ * \note use the TRACE_BEGIN()/TRACE_END() macros, they skip the call when tracing is off
+ *
+ * \param phase	'B'egin or 'E'nd
+ * \param name	name of the event, truncated to 39 characters
+ */
+void trace_event(char phase, const char * name) {
+    trace_buffer_t * buffer = trace_buffer();
+    trace_event_t * event;
+
+    if (!buffer) {
+        return;
+    }
+
+    event = &buffer->events[buffer->count % TRACE_RING_SIZE];
+    event->ts = trace_now();
+    event->phase = phase;
+    strncpy(event->name, name ? name : "", TRACE_NAME_SIZE - 1);
+    event->name[TRACE_NAME_SIZE - 1] = 0;
+
+    buffer->count++;
+}
+
+/*!
+ * \brief names the calling thread in the trace
+ *
+ * \param name	name of the thread
+ */
+void trace_thread_name(const char * name) {
+    trace_buffer_t * buffer;
+
+    if (!g_trace_enabled || !(buffer = trace_buffer())) {
+        return;
+    }
+
+    strncpy(buffer->thread_name, name, TRACE_NAME_SIZE - 1);
+}
+
+/*!
+ * \brief writes a string as a JSON string literal
+ *
+ * \param fp	output stream
+ * \param str	string
+ */
+static void write_json_string(FILE * fp, const char * str) {
+    fputc('"', fp);
+
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(fp, "\\%c", *str);
+        } else if ((unsigned char)*str < 0x20) {
+            fprintf(fp, "\\u%04x", *str);
+        } else {
+            fputc(*str, fp);
+        }
+    }
+
+    fputc('"', fp);
+}
+
+/*!
+ * \brief writes the recorded events into the output file
+ *
+ * \note must not run while other threads are recording
+ *
+ * \return success
+ */
+bool trace_flush(void) {
+    trace_buffer_t * buffer;
+    uint64_t dropped = 0;
+    bool first = true;
+    FILE * fp;
+
+    if (!g_trace_enabled) {
+        return true;
+    }
+
+    fp = fopen(s_file_name, "w");
+    if (!fp) {
+        return false;
+    }
+
+    fprintf(fp, "{\"traceEvents\":[");
+
+    for (buffer = s_buffers; buffer; buffer = buffer->next) {
+        uint64_t i = buffer->count > TRACE_RING_SIZE ? buffer->count - TRACE_RING_SIZE : 0;
+        uint32_t depth = 0; /* open begins in the ring */
+
+        dropped += i;
+
+        if (buffer->thread_name[0]) {
+            fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+                    first ? "" : ",", buffer->tid);
+            write_json_string(fp, buffer->thread_name);
+            fprintf(fp, "}}");
+            first = false;
+        }
+
+        for (; i < buffer->count; i++) {
+            trace_event_t * event = &buffer->events[i % TRACE_RING_SIZE];
+
+            /* the events nest, an end without an open begin lost its begin to the ring */
+            if (event->phase == 'B') {
+                depth++;
+            } else if (depth > 0) {
+                depth--;
+            } else {
+                dropped++;
+                continue;
+            }
+
+            fprintf(fp, "%s\n{\"name\":", first ? "" : ",");
+            write_json_string(fp, event->name);
+            fprintf(fp, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                    event->phase, (event->ts - s_start) / 1000.0, buffer->tid);
+            first = false;
+        }
+    }
+
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":%" PRIu64 "}}\n",
+            dropped);
+
+    return fclose(fp) == 0;
+}
+
+/*!
+ * \brief stops recording and releases the buffers of all threads
+ *
+ * \note must not run while other threads are recording, their buffers are freed
+ */
+void trace_close(void) {
+    trace_buffer_t * buffer = s_buffers;
+
+    g_trace_enabled = false;
+
+    while (buffer) {
+        trace_buffer_t * next = buffer->next;
+
+        free(buffer);
+        buffer = next;
+    }
+
+    s_buffers = NULL;
+    s_buffer = NULL;
+
+    free(s_file_name);
+    s_file_name = NULL;
+}
@@ -0,0 +1,477 @@
+/*!
+ * \file watch.c
+ * \brief watch mode, reassembles the source every time it changes
+ *
+ * The cleaned lines and the tables of the previous run are kept. When only
+ * operation lines change and every changed line keeps its label and its number
+ * of words, the addresses stay the same, so only the words of the changed
+ * lines are encoded again. Otherwise both passes run again over the cached lines.
+ * The language server (lsp.c) encodes the edited lines of a document the same way.
+ *
+ * The diagnostics of an incremental attempt go to a scratch context, written
+ * only if the attempt succeeds: a full run reports the same errors again.
+ */
+
+#include "asm.h"
+
+#ifdef __linux__
+    #include <sys/inotify.h> /* for inotify_init1(), inotify_add_watch() */
+    #include <time.h> /* for clock_gettime() */
+    #include <unistd.h> /* for read(), close() */
+#endif
+
+/* global variables */
+extern object_code_t g_object_code[TABLE_SIZE];
+extern uint16_t g_object_code_size;
+
+extern link_object_t g_external_table[TABLE_SIZE];
+extern uint16_t g_external_table_size;
+
+/*!
+ * \brief kind of a line, from the point of view of the incremental assembling
+ */
+typedef enum line_kind_e {
+    LINE_BLANK = 0, /*!< empty line or comment */
+    LINE_OPERATION, /*!< operation, optionally with a label */
+    LINE_OTHER /*!< directive or invalid line */
+} line_kind_t;
+
+/*!
+ * \brief gets the kind of a line
+ *
+ * \param line	line of the source
+ * \param label	set to the label of an operation (must be free()-d) or NULL
+ * \return		kind of the line
+ */
+static line_kind_t get_line_kind(source_line_t * line, char ** label) {
+    line_kind_t kind = LINE_OTHER;
+    char * col;
+
+    *label = NULL;
+
+    if (!line->clean) {
+        return LINE_OTHER;
+    }
+
+    if (line->clean[0] == 0 || line->clean[0] == ';') {
+        return LINE_BLANK;
+    }
+
+    col = string_split(line->clean, " ", 0);
+
+    switch (column_type(col)) {
+    case OPERATION:
+        kind = LINE_OPERATION;
+        break;
+
+    case LABEL: {
+        char * col2 = string_split(line->clean, " ", 1);
+
+        if (column_type(col2) == OPERATION) {
+            kind = LINE_OPERATION;
+            *label = col;
+            col = NULL;
+        }
+
+        free(col2);
+    } break;
+
+    default:
+        break;
+    }
+
+    free(col);
+
+    return kind;
+}
+
+/*!
+ * \brief checks if the changed lines can be encoded again in place
+ *
+ * \param old	previous version of the line
+ * \param line	new version of the line
+ * \return		line can be reassembled alone
+ */
+static bool same_shape(source_line_t * old, source_line_t * line) {
+    char * old_label;
+    char * label;
+    line_kind_t old_kind = get_line_kind(old, &old_label);
+    line_kind_t kind = get_line_kind(line, &label);
+    bool same = old_kind == kind && kind != LINE_OTHER;
+
+    if (same && kind == LINE_OPERATION) {
+        same = old_label && label ? strcmp(old_label, label) == 0 : old_label == label;
+    }
+
+    free(old_label);
+    free(label);
+
+    return same;
+}
+
+/*!
+ * \brief removes the externals referenced from an address range
+ *
+ * \param address	first address
+ * \param size		number of words
+ */
+static void remove_externals(uint16_t address, uint16_t size) {
+    uint16_t i, n = 0;
+
+    for (i = 0; i < g_external_table_size; i++) {
+        link_object_t * obj = &g_external_table[i];
+
+        if (obj->value >= address && obj->value < address + size) {
+            free(obj->name);
+        } else {
+            g_external_table[n++] = *obj;
+        }
+    }
+
+    g_external_table_size = n;
+}
+
+/*!
+ * \brief compares two link objects by their address, for qsort()
+ *
+ * \param a	first link object
+ * \param b	second link object
+ * \return	order of the objects
+ */
+static int compare_address(const void * a, const void * b) {
+    return (int)((const link_object_t *)a)->value - (int)((const link_object_t *)b)->value;
+}
+
+/*!
+ * \brief encodes the changed lines again, keeping every address
+ *
+ * \note the tables and the addresses of the lines must be the ones of the last
+ * successful assembling of the source, without macros and .set redefinitions
+ *
+ * \param source	lines of the source, already updated
+ * \param removed	previous version of the changed lines
+ * \param first		index of the first changed line
+ * \param end		end of the changed lines
+ * \return			success, false if a full reassembling is needed
+ */
+bool assemble_incremental(source_t * source, source_line_t * removed, uint32_t first, uint32_t end) {
+    uint32_t i;
+
+    for (i = first; i < end; i++) {
+        source_line_t * old = &removed[i - first];
+        source_line_t * line = &source->lines[i];
+        uint16_t code_size = g_object_code_size;
+        char * label;
+        uint16_t errors;
+
+        if (!same_shape(old, line)) {
+            return false;
+        }
+
+        line->address = old->address;
+        line->size = old->size;
+
+        if (get_line_kind(line, &label) == LINE_BLANK) {
+            continue;
+        }
+
+        /* first pass of the line at its old address, skipping the label */
+        g_object_code_size = old->address;
+        errors = first_pass_line(source, i, label ? 1 : 0);
+        g_object_code_size = code_size;
+        free(label);
+
+        if (errors != 0 || line->address != old->address || line->size != old->size) {
+            return false;
+        }
+
+        remove_externals(line->address, line->size);
+
+        if (second_pass_line(source, i) != 0) {
+            return false;
+        }
+    }
+
+    /* same order as a full second pass would produce */
+    qsort(g_external_table, g_external_table_size, sizeof(link_object_t), compare_address);
+
+    return true;
+}
+
+#ifdef __linux__
+
+static bool s_macros = false; /*!< \brief the source has macros or included files, the lines differ from the expanded ones */
+
+/*!
+ * \brief empties a context of diagnostics and its counts, keeps its settings
+ *
+ * \param d	context, selected again
+ */
+static void restart_diagnostics(diagnostics_t * d) {
+    FILE * fp = d->fp;
+    diagnostic_format_t format = d->format;
+    uint32_t limit = d->limit;
+
+    diagnostics_flush(d);
+    diagnostics_free(d);
+    diagnostics_init(d, fp, format, limit);
+    diagnostics_select(d);
+}
+
+/*!
+ * \brief writes the diagnostics, then the failure of a step
+ *
+ * \param d		context of the diagnostics
+ * \param step	failed step
+ */
+static void report_failure(diagnostics_t * d, const char * step) {
+    diagnostics_flush(d);
+
+    /* the JSON output has the diagnostics only */
+    if (d->format == DIAGNOSTIC_TEXT) {
+        fprintf(stderr, "%s failed with %lu error(s)\n", step, (unsigned long)d->errors);
+    }
+}
+
+/*!
+ * \brief runs both passes over the whole source
+ *
+ * \param source	lines of the source
+ * \param path		path of the source, the included files are relative to it
+ * \param d			context of the diagnostics
+ * \return			number of errors
+ */
+static uint16_t assemble_full(source_t * source, const char * path, diagnostics_t * d) {
+    source_t expanded;
+    source_t * lines = source;
+    uint16_t errors;
+
+    restart_diagnostics(d);
+    reset_tables();
+
+    TRACE_BEGIN("macros");
+    errors = macro_expand(source, path, &expanded, &s_macros);
+    TRACE_END("macros");
+
+    if (errors != 0) {
+        report_failure(d, "macro expansion");
+        source_free(&expanded);
+        return errors;
+    }
+
+    /* without macros the addresses are kept in the lines of the source for the incremental assembling */
+    if (s_macros) {
+        lines = &expanded;
+    }
+
+    TRACE_BEGIN("first_pass");
+    errors = first_pass(lines);
+    TRACE_END("first_pass");
+
+    if (errors != 0) {
+        report_failure(d, "first pass");
+        source_free(&expanded);
+        return errors;
+    }
+
+    TRACE_BEGIN("second_pass");
+    errors = second_pass(lines);
+    TRACE_END("second_pass");
+
+    if (errors != 0) {
+        report_failure(d, "second pass");
+    } else {
+        diagnostics_flush(d);
+    }
+
+    source_free(&expanded);
+
+    return errors;
+}
+
+/*!
+ * \brief encodes the changed lines again, the diagnostics are written only on success
+ *
+ * \param source	lines of the source, already updated
+ * \param removed	previous version of the changed lines
+ * \param first		index of the first changed line
+ * \param end		end of the changed lines
+ * \param d			context of the diagnostics, its settings are used
+ * \return			success, false if a full reassembling is needed
+ */
+static bool watch_incremental(source_t * source, source_line_t * removed, uint32_t first, uint32_t end,
+                              diagnostics_t * d) {
+    diagnostics_t scratch;
+    bool ok;
+
+    diagnostics_init(&scratch, d->fp, d->format, d->limit);
+    diagnostics_select(&scratch);
+
+    ok = assemble_incremental(source, removed, first, end);
+
+    /* the warnings of the changed lines, the errors are reported by the full run */
+    if (ok) {
+        diagnostics_flush(&scratch);
+    }
+
+    diagnostics_free(&scratch);
+    diagnostics_select(d);
+
+    return ok;
+}
+
+/*!
+ * \brief gets a monotonic time in microseconds
+ *
+ * \return time in microseconds
+ */
+static double now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*!
+ * \brief watches a source file and reassembles it on every change
+ *
+ * \note runs until the process is interrupted
+ *
+ * \param file_name	path of the source file
+ * \param output	creates the output files after a successful assembling
+ * \param d			context of the diagnostics, selected
+ * \return			error code
+ */
+int watch_file(const char * file_name, output_handler_t output, diagnostics_t * d) {
+    char * base_name = get_file_base_name(file_name);
+    char * dir = strdup(file_name);
+    char events[4096];
+    source_t source;
+    bool valid;
+    size_t len;
+    char * src;
+    int fd;
+
+    if (!dir) {
+        return 1;
+    }
+
+    /* watch the directory, editors often replace the file instead of writing it */
+    dir[base_name - file_name] = 0;
+
+    fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir[0] ? dir : ".", IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "unable to watch '%s'\n", file_name);
+        free(dir);
+        return 1;
+    }
+
+    free(dir);
+
+    src = read_file(file_name, &len);
+    if (!src || !source_load(&source, base_name, src, len)) {
+        fprintf(stderr, "unable to open '%s'\n", file_name);
+        free(src);
+        close(fd);
+        return 2;
+    }
+
+    free(src);
+
+    valid = assemble_full(&source, file_name, d) == 0 && output(file_name) == 0;
+    printf("%s: assembled (%u lines)\n", base_name, source.count);
+    fflush(stdout);
+
+    for (;;) {
+        ssize_t n = read(fd, events, sizeof(events));
+        source_line_t * removed = NULL;
+        uint32_t first, old_end, new_end;
+        bool changed = false, incremental = false;
+        double start;
+        char * p;
+
+        if (n <= 0) {
+            break;
+        }
+
+        for (p = events; p < events + n;) {
+            struct inotify_event * event = (struct inotify_event *)p;
+
+            if (event->len > 0 && strcmp(event->name, base_name) == 0) {
+                changed = true;
+            }
+
+            p += sizeof(struct inotify_event) + event->len;
+        }
+
+        if (!changed) {
+            continue;
+        }
+
+        start = now_us();
+        TRACE_BEGIN("reassemble");
+
+        src = read_file(file_name, &len);
+        if (!src) {
+            fprintf(stderr, "unable to open '%s'\n", file_name);
+            TRACE_END("reassemble");
+            continue;
+        }
+
+        if (!source_update(&source, src, len, &first, &old_end, &new_end, &removed)) {
+            fprintf(stderr, "unable to allocate memory for the source\n");
+            free(src);
+            break;
+        }
+
+        free(src);
+
+        /* same number of lines changed in place, try to keep the addresses (a .set value depends on the line) */
+        if (valid && !s_macros && !constants_redefined() && old_end - first == new_end - first) {
+            incremental = watch_incremental(&source, removed, first, new_end, d);
+        }
+
+        source_lines_free(removed, old_end - first);
+
+        if (incremental) {
+            valid = output(file_name) == 0;
+        } else {
+            valid = assemble_full(&source, file_name, d) == 0 && output(file_name) == 0;
+        }
+
+        TRACE_END("reassemble");
+        trace_flush();
+
+        printf("%s: %s %u changed line(s) in %.0f us (%s)\n", base_name,
+               valid ? "reassembled" : "failed after", new_end - first,
+               now_us() - start, incremental ? "incremental" : "full");
+        fflush(stdout);
+    }
+
+    source_free(&source);
+    close(fd);
+
+    return 0;
+}
+
+#else
+
+/*!
+ * \brief watches a source file and reassembles it on every change
+ *
+ * \param file_name	path of the source file
+ * \param output	creates the output files after a successful assembling
+ * \param d			context of the diagnostics, selected
+ * \return			error code
+ */
+int watch_file(const char * file_name, output_handler_t output, diagnostics_t * d) {
+    (void)file_name;
+    (void)output;
+    (void)d;
+
+    fprintf(stderr, "--watch is only supported on Linux\n");
+    return 1;
+}
+
+#endif
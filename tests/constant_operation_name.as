@@ -0,0 +1,6 @@
+; constant_operation_name.as
+; Fails with "invalid NAME: mov", a constant can not be named as an operation.
+
+.equ    mov 2
+MAIN:   prn #mov
+        hlt
@@ -0,0 +1,12 @@
+; pool_written.as
+; Prints "21" with and without --pool-data: A and B are equal, but written.
+
+        .entry MAIN
+MAIN:   inc A            ; A = '2'
+        inc A
+        inc B            ; B = '1'
+        prn A
+        prn B
+        hlt
+A:      .string "0"
+B:      .string "0"
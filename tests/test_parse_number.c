@@ -0,0 +1,81 @@
+/*!
+ * \file test_parse_number.c
+ * \brief cases of parse_number() and of its wrappers
+ */
+
+#include "asm.h"
+
+/*!
+ * \brief case of parse_number()
+ */
+typedef struct number_case_s {
+    const char * str; /*!< \brief input */
+    int start_index; /*!< \brief start of the literal in the input */
+    number_status_t status; /*!< \brief expected status */
+    uint16_t value; /*!< \brief expected value, if the status is NUMBER_OK */
+} number_case_t;
+
+/* clang-format off */
+static const number_case_t s_cases[] = {
+    { "12",      0, NUMBER_OK,     12 },
+    { "#12",     1, NUMBER_OK,     12 },
+    { "+7",      0, NUMBER_OK,     7 },
+    { "0",       0, NUMBER_OK,     0 },
+    { "65535",   0, NUMBER_OK,     0xffff },
+    { "65536",   0, NUMBER_RANGE,  0 },
+    { "-1",      0, NUMBER_OK,     0xffff },
+    { "-32768",  0, NUMBER_OK,     0x8000 },
+    { "-32769",  0, NUMBER_RANGE,  0 },
+    { "0x1F",    0, NUMBER_OK,     31 },
+    { "0X1f",    0, NUMBER_OK,     31 },
+    { "0xffff",  0, NUMBER_OK,     0xffff },
+    { "0x10000", 0, NUMBER_RANGE,  0 },
+    { "-0x8000", 0, NUMBER_OK,     0x8000 },
+    { "0b101",   0, NUMBER_OK,     5 },
+    { "0B11",    0, NUMBER_OK,     3 },
+    { "0b2",     0, NUMBER_SYNTAX, 0 },
+    { "0x",      0, NUMBER_SYNTAX, 0 },
+    { "0b",      0, NUMBER_SYNTAX, 0 },
+    { "#",       1, NUMBER_SYNTAX, 0 },
+    { "-",       0, NUMBER_SYNTAX, 0 },
+    { "+",       0, NUMBER_SYNTAX, 0 },
+    { "",        0, NUMBER_SYNTAX, 0 },
+    { "12a",     0, NUMBER_SYNTAX, 0 },
+    { "1 2",     0, NUMBER_SYNTAX, 0 },
+    { "--1",     0, NUMBER_SYNTAX, 0 },
+    { "99999999999999999999", 0, NUMBER_RANGE, 0 }
+};
+/* clang-format on */
+
+/*!
+ * \brief entry point of the test
+ *
+ * \return	number of failed cases
+ */
+int main(void) {
+    uint32_t i, failed = 0;
+
+    for (i = 0; i < sizeof(s_cases) / sizeof(s_cases[0]); i++) {
+        const number_case_t * c = &s_cases[i];
+        char str[32];
+        uint16_t value = 0;
+        number_status_t status;
+
+        strcpy(str, c->str);
+        status = parse_number(str, c->start_index, &value);
+
+        if (status != c->status || (status == NUMBER_OK && value != c->value)) {
+            printf("parse_number(\"%s\", %d): %d %u, expected %d %u\n", c->str, c->start_index, (int)status, value,
+                   (int)c->status, c->value);
+            failed++;
+        } else if (is_valid_numeric_literal(str, c->start_index) != (status != NUMBER_SYNTAX) ||
+                   get_number(str, c->start_index) != (status == NUMBER_OK ? c->value : 0)) {
+            printf("the wrappers of parse_number(\"%s\", %d) disagree\n", c->str, c->start_index);
+            failed++;
+        }
+    }
+
+    printf("%u of %u case(s) failed\n", failed, (unsigned)(sizeof(s_cases) / sizeof(s_cases[0])));
+
+    return failed != 0;
+}